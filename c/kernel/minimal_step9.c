@@ -11,13 +11,25 @@
 // - VGA text mode output
 
 #include "vga.h"
+#include "../../common/simd.h"
 
 #define COM1 0x3F8
 #define ACPI_SEARCH_START 0x000E0000
 #define ACPI_SEARCH_END   0x000FFFFF
-#define MAX_CPUS 16
 #define AP_STACK_SIZE 8192  // 8KB per CPU
 
+// Most logical CPUs brought up (make MAX_CPUS=...). Per-CPU tables are
+// allocated at boot for the CPUs the MADT lists (percpu_init), so this
+// only sizes CPU masks and the IPI cluster list.
+#ifndef MAX_CPUS
+#define MAX_CPUS 256
+#endif
+#if MAX_CPUS < 2
+#error "MAX_CPUS must be at least 2"
+#endif
+#define CPU_NONE      0xFFFFFFFFU   // No logical CPU
+#define APIC_ID_NONE  0xFFFFFFFFU   // Not a CPU's APIC ID (x2APIC broadcast)
+
 // Memory Management constants
 #define PAGE_SIZE 4096
 #define PAGE_ALIGN(addr) (((addr) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1))
@@ -49,8 +61,78 @@
 #define MULTIBOOT_TAG_TYPE_END 0
 #define MULTIBOOT_TAG_TYPE_MMAP 6
 
+// Log levels - messages above their subsystem's threshold compile to nothing
+#define LOG_ERROR 1
+#define LOG_WARN  2
+#define LOG_INFO  3
+#define LOG_DEBUG 4
+#define LOG_TRACE 5
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_INFO              // Default threshold (make LOG_LEVEL=DEBUG)
+#endif
+
+// Per-subsystem thresholds (e.g. make LOG_FLAGS=-DLOG_LEVEL_PMM=LOG_TRACE)
+#ifndef LOG_LEVEL_MMAP
+#define LOG_LEVEL_MMAP  LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_PMM
+#define LOG_LEVEL_PMM   LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_HEAP
+#define LOG_LEVEL_HEAP  LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_ACPI
+#define LOG_LEVEL_ACPI  LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_APIC
+#define LOG_LEVEL_APIC  LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_SMP
+#define LOG_LEVEL_SMP   LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_CLOCK
+#define LOG_LEVEL_CLOCK LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_RCU
+#define LOG_LEVEL_RCU   LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_PERF
+#define LOG_LEVEL_PERF  LOG_LEVEL
+#endif
+
+// APIC timer period in bus clocks / 16 (10000000 is roughly 10 Hz)
+#ifndef TIMER_INITIAL_COUNT
+#define TIMER_INITIAL_COUNT 10000000
+#endif
+
+// Sampling profiler: every timer tick records the interrupted RIP. With
+// PROF_DEPTH > 1 it also walks frame pointers (make PROFILE=1 builds with
+// -fno-omit-frame-pointer and a faster tick)
+#ifndef PROF_DEPTH
+#define PROF_DEPTH 1
+#endif
+#define PROF_BUCKETS 512        // Distinct stacks per CPU (power of two)
+#define PROF_PROBES 16          // Hash probes before a sample is dropped
+#define PROF_STACK_SPAN 16384   // Largest kernel stack (BSP boot stack)
+
+// Take profiler samples every PERF_SAMPLE_PERIOD unhalted cycles from PMU
+// overflow interrupts instead of timer ticks (0 = off, needs a PMU with a
+// spare counter; falls back to the timer otherwise)
+#ifndef PERF_SAMPLE_PERIOD
+#define PERF_SAMPLE_PERIOD 0
+#endif
+
 // Interrupt vectors
 #define TIMER_VECTOR      32    // IRQ 0 (timer) mapped to vector 32
+#define DOORBELL_VECTOR   33    // IPI: wake a halted message ring consumer
+#define PMU_VECTOR        34    // LVT PMC: performance counter overflow
+#define IPI_BENCH_VECTOR  35    // IPI benchmark (bench_ipi)
+
+// Use xAPIC (MMIO) even when x2APIC is available (make XAPIC=1)
+#ifndef FORCE_XAPIC
+#define FORCE_XAPIC 0
+#endif
 
 // APIC MSR and registers (xAPIC - MMIO mode)
 #define APIC_BASE_MSR     0x1B
@@ -92,12 +174,23 @@
 // Timer modes
 #define APIC_TIMER_PERIODIC  0x20000    // Periodic mode (bit 17)
 
+// TSC calibration and clock
+#define MSR_TSC_AUX       0xC0000103    // Returned by rdtscp (we store the logical CPU)
+#define PIT_CH2_DATA      0x42
+#define PIT_COMMAND       0x43
+#define PIT_GATE_PORT     0x61          // Bit 0: ch2 gate, bit 1: speaker, bit 5: ch2 output
+#define PIT_FREQ_HZ       1193182
+#define PIT_CALIBRATE_MS  10
+
 // IPI types (from Linux)
 #define APIC_DM_INIT          0x00000500
 #define APIC_DM_STARTUP       0x00000600
 #define APIC_INT_LEVELTRIG    0x00008000
 #define APIC_INT_ASSERT       0x00004000
 #define APIC_DEST_PHYSICAL    0x00000000
+#define APIC_DEST_LOGICAL     0x00000800    // Destination is an LDR pattern
+#define APIC_DEST_ALLINC      0x00080000    // Shorthand: every CPU
+#define APIC_DEST_ALLBUT      0x000C0000    // Shorthand: every CPU but the sender
 
 typedef unsigned char uint8_t;
 typedef unsigned short uint16_t;
@@ -150,6 +243,31 @@ static inline uint8_t inb(uint16_t port) {
     return ret;
 }
 
+static inline void outw(uint16_t port, uint16_t val) {
+    __asm__ volatile("outw %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline uint16_t inw(uint16_t port) {
+    uint16_t ret;
+    __asm__ volatile("inw %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+static inline void outl(uint16_t port, uint32_t val) {
+    __asm__ volatile("outl %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline uint32_t inl(uint16_t port) {
+    uint32_t ret;
+    __asm__ volatile("inl %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+// Write a whole buffer to one port (one instruction, one VM exit under KVM)
+static inline void outsb(uint16_t port, const void *buf, uint64_t len) {
+    __asm__ volatile("rep outsb" : "+S"(buf), "+c"(len) : "d"(port) : "memory");
+}
+
 // MSR operations
 static inline uint64_t rdmsr(uint32_t msr) {
     uint32_t low, high;
@@ -170,11 +288,30 @@ static inline uint64_t rdtsc(void) {
     return ((uint64_t)high << 32) | low;
 }
 
+// TSC read that doesn't start before earlier instructions finish
+static inline uint64_t rdtsc_ordered(void) {
+    uint32_t low, high;
+    __asm__ volatile("lfence; rdtsc" : "=a"(low), "=d"(high) : : "memory");
+    return ((uint64_t)high << 32) | low;
+}
+
+// TSC + TSC_AUX in one instruction (no migration between the two)
+static inline uint64_t rdtscp(uint32_t *aux) {
+    uint32_t low, high;
+    __asm__ volatile("rdtscp" : "=a"(low), "=d"(high), "=c"(*aux));
+    return ((uint64_t)high << 32) | low;
+}
+
 // CPUID function
-static inline void cpuid(uint32_t leaf, uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx) {
+static inline void cpuid_count(uint32_t leaf, uint32_t subleaf,
+                               uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx) {
     __asm__ volatile("cpuid"
                      : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
-                     : "a"(leaf), "c"(0));
+                     : "a"(leaf), "c"(subleaf));
+}
+
+static inline void cpuid(uint32_t leaf, uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx) {
+    cpuid_count(leaf, 0, eax, ebx, ecx, edx);
 }
 
 // APIC mode tracking
@@ -212,8 +349,8 @@ static inline void atomic_inc(volatile uint32_t *ptr) {
     __asm__ volatile("lock incl %0" : "+m"(*ptr) : : "memory");
 }
 
-// Per-CPU stacks (8KB each, aligned)
-static uint8_t __attribute__((aligned(16))) ap_stacks[MAX_CPUS][AP_STACK_SIZE];
+// Per-CPU stacks (8KB each, by MADT index, from percpu_init)
+static uint8_t (*ap_stacks)[AP_STACK_SIZE];
 
 // Trampoline symbols (from trampoline.S)
 extern char trampoline_start[];
@@ -245,17 +382,275 @@ static uint64_t *pml4 = 0;            // Pointer to PML4 (via recursive mapping)
 // PARALLEL COMPUTATION DATA STRUCTURES
 // ============================================================================
 
-// Test 1: Parallel counters
-static volatile uint64_t per_cpu_counters[MAX_CPUS] = {0};
+// Test 1: Parallel counters - packed, so neighbouring CPUs share a cache
+// line and the test pays for false sharing (bench_coherence() measures it)
+static volatile uint64_t *per_cpu_counters;
 
 // Test 2: Distributed sum (sum of 1 to 10,000,000)
 #define SUM_TARGET 10000000UL
-static volatile uint64_t partial_sums[MAX_CPUS] = {0};
+static volatile uint64_t *partial_sums;
 static volatile uint64_t total_sum = 0;
 
 // Test 3: Barrier synchronization
-static volatile uint32_t barrier_count = 0;
-static volatile uint32_t barrier_sense = 0;
+#define CACHE_LINE_SIZE 64
+#define BARRIER_MAX_ROUNDS (32 - __builtin_clz(MAX_CPUS - 1))   // ceil(log2(MAX_CPUS))
+
+// Centralized sense-reversing barrier (baseline for the barrier benchmark)
+// Every CPU does a RMW on 'count' and spins on 'sense': O(N) line transfers
+struct central_barrier {
+    volatile uint32_t count;
+    volatile uint32_t sense;
+};
+
+// Dissemination barrier flag - one cache line each, so spinning stays local
+struct barrier_flag {
+    volatile uint32_t count;            // Bumped by the partner CPU of this round
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+struct barrier_cpu {
+    struct barrier_flag round[BARRIER_MAX_ROUNDS];  // Written by partners, spun on by owner
+    uint32_t episodes;                              // Owner-only: episodes entered
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+struct dissem_barrier {
+    struct barrier_cpu *cpu;            // One per CPU (percpu_init)
+};
+
+static struct dissem_barrier global_barrier;
+
+// Barrier benchmark: average TSC cycles per episode, indexed by participant count
+#define BARRIER_BENCH_ITERS 1000
+static struct central_barrier bench_central_barrier;
+static struct dissem_barrier bench_dissem_barrier;
+static uint64_t *barrier_bench_central;          // cpu_count + 1 entries
+static uint64_t *barrier_bench_dissem;
+
+// Cross-CPU message rings: one SPSC ring per ordered (producer, consumer) pair
+#define MSG_RING_SIZE 128               // Slots per ring (power of two)
+#define MSG_RING_SPINS 10000            // Polls before a consumer halts
+
+struct msg_ring {
+    // Consumer-owned line
+    volatile uint32_t head __attribute__((aligned(CACHE_LINE_SIZE)));  // Next slot to read
+    uint32_t tail_cache;                // Consumer's last view of tail
+
+    // Producer-owned line
+    volatile uint32_t tail __attribute__((aligned(CACHE_LINE_SIZE)));  // Published write index
+    uint32_t pending;                   // Write index incl. unpublished batch
+    uint32_t head_cache;                // Producer's last view of head
+    uint32_t consumer;                  // Logical CPU to ring on publish
+
+    uint64_t slots[MSG_RING_SIZE] __attribute__((aligned(CACHE_LINE_SIZE)));
+};
+
+// [producer * cpu_count + consumer], allocated by the first msg_ring_get()
+static struct msg_ring **msg_rings;
+
+// Set while a CPU sleeps in msg_ring_wait() - producers send a doorbell IPI
+struct cpu_halt_flag {
+    volatile uint32_t halted;
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+static struct cpu_halt_flag *cpu_halt;
+
+// APIC ID of each logical CPU (registered by the CPU itself at startup)
+static uint32_t *logical_apic_ids;
+
+// x2APIC logical destination of each CPU: cluster in bits 31:16, one bit
+// of 16 in bits 15:0 (X2APIC_LDR, fixed by hardware). 0 in xAPIC mode.
+static uint32_t *x2apic_ldrs;
+
+// Set of logical CPUs (send_ipi_mask)
+#define CPUMASK_WORDS ((MAX_CPUS + 63) / 64)
+
+struct cpumask {
+    uint64_t bits[CPUMASK_WORDS];
+};
+
+// x2APIC clusters send_ipi_mask_via() merges per batch of ICR writes:
+// every cluster when the IDs are dense, a batch at a time when not
+#define IPI_MAX_CLUSTERS (MAX_CPUS / 16 + 1)
+
+// The only MAX_CPUS-sized things on the stack: a few masks and the cluster
+// list. Keep them to an eighth of an AP's stack.
+#if 4 * CPUMASK_WORDS * 8 + IPI_MAX_CLUSTERS * 4 > AP_STACK_SIZE / 8
+#error "MAX_CPUS too large for AP_STACK_SIZE"
+#endif
+
+// Message ring benchmark results
+#define MSG_BENCH_COUNT 100000          // Messages per CPU in the throughput run
+#define MSG_BENCH_BATCH 16              // Messages per publish
+#define MSG_PINGPONG_ROUNDS 10000
+#define MSG_DOORBELL_ROUNDS 1000
+static uint64_t *msg_bench_cycles;             // Cycles per message (send + receive)
+static uint64_t msg_bench_errors = 0;          // Out-of-order or lost messages
+static uint64_t msg_bench_pingpong = 0;        // One-way latency, polling consumer
+static uint64_t msg_bench_doorbell = 0;        // One-way latency, halted consumer
+static volatile uint64_t doorbell_irqs = 0;
+
+// Cache-coherence benchmark: core-to-core latency, false sharing, atomics
+#define C2C_ROUNDS 1000                 // Round trips per CPU pair
+#define C2C_WARMUP 100
+#define COH_COUNTER_ITERS 200000        // Increments per CPU per run
+#define COH_ATOMIC_ITERS 100000         // Operations per CPU per run
+
+// One line bounced between the two CPUs of a pair
+struct coh_line {
+    volatile uint64_t value;
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+enum { COH_PACKED, COH_PADDED, COH_SHARED, COH_COUNTER_KINDS };
+static const char *const coh_counter_names[COH_COUNTER_KINDS] = { "packed", "padded", "shared" };
+
+// Atomic operations by memory order. On x86 every locked RMW is a full
+// barrier whatever the order asked for; only seq_cst stores cost more
+// (xchg instead of mov), which the table makes visible.
+enum {
+    COH_LOAD_ACQUIRE, COH_STORE_RELAXED, COH_STORE_RELEASE, COH_STORE_SEQ_CST,
+    COH_ADD_RELAXED, COH_ADD_ACQ_REL, COH_ADD_SEQ_CST, COH_XCHG, COH_CAS, COH_ATOMIC_OPS
+};
+static const char *const coh_atomic_names[COH_ATOMIC_OPS] = {
+    "load_acquire", "store_relaxed", "store_release", "store_seq_cst",
+    "add_relaxed", "add_acq_rel", "add_seq_cst", "xchg", "cas",
+};
+
+static struct coh_line c2c_line;
+static uint64_t *c2c_latency;                       // [a * cpu_count + b], one-way, TSC cycles
+static volatile uint64_t *coh_packed;               // Test 1's layout
+static struct coh_line *coh_padded;                 // One line per CPU
+static struct coh_line coh_shared;                  // One line for everyone
+static uint64_t *coh_cycles;                        // Per-CPU time of the last run
+static uint64_t *coh_counter_cycles[COH_COUNTER_KINDS];  // Slowest CPU, by CPU count (cpu_count + 1)
+static uint64_t coh_atomic_cycles[2][COH_ATOMIC_OPS];  // [private, shared line]
+static uint64_t coh_errors = 0;                     // Lost shared increments
+
+// IPI benchmark: latency, unicast vs broadcast, IPIs per second per sender
+#define IPI_BENCH_ROUNDS 1000           // Per target and measurement
+#define IPI_BENCH_BURST 10000           // Back-to-back sends per CPU
+#define IPI_BENCH_TIMEOUT_MS 100        // Before an IPI counts as lost
+
+// Written by the CPU's own IPI handler
+struct ipi_bench_cpu {
+    volatile uint64_t received;
+    volatile uint64_t arrival;          // TSC of the last one, BSP timebase
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+static struct ipi_bench_cpu *ipi_bench_cpus;
+static uint64_t *ipi_bench_seen;                   // BSP only: received counts before a send
+static volatile uint32_t ipi_bench_echo = CPU_NONE;  // Handlers answer this CPU
+static uint64_t *ipi_oneway;                       // BSP -> CPU, cycles
+static uint64_t *ipi_roundtrip;                    // BSP -> CPU -> BSP, cycles
+static uint64_t ipi_fanout_send[4], ipi_fanout_done[4];   // Reach every other CPU, by ipi_method
+static uint32_t ipi_fanout_writes[4];                     // ICR writes per round (0 = not usable)
+static uint64_t *ipi_burst_cycles;                 // IPI_BENCH_BURST sends
+static uint64_t *ipi_burst_received;               // Fewer than sent: pending IPIs merge
+static uint64_t ipi_bench_timeouts = 0;
+static uint64_t ipi_mask_errors = 0;               // Test 6: CPUs missed or hit wrongly
+
+// Quiescent-state RCU for read-mostly tables. Readers only touch their own
+// nesting count; a grace period ends once every online CPU has passed a
+// quiescent state (timer tick outside a read-side section, or idle).
+struct rcu_cpu {
+    volatile uint64_t qs_count;         // Quiescent states passed (owner writes)
+    volatile uint32_t nesting;          // rcu_read_lock() depth
+    volatile uint32_t online;           // Waited for by synchronize_rcu()
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+static struct rcu_cpu *rcu_cpus;
+static uint64_t *rcu_snap;              // synchronize_rcu()'s view of every CPU
+
+// Deferred callback, embedded in the object it reclaims
+struct rcu_head {
+    struct rcu_head *next;
+    void (*func)(struct rcu_head *head);
+};
+
+static struct rcu_head *rcu_pending = 0;   // Queued by call_rcu()
+
+// Publish / read an RCU-protected pointer (see READ-COPY-UPDATE)
+#define rcu_assign_pointer(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+#define rcu_dereference(p) __atomic_load_n(&(p), __ATOMIC_CONSUME)
+
+// APIC ID -> logical CPU, written once by each CPU at startup. x2APIC IDs
+// are 32-bit and sparse, so this is an open-addressing hash of
+// (apic_id << 32 | cpu) entries with at least twice as many slots as CPUs.
+// percpu_init() publishes it with rcu_assign_pointer(), mask and slots in
+// one object; registering CPUs then fill slots in place. It is never
+// replaced, so lookups (interrupt handlers, this_cpu()) skip rcu_read_lock().
+#define APIC_MAP_EMPTY (~0UL)
+struct apic_map {
+    uint32_t mask;                      // Slots - 1 (a power of two)
+    uint64_t slots[];
+};
+static struct apic_map *apic_map;
+static uint32_t percpu_cpus = 1;        // Slots per per-CPU table: the BSP's boot slot until percpu_init()
+
+static inline uint32_t apic_map_hash(const struct apic_map *map, uint32_t apic_id) {
+    return (apic_id * 0x9E3779B1U) & map->mask;
+}
+
+// Logical CPU with this APIC ID (CPU_NONE if none registered it)
+static uint32_t cpu_from_apic_id(uint32_t apic_id) {
+    struct apic_map *map = rcu_dereference(apic_map);
+    if (!map) return CPU_NONE;
+    for (uint32_t i = apic_map_hash(map, apic_id); ; i = (i + 1) & map->mask) {
+        uint64_t entry = __atomic_load_n(&map->slots[i], __ATOMIC_ACQUIRE);
+        if (entry == APIC_MAP_EMPTY) return CPU_NONE;
+        if ((uint32_t)(entry >> 32) == apic_id) return (uint32_t)entry;
+    }
+}
+
+// CPUs register concurrently: claim the first empty slot of the probe sequence
+static void apic_map_insert(uint32_t apic_id, uint32_t cpu) {
+    struct apic_map *map = rcu_dereference(apic_map);
+    uint64_t entry = ((uint64_t)apic_id << 32) | cpu;
+    for (uint32_t i = apic_map_hash(map, apic_id); ; i = (i + 1) & map->mask) {
+        uint64_t empty = APIC_MAP_EMPTY;
+        if (__atomic_compare_exchange_n(&map->slots[i], &empty, entry, 0,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            return;
+        }
+    }
+}
+static volatile uint32_t cpu_ids_ready = 0;  // BSP registered: ask the hardware
+static int has_rdtscp = 0;                   // TSC_AUX holds the logical CPU
+
+// Test 4: RCU - readers must never see a torn or reclaimed table
+#define RCU_TEST_ENTRIES 16
+#define RCU_TEST_UPDATES 5
+#define RCU_POISON 0xDEADDEADDEADDEADUL
+
+struct rcu_test_table {
+    struct rcu_head rcu;                // First member: callbacks cast back
+    uint64_t version;
+    uint64_t entries[RCU_TEST_ENTRIES]; // All equal to version
+};
+
+static struct rcu_test_table rcu_test_tables[2];
+static struct rcu_test_table *rcu_test_current = 0;
+static volatile uint32_t rcu_test_done = 0;
+static uint64_t *rcu_test_reads;
+static uint64_t rcu_test_errors = 0;
+static uint64_t rcu_test_grace_cycles = 0;  // Average update cost (grace period)
+
+// TSC offset measurement: BSP answers each AP's pings with its own TSC
+#define TSC_SYNC_ROUNDS 64
+
+struct tsc_sync {
+    volatile uint32_t ping __attribute__((aligned(CACHE_LINE_SIZE)));  // AP -> BSP
+    volatile uint32_t pong __attribute__((aligned(CACHE_LINE_SIZE)));  // BSP -> AP
+    volatile uint64_t bsp_tsc;
+};
+
+static struct tsc_sync tsc_sync;
+
+// Clock check: every CPU reads the clock against a shared high-water mark
+#define CLOCK_TEST_READS 100000
+#define CLOCK_SKEW_TOLERANCE_NS 1000    // Residual offset error we accept
+static uint64_t clock_test_last = 0;
+static uint64_t clock_test_backsteps = 0;     // Reads behind a value already seen
+static uint64_t clock_test_max_backstep = 0;  // ns
+static uint64_t clock_read_cycles = 0;        // Cost of clock_monotonic_ns() on BSP
 
 // ============================================================================
 // IDT (INTERRUPT DESCRIPTOR TABLE)
@@ -326,7 +721,7 @@ static const char *exception_names[32] = {
 static volatile uint32_t exception_count = 0;
 
 // Timer interrupt counters (per-CPU)
-static volatile uint64_t timer_ticks[MAX_CPUS] = {0};
+static volatile uint64_t *timer_ticks;
 
 // ============================================================================
 // IDT FUNCTIONS
@@ -336,6 +731,7 @@ static volatile uint64_t timer_ticks[MAX_CPUS] = {0};
 static void puts(const char *s);
 static void print_hex(uint32_t n);
 static void print_hex_64(uint64_t n);
+static void console_flush(void);
 
 // Set an IDT entry
 static void idt_set_gate(uint8_t num, uint64_t handler, uint16_t selector, uint8_t flags) {
@@ -351,6 +747,12 @@ static void idt_set_gate(uint8_t num, uint64_t handler, uint16_t selector, uint8
 // Generic exception handler (called from assembly stubs)
 __attribute__((used))
 static void exception_handler(uint64_t vector, uint64_t error_code, uint64_t rip) {
+    // Lazy FPU switch (CR0.TS), not an error
+    if (vector == 7) {
+        fpu_handle_nm();
+        return;
+    }
+
     __atomic_fetch_add(&exception_count, 1, __ATOMIC_SEQ_CST);
 
     puts("\n[EXCEPTION] ");
@@ -381,6 +783,7 @@ static void exception_handler(uint64_t vector, uint64_t error_code, uint64_t rip
 
     // For other exceptions, halt
     puts("[HALT] System halted due to exception\n");
+    console_flush();
     while (1) {
         __asm__ volatile("hlt");
     }
@@ -459,7 +862,8 @@ __attribute__((naked)) void exception_common(void) {
         "mov 16*8(%%rsp), %%rsi\n"    // error_code (arg 2)
         "mov 17*8(%%rsp), %%rdx\n"    // RIP (arg 3)
 
-        // Call C handler
+        // Call C handler (the ABI wants DF clear; iretq restores it)
+        "cld\n"
         "call exception_handler\n"
 
         // Restore registers (we'll never get here if handler halts)
@@ -553,9 +957,123 @@ static void send_eoi(void) {
 // Global debug counter to see if handler is called at all
 static volatile uint64_t global_timer_calls = 0;
 
+static void rcu_quiescent_state(int cpu_id);
+static void console_tick(void);
+
+// ============================================================================
+// SAMPLING PROFILER
+// ============================================================================
+//
+// The timer tick samples whatever it interrupted. Each CPU keeps its own
+// hash table of distinct stacks with a hit count, written only from its own
+// timer interrupt, so sampling needs no locks. prof_dump() prints the tables
+// for tools/prof_fold.py, which symbolizes them into folded stacks.
+
+// Stack layout built by timer_irq_stub: saved registers, then the iret frame
+struct irq_frame {
+    uint64_t r15, r14, r13, r12, r11, r10, r9, r8;
+    uint64_t rbp, rdi, rsi, rdx, rcx, rbx, rax;
+    uint64_t rip, cs, rflags, rsp, ss;
+};
+
+struct prof_bucket {
+    uint32_t count;             // 0 = empty
+    uint32_t depth;
+    uint64_t pcs[PROF_DEPTH];   // Interrupted RIP, then return addresses
+};
+
+struct prof_cpu {
+    uint64_t samples;
+    uint64_t dropped;           // Table full around the stack's hash
+    struct prof_bucket buckets[PROF_BUCKETS];
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+static struct prof_cpu *prof_cpus;
+static volatile int prof_on = 0;
+static int prof_from_pmi = 0;   // PMU overflow interrupts take the samples
+
+static void prof_sample(const struct irq_frame *frame, uint32_t cpu) {
+    if (!prof_on || cpu >= percpu_cpus) return;
+
+    uint64_t pcs[PROF_DEPTH];
+    uint32_t depth = 0;
+    pcs[depth++] = frame->rip;
+
+#if PROF_DEPTH > 1
+    // Follow saved RBPs while they stay on the interrupted stack and move up
+    uint64_t fp = frame->rbp;
+    uint64_t low = frame->rsp;
+    while (depth < PROF_DEPTH && fp >= low && !(fp & 7) &&
+           fp - frame->rsp < PROF_STACK_SPAN) {
+        const uint64_t *f = (const uint64_t *)fp;
+        if (!f[1]) break;
+        pcs[depth++] = f[1];
+        low = fp + 16;
+        fp = f[0];
+    }
+#endif
+
+    // FNV-1a over the stack picks the home bucket
+    uint64_t hash = 0xcbf29ce484222325UL;
+    for (uint32_t i = 0; i < depth; i++) {
+        hash = (hash ^ pcs[i]) * 0x100000001b3UL;
+    }
+
+    struct prof_cpu *pc = &prof_cpus[cpu];
+    pc->samples++;
+    for (uint32_t probe = 0; probe < PROF_PROBES; probe++) {
+        struct prof_bucket *b = &pc->buckets[(hash + probe) & (PROF_BUCKETS - 1)];
+        if (b->count == 0) {
+            b->depth = depth;
+            for (uint32_t i = 0; i < depth; i++) b->pcs[i] = pcs[i];
+            b->count = 1;
+            return;
+        }
+        if (b->depth == depth) {
+            uint32_t i = 0;
+            while (i < depth && b->pcs[i] == pcs[i]) i++;
+            if (i == depth) {
+                b->count++;
+                return;
+            }
+        }
+    }
+    pc->dropped++;
+}
+
+__attribute__((format(printf, 1, 2)))
+static void log_printf(const char *fmt, ...);
+
+// Print every CPU's stacks for tools/prof_fold.py:
+//   @PROF v1 depth=<max frames>
+//   @C <cpu> <samples> <dropped>
+//   @S <cpu> <count> <rip> [<return address> ...]   (hex, innermost first)
+//   @END
+static void prof_dump(void) {
+    prof_on = 0;
+
+    log_printf("@PROF v1 depth=%u\n", (uint32_t)PROF_DEPTH);
+    for (uint32_t cpu = 0; cpu < percpu_cpus; cpu++) {
+        struct prof_cpu *pc = &prof_cpus[cpu];
+        if (!pc->samples) continue;
+
+        log_printf("@C %u %lu %lu\n", cpu, pc->samples, pc->dropped);
+        for (uint32_t i = 0; i < PROF_BUCKETS; i++) {
+            struct prof_bucket *b = &pc->buckets[i];
+            if (!b->count) continue;
+            log_printf("@S %u %u", cpu, b->count);
+            for (uint32_t d = 0; d < b->depth; d++) {
+                log_printf(" %lx", b->pcs[d]);
+            }
+            log_printf("\n");
+        }
+    }
+    log_printf("@END\n");
+}
+
 // Timer interrupt handler (called from assembly stub)
 __attribute__((used))
-void timer_interrupt_handler(void) {
+void timer_interrupt_handler(struct irq_frame *frame) {
     // Increment global counter (debug)
     __atomic_fetch_add(&global_timer_calls, 1, __ATOMIC_SEQ_CST);
 
@@ -567,10 +1085,23 @@ void timer_interrupt_handler(void) {
         apic_id = apic_read(APIC_ID_REG) >> 24;
     }
 
-    // Use APIC ID directly as index (works for sequential APIC IDs like in QEMU)
-    // In QEMU with -smp 4, APIC IDs are typically 0, 1, 2, 3
-    if (apic_id < MAX_CPUS) {
-        __atomic_fetch_add(&timer_ticks[apic_id], 1, __ATOMIC_SEQ_CST);
+    // APIC IDs need not be dense (x2APIC IDs encode the topology)
+    uint32_t cpu = cpu_from_apic_id(apic_id);
+    if (cpu < percpu_cpus) {
+        __atomic_fetch_add(&timer_ticks[cpu], 1, __ATOMIC_SEQ_CST);
+        if (!prof_from_pmi) {
+            prof_sample(frame, cpu);
+        }
+
+        // A tick that didn't interrupt a read-side section is a quiescent state
+        if (rcu_cpus[cpu].nesting == 0) {
+            rcu_quiescent_state(cpu);
+        }
+    }
+
+    // Push out buffered console output - one CPU is enough
+    if (cpu == 0) {
+        console_tick();
     }
 
     // Send EOI to acknowledge interrupt
@@ -601,7 +1132,9 @@ __asm__(
     "    push %r14\n"
     "    push %r15\n"
 
-    // Call C handler
+    // Call C handler with the saved registers + iret frame (struct irq_frame)
+    "    cld\n"
+    "    mov %rsp, %rdi\n"
     "    call timer_interrupt_handler\n"
 
     // Restore all registers
@@ -625,6 +1158,66 @@ __asm__(
     "    iretq\n"
 );
 
+// Get current CPU APIC ID
+static uint32_t get_apic_id(void) {
+    if (use_x2apic) {
+        return (uint32_t)rdmsr(X2APIC_APICID);
+    } else {
+        return apic_read(APIC_ID_REG) >> 24;
+    }
+}
+
+// Logical CPU of the caller (CPU_NONE if it hasn't registered yet)
+uint32_t this_cpu(void) {
+    if (!cpu_ids_ready) return 0;       // Only the BSP runs before it registers
+    if (has_rdtscp) {
+        uint32_t cpu;
+        rdtscp(&cpu);
+        return cpu;
+    }
+    return cpu_from_apic_id(get_apic_id());
+}
+
+// Doorbell IPI handler - the wakeup itself is the point, just acknowledge it
+__attribute__((used))
+void doorbell_interrupt_handler(void) {
+    __atomic_fetch_add(&doorbell_irqs, 1, __ATOMIC_RELAXED);
+    send_eoi();
+}
+
+// Doorbell IPI stub
+__attribute__((used))
+void doorbell_irq_stub(void);
+
+__asm__(
+    ".global doorbell_irq_stub\n"
+    "doorbell_irq_stub:\n"
+    // Save caller-saved registers (the C handler preserves the rest)
+    "    push %rax\n"
+    "    push %rcx\n"
+    "    push %rdx\n"
+    "    push %rsi\n"
+    "    push %rdi\n"
+    "    push %r8\n"
+    "    push %r9\n"
+    "    push %r10\n"
+    "    push %r11\n"
+
+    "    cld\n"
+    "    call doorbell_interrupt_handler\n"
+
+    "    pop %r11\n"
+    "    pop %r10\n"
+    "    pop %r9\n"
+    "    pop %r8\n"
+    "    pop %rdi\n"
+    "    pop %rsi\n"
+    "    pop %rdx\n"
+    "    pop %rcx\n"
+    "    pop %rax\n"
+    "    iretq\n"
+);
+
 // ============================================================================
 // IDT INITIALIZATION
 // ============================================================================
@@ -635,6 +1228,12 @@ static void print_dec(uint32_t num);
 // External pure assembly handler
 extern void pure_iretq_handler(void);
 
+// PMU overflow stub (PERFORMANCE COUNTERS section)
+void pmu_irq_stub(void);
+
+// IPI benchmark stub (PARALLEL COMPUTATION FUNCTIONS section)
+void ipi_bench_irq_stub(void);
+
 // Initialize IDT
 static void idt_init(void) {
     // Set ALL 256 entries to pure assembly handler (just iretq) as default
@@ -652,6 +1251,15 @@ static void idt_init(void) {
     // Set up timer IRQ handler (vector 32)
     idt_set_gate(TIMER_VECTOR, (uint64_t)timer_irq_stub, 0x08, 0x8E);
 
+    // Set up message ring doorbell IPI handler (vector 33)
+    idt_set_gate(DOORBELL_VECTOR, (uint64_t)doorbell_irq_stub, 0x08, 0x8E);
+
+    // Set up performance counter overflow handler (vector 34)
+    idt_set_gate(PMU_VECTOR, (uint64_t)pmu_irq_stub, 0x08, 0x8E);
+
+    // Set up IPI benchmark handler (vector 35)
+    idt_set_gate(IPI_BENCH_VECTOR, (uint64_t)ipi_bench_irq_stub, 0x08, 0x8E);
+
     // Set up IDTR
     idtr.limit = sizeof(idt) - 1;
     idtr.base = (uint64_t)&idt;
@@ -660,29 +1268,253 @@ static void idt_init(void) {
     idt_load();
 }
 
+// ============================================================================
+// BUFFERED CONSOLE
+// ============================================================================
+
+// puts()/putc() only append to the calling CPU's ring; whoever wins the
+// console lock moves bytes to the console backend and VGA. Draining happens
+// after each append, on every timer tick and in console_flush(). A full ring
+// makes the writer drain; it drops output only when it interrupted its own
+// CPU's drain (an exception or NMI mid-drain), which it can't wait for.
+#define CONSOLE_RING_SIZE 4096          // Bytes per CPU (power of two)
+#define UART_FIFO_SIZE    16
+#define UART_LSR_THRE     0x20          // Transmit FIFO empty
+#define DEBUGCON_PORT     0xE9          // QEMU/Bochs debug console
+
+// Backend, chosen at build time (make -f Makefile.step9 CONSOLE=...)
+#define CONSOLE_SERIAL    0             // COM1, 16 bytes per FIFO-empty poll
+#define CONSOLE_DEBUGCON  1             // Port 0xE9, rep outsb, no polling
+#define CONSOLE_VIRTIO    2             // virtio-console, bulk DMA buffers
+
+#ifndef CONSOLE_BACKEND
+#define CONSOLE_BACKEND CONSOLE_SERIAL
+#endif
+
+#ifndef CONSOLE_VGA
+#define CONSOLE_VGA 1                   // Mirror console output to VGA text mode
+#endif
+
+struct console_backend {
+    const char *name;
+    // Take up to 'len' bytes without blocking, return how many were taken
+    uint32_t (*write)(const char *buf, uint32_t len);
+};
+
+struct console_ring {
+    volatile uint32_t head __attribute__((aligned(CACHE_LINE_SIZE)));  // Drainer
+    volatile uint32_t tail __attribute__((aligned(CACHE_LINE_SIZE)));  // Owner CPU
+    char buf[CONSOLE_RING_SIZE];
+};
+
+static struct console_ring console_ring_boot;  // The BSP's until percpu_init()
+static struct console_ring *console_rings = &console_ring_boot;
+static volatile uint32_t console_lock = 0;      // 1 + console_self() of the holder, 0 if free
+static volatile uint32_t console_deferred = 0;  // Append only, no device I/O
+static volatile uint32_t console_pending = 0;   // Some ring may hold undrained output
+
 // Serial functions
 static void serial_init(void) {
     outb(COM1 + 1, 0x00);
     outb(COM1 + 3, 0x80);
-    outb(COM1 + 0, 0x03);
+    outb(COM1 + 0, 0x01);               // Divisor 1: 115200 baud
     outb(COM1 + 1, 0x00);
     outb(COM1 + 3, 0x03);
     outb(COM1 + 2, 0xC7);
     outb(COM1 + 4, 0x0B);
 }
 
+// Serial backend: fill the FIFO only when it's empty ('\n' costs two bytes)
+static uint32_t serial_console_write(const char *buf, uint32_t len) {
+    if (!(inb(COM1 + 5) & UART_LSR_THRE)) return 0;
+
+    uint32_t taken = 0;
+    for (int room = UART_FIFO_SIZE; room >= 2 && taken < len; taken++) {
+        if (buf[taken] == '\n') {
+            outb(COM1, '\r');
+            room--;
+        }
+        outb(COM1, buf[taken]);
+        room--;
+    }
+    return taken;
+}
+
+static const struct console_backend serial_backend = { "serial", serial_console_write };
+
+#if CONSOLE_BACKEND == CONSOLE_DEBUGCON
+// Debugcon backend: the device never stalls, take everything at once
+static uint32_t debugcon_console_write(const char *buf, uint32_t len) {
+    outsb(DEBUGCON_PORT, buf, len);
+    return len;
+}
+
+static const struct console_backend debugcon_backend = { "debugcon", debugcon_console_write };
+#endif
+
+// Current backend - serial until console_init()/virtio_console_init() switch
+static const struct console_backend *console = &serial_backend;
+
+// Pick the build-time backend if the device is there (serial otherwise)
+static void console_init(void) {
+#if CONSOLE_BACKEND == CONSOLE_DEBUGCON
+    // Reading the debugcon port returns 0xE9 when the device exists
+    if (inb(DEBUGCON_PORT) == DEBUGCON_PORT) {
+        console = &debugcon_backend;
+    }
+#endif
+}
+
+static inline uint64_t irq_save(void) {
+    uint64_t flags;
+    __asm__ volatile("pushfq; pop %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void irq_restore(uint64_t flags) {
+    if (flags & 0x200) __asm__ volatile("sti" ::: "memory");
+}
+
+// Lock holder: the logical CPU, or the APIC ID with the top bit set on a
+// CPU that hasn't registered yet
+static uint32_t console_self(void) {
+    uint32_t cpu = this_cpu();
+    return cpu < percpu_cpus ? cpu : (get_apic_id() | 0x80000000U);
+}
+
+// 0 without the lock: another CPU holds it and !wait, or this CPU does -
+// an exception or NMI can't wait for the drain it interrupted
+static int console_lock_take(int wait) {
+    uint32_t self = console_self() + 1;
+    uint32_t held = 0;
+    while (!__atomic_compare_exchange_n(&console_lock, &held, self, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        if (!wait || held == self) return 0;
+        held = 0;
+        __asm__ volatile("pause");
+    }
+    return 1;
+}
+
+static void console_lock_drop(void) {
+    __atomic_store_n(&console_lock, 0, __ATOMIC_RELEASE);
+}
+
+// Under the lock (or breaking it, console_flush())
+static void console_drain_rings(int wait) {
+    // Cleared before the scan: a write that lands after it sets it again
+    __atomic_store_n(&console_pending, 0, __ATOMIC_SEQ_CST);
+
+    int progress, left;
+    do {
+        progress = 0;
+        left = 0;
+        for (uint32_t cpu = 0; cpu < percpu_cpus; cpu++) {
+            struct console_ring *r = &console_rings[cpu];
+            uint32_t head = r->head;
+            uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+
+            while (head != tail) {
+                // Largest contiguous chunk (stop at the wrap point)
+                uint32_t offset = head & (CONSOLE_RING_SIZE - 1);
+                uint32_t chunk = tail - head;
+                if (chunk > CONSOLE_RING_SIZE - offset) chunk = CONSOLE_RING_SIZE - offset;
+
+                uint32_t taken = console->write(&r->buf[offset], chunk);
+                if (!taken) {
+                    if (!wait) break;
+                    __asm__ volatile("pause");
+                    continue;
+                }
+
+#if CONSOLE_VGA
+                for (uint32_t i = 0; i < taken; i++) {
+                    vga_putchar(r->buf[offset + i]);
+                }
+#endif
+                head += taken;
+                progress = 1;
+            }
+            __atomic_store_n(&r->head, head, __ATOMIC_RELEASE);
+            if (head != tail) left = 1;
+        }
+    } while (progress && wait);
+
+    if (left) __atomic_store_n(&console_pending, 1, __ATOMIC_RELEASE);
+}
+
+// Move buffered output to the hardware. Without 'wait', gives up as soon as
+// another CPU is draining or the backend can't take more right now.
+static void console_drain(int wait) {
+    if (!console_lock_take(wait)) return;
+    console_drain_rings(wait);
+    console_lock_drop();
+}
+
+// Timer tick: drain what the backend couldn't take before. An idle console
+// costs one load; nothing happens while AP bring-up defers device I/O.
+static void console_tick(void) {
+    if (console_pending && !console_deferred) {
+        console_drain(0);
+    }
+}
+
+// Write out everything buffered so far (before halting, after a panic, ...).
+// A fault in this CPU's own drain drains anyway: the CPU halts next, so
+// the interrupted drain never resumes.
+static void console_flush(void) {
+    int locked = console_lock_take(1);
+    console_drain_rings(1);
+    if (locked) console_lock_drop();
+}
+
+static void console_write(const char *s, uint64_t len) {
+    uint64_t flags = irq_save();        // An interrupt on this CPU may log too
+    uint32_t cpu = this_cpu();
+
+    if (cpu >= percpu_cpus) {
+        // Not registered yet - no ring to use, write through under the lock
+        // (straight through if this CPU faulted while holding it)
+        int locked = console_lock_take(1);
+        for (uint64_t done = 0; done < len; ) {
+            uint32_t taken = console->write(s + done, len - done);
+            if (!taken) __asm__ volatile("pause");
+            done += taken;
+        }
+        if (locked) console_lock_drop();
+        irq_restore(flags);
+        return;
+    }
+
+    struct console_ring *r = &console_rings[cpu];
+    uint32_t tail = r->tail;
+    for (uint64_t i = 0; i < len; i++) {
+        if (tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == CONSOLE_RING_SIZE) {
+            __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+            console_drain(1);
+            // Still full: this CPU interrupted its own drain, drop the rest
+            if (tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == CONSOLE_RING_SIZE) break;
+        }
+        r->buf[tail & (CONSOLE_RING_SIZE - 1)] = s[i];
+        tail++;
+    }
+    __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+    __atomic_store_n(&console_pending, 1, __ATOMIC_RELEASE);      // After the tail
+    irq_restore(flags);
+
+    if (!console_deferred) {
+        console_drain(0);
+    }
+}
+
 static void putc(char c) {
-    while ((inb(COM1 + 5) & 0x20) == 0);
-    outb(COM1, c);
+    console_write(&c, 1);
 }
 
 static void puts(const char *s) {
-    while (*s) {
-        if (*s == '\n') putc('\r');
-        putc(*s);
-        vga_putchar(*s);  // Also write to VGA
-        s++;
-    }
+    uint64_t len = 0;
+    while (s[len]) len++;
+    console_write(s, len);
 }
 
 static void print_dec(uint32_t num) {
@@ -745,58 +1577,814 @@ static void print_hex_64(uint64_t num) {
     puts(buf);
 }
 
-// Minimal memcpy
-static void *memcpy(void *dest, const void *src, uint64_t n) {
-    uint8_t *d = (uint8_t*)dest;
-    const uint8_t *s = (const uint8_t*)src;
-    while (n--) *d++ = *s++;
-    return dest;
-}
+// ============================================================================
+// LOGGING
+// ============================================================================
 
-static void *memset(void *dest, int val, uint64_t n) {
-    uint8_t *d = (uint8_t*)dest;
-    while (n--) *d++ = (uint8_t)val;
-    return dest;
-}
+// Text: LOG(PMM, DEBUG, "[PMM] page %lx\n", addr) formats the whole line on
+// the stack and appends it to the console in one go.
+// Binary: BLOG(SMP, INFO, EV_AP_ONLINE, a0, a1) stores (tsc, cpu, event, 2 args)
+// in a per-CPU flight recorder; blog_dump() prints the raw records and the
+// event formats for tools/blog_decode.py. Either compiles to nothing when
+// the level is above the subsystem's threshold.
+#define LOG_ENABLED(sys, lvl) (LOG_##lvl <= LOG_LEVEL_##sys)
+#define LOG(sys, lvl, ...) \
+    do { if (LOG_ENABLED(sys, lvl)) log_printf(__VA_ARGS__); } while (0)
+#define BLOG(sys, lvl, ev, a0, a1) \
+    do { if (LOG_ENABLED(sys, lvl)) blog_record(ev, (uint64_t)(a0), (uint64_t)(a1)); } while (0)
+
+#define LOG_LINE_MAX 256
+
+// Binary log events: id, printf-style format for the host decoder
+#define LOG_EVENTS(X) \
+    X(EV_AP_ONLINE,     "smp: online, APIC ID %lu, after %lu cycles since boot") \
+    X(EV_TSC_OFFSET,    "clock: TSC offset %ld cycles (round trip %lu cycles)") \
+    X(EV_RCU_GRACE,     "rcu: grace period %lu cycles, %lu callbacks") \
+    X(EV_PMM_ALLOC,     "pmm: alloc page %#lx, %lu pages used") \
+    X(EV_PMM_FREE,      "pmm: free page %#lx, %lu pages used") \
+    X(EV_HEAP_ALLOC,    "heap: kmalloc %lu bytes at %#lx")
+
+enum log_event {
+#define LOG_EVENT_ID(id, fmt) id,
+    LOG_EVENTS(LOG_EVENT_ID)
+#undef LOG_EVENT_ID
+    EV_COUNT
+};
 
-// TSC calibration and delays
-static uint64_t tsc_khz = 0;
+static const char *const log_event_formats[EV_COUNT] = {
+#define LOG_EVENT_FMT(id, fmt) fmt,
+    LOG_EVENTS(LOG_EVENT_FMT)
+#undef LOG_EVENT_FMT
+};
 
-static void calibrate_tsc(void) {
-    // For this minimal kernel, we use a simple fixed estimate
-    // TCG: ~500 MHz, KVM: ~2-6 GHz
-    // We'll use 2GHz as a reasonable middle ground
-    // The delays don't need to be exact for SMP boot to work
+#define BLOG_RING_SIZE 512              // Records per CPU (power of two, oldest overwritten)
 
-    tsc_khz = 2000000;  // 2 GHz = 2,000,000 kHz
+struct blog_record {
+    uint64_t tsc;
+    uint32_t event;
+    uint32_t cpu;
+    uint64_t args[2];
+};
+
+struct blog_ring {
+    uint64_t next;                      // Records written (owner CPU only)
+    struct blog_record rec[BLOG_RING_SIZE];
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+static struct blog_ring blog_ring_boot;        // The BSP's until percpu_init()
+static struct blog_ring *blog_rings = &blog_ring_boot;
+
+// Minimal vsnprintf: %s %c %d %u %x %X, 'l' for 64-bit, '#' for 0x, width, '0'
+static uint32_t log_vformat(char *buf, uint32_t size, const char *fmt, __builtin_va_list ap) {
+    uint32_t n = 0;
+#define LOG_EMIT(ch) do { if (n + 1 < size) buf[n] = (ch); n++; } while (0)
+    for (; *fmt; fmt++) {
+        if (*fmt != '%') {
+            LOG_EMIT(*fmt);
+            continue;
+        }
+        fmt++;
+
+        int alt = 0, zero = 0, is_long = 0;
+        uint32_t width = 0;
+        if (*fmt == '#') { alt = 1; fmt++; }
+        if (*fmt == '0') { zero = 1; fmt++; }
+        while (*fmt >= '0' && *fmt <= '9') width = width * 10 + (*fmt++ - '0');
+        if (*fmt == 'l') { is_long = 1; fmt++; }
+
+        char digits[24];
+        uint32_t nd = 0;
+        uint64_t v;
+        int negative = 0;
+        switch (*fmt) {
+            case 's': {
+                const char *str = __builtin_va_arg(ap, const char *);
+                while (*str) LOG_EMIT(*str++);
+                continue;
+            }
+            case 'c':
+                LOG_EMIT((char)__builtin_va_arg(ap, int));
+                continue;
+            case 'd':
+                v = is_long ? __builtin_va_arg(ap, uint64_t) : (uint64_t)(long)__builtin_va_arg(ap, int);
+                if ((long)v < 0) { negative = 1; v = -v; }
+                do { digits[nd++] = '0' + v % 10; v /= 10; } while (v);
+                break;
+            case 'u':
+                v = is_long ? __builtin_va_arg(ap, uint64_t) : __builtin_va_arg(ap, uint32_t);
+                do { digits[nd++] = '0' + v % 10; v /= 10; } while (v);
+                break;
+            case 'x':
+            case 'X': {
+                const char *hex = (*fmt == 'x') ? "0123456789abcdef" : "0123456789ABCDEF";
+                v = is_long ? __builtin_va_arg(ap, uint64_t) : __builtin_va_arg(ap, uint32_t);
+                do { digits[nd++] = hex[v & 0xF]; v >>= 4; } while (v);
+                break;
+            }
+            case '%':
+                LOG_EMIT('%');
+                continue;
+            default:
+                LOG_EMIT('%');
+                if (*fmt) LOG_EMIT(*fmt);
+                if (!*fmt) fmt--;
+                continue;
+        }
+
+        // Width counts sign and prefix, as in printf
+        uint32_t len = nd + negative + (alt ? 2 : 0);
+        uint32_t pad = (width > len) ? width - len : 0;
+        if (!zero) while (pad) { LOG_EMIT(' '); pad--; }
+        if (negative) LOG_EMIT('-');
+        if (alt) { LOG_EMIT('0'); LOG_EMIT('x'); }
+        while (pad) { LOG_EMIT('0'); pad--; }
+        while (nd) LOG_EMIT(digits[--nd]);
+    }
+#undef LOG_EMIT
+    buf[(n < size) ? n : size - 1] = 0;
+    return (n < size) ? n : size - 1;
 }
 
-// Ultra-simple delays - NO I/O operations during SMP boot!
-static void udelay(uint64_t usec) {
-    // Simple busy loop - very approximate
-    for (volatile uint64_t i = 0; i < usec * 10; i++) {
-        __asm__ volatile("pause");
+__attribute__((format(printf, 1, 2)))
+static void log_printf(const char *fmt, ...) {
+    char line[LOG_LINE_MAX];
+    __builtin_va_list ap;
+    __builtin_va_start(ap, fmt);
+    uint32_t len = log_vformat(line, sizeof(line), fmt, ap);
+    __builtin_va_end(ap);
+    console_write(line, len);
+}
+
+// Append one record to this CPU's flight recorder (~tens of cycles)
+static void blog_record(uint32_t event, uint64_t a0, uint64_t a1) {
+    uint64_t flags = irq_save();        // Interrupts on this CPU may log too
+    uint32_t cpu;
+    uint64_t tsc;
+    if (has_rdtscp) {
+        tsc = rdtscp(&cpu);
+    } else {
+        tsc = rdtsc();
+        cpu = this_cpu();
     }
+    if (cpu >= percpu_cpus || !cpu_ids_ready) cpu = 0;
+
+    struct blog_ring *ring = &blog_rings[cpu];
+    struct blog_record *rec = &ring->rec[ring->next & (BLOG_RING_SIZE - 1)];
+    rec->tsc = tsc;
+    rec->event = event;
+    rec->cpu = cpu;
+    rec->args[0] = a0;
+    rec->args[1] = a1;
+    ring->next++;
+    irq_restore(flags);
 }
 
-static void mdelay(uint64_t msec) {
-    for (uint64_t i = 0; i < msec; i++) {
-        udelay(1000);
+// Forward declaration (TSC calibration below)
+static uint64_t tsc_khz;
+
+// Print every recorded event for the host decoder (call once CPUs are quiet)
+static void blog_dump(void) {
+    uint64_t total = 0;
+    for (uint32_t cpu = 0; cpu < percpu_cpus; cpu++) {
+        total += blog_rings[cpu].next;
+    }
+    if (!total) return;
+
+    log_printf("@BLOG v1 tsc_khz=%lu events=%u\n", tsc_khz, (uint32_t)EV_COUNT);
+    for (uint32_t ev = 0; ev < EV_COUNT; ev++) {
+        log_printf("@E %u %s\n", ev, log_event_formats[ev]);
+    }
+    for (uint32_t cpu = 0; cpu < percpu_cpus; cpu++) {
+        struct blog_ring *ring = &blog_rings[cpu];
+        uint64_t first = (ring->next > BLOG_RING_SIZE) ? ring->next - BLOG_RING_SIZE : 0;
+        for (uint64_t i = first; i < ring->next; i++) {
+            struct blog_record *rec = &ring->rec[i & (BLOG_RING_SIZE - 1)];
+            log_printf("@R %u %lx %u %lx %lx\n", rec->cpu, rec->tsc, rec->event,
+                       rec->args[0], rec->args[1]);
+        }
     }
+    log_printf("@END\n");
 }
 
-// ACPI structures
-struct acpi_rsdp {
-    char signature[8];
-    uint8_t checksum;
-    char oem_id[6];
-    uint8_t revision;
-    uint32_t rsdt_address;
-    uint32_t length;
-    uint64_t xsdt_address;
-    uint8_t extended_checksum;
-    uint8_t reserved[3];
-} __attribute__((packed));
+// ============================================================================
+// PERFORMANCE COUNTERS (PMU)
+// ============================================================================
+//
+// Architectural performance monitoring (CPUID leaf 0xA). Every CPU programs
+// the same general-purpose counters in perf_cpu_init(), and perf_begin() /
+// perf_end() read them with rdpmc around a region. Without a PMU (TCG, or
+// KVM without a virtual PMU) only the TSC delta is measured.
+
+#define MSR_PERFEVTSEL0           0x186
+#define MSR_PMC0                  0x0C1
+#define MSR_PERF_GLOBAL_STATUS    0x38E
+#define MSR_PERF_GLOBAL_CTRL      0x38F
+#define MSR_PERF_GLOBAL_OVF_CTRL  0x390
+
+#define PERFEVTSEL_USR  (1 << 16)
+#define PERFEVTSEL_OS   (1 << 17)
+#define PERFEVTSEL_INT  (1 << 20)       // Raise a PMI on overflow
+#define PERFEVTSEL_EN   (1 << 22)
+
+#define APIC_LVT_PMC    0x340
+#define X2APIC_LVT_PMC  0x834
+#define APIC_LVT_MASKED (1 << 16)
+
+enum perf_counter {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_COUNTERS
+};
+
+// Architectural events: CPUID.0xA EBX bit (set = not available), event, umask
+static const struct {
+    uint8_t ebx_bit;
+    uint8_t event;
+    uint8_t umask;
+    const char *name;
+} perf_events[PERF_COUNTERS] = {
+    [PERF_CYCLES]        = { 0, 0x3C, 0x00, "cycles" },
+    [PERF_INSTRUCTIONS]  = { 1, 0xC0, 0x00, "instructions" },
+    [PERF_LLC_MISSES]    = { 4, 0x2E, 0x41, "LLC misses" },
+    [PERF_BRANCH_MISSES] = { 6, 0xC5, 0x00, "branch misses" },
+};
+
+struct perf_sample {
+    uint64_t tsc;
+    uint64_t count[PERF_COUNTERS];
+    uint32_t valid;                     // Bit per enum perf_counter counted
+};
+
+static uint32_t perf_version = 0;       // Architectural PMU version, 0 = none
+static uint32_t perf_gp_counters = 0;
+static uint64_t perf_counter_mask = 0;  // Counter width
+static uint32_t perf_valid = 0;         // Events we programmed
+static uint32_t perf_sample_pmc = 0;    // Counter driving PMU sampling
+
+static inline uint64_t rdpmc(uint32_t index) {
+    uint32_t low, high;
+    __asm__ volatile("rdpmc" : "=a"(low), "=d"(high) : "c"(index));
+    return ((uint64_t)high << 32) | low;
+}
+
+static void perf_lvt_write(uint32_t value) {
+    if (use_x2apic) {
+        wrmsr(X2APIC_LVT_PMC, value);
+    } else {
+        apic_write(APIC_LVT_PMC, value);
+    }
+}
+
+// BSP, once: find out which events this CPU model can count
+static void perf_detect(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(0, &eax, &ebx, &ecx, &edx);
+    if (eax < 0xA) {
+        LOG(PERF, INFO, "[PERF] No PMU (CPUID leaf 0xA missing), TSC only\n");
+        return;
+    }
+
+    cpuid(0xA, &eax, &ebx, &ecx, &edx);
+    uint32_t version = eax & 0xFF;
+    uint32_t counters = (eax >> 8) & 0xFF;
+    uint32_t width = (eax >> 16) & 0xFF;
+    uint32_t ebx_len = (eax >> 24) & 0xFF;
+    if (version == 0 || counters == 0 || width == 0) {
+        LOG(PERF, INFO, "[PERF] No PMU (architectural version 0), TSC only\n");
+        return;
+    }
+
+    perf_version = version;
+    perf_gp_counters = counters;
+    perf_counter_mask = (width >= 64) ? ~0UL : (1UL << width) - 1;
+
+    // Events take general-purpose counters in enum order
+    for (uint32_t ev = 0; ev < PERF_COUNTERS && ev < counters; ev++) {
+        uint32_t bit = perf_events[ev].ebx_bit;
+        if (bit < ebx_len && !(ebx & (1U << bit))) {
+            perf_valid |= 1U << ev;
+        }
+    }
+
+    // PMU sampling needs a spare counter counting cycles
+    if (PERF_SAMPLE_PERIOD && (perf_valid & (1U << PERF_CYCLES)) && counters > PERF_COUNTERS) {
+        perf_sample_pmc = PERF_COUNTERS;
+        prof_from_pmi = 1;
+    }
+
+    LOG(PERF, INFO, "[PERF] PMU v%u: %u counters, %u bits\n", version, counters, width);
+    for (uint32_t ev = 0; ev < PERF_COUNTERS; ev++) {
+        LOG(PERF, INFO, "[PERF]   %s: %s\n", perf_events[ev].name,
+            (perf_valid & (1U << ev)) ? "yes" : "no");
+    }
+    if (prof_from_pmi) {
+        LOG(PERF, INFO, "[PERF] Profiler samples every %lu cycles (PMI)\n",
+            (uint64_t)PERF_SAMPLE_PERIOD);
+    }
+}
+
+// Every CPU, after its local APIC is enabled: program and start the counters
+static void perf_cpu_init(void) {
+    if (!perf_version) return;
+
+    uint64_t enable = 0;
+    if (perf_version >= 2) {
+        wrmsr(MSR_PERF_GLOBAL_CTRL, 0);
+    }
+    for (uint32_t ev = 0; ev < PERF_COUNTERS; ev++) {
+        if (!(perf_valid & (1U << ev))) continue;
+        wrmsr(MSR_PERFEVTSEL0 + ev, 0);
+        wrmsr(MSR_PMC0 + ev, 0);
+        wrmsr(MSR_PERFEVTSEL0 + ev, perf_events[ev].event | (perf_events[ev].umask << 8) |
+              PERFEVTSEL_USR | PERFEVTSEL_OS | PERFEVTSEL_EN);
+        enable |= 1UL << ev;
+    }
+
+    if (prof_from_pmi) {
+        // Count up from -period so the counter overflows after 'period' cycles
+        uint32_t pmc = perf_sample_pmc;
+        wrmsr(MSR_PMC0 + pmc, (-(uint64_t)PERF_SAMPLE_PERIOD) & perf_counter_mask);
+        wrmsr(MSR_PERFEVTSEL0 + pmc, perf_events[PERF_CYCLES].event | PERFEVTSEL_OS |
+              PERFEVTSEL_INT | PERFEVTSEL_EN);
+        enable |= 1UL << pmc;
+        perf_lvt_write(PMU_VECTOR);
+    }
+
+    if (perf_version >= 2) {
+        wrmsr(MSR_PERF_GLOBAL_CTRL, enable);
+    }
+}
+
+static void perf_read(struct perf_sample *s) {
+    s->valid = perf_valid;
+    for (uint32_t ev = 0; ev < PERF_COUNTERS; ev++) {
+        s->count[ev] = (perf_valid & (1U << ev)) ? rdpmc(ev) : 0;
+    }
+    s->tsc = rdtsc_ordered();
+}
+
+// Start measuring a region on the calling CPU
+static void perf_begin(struct perf_sample *s) {
+    perf_read(s);
+}
+
+// Turn the sample taken by perf_begin() into deltas for the region
+static void perf_end(struct perf_sample *s) {
+    struct perf_sample now;
+    perf_read(&now);
+    s->tsc = now.tsc - s->tsc;
+    for (uint32_t ev = 0; ev < PERF_COUNTERS; ev++) {
+        s->count[ev] = (now.count[ev] - s->count[ev]) & perf_counter_mask;
+    }
+}
+
+// "cycles .. instr .. IPC .. LLC miss .. br miss .." (or just TSC cycles)
+static void perf_print(const struct perf_sample *s) {
+    log_printf("%lu TSC cycles", s->tsc);
+    if (s->valid & (1U << PERF_CYCLES)) {
+        log_printf(", %lu cycles", s->count[PERF_CYCLES]);
+    }
+    if (s->valid & (1U << PERF_INSTRUCTIONS)) {
+        log_printf(", %lu instr", s->count[PERF_INSTRUCTIONS]);
+        if ((s->valid & (1U << PERF_CYCLES)) && s->count[PERF_CYCLES]) {
+            uint64_t ipc = s->count[PERF_INSTRUCTIONS] * 100 / s->count[PERF_CYCLES];
+            log_printf(" (IPC %lu.%02lu)", ipc / 100, ipc % 100);
+        }
+    }
+    if (s->valid & (1U << PERF_LLC_MISSES)) {
+        log_printf(", %lu LLC miss", s->count[PERF_LLC_MISSES]);
+    }
+    if (s->valid & (1U << PERF_BRANCH_MISSES)) {
+        log_printf(", %lu br miss", s->count[PERF_BRANCH_MISSES]);
+    }
+    log_printf("\n");
+}
+
+// PMU overflow interrupt - take a profiler sample and re-arm the counter
+__attribute__((used))
+void pmu_interrupt_handler(struct irq_frame *frame) {
+    uint32_t pmc = perf_sample_pmc;
+    prof_sample(frame, this_cpu());
+
+    wrmsr(MSR_PMC0 + pmc, (-(uint64_t)PERF_SAMPLE_PERIOD) & perf_counter_mask);
+    if (perf_version >= 2) {
+        wrmsr(MSR_PERF_GLOBAL_OVF_CTRL, 1UL << pmc);
+    }
+    // Delivery masks LVT PMC - unmask for the next overflow
+    perf_lvt_write(PMU_VECTOR);
+    send_eoi();
+}
+
+// PMU overflow stub - same frame layout as timer_irq_stub
+__asm__(
+    ".global pmu_irq_stub\n"
+    "pmu_irq_stub:\n"
+    "    push %rax\n"
+    "    push %rbx\n"
+    "    push %rcx\n"
+    "    push %rdx\n"
+    "    push %rsi\n"
+    "    push %rdi\n"
+    "    push %rbp\n"
+    "    push %r8\n"
+    "    push %r9\n"
+    "    push %r10\n"
+    "    push %r11\n"
+    "    push %r12\n"
+    "    push %r13\n"
+    "    push %r14\n"
+    "    push %r15\n"
+    "    cld\n"
+    "    mov %rsp, %rdi\n"
+    "    call pmu_interrupt_handler\n"
+    "    pop %r15\n"
+    "    pop %r14\n"
+    "    pop %r13\n"
+    "    pop %r12\n"
+    "    pop %r11\n"
+    "    pop %r10\n"
+    "    pop %r9\n"
+    "    pop %r8\n"
+    "    pop %rbp\n"
+    "    pop %rdi\n"
+    "    pop %rsi\n"
+    "    pop %rdx\n"
+    "    pop %rcx\n"
+    "    pop %rbx\n"
+    "    pop %rax\n"
+    "    iretq\n"
+);
+
+// ============================================================================
+// PCI + VIRTIO CONSOLE
+// ============================================================================
+
+#if CONSOLE_BACKEND == CONSOLE_VIRTIO
+
+// PCI configuration mechanism #1
+#define PCI_CONFIG_ADDR   0xCF8
+#define PCI_CONFIG_DATA   0xCFC
+#define PCI_COMMAND       0x04
+#define PCI_BAR0          0x10
+#define PCI_CMD_IO        0x1           // I/O space enable
+#define PCI_CMD_MASTER    0x4           // Bus master (device may DMA)
+
+static uint32_t pci_read32(uint32_t bus, uint32_t dev, uint32_t fn, uint32_t off) {
+    outl(PCI_CONFIG_ADDR, 0x80000000 | (bus << 16) | (dev << 11) | (fn << 8) | (off & 0xFC));
+    return inl(PCI_CONFIG_DATA);
+}
+
+static void pci_write32(uint32_t bus, uint32_t dev, uint32_t fn, uint32_t off, uint32_t val) {
+    outl(PCI_CONFIG_ADDR, 0x80000000 | (bus << 16) | (dev << 11) | (fn << 8) | (off & 0xFC));
+    outl(PCI_CONFIG_DATA, val);
+}
+
+// Brute-force scan for vendor:device, returns bus << 8 | dev << 3 | fn or -1
+static int pci_find_device(uint16_t vendor, uint16_t device) {
+    for (uint32_t bus = 0; bus < 256; bus++) {
+        for (uint32_t dev = 0; dev < 32; dev++) {
+            for (uint32_t fn = 0; fn < 8; fn++) {
+                uint32_t id = pci_read32(bus, dev, fn, 0);
+                if ((id & 0xFFFF) == 0xFFFF) {
+                    if (fn == 0) break;         // No device in this slot
+                    continue;
+                }
+                if ((id & 0xFFFF) == vendor && (id >> 16) == device) {
+                    return (bus << 8) | (dev << 3) | fn;
+                }
+            }
+        }
+    }
+    return -1;
+}
+
+// Legacy (transitional) virtio-pci: registers live in I/O BAR0
+#define VIRTIO_VENDOR_ID            0x1AF4
+#define VIRTIO_CONSOLE_DEVICE_ID    0x1003
+#define VIRTIO_PCI_GUEST_FEATURES   0x04
+#define VIRTIO_PCI_QUEUE_PFN        0x08
+#define VIRTIO_PCI_QUEUE_SIZE       0x0C
+#define VIRTIO_PCI_QUEUE_SEL        0x0E
+#define VIRTIO_PCI_QUEUE_NOTIFY     0x10
+#define VIRTIO_PCI_STATUS           0x12
+#define VIRTIO_STATUS_ACK           0x1
+#define VIRTIO_STATUS_DRIVER        0x2
+#define VIRTIO_STATUS_DRIVER_OK     0x4
+#define VRING_AVAIL_F_NO_INTERRUPT  0x1
+
+#define VIRTIO_CONSOLE_TXQ  1           // Port 0 transmit queue (no MULTIPORT)
+#define VIRTIO_QUEUE_MAX    256         // Largest queue the static vring fits
+#define VIRTIO_TX_SLOTS     8           // Buffers in flight
+#define VIRTIO_TX_BUF       2048        // Bytes per buffer
+
+struct vring_desc {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+};
+
+struct vring_avail {
+    uint16_t flags;
+    volatile uint16_t idx;
+    uint16_t ring[];
+};
+
+struct vring_used_elem {
+    uint32_t id;
+    uint32_t len;
+};
+
+struct vring_used {
+    uint16_t flags;
+    volatile uint16_t idx;
+    struct vring_used_elem ring[];
+};
+
+// Legacy layout: descriptors, avail ring, then used ring on the next page
+static uint8_t virtio_vring[3 * PAGE_SIZE] __attribute__((aligned(PAGE_SIZE)));
+static char virtio_tx_bufs[VIRTIO_TX_SLOTS][VIRTIO_TX_BUF];
+
+static struct {
+    uint16_t iobase;
+    uint16_t qsize;
+    struct vring_desc *desc;
+    struct vring_avail *avail;
+    struct vring_used *used;
+    uint16_t avail_idx;                 // Next avail->idx to publish
+    uint16_t used_seen;                 // used->idx already reclaimed
+    uint16_t free_slots[VIRTIO_TX_SLOTS];
+    uint32_t free_count;
+} virtio_con;
+
+// Take back buffers the device has finished with
+static void virtio_console_reclaim(void) {
+    while (virtio_con.used_seen != virtio_con.used->idx) {
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        uint16_t slot = virtio_con.used->ring[virtio_con.used_seen % virtio_con.qsize].id;
+        virtio_con.free_slots[virtio_con.free_count++] = slot;
+        virtio_con.used_seen++;
+    }
+}
+
+// Virtio backend: one descriptor per chunk, device copies it out on notify
+static uint32_t virtio_console_write(const char *buf, uint32_t len) {
+    virtio_console_reclaim();
+    if (!virtio_con.free_count) return 0;
+
+    uint32_t n = (len < VIRTIO_TX_BUF) ? len : VIRTIO_TX_BUF;
+    uint16_t slot = virtio_con.free_slots[--virtio_con.free_count];
+    memcpy(virtio_tx_bufs[slot], buf, n);
+
+    // Kernel image is identity mapped: virtual == physical
+    virtio_con.desc[slot].addr = (uint64_t)virtio_tx_bufs[slot];
+    virtio_con.desc[slot].len = n;
+    virtio_con.desc[slot].flags = 0;
+    virtio_con.avail->ring[virtio_con.avail_idx % virtio_con.qsize] = slot;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    virtio_con.avail->idx = ++virtio_con.avail_idx;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);  // idx visible before the notify
+    outw(virtio_con.iobase + VIRTIO_PCI_QUEUE_NOTIFY, VIRTIO_CONSOLE_TXQ);
+    return n;
+}
+
+static const struct console_backend virtio_backend = { "virtio-console", virtio_console_write };
+
+// Bring up the transmit queue of a legacy virtio-console and switch to it
+static void virtio_console_init(void) {
+    int bdf = pci_find_device(VIRTIO_VENDOR_ID, VIRTIO_CONSOLE_DEVICE_ID);
+    if (bdf < 0) {
+        puts("[CONSOLE] virtio-console not found, staying on serial\n");
+        return;
+    }
+
+    uint32_t bus = bdf >> 8, dev = (bdf >> 3) & 0x1F, fn = bdf & 0x7;
+    uint32_t bar0 = pci_read32(bus, dev, fn, PCI_BAR0);
+    if (!(bar0 & 1)) {
+        puts("[CONSOLE] virtio-console has no legacy I/O BAR, staying on serial\n");
+        return;
+    }
+    pci_write32(bus, dev, fn, PCI_COMMAND,
+                pci_read32(bus, dev, fn, PCI_COMMAND) | PCI_CMD_IO | PCI_CMD_MASTER);
+
+    uint16_t io = bar0 & ~0x3;
+    outb(io + VIRTIO_PCI_STATUS, 0);    // Reset
+    outb(io + VIRTIO_PCI_STATUS, VIRTIO_STATUS_ACK);
+    outb(io + VIRTIO_PCI_STATUS, VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER);
+    outl(io + VIRTIO_PCI_GUEST_FEATURES, 0);  // Single port, no extras
+
+    outw(io + VIRTIO_PCI_QUEUE_SEL, VIRTIO_CONSOLE_TXQ);
+    uint16_t qsize = inw(io + VIRTIO_PCI_QUEUE_SIZE);
+    // TX slots double as descriptor indices: one descriptor per slot
+    if (qsize < VIRTIO_TX_SLOTS || qsize > VIRTIO_QUEUE_MAX) {
+        puts("[CONSOLE] virtio-console queue unusable, staying on serial\n");
+        return;
+    }
+
+    memset(virtio_vring, 0, sizeof(virtio_vring));
+    uint64_t avail_off = 16UL * qsize;
+    uint64_t used_off = PAGE_ALIGN(avail_off + 2UL * (3 + qsize));
+    virtio_con.iobase = io;
+    virtio_con.qsize = qsize;
+    virtio_con.desc = (struct vring_desc *)virtio_vring;
+    virtio_con.avail = (struct vring_avail *)(virtio_vring + avail_off);
+    virtio_con.used = (struct vring_used *)(virtio_vring + used_off);
+    virtio_con.avail->flags = VRING_AVAIL_F_NO_INTERRUPT;  // We poll the used ring
+    virtio_con.avail_idx = 0;
+    virtio_con.used_seen = 0;
+    for (uint32_t i = 0; i < VIRTIO_TX_SLOTS; i++) {
+        virtio_con.free_slots[i] = i;
+    }
+    virtio_con.free_count = VIRTIO_TX_SLOTS;
+
+    outl(io + VIRTIO_PCI_QUEUE_PFN, (uint64_t)virtio_vring >> 12);
+    outb(io + VIRTIO_PCI_STATUS, VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK);
+
+    // Switch once everything buffered so far went out the old way
+    console_flush();
+    console_lock_take(1);
+    console = &virtio_backend;
+    console_lock_drop();
+
+    puts("[CONSOLE] Output switched to virtio-console (PCI ");
+    print_hex(bdf);
+    puts(")\n");
+}
+#endif // CONSOLE_BACKEND == CONSOLE_VIRTIO
+
+// TSC calibration and delays
+static uint64_t tsc_khz = 0;
+static const char *tsc_khz_source = "fixed estimate";
+
+// Measure the TSC against a PIT channel 2 one-shot (0 if the PIT never fires)
+static uint64_t calibrate_tsc_pit(void) {
+    uint32_t latch = PIT_FREQ_HZ / (1000 / PIT_CALIBRATE_MS);
+
+    // Gate on, speaker off; mode 0 starts counting when the count is written
+    outb(PIT_GATE_PORT, (inb(PIT_GATE_PORT) & ~0x02) | 0x01);
+    outb(PIT_COMMAND, 0xB0);            // Channel 2, lo/hi byte, mode 0, binary
+    outb(PIT_CH2_DATA, latch & 0xFF);
+    outb(PIT_CH2_DATA, latch >> 8);
+
+    uint64_t start = rdtsc_ordered();
+    uint32_t spins = 0;
+    while (!(inb(PIT_GATE_PORT) & 0x20)) {
+        if (++spins > 10000000) return 0;
+    }
+    uint64_t end = rdtsc_ordered();
+
+    return (end - start) / PIT_CALIBRATE_MS;
+}
+
+static void calibrate_tsc(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(0, &eax, &ebx, &ecx, &edx);
+    uint32_t max_leaf = eax;
+
+    // CPUID 0x15: TSC = crystal * ebx / eax (crystal Hz in ecx, may be 0)
+    if (max_leaf >= 0x15) {
+        cpuid(0x15, &eax, &ebx, &ecx, &edx);
+        if (eax && ebx && ecx) {
+            tsc_khz = (uint64_t)ecx * ebx / eax / 1000;
+            tsc_khz_source = "CPUID 0x15";
+            return;
+        }
+    }
+
+    // PIT works on every PC and in both TCG and KVM
+    uint64_t khz = calibrate_tsc_pit();
+    if (khz) {
+        tsc_khz = khz;
+        tsc_khz_source = "PIT";
+        return;
+    }
+
+    // Last resort - the delays don't need to be exact for SMP boot to work
+    tsc_khz = 2000000;  // 2 GHz = 2,000,000 kHz
+}
+
+// ============================================================================
+// MONOTONIC CLOCK
+// ============================================================================
+
+// ns = base_ns + ((tsc + tsc_offset[cpu] - base_tsc) * mult) >> shift
+// The parameters are published under a seqlock: readers never write shared
+// memory, they retry if 'seq' was odd or changed while they read.
+#define CLOCK_SHIFT 32
+
+struct clock_data {
+    volatile uint32_t seq;              // Odd while an update is in progress
+    uint64_t mult;
+    uint64_t base_tsc;
+    uint64_t base_ns;
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+static struct clock_data clock;
+
+// Per-CPU TSC correction against the BSP (two's complement, set by clock_sync)
+static uint64_t tsc_offset_boot;                // The BSP's until percpu_init()
+static uint64_t *tsc_offsets = &tsc_offset_boot;
+
+static inline uint64_t clock_scale(uint64_t delta, uint64_t mult) {
+    return (uint64_t)(((unsigned __int128)delta * mult) >> CLOCK_SHIFT);
+}
+
+// Local TSC corrected to the BSP's timebase
+static inline uint64_t clock_read_tsc(void) {
+    uint32_t cpu;
+    uint64_t tsc;
+    if (has_rdtscp) {
+        tsc = rdtscp(&cpu);
+    } else {
+        tsc = rdtsc_ordered();
+        cpu = cpu_from_apic_id(get_apic_id());
+    }
+    return (cpu < percpu_cpus) ? tsc + tsc_offsets[cpu] : tsc;
+}
+
+static uint64_t clock_monotonic_ns(void) {
+    uint32_t seq;
+    uint64_t ns;
+    do {
+        while ((seq = __atomic_load_n(&clock.seq, __ATOMIC_ACQUIRE)) & 1) {
+            __asm__ volatile("pause");
+        }
+        ns = clock.base_ns + clock_scale(clock_read_tsc() - clock.base_tsc, clock.mult);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&clock.seq, __ATOMIC_RELAXED) != seq);
+    return ns;
+}
+
+// Publish a new TSC frequency without making time jump (single writer)
+static void clock_set_khz(uint64_t khz) {
+    uint64_t tsc = clock_read_tsc();
+    uint64_t now = clock.seq ? clock.base_ns + clock_scale(tsc - clock.base_tsc, clock.mult) : 0;
+
+    __atomic_store_n(&clock.seq, clock.seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    clock.mult = (1000000UL << CLOCK_SHIFT) / khz;
+    clock.base_tsc = tsc;
+    clock.base_ns = now;
+    __atomic_store_n(&clock.seq, clock.seq + 1, __ATOMIC_RELEASE);
+}
+
+// Every CPU: make rdtscp return our logical CPU
+static void clock_cpu_init(int cpu_id) {
+    if (has_rdtscp) {
+        wrmsr(MSR_TSC_AUX, cpu_id);
+    }
+}
+
+// BSP: start the clock at 0 ns with the calibrated frequency
+static void clock_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(0x80000001, &eax, &ebx, &ecx, &edx);
+    has_rdtscp = (edx >> 27) & 1;
+    clock_cpu_init(0);
+    clock_set_khz(tsc_khz);
+}
+
+// Every CPU, right after enabling its APIC: make this_cpu() work
+static void cpu_register(int cpu_id) {
+    uint32_t apic_id = get_apic_id();
+    logical_apic_ids[cpu_id] = apic_id;
+    x2apic_ldrs[cpu_id] = use_x2apic ? (uint32_t)rdmsr(X2APIC_LDR) : 0;
+    apic_map_insert(apic_id, cpu_id);
+    clock_cpu_init(cpu_id);
+    if (cpu_id == 0) {
+        __atomic_store_n(&cpu_ids_ready, 1, __ATOMIC_RELEASE);
+    }
+}
+
+// Ultra-simple delays - NO I/O operations during SMP boot!
+static void udelay(uint64_t usec) {
+    // Simple busy loop - very approximate
+    for (volatile uint64_t i = 0; i < usec * 10; i++) {
+        __asm__ volatile("pause");
+    }
+}
+
+static void mdelay(uint64_t msec) {
+    for (uint64_t i = 0; i < msec; i++) {
+        udelay(1000);
+    }
+}
+
+// ACPI structures
+struct acpi_rsdp {
+    char signature[8];
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_address;
+    uint32_t length;
+    uint64_t xsdt_address;
+    uint8_t extended_checksum;
+    uint8_t reserved[3];
+} __attribute__((packed));
 
 struct acpi_sdt_header {
     char signature[4];
@@ -824,6 +2412,21 @@ struct acpi_madt_lapic {
     uint32_t flags;
 } __attribute__((packed));
 
+// Firmware lists CPUs whose APIC ID doesn't fit in 8 bits (and, on some
+// machines, all of them) as x2APIC entries
+struct acpi_madt_x2apic {
+    uint8_t type;
+    uint8_t length;
+    uint16_t reserved;
+    uint32_t x2apic_id;
+    uint32_t flags;
+    uint32_t processor_uid;
+} __attribute__((packed));
+
+#define MADT_LAPIC    0
+#define MADT_X2APIC   9
+#define MADT_ENABLED  0x1
+
 static int acpi_checksum(void *ptr, int length) {
     uint8_t sum = 0;
     uint8_t *p = (uint8_t*)ptr;
@@ -876,37 +2479,70 @@ static struct acpi_sdt_header *acpi_find_madt(struct acpi_rsdp *rsdp) {
     return 0;
 }
 
-// CPU tracking
-static uint8_t cpu_apic_ids[MAX_CPUS];
+// CPU tracking: APIC ID by MADT index, the BSP first
+static uint32_t *cpu_apic_ids;
 static volatile int cpu_count = 0;
 
+// APIC ID of the caller from CPUID: all 32 bits from leaf 0xB, else the
+// 8-bit initial ID from leaf 1 (usable before the local APIC is set up)
+static uint32_t cpuid_apic_id(void) {
+    uint32_t max_leaf, eax, ebx, ecx, edx;
+    cpuid(0, &max_leaf, &ebx, &ecx, &edx);
+    if (max_leaf >= 0xB) {
+        cpuid_count(0xB, 0, &eax, &ebx, &ecx, &edx);
+        if (ebx) return edx;
+    }
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    return ebx >> 24;
+}
+
+// APIC ID of an enabled processor entry, APIC_ID_NONE for anything else
+static uint32_t madt_cpu_apic_id(const uint8_t *entry) {
+    if (entry[0] == MADT_LAPIC) {
+        const struct acpi_madt_lapic *lapic = (const struct acpi_madt_lapic*)entry;
+        return (lapic->flags & MADT_ENABLED) ? lapic->apic_id : APIC_ID_NONE;
+    }
+    if (entry[0] == MADT_X2APIC) {
+        const struct acpi_madt_x2apic *x2apic = (const struct acpi_madt_x2apic*)entry;
+        return (x2apic->flags & MADT_ENABLED) ? x2apic->x2apic_id : APIC_ID_NONE;
+    }
+    return APIC_ID_NONE;
+}
+
+// Fills cpu_apic_ids with the BSP and then every other enabled CPU, up to
+// MAX_CPUS. Returns the CPU count.
 static int acpi_parse_madt(struct acpi_sdt_header *madt_header) {
     struct acpi_madt_header *madt = (struct acpi_madt_header*)madt_header;
-    uint8_t *ptr = (uint8_t*)madt + sizeof(struct acpi_madt_header);
+    uint8_t *start = (uint8_t*)madt + sizeof(struct acpi_madt_header);
     uint8_t *end = (uint8_t*)madt + madt->header.length;
-    int count = 0;
-
-    while (ptr < end) {
-        uint8_t type = *ptr;
-        uint8_t length = *(ptr + 1);
-
-        if (type == 0) {  // Local APIC
-            struct acpi_madt_lapic *lapic = (struct acpi_madt_lapic*)ptr;
-            if (lapic->flags & 0x1) {
-                puts("[ACPI] CPU ");
-                print_dec(count);
-                puts(" detected (APIC ID ");
-                print_dec(lapic->apic_id);
-                puts(")\n");
-
-                if (count < MAX_CPUS) {
-                    cpu_apic_ids[count] = lapic->apic_id;
-                }
-                count++;
-            }
-        }
 
-        ptr += length;
+    int entries = 0;
+    for (uint8_t *ptr = start; ptr < end && ptr[1]; ptr += ptr[1]) {
+        if (madt_cpu_apic_id(ptr) != APIC_ID_NONE) entries++;
+    }
+    int limit = (entries < MAX_CPUS) ? entries : MAX_CPUS;
+    if (limit < 1) limit = 1;
+    cpu_apic_ids = (uint32_t*)kmalloc(limit * sizeof(uint32_t));
+
+    // Boot code takes MADT index 0 to be the CPU running it
+    cpu_apic_ids[0] = cpuid_apic_id();
+    int count = 1, skipped = 0;
+    for (uint8_t *ptr = start; ptr < end && ptr[1]; ptr += ptr[1]) {
+        uint32_t apic_id = madt_cpu_apic_id(ptr);
+        if (apic_id == APIC_ID_NONE) continue;
+
+        int dup = 0;
+        for (int i = 0; i < count && !dup; i++) dup = cpu_apic_ids[i] == apic_id;
+        if (dup) continue;                  // The BSP, or listed as both types
+        if (count == limit) {
+            skipped++;
+            continue;
+        }
+        LOG(ACPI, DEBUG, "[ACPI] CPU %d detected (APIC ID %u)\n", count, apic_id);
+        cpu_apic_ids[count++] = apic_id;
+    }
+    if (skipped) {
+        LOG(ACPI, WARN, "[ACPI] %d more CPU(s) left offline (MAX_CPUS=%d)\n", skipped, MAX_CPUS);
     }
 
     return count;
@@ -915,11 +2551,11 @@ static int acpi_parse_madt(struct acpi_sdt_header *madt_header) {
 // APIC functions
 // Disable legacy 8259 PIC (CRITICAL before using APIC!)
 static void disable_pic(void) {
-    puts("[PIC] Disabling legacy 8259 PIC...\n");
+    LOG(APIC, DEBUG, "[PIC] Disabling legacy 8259 PIC...\n");
     // Mask all interrupts on both PICs
     outb(0x21, 0xFF);  // Master PIC data port
     outb(0xA1, 0xFF);  // Slave PIC data port
-    puts("[PIC] Legacy PIC disabled\n");
+    LOG(APIC, DEBUG, "[PIC] Legacy PIC disabled\n");
 }
 
 static void apic_init(void) {
@@ -933,8 +2569,20 @@ static void apic_init(void) {
     cpuid(1, &eax, &ebx, &ecx, &edx);
     int x2apic_available = (ecx >> 21) & 1;
 
+    // FORCE_XAPIC: stay in xAPIC mode to compare the two on one host. Only
+    // possible if firmware hasn't switched to x2APIC already (going back
+    // would mean disabling the APIC).
+    if (FORCE_XAPIC && x2apic_available) {
+        if (rdmsr(APIC_BASE_MSR) & X2APIC_ENABLE) {
+            LOG(APIC, WARN, "[APIC] XAPIC=1 ignored: firmware already enabled x2APIC\n");
+        } else {
+            LOG(APIC, INFO, "[APIC] x2APIC supported, xAPIC forced (XAPIC=1)\n");
+            x2apic_available = 0;
+        }
+    }
+
     if (x2apic_available) {
-        puts("[APIC] x2APIC supported - enabling x2APIC mode\n");
+        LOG(APIC, DEBUG, "[APIC] x2APIC supported - enabling x2APIC mode\n");
 
         // Read current APIC base MSR
         uint64_t apic_msr = rdmsr(APIC_BASE_MSR);
@@ -960,26 +2608,24 @@ static void apic_init(void) {
 
         // Read APIC ID from x2APIC MSR
         uint32_t apic_id = (uint32_t)rdmsr(X2APIC_APICID);
-        puts("[APIC] x2APIC mode enabled (MSR-based)\n");
-        puts("[APIC] BSP APIC ID: ");
-        print_dec(apic_id);
-        puts("\n");
+        LOG(APIC, INFO, "[APIC] x2APIC mode enabled (MSR-based)\n");
+        LOG(APIC, INFO, "[APIC] BSP APIC ID: %u\n", apic_id);
     } else {
-        puts("[APIC] x2APIC not available - using xAPIC mode\n");
+        LOG(APIC, DEBUG, "[APIC] x2APIC not available - using xAPIC mode\n");
 
         uint64_t apic_msr = rdmsr(APIC_BASE_MSR);
         uint64_t apic_phys_addr = apic_msr & 0xFFFFF000;
 
-        puts("[APIC] Physical address: 0xFEE00000 (default)\n");
+        LOG(APIC, DEBUG, "[APIC] Physical address: %#018lx\n", apic_phys_addr);
 
         apic_base = (volatile uint32_t*)apic_phys_addr;
 
         if (!(apic_msr & APIC_BASE_ENABLE)) {
-            puts("[APIC] Enabling APIC in MSR...\n");
+            LOG(APIC, DEBUG, "[APIC] Enabling APIC in MSR...\n");
             wrmsr(APIC_BASE_MSR, apic_msr | APIC_BASE_ENABLE);
         }
 
-        puts("[APIC] Enabling APIC (SVR register)...\n");
+        LOG(APIC, DEBUG, "[APIC] Enabling APIC (SVR register)...\n");
 
         apic_write(APIC_SVR_REG, APIC_ENABLE | SPURIOUS_VECTOR);
 
@@ -987,9 +2633,8 @@ static void apic_init(void) {
         apic_write(0x80, 0);  // TPR register at offset 0x80
 
         uint32_t apic_id = apic_read(APIC_ID_REG) >> 24;
-        puts("[APIC] BSP APIC ID: ");
-        print_dec(apic_id);
-        puts("\n");
+        LOG(APIC, INFO, "[APIC] xAPIC mode enabled (MMIO-based)\n");
+        LOG(APIC, INFO, "[APIC] BSP APIC ID: %u\n", apic_id);
 
         use_x2apic = 0;
     }
@@ -1034,7 +2679,7 @@ static void apic_timer_init(void) {
 
     // Set initial count (this starts the timer)
     // Lower value = faster interrupts. 10000000 gives roughly 10 Hz with divide-by-16
-    uint32_t initial_count = 10000000;
+    uint32_t initial_count = TIMER_INITIAL_COUNT;
     if (use_x2apic) {
         wrmsr(X2APIC_TIMER_ICR, initial_count);
         timer_init_debug[3] = (uint32_t)rdmsr(X2APIC_TIMER_ICR);
@@ -1057,192 +2702,1418 @@ static void apic_wait_icr(void) {
     }
 }
 
-static void send_ipi(uint32_t apic_id, uint32_t flags) {
+// One ICR write. 'dest' is an APIC ID, or an LDR pattern with
+// APIC_DEST_LOGICAL. xAPIC only waits for the previous IPI to be accepted,
+// so a batch of writes overlaps with delivery.
+static void apic_icr_write(uint32_t dest, uint32_t flags) {
     if (use_x2apic) {
         // x2APIC: ICR is a single 64-bit MSR
         // Bits 0-31: flags (ICR low)
-        // Bits 32-63: destination APIC ID
-        uint64_t icr = ((uint64_t)apic_id << 32) | flags;
+        // Bits 32-63: destination
+        uint64_t icr = ((uint64_t)dest << 32) | flags;
         wrmsr(X2APIC_ICR, icr);
     } else {
         // xAPIC: ICR is two 32-bit MMIO registers
         apic_wait_icr();
-        apic_write(APIC_ICR_HIGH, apic_id << 24);
+        apic_write(APIC_ICR_HIGH, dest << 24);
         apic_write(APIC_ICR_LOW, flags);
-        apic_wait_icr();
     }
 }
 
-// Trampoline functions
-static void setup_trampoline(void) {
-    puts("\n[SMP] Setting up trampoline...\n");
+static void send_ipi(uint32_t apic_id, uint32_t flags) {
+    apic_icr_write(apic_id, flags);
+    apic_wait_icr();
+}
 
-    uint64_t trampoline_size = trampoline_end - trampoline_start;
-    puts("[SMP] Trampoline size: ");
-    print_dec(trampoline_size);
-    puts(" bytes\n");
+static inline void cpumask_clear(struct cpumask *m) {
+    for (int i = 0; i < CPUMASK_WORDS; i++) m->bits[i] = 0;
+}
 
-    // Copy trampoline to 0x8000
-    uint8_t *dest = (uint8_t*)0x8000;
-    memcpy(dest, trampoline_start, trampoline_size);
+static inline void cpumask_set(struct cpumask *m, uint32_t cpu) {
+    m->bits[cpu / 64] |= 1UL << (cpu % 64);
+}
+
+static inline int cpumask_test(const struct cpumask *m, uint32_t cpu) {
+    return (m->bits[cpu / 64] >> (cpu % 64)) & 1;
+}
+
+// How send_ipi_mask_via() reaches the CPUs of a mask
+enum ipi_method {
+    IPI_AUTO,                           // Cheapest usable one of the below
+    IPI_SHORTHAND,                      // All (but self): one write
+    IPI_CLUSTER,                        // x2APIC logical: one write per cluster of 16
+    IPI_UNICAST,                        // One write per CPU
+};
+
+// Sends 'flags' (vector, fixed delivery) to every online CPU in 'mask',
+// self included if set. Returns the number of ICR writes, 0 if 'method'
+// can't express the mask. The shorthands also reach CPUs that never came
+// online, so they are only used when every CPU in the MADT did.
+static uint32_t send_ipi_mask_via(const struct cpumask *mask, uint32_t flags, enum ipi_method method) {
+    uint32_t self = this_cpu();
+    uint32_t online = cpus_online;
+    uint32_t targets = 0;
+    int all_others = 1;
+
+    for (uint32_t cpu = 0; cpu < online; cpu++) {
+        if (cpumask_test(mask, cpu)) targets++;
+        else if (cpu != self) all_others = 0;
+    }
+    if (targets == 0) return 0;
+
+    int shorthand_ok = all_others && online == (uint32_t)cpu_count && targets > 1;
+    int cluster_ok = use_x2apic && x2apic_ldrs[self] != 0;
+    if (method == IPI_AUTO) {
+        method = shorthand_ok ? IPI_SHORTHAND : (cluster_ok && targets > 1) ? IPI_CLUSTER : IPI_UNICAST;
+    }
+    if ((method == IPI_SHORTHAND && !shorthand_ok) || (method == IPI_CLUSTER && !cluster_ok)) return 0;
+
+    // xAPIC sends are two register writes - keep handlers on this CPU out
+    uint64_t irq = irq_save();
+    uint32_t writes = 0;
+    if (method == IPI_SHORTHAND) {
+        apic_icr_write(0, flags | (cpumask_test(mask, self) ? APIC_DEST_ALLINC : APIC_DEST_ALLBUT));
+        writes = 1;
+    } else if (method == IPI_CLUSTER) {
+        // Merge the CPUs of each cluster into one destination. Sparse IDs
+        // can spread the CPUs over more clusters than fit: send a full
+        // list and start over (a cluster may then take two writes).
+        uint32_t dests[IPI_MAX_CLUSTERS];
+        uint32_t clusters = 0;
+        for (uint32_t cpu = 0; cpu < online; cpu++) {
+            if (!cpumask_test(mask, cpu)) continue;
+            uint32_t ldr = x2apic_ldrs[cpu];
+            uint32_t c = 0;
+            while (c < clusters && (dests[c] >> 16) != (ldr >> 16)) c++;
+            if (c == clusters) {
+                if (clusters == IPI_MAX_CLUSTERS) {
+                    for (c = 0; c < clusters; c++) apic_icr_write(dests[c], flags | APIC_DEST_LOGICAL);
+                    writes += clusters;
+                    clusters = c = 0;
+                }
+                dests[clusters++] = ldr;
+            } else {
+                dests[c] |= ldr & 0xFFFF;
+            }
+        }
+        for (uint32_t c = 0; c < clusters; c++) apic_icr_write(dests[c], flags | APIC_DEST_LOGICAL);
+        writes += clusters;
+    } else {
+        for (uint32_t cpu = 0; cpu < online; cpu++) {
+            if (!cpumask_test(mask, cpu)) continue;
+            apic_icr_write(logical_apic_ids[cpu], flags);
+            writes++;
+        }
+    }
+    apic_wait_icr();
+    irq_restore(irq);
+    return writes;
+}
+
+static uint32_t send_ipi_mask(const struct cpumask *mask, uint32_t flags) {
+    return send_ipi_mask_via(mask, flags, IPI_AUTO);
+}
+
+// Trampoline functions
+static void setup_trampoline(void) {
+    puts("\n[SMP] Setting up trampoline...\n");
+
+    uint64_t trampoline_size = trampoline_end - trampoline_start;
+    puts("[SMP] Trampoline size: ");
+    print_dec(trampoline_size);
+    puts(" bytes\n");
+
+    // Copy trampoline to 0x8000
+    uint8_t *dest = (uint8_t*)0x8000;
+    memcpy(dest, trampoline_start, trampoline_size);
+
+    puts("[SMP] Trampoline copied to 0x8000\n");
+
+    // Get current CR3
+    uint64_t cr3;
+    __asm__ volatile("mov %%cr3, %0" : "=r"(cr3));
+
+    // Patch trampoline variables at end (like linux-minimal)
+    // Offsets from end: -24: cr3, -16: stack, -8: entry
+    uint64_t *cr3_ptr = (uint64_t*)(0x8000 + trampoline_size - 24);
+    uint64_t *stack_ptr = (uint64_t*)(0x8000 + trampoline_size - 16);
+    uint64_t *entry_ptr = (uint64_t*)(0x8000 + trampoline_size - 8);
+
+    *cr3_ptr = cr3;
+    *stack_ptr = 0;  // Will be patched per-AP
+    extern void ap_entry(void);
+    *entry_ptr = (uint64_t)ap_entry;
+
+    // CRITICAL: Flush caches after patching
+    __asm__ volatile("wbinvd" ::: "memory");
+
+    puts("[SMP] Trampoline configured\n");
+}
+
+// Boot a single AP (adapted from Linux smpboot.c)
+static void boot_ap(int cpu_idx) {
+    if (cpu_idx == 0) return;  // Skip BSP
+    if (cpu_idx >= cpu_count) return;
+
+    uint32_t apic_id = cpu_apic_ids[cpu_idx];
+    unsigned long start_eip = 0x8000;  // Trampoline address
+
+    // Patch per-CPU stack (like linux-minimal)
+    uint64_t trampoline_size = trampoline_end - trampoline_start;
+    uint64_t *stack_ptr = (uint64_t*)(0x8000 + trampoline_size - 16);
+    *stack_ptr = (uint64_t)&ap_stacks[cpu_idx][AP_STACK_SIZE];
+
+    // CRITICAL: Flush caches after patching
+    __asm__ volatile("wbinvd" ::: "memory");
+
+    // INIT-SIPI-SIPI sequence
+    // INIT IPI
+    send_ipi(apic_id, APIC_INT_LEVELTRIG | APIC_INT_ASSERT | APIC_DM_INIT);
+    apic_wait_icr();
+
+    // Wait 10ms
+    mdelay(10);
+
+    // INIT deassert
+    send_ipi(apic_id, APIC_INT_LEVELTRIG | APIC_DM_INIT);
+    apic_wait_icr();
+
+    // SIPI #1
+    send_ipi(apic_id, APIC_DM_STARTUP | (start_eip >> 12));
+    apic_wait_icr();
+
+    // Wait 200μs
+    udelay(200);
+
+    // SIPI #2
+    send_ipi(apic_id, APIC_DM_STARTUP | (start_eip >> 12));
+    apic_wait_icr();
+
+    // Wait 200μs
+    udelay(200);
+}
+
+// Boot all APs
+static void boot_all_aps(void) {
+    // No UART I/O while sending INIT-SIPI-SIPI - it's fragile! Logging is
+    // fine: output stays in the ring until console_flush() below.
+    console_deferred = 1;
+
+    // BSP is already online
+    cpus_online = 1;
+
+    // xAPIC destinations are 8 bits and 0xFF is broadcast: leave CPUs with
+    // larger IDs out rather than have every barrier wait for them
+    if (!use_x2apic) {
+        int kept = 1;
+        for (int i = 1; i < cpu_count; i++) {
+            if (cpu_apic_ids[i] < 0xFF) cpu_apic_ids[kept++] = cpu_apic_ids[i];
+        }
+        if (kept < cpu_count) {
+            LOG(SMP, WARN, "[SMP] %d CPU(s) need x2APIC, left offline\n", cpu_count - kept);
+            cpu_count = kept;
+        }
+    }
+
+    // Boot all APs
+    for (int i = 1; i < cpu_count; i++) {
+        boot_ap(i);
+        puts("[SMP] INIT-SIPI-SIPI sent to APIC ID ");
+        print_dec(cpu_apic_ids[i]);
+        puts("\n");
+    }
+
+    // Wait for APs
+    for (volatile int i = 0; i < 1000000; i++) __asm__ volatile("pause");
+
+    console_deferred = 0;
+    console_flush();
+}
+
+// ============================================================================
+// CROSS-CPU MESSAGE RINGS
+// ============================================================================
+
+// Bounded single-producer/single-consumer rings, one per ordered CPU pair.
+// Indices are free-running; each side caches the other's index and only
+// touches the remote line when its cached view says full/empty.
+
+static void *kmalloc_aligned(uint64_t size, uint64_t align);
+
+// A ring per pair would be N^2 rings, so each is allocated on first use.
+// Both ends may get there at once; the loser's allocation is wasted.
+static struct msg_ring *msg_ring_get(int from, int to) {
+    struct msg_ring **slot = &msg_rings[from * cpu_count + to];
+    struct msg_ring *r = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+    if (r) return r;
+
+    r = (struct msg_ring*)kmalloc_aligned(sizeof(struct msg_ring), CACHE_LINE_SIZE);
+    memset(r, 0, sizeof(struct msg_ring));
+    r->consumer = to;
+    struct msg_ring *expected = 0;
+    if (!__atomic_compare_exchange_n(slot, &expected, r, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        r = expected;
+    }
+    return r;
+}
+
+// Producer: queue a message without publishing it (0 if the ring is full)
+static int msg_ring_enqueue(struct msg_ring *r, uint64_t msg) {
+    if (r->pending - r->head_cache == MSG_RING_SIZE) {
+        r->head_cache = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        if (r->pending - r->head_cache == MSG_RING_SIZE) {
+            return 0;
+        }
+    }
+    r->slots[r->pending & (MSG_RING_SIZE - 1)] = msg;
+    r->pending++;
+    return 1;
+}
+
+// Producer: make all queued messages visible, ring the doorbell if needed
+static void msg_ring_publish(struct msg_ring *r) {
+    if (r->pending == r->tail) return;
+    __atomic_store_n(&r->tail, r->pending, __ATOMIC_RELEASE);
+
+    // Pairs with the fence in msg_ring_wait(): either the consumer sees the
+    // new tail before halting, or we see its halted flag and wake it
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (cpu_halt[r->consumer].halted) {
+        send_ipi(logical_apic_ids[r->consumer], APIC_INT_ASSERT | DOORBELL_VECTOR);
+    }
+}
+
+// Producer: enqueue + publish a single message (0 if the ring is full)
+static int msg_ring_send(struct msg_ring *r, uint64_t msg) {
+    if (!msg_ring_enqueue(r, msg)) return 0;
+    msg_ring_publish(r);
+    return 1;
+}
+
+// Consumer: is there anything to read?
+static int msg_ring_peek(struct msg_ring *r) {
+    if (r->head != r->tail_cache) return 1;
+    r->tail_cache = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+    return r->head != r->tail_cache;
+}
+
+// Consumer: read up to 'max' messages, release the slots with a single store
+static uint32_t msg_ring_dequeue_batch(struct msg_ring *r, uint64_t *buf, uint32_t max) {
+    if (!msg_ring_peek(r)) return 0;
+
+    uint32_t head = r->head;
+    uint32_t avail = r->tail_cache - head;
+    uint32_t n = (avail < max) ? avail : max;
+    for (uint32_t i = 0; i < n; i++) {
+        buf[i] = r->slots[(head + i) & (MSG_RING_SIZE - 1)];
+    }
+    __atomic_store_n(&r->head, head + n, __ATOMIC_RELEASE);
+    return n;
+}
+
+static int msg_ring_dequeue(struct msg_ring *r, uint64_t *msg) {
+    return msg_ring_dequeue_batch(r, msg, 1) == 1;
+}
+
+// Consumer: wait for data - poll 'spins' times, then halt until a doorbell
+// (or any other interrupt) arrives. Returns with data available or after a
+// wakeup; callers loop on msg_ring_dequeue().
+static void msg_ring_wait(struct msg_ring *r, int cpu_id, uint32_t spins) {
+    for (uint32_t i = 0; i < spins; i++) {
+        if (msg_ring_peek(r)) return;
+        __asm__ volatile("pause");
+    }
+
+    // cli..sti;hlt closes the window between the last check and halting:
+    // a doorbell sent in between stays pending and ends the hlt immediately
+    __asm__ volatile("cli" ::: "memory");
+    cpu_halt[cpu_id].halted = 1;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!msg_ring_peek(r)) {
+        __asm__ volatile("sti; hlt" ::: "memory");
+    } else {
+        __asm__ volatile("sti" ::: "memory");
+    }
+    cpu_halt[cpu_id].halted = 0;
+}
+
+// Consumer: blocking receive
+static uint64_t msg_ring_recv(struct msg_ring *r, int cpu_id, uint32_t spins) {
+    uint64_t msg;
+    while (!msg_ring_dequeue(r, &msg)) {
+        msg_ring_wait(r, cpu_id, spins);
+    }
+    return msg;
+}
+
+// ============================================================================
+// READ-COPY-UPDATE (RCU)
+// ============================================================================
+
+// Readers: rcu_read_lock(); p = rcu_dereference(ptr); ... rcu_read_unlock();
+// Writers: copy, modify, rcu_assign_pointer(ptr, new), then reclaim the old
+// version with synchronize_rcu() or call_rcu(). Writers serialize among
+// themselves. Interrupt handlers run with IF clear, so no tick can land in
+// them and they may read RCU data without rcu_read_lock().
+//
+// Published this way: the APIC-ID map (apic_map) and test 4's table.
+
+static void rcu_init(void) {
+    memset(rcu_cpus, 0, percpu_cpus * sizeof(struct rcu_cpu));
+}
+
+// Start counting this CPU in grace periods (its timer must already run)
+static void rcu_cpu_online(int cpu_id) {
+    __atomic_store_n(&rcu_cpus[cpu_id].online, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline void rcu_read_lock(int cpu_id) {
+    rcu_cpus[cpu_id].nesting++;
+    __asm__ volatile("" ::: "memory");
+}
+
+static inline void rcu_read_unlock(int cpu_id) {
+    __asm__ volatile("" ::: "memory");
+    rcu_cpus[cpu_id].nesting--;
+}
+
+// Called from the timer tick and before idling - never inside a read-side section
+static void rcu_quiescent_state(int cpu_id) {
+    __atomic_store_n(&rcu_cpus[cpu_id].qs_count, rcu_cpus[cpu_id].qs_count + 1, __ATOMIC_RELEASE);
+}
+
+// Wait until every other online CPU has passed a quiescent state. The caller
+// must not hold rcu_read_lock(), so it is trivially quiescent itself.
+// Pairs with the tick: iretq is serializing, so a CPU whose counter moved
+// cannot still be using a pointer loaded before our update.
+static void synchronize_rcu(int cpu_id) {
+    uint64_t *snap = rcu_snap;              // Writers serialize, one is enough
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);  // Update visible before snapshot
+    for (int i = 0; i < cpu_count; i++) {
+        snap[i] = __atomic_load_n(&rcu_cpus[i].qs_count, __ATOMIC_ACQUIRE);
+    }
+
+    for (int i = 0; i < cpu_count; i++) {
+        if (i == cpu_id || !rcu_cpus[i].online) continue;
+        while (__atomic_load_n(&rcu_cpus[i].qs_count, __ATOMIC_ACQUIRE) == snap[i]) {
+            __asm__ volatile("pause");
+        }
+    }
+}
+
+// Queue func(head) to run after a grace period (object already unpublished)
+static void call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *head)) {
+    head->func = func;
+    struct rcu_head *old = __atomic_load_n(&rcu_pending, __ATOMIC_RELAXED);
+    do {
+        head->next = old;
+    } while (!__atomic_compare_exchange_n(&rcu_pending, &old, head, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+// Run every callback queued so far, after one grace period covering them all
+static void rcu_reclaim(int cpu_id) {
+    struct rcu_head *list = __atomic_exchange_n(&rcu_pending, 0, __ATOMIC_ACQUIRE);
+    if (!list) return;
+
+    uint64_t start = rdtsc();
+    synchronize_rcu(cpu_id);
+    uint64_t callbacks = 0;
+    uint64_t grace = rdtsc() - start;
+    while (list) {
+        struct rcu_head *next = list->next;
+        list->func(list);
+        list = next;
+        callbacks++;
+    }
+    BLOG(RCU, INFO, EV_RCU_GRACE, grace, callbacks);
+}
+
+// ============================================================================
+// PARALLEL COMPUTATION FUNCTIONS
+// ============================================================================
+
+// Centralized barrier (sense-reversing) - n CPUs with IDs 0..n-1
+static void central_barrier_wait(struct central_barrier *b, int n) {
+    uint32_t my_sense = b->sense;
+
+    // Last CPU to arrive flips the sense
+    uint32_t arrived = __atomic_add_fetch(&b->count, 1, __ATOMIC_SEQ_CST);
+
+    if (arrived == (uint32_t)n) {
+        // Last one - reset and flip sense
+        b->count = 0;
+        __atomic_store_n(&b->sense, !my_sense, __ATOMIC_SEQ_CST);
+    } else {
+        // Wait for sense to flip
+        while (__atomic_load_n(&b->sense, __ATOMIC_SEQ_CST) == my_sense) {
+            __asm__ volatile("pause");
+        }
+    }
+}
+
+// Dissemination barrier - n CPUs with IDs 0..n-1
+// Round r: signal CPU (id + 2^r) % n, then wait for CPU (id - 2^r) % n.
+// After ceil(log2 n) rounds every CPU has (transitively) heard from all others.
+// Flags are monotonic counters, so the barrier is reusable without resetting,
+// as long as the same n is used for every episode on a given instance.
+static void dissem_barrier_wait(struct dissem_barrier *b, int cpu_id, int n) {
+    struct barrier_cpu *me = &b->cpu[cpu_id];
+    uint32_t target = ++me->episodes;
+
+    int round = 0;
+    for (int dist = 1; dist < n; dist <<= 1, round++) {
+        struct barrier_cpu *partner = &b->cpu[(cpu_id + dist) % n];
+        __atomic_fetch_add(&partner->round[round].count, 1, __ATOMIC_RELEASE);
+
+        // Wrap-safe "count < target"
+        while ((int)(__atomic_load_n(&me->round[round].count, __ATOMIC_ACQUIRE) - target) < 0) {
+            __asm__ volatile("pause");
+        }
+    }
+}
+
+// Barrier across all online CPUs
+static void barrier_wait(int cpu_id) {
+    dissem_barrier_wait(&global_barrier, cpu_id, cpu_count);
+}
+
+// PMU counts for tests 1 and 2, per CPU
+static struct perf_sample *perf_test_counters;
+static struct perf_sample *perf_test_sum;
+
+// Test 1: Parallel counter (each CPU counts to 1 million)
+static void test_parallel_counters(int cpu_id) {
+    perf_begin(&perf_test_counters[cpu_id]);
+    for (uint64_t i = 0; i < 1000000; i++) {
+        per_cpu_counters[cpu_id]++;
+        if (i % 100000 == 0) {
+            __asm__ volatile("pause");
+        }
+    }
+    perf_end(&perf_test_counters[cpu_id]);
+}
+
+// Test 2: Distributed sum (divide work among CPUs)
+static void test_distributed_sum(int cpu_id) {
+    uint64_t per_cpu_work = SUM_TARGET / cpu_count;
+    uint64_t start = cpu_id * per_cpu_work + 1;
+    uint64_t end = (cpu_id + 1) * per_cpu_work;
+
+    // Last CPU handles remainder
+    if (cpu_id == cpu_count - 1) {
+        end = SUM_TARGET;
+    }
+
+    perf_begin(&perf_test_sum[cpu_id]);
+    uint64_t local_sum = 0;
+    for (uint64_t i = start; i <= end; i++) {
+        local_sum += i;
+    }
+    perf_end(&perf_test_sum[cpu_id]);
+
+    partial_sums[cpu_id] = local_sum;
+
+    // Atomically add to total
+    __atomic_add_fetch(&total_sum, local_sum, __ATOMIC_SEQ_CST);
+}
+
+// Test 3: Barrier synchronization test
+static void test_barrier_sync(int cpu_id) {
+    // Phase 1: Count to 500k
+    for (uint64_t i = 0; i < 500000; i++) {
+        per_cpu_counters[cpu_id]++;
+    }
+
+    // Barrier: wait for all CPUs
+    barrier_wait(cpu_id);
+
+    // Phase 2: Count to 1M (everyone starts together)
+    for (uint64_t i = 500000; i < 1000000; i++) {
+        per_cpu_counters[cpu_id]++;
+    }
+}
+
+// Test 4 reclaim callback: poison the old table so a late reader notices
+static void rcu_test_poison(struct rcu_head *head) {
+    struct rcu_test_table *t = (struct rcu_test_table *)head;
+    t->version = RCU_POISON;
+    for (int i = 0; i < RCU_TEST_ENTRIES; i++) {
+        t->entries[i] = RCU_POISON;
+    }
+}
+
+// Test 4: RCU - CPU 0 republishes a table while the others read it
+static void test_rcu(int cpu_id) {
+    if (cpu_id == 0) {
+        rcu_test_tables[0].version = 1;
+        for (int i = 0; i < RCU_TEST_ENTRIES; i++) {
+            rcu_test_tables[0].entries[i] = 1;
+        }
+        rcu_assign_pointer(rcu_test_current, &rcu_test_tables[0]);
+        rcu_test_done = 0;
+    }
+    barrier_wait(cpu_id);
+
+    if (cpu_id == 0) {
+        uint64_t start = rdtsc();
+        for (uint64_t v = 2; v < 2 + RCU_TEST_UPDATES; v++) {
+            // Copy side: the spare table is unreachable after the last grace period
+            struct rcu_test_table *old = rcu_test_current;
+            struct rcu_test_table *new = (old == &rcu_test_tables[0]) ?
+                                         &rcu_test_tables[1] : &rcu_test_tables[0];
+            new->version = v;
+            for (int i = 0; i < RCU_TEST_ENTRIES; i++) {
+                new->entries[i] = v;
+            }
+
+            rcu_assign_pointer(rcu_test_current, new);
+            call_rcu(&old->rcu, rcu_test_poison);
+            rcu_reclaim(cpu_id);
+        }
+        rcu_test_grace_cycles = (rdtsc() - start) / RCU_TEST_UPDATES;
+        __atomic_store_n(&rcu_test_done, 1, __ATOMIC_RELEASE);
+    } else {
+        uint64_t reads = 0;
+        uint64_t errors = 0;
+        while (!__atomic_load_n(&rcu_test_done, __ATOMIC_ACQUIRE)) {
+            rcu_read_lock(cpu_id);
+            struct rcu_test_table *t = rcu_dereference(rcu_test_current);
+            uint64_t v = t->version;
+            if (v == RCU_POISON) errors++;
+            for (int i = 0; i < RCU_TEST_ENTRIES; i++) {
+                if (t->entries[i] != v) errors++;
+            }
+            rcu_read_unlock(cpu_id);
+            reads++;
+
+            // Like a real hot path, spend most of the time outside the section
+            for (int i = 0; i < 64; i++) __asm__ volatile("pause");
+        }
+        rcu_test_reads[cpu_id] = reads;
+        __atomic_fetch_add(&rcu_test_errors, errors, __ATOMIC_RELAXED);
+    }
+    barrier_wait(cpu_id);
+}
+
+// Measure each AP's TSC offset from the BSP. The AP timestamps a ping, the
+// BSP answers with its TSC; assuming the BSP read lands mid-round-trip,
+// offset = bsp_tsc - (t0 + t1) / 2. The fastest round trip wins.
+static void clock_sync(int cpu_id) {
+    barrier_wait(cpu_id);
+
+    for (int ap = 1; ap < cpu_count; ap++) {
+        uint32_t seq = (ap - 1) * TSC_SYNC_ROUNDS;
+
+        if (cpu_id == 0) {
+            for (int r = 1; r <= TSC_SYNC_ROUNDS; r++) {
+                while (__atomic_load_n(&tsc_sync.ping, __ATOMIC_ACQUIRE) != seq + r) {
+                    __asm__ volatile("pause");
+                }
+                tsc_sync.bsp_tsc = rdtsc_ordered();
+                __atomic_store_n(&tsc_sync.pong, seq + r, __ATOMIC_RELEASE);
+            }
+        } else if (cpu_id == ap) {
+            uint64_t best_rtt = ~0UL;
+            uint64_t best_offset = 0;
+            for (int r = 1; r <= TSC_SYNC_ROUNDS; r++) {
+                uint64_t t0 = rdtsc_ordered();
+                __atomic_store_n(&tsc_sync.ping, seq + r, __ATOMIC_RELEASE);
+                while (__atomic_load_n(&tsc_sync.pong, __ATOMIC_ACQUIRE) != seq + r) {
+                    __asm__ volatile("pause");
+                }
+                uint64_t t1 = rdtsc_ordered();
+                if (t1 - t0 < best_rtt) {
+                    best_rtt = t1 - t0;
+                    best_offset = tsc_sync.bsp_tsc - (t0 + (t1 - t0) / 2);
+                }
+            }
+            // Within the measurement error the TSCs are already in sync
+            uint64_t magnitude = (best_offset >> 63) ? -best_offset : best_offset;
+            tsc_offsets[cpu_id] = (magnitude <= best_rtt / 2) ? 0 : best_offset;
+            BLOG(CLOCK, INFO, EV_TSC_OFFSET, best_offset, best_rtt);
+        }
+    }
+
+    barrier_wait(cpu_id);
+}
+
+// Test 5: clock - cross-CPU monotonicity and read cost
+static void test_clock(int cpu_id) {
+    if (cpu_id == 0) {
+        clock_test_last = 0;
+        clock_test_backsteps = 0;
+        clock_test_max_backstep = 0;
+    }
+    barrier_wait(cpu_id);
+
+    // A value loaded from clock_test_last was read before our clock read,
+    // so our reading must not be smaller
+    for (int i = 0; i < CLOCK_TEST_READS; i++) {
+        uint64_t seen = __atomic_load_n(&clock_test_last, __ATOMIC_ACQUIRE);
+        uint64_t now = clock_monotonic_ns();
+        if (now < seen) {
+            __atomic_fetch_add(&clock_test_backsteps, 1, __ATOMIC_RELAXED);
+            uint64_t step = seen - now;
+            uint64_t max = __atomic_load_n(&clock_test_max_backstep, __ATOMIC_RELAXED);
+            while (step > max && !__atomic_compare_exchange_n(&clock_test_max_backstep, &max, step, 1,
+                                                             __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            }
+        }
+        while (now > seen && !__atomic_compare_exchange_n(&clock_test_last, &seen, now, 1,
+                                                         __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+        }
+    }
+    barrier_wait(cpu_id);
+
+    // Uncontended read cost (no shared writes on the read path)
+    if (cpu_id == 0) {
+        uint64_t start = rdtsc_ordered();
+        for (int i = 0; i < CLOCK_TEST_READS; i++) {
+            (void)clock_monotonic_ns();
+        }
+        clock_read_cycles = (rdtsc_ordered() - start) / CLOCK_TEST_READS;
+    }
+    barrier_wait(cpu_id);
+}
+
+// Participant counts for the barrier benchmark: 1, 2, 4, ... then cpu_count
+static int bench_next_cpu_count(int n) {
+    if (n >= cpu_count) return cpu_count + 1;  // Done
+    return (n * 2 < cpu_count) ? n * 2 : cpu_count;
+}
+
+// Benchmark: barrier latency of both implementations across CPU counts
+// Called by every online CPU; CPUs >= n sit out a run at the global barrier.
+static void bench_barriers(int cpu_id) {
+    for (int n = 1; n <= cpu_count; n = bench_next_cpu_count(n)) {
+        // Fresh instances for each participant count (everyone is parked here)
+        if (cpu_id == 0) {
+            memset(&bench_central_barrier, 0, sizeof(bench_central_barrier));
+            memset(bench_dissem_barrier.cpu, 0, cpu_count * sizeof(struct barrier_cpu));
+        }
+        barrier_wait(cpu_id);
+
+        if (cpu_id < n) {
+            uint64_t start = rdtsc();
+            for (int i = 0; i < BARRIER_BENCH_ITERS; i++) {
+                central_barrier_wait(&bench_central_barrier, n);
+            }
+            uint64_t mid = rdtsc();
+            for (int i = 0; i < BARRIER_BENCH_ITERS; i++) {
+                dissem_barrier_wait(&bench_dissem_barrier, cpu_id, n);
+            }
+            uint64_t end = rdtsc();
+
+            if (cpu_id == 0) {
+                barrier_bench_central[n] = (mid - start) / BARRIER_BENCH_ITERS;
+                barrier_bench_dissem[n] = (end - mid) / BARRIER_BENCH_ITERS;
+            }
+        }
+        barrier_wait(cpu_id);
+    }
+}
+
+// Ping-pong between CPU 0 and CPU 1: returns average one-way latency (cycles)
+// The echo side waits with 'spins' polls before halting (0 = always halt)
+static uint64_t bench_msg_pingpong(int cpu_id, uint32_t rounds, uint32_t spins) {
+    if (cpu_id == 0) {
+        struct msg_ring *out = msg_ring_get(0, 1);
+        struct msg_ring *in = msg_ring_get(1, 0);
+        uint64_t start = rdtsc();
+        for (uint32_t i = 0; i < rounds; i++) {
+            while (!msg_ring_send(out, i)) __asm__ volatile("pause");
+            if (msg_ring_recv(in, 0, 0xFFFFFFFF) != i) msg_bench_errors++;
+        }
+        return (rdtsc() - start) / (2 * (uint64_t)rounds);
+    } else if (cpu_id == 1) {
+        struct msg_ring *in = msg_ring_get(0, 1);
+        struct msg_ring *out = msg_ring_get(1, 0);
+        for (uint32_t i = 0; i < rounds; i++) {
+            uint64_t msg = msg_ring_recv(in, 1, spins);
+            while (!msg_ring_send(out, msg)) __asm__ volatile("pause");
+        }
+    }
+    return 0;
+}
+
+// Benchmark: message ring throughput and latency
+// Called by every online CPU; needs at least 2 CPUs.
+static void bench_msg_rings(int cpu_id) {
+    if (cpu_count < 2) return;
+
+    // Run 1: throughput - every CPU streams sequence numbers to its right
+    // neighbour while draining its left neighbour, publishing in batches
+    struct msg_ring *out = msg_ring_get(cpu_id, (cpu_id + 1) % cpu_count);
+    struct msg_ring *in = msg_ring_get((cpu_id + cpu_count - 1) % cpu_count, cpu_id);
+    uint64_t buf[MSG_BENCH_BATCH];
+    uint64_t sent = 0, received = 0, errors = 0;
+
+    barrier_wait(cpu_id);
+    uint64_t start = rdtsc();
+    while (sent < MSG_BENCH_COUNT || received < MSG_BENCH_COUNT) {
+        uint32_t queued = 0;
+        while (sent < MSG_BENCH_COUNT && queued < MSG_BENCH_BATCH && msg_ring_enqueue(out, sent)) {
+            sent++;
+            queued++;
+        }
+        if (queued) msg_ring_publish(out);
+
+        uint32_t got = msg_ring_dequeue_batch(in, buf, MSG_BENCH_BATCH);
+        for (uint32_t i = 0; i < got; i++) {
+            if (buf[i] != received + i) errors++;
+        }
+        received += got;
+    }
+    msg_bench_cycles[cpu_id] = (rdtsc() - start) / MSG_BENCH_COUNT;
+    if (errors) __atomic_fetch_add(&msg_bench_errors, errors, __ATOMIC_SEQ_CST);
+    barrier_wait(cpu_id);
+
+    // Run 2: one-way latency with a polling consumer
+    uint64_t latency = bench_msg_pingpong(cpu_id, MSG_PINGPONG_ROUNDS, 0xFFFFFFFF);
+    if (cpu_id == 0) msg_bench_pingpong = latency;
+    barrier_wait(cpu_id);
+
+    // Run 3: one-way latency with a halted consumer woken by the doorbell IPI
+    latency = bench_msg_pingpong(cpu_id, MSG_DOORBELL_ROUNDS, 0);
+    if (cpu_id == 0) msg_bench_doorbell = latency;
+    barrier_wait(cpu_id);
+}
+
+// Ping-pong on one cache line between CPUs a and b: returns the average
+// one-way latency on a (cycles). Both sides spin without pause so the
+// line moves as soon as it is written.
+static uint64_t c2c_pingpong(int cpu_id, int a, int b) {
+    volatile uint64_t *line = &c2c_line.value;
+    uint64_t start = 0;
+
+    if (cpu_id == a) {
+        for (uint64_t i = 0; i < C2C_WARMUP + C2C_ROUNDS; i++) {
+            if (i == C2C_WARMUP) start = rdtsc_ordered();
+            *line = 2 * i + 1;
+            while (*line != 2 * i + 2) {}
+        }
+        return (rdtsc_ordered() - start) / (2 * C2C_ROUNDS);
+    } else if (cpu_id == b) {
+        for (uint64_t i = 0; i < C2C_WARMUP + C2C_ROUNDS; i++) {
+            while (*line != 2 * i + 1) {}
+            *line = 2 * i + 2;
+        }
+    }
+    return 0;
+}
+
+static void coh_counter_loop(int kind, int cpu_id) {
+    switch (kind) {
+    case COH_PACKED:
+        for (uint32_t i = 0; i < COH_COUNTER_ITERS; i++) coh_packed[cpu_id]++;
+        break;
+    case COH_PADDED:
+        for (uint32_t i = 0; i < COH_COUNTER_ITERS; i++) coh_padded[cpu_id].value++;
+        break;
+    case COH_SHARED:
+        for (uint32_t i = 0; i < COH_COUNTER_ITERS; i++) {
+            __atomic_fetch_add(&coh_shared.value, 1, __ATOMIC_RELAXED);
+        }
+        break;
+    }
+}
+
+// The memory order has to be a constant for the builtins, hence one loop
+// each. p is volatile, so not even the loads can be dropped.
+static void coh_atomic_loop(int op, volatile uint64_t *p) {
+    switch (op) {
+    case COH_LOAD_ACQUIRE:
+        for (uint32_t i = 0; i < COH_ATOMIC_ITERS; i++) (void)__atomic_load_n(p, __ATOMIC_ACQUIRE);
+        break;
+    case COH_STORE_RELAXED:
+        for (uint32_t i = 0; i < COH_ATOMIC_ITERS; i++) __atomic_store_n(p, i, __ATOMIC_RELAXED);
+        break;
+    case COH_STORE_RELEASE:
+        for (uint32_t i = 0; i < COH_ATOMIC_ITERS; i++) __atomic_store_n(p, i, __ATOMIC_RELEASE);
+        break;
+    case COH_STORE_SEQ_CST:
+        for (uint32_t i = 0; i < COH_ATOMIC_ITERS; i++) __atomic_store_n(p, i, __ATOMIC_SEQ_CST);
+        break;
+    case COH_ADD_RELAXED:
+        for (uint32_t i = 0; i < COH_ATOMIC_ITERS; i++) __atomic_fetch_add(p, 1, __ATOMIC_RELAXED);
+        break;
+    case COH_ADD_ACQ_REL:
+        for (uint32_t i = 0; i < COH_ATOMIC_ITERS; i++) __atomic_fetch_add(p, 1, __ATOMIC_ACQ_REL);
+        break;
+    case COH_ADD_SEQ_CST:
+        for (uint32_t i = 0; i < COH_ATOMIC_ITERS; i++) __atomic_fetch_add(p, 1, __ATOMIC_SEQ_CST);
+        break;
+    case COH_XCHG:
+        for (uint32_t i = 0; i < COH_ATOMIC_ITERS; i++) __atomic_exchange_n(p, i, __ATOMIC_SEQ_CST);
+        break;
+    case COH_CAS:
+        // One attempt per iteration, successful or not
+        for (uint32_t i = 0; i < COH_ATOMIC_ITERS; i++) {
+            uint64_t v = __atomic_load_n(p, __ATOMIC_RELAXED);
+            __atomic_compare_exchange_n(p, &v, v + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+        }
+        break;
+    }
+}
+
+// Slowest participant's time for the run that just ended (BSP)
+static uint64_t coh_slowest(int n) {
+    uint64_t max = 0;
+    for (int i = 0; i < n; i++) {
+        if (coh_cycles[i] > max) max = coh_cycles[i];
+    }
+    return max;
+}
+
+// Benchmark: cache-line transfer costs
+// Called by every online CPU; CPUs not taking part wait at the global barrier.
+//  1. One-way latency for every CPU pair (c2c_latency, symmetric)
+//  2. Per-CPU counters packed into shared lines vs padded to a line each vs
+//     one atomic counter, on 1, 2, 4, ... CPUs
+//  3. Atomic operations on a private line and on a line all CPUs hit
+static void bench_coherence(int cpu_id) {
+    for (int a = 0; a < cpu_count; a++) {
+        for (int b = a + 1; b < cpu_count; b++) {
+            if (cpu_id == a) c2c_line.value = 0;
+            barrier_wait(cpu_id);
+            uint64_t latency = c2c_pingpong(cpu_id, a, b);
+            if (cpu_id == a) c2c_latency[a * cpu_count + b] = c2c_latency[b * cpu_count + a] = latency;
+            barrier_wait(cpu_id);
+        }
+    }
+
+    for (int kind = 0; kind < COH_COUNTER_KINDS; kind++) {
+        for (int n = 1; n <= cpu_count; n = bench_next_cpu_count(n)) {
+            if (cpu_id == 0) coh_shared.value = 0;
+            barrier_wait(cpu_id);
+            if (cpu_id < n) {
+                uint64_t start = rdtsc_ordered();
+                coh_counter_loop(kind, cpu_id);
+                coh_cycles[cpu_id] = rdtsc_ordered() - start;
+            }
+            barrier_wait(cpu_id);
+            if (cpu_id == 0) {
+                coh_counter_cycles[kind][n] = coh_slowest(n);
+                if (kind == COH_SHARED && coh_shared.value != (uint64_t)n * COH_COUNTER_ITERS) coh_errors++;
+            }
+        }
+    }
+
+    for (int shared = 0; shared < 2; shared++) {
+        for (int op = 0; op < COH_ATOMIC_OPS; op++) {
+            volatile uint64_t *p = shared ? &coh_shared.value : &coh_padded[cpu_id].value;
+            barrier_wait(cpu_id);
+            uint64_t start = rdtsc_ordered();
+            coh_atomic_loop(op, p);
+            coh_cycles[cpu_id] = rdtsc_ordered() - start;
+            barrier_wait(cpu_id);
+            if (cpu_id == 0) coh_atomic_cycles[shared][op] = coh_slowest(cpu_count);
+        }
+    }
+}
+
+// IPI benchmark handler: timestamp and count, then answer ipi_bench_echo
+// (round trips). Safe to send from here - the benchmark never has the CPU
+// it interrupts in the middle of its own send_ipi().
+__attribute__((used))
+void ipi_bench_interrupt_handler(void) {
+    uint64_t now = clock_read_tsc();
+    uint32_t cpu = this_cpu();
+    if (cpu < percpu_cpus) {
+        ipi_bench_cpus[cpu].arrival = now;
+        ipi_bench_cpus[cpu].received++;
+        uint32_t echo = ipi_bench_echo;
+        if (echo < percpu_cpus && echo != cpu) {
+            send_ipi(logical_apic_ids[echo], APIC_INT_ASSERT | IPI_BENCH_VECTOR);
+        }
+    }
+    send_eoi();
+}
+
+// Same frame as doorbell_irq_stub
+__asm__(
+    ".global ipi_bench_irq_stub\n"
+    "ipi_bench_irq_stub:\n"
+    "    push %rax\n"
+    "    push %rcx\n"
+    "    push %rdx\n"
+    "    push %rsi\n"
+    "    push %rdi\n"
+    "    push %r8\n"
+    "    push %r9\n"
+    "    push %r10\n"
+    "    push %r11\n"
+    "    cld\n"
+    "    call ipi_bench_interrupt_handler\n"
+    "    pop %r11\n"
+    "    pop %r10\n"
+    "    pop %r9\n"
+    "    pop %r8\n"
+    "    pop %rdi\n"
+    "    pop %rsi\n"
+    "    pop %rdx\n"
+    "    pop %rcx\n"
+    "    pop %rax\n"
+    "    iretq\n"
+);
+
+// Spin (no pause, it would add to the latency) until 'cpu' has handled
+// 'count' benchmark IPIs. 0 and a recorded timeout if one went missing.
+static int ipi_bench_wait(uint32_t cpu, uint64_t count) {
+    uint64_t start = rdtsc();
+    while (ipi_bench_cpus[cpu].received < count) {
+        if (rdtsc() - start > tsc_khz * IPI_BENCH_TIMEOUT_MS) {
+            ipi_bench_timeouts++;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Runs 1-2 on the BSP: one-way latency (send to handler entry, both on the
+// BSP timebase) and round trip (the target's handler answers)
+static void ipi_bench_latency(uint32_t target) {
+    struct ipi_bench_cpu *t = &ipi_bench_cpus[target];
+    uint32_t apic_id = logical_apic_ids[target];
+    uint64_t oneway = 0;
+
+    for (uint32_t i = 0; i < IPI_BENCH_ROUNDS; i++) {
+        uint64_t seen = t->received;
+        uint64_t t0 = clock_read_tsc();
+        send_ipi(apic_id, APIC_INT_ASSERT | IPI_BENCH_VECTOR);
+        if (!ipi_bench_wait(target, seen + 1)) return;
+        oneway += t->arrival - t0;
+    }
+    ipi_oneway[target] = oneway / IPI_BENCH_ROUNDS;
+
+    ipi_bench_echo = 0;
+    uint64_t start = rdtsc_ordered();
+    for (uint32_t i = 0; i < IPI_BENCH_ROUNDS; i++) {
+        uint64_t seen = ipi_bench_cpus[0].received;
+        send_ipi(apic_id, APIC_INT_ASSERT | IPI_BENCH_VECTOR);
+        if (!ipi_bench_wait(0, seen + 1)) break;
+    }
+    ipi_roundtrip[target] = (rdtsc_ordered() - start) / IPI_BENCH_ROUNDS;
+    ipi_bench_echo = CPU_NONE;
+}
+
+// Run 3 on the BSP: reach every other CPU through send_ipi_mask_via()
+// with each method. 'send' is the sender's cost, 'done' the time until
+// the last handler ran.
+static void ipi_bench_fanout(enum ipi_method method) {
+    struct cpumask others;
+    uint64_t *seen = ipi_bench_seen;
+    uint64_t send_total = 0, done_total = 0;
+
+    cpumask_clear(&others);
+    for (int cpu = 1; cpu < cpu_count; cpu++) cpumask_set(&others, cpu);
+
+    for (uint32_t i = 0; i < IPI_BENCH_ROUNDS; i++) {
+        for (int cpu = 1; cpu < cpu_count; cpu++) seen[cpu] = ipi_bench_cpus[cpu].received;
+        uint64_t t0 = rdtsc_ordered();
+        uint32_t writes = send_ipi_mask_via(&others, APIC_INT_ASSERT | IPI_BENCH_VECTOR, method);
+        uint64_t t1 = rdtsc_ordered();
+        if (writes == 0) return;
+        for (int cpu = 1; cpu < cpu_count; cpu++) {
+            if (!ipi_bench_wait(cpu, seen[cpu] + 1)) return;
+        }
+        send_total += t1 - t0;
+        done_total += rdtsc_ordered() - t0;
+        ipi_fanout_writes[method] = writes;
+    }
+    ipi_fanout_send[method] = send_total / IPI_BENCH_ROUNDS;
+    ipi_fanout_done[method] = done_total / IPI_BENCH_ROUNDS;
+}
+
+// Test 6 on the BSP: one mask, one method - exactly the CPUs in the mask
+// take exactly one IPI
+static void ipi_mask_check(const struct cpumask *mask, enum ipi_method method) {
+    uint64_t *seen = ipi_bench_seen;
+    for (int cpu = 0; cpu < cpu_count; cpu++) seen[cpu] = ipi_bench_cpus[cpu].received;
+
+    uint32_t flags = APIC_INT_ASSERT | IPI_BENCH_VECTOR;
+    uint32_t writes = (method == IPI_AUTO) ? send_ipi_mask(mask, flags) : send_ipi_mask_via(mask, flags, method);
+    if (writes == 0) return;
+    for (int cpu = 0; cpu < cpu_count; cpu++) {
+        if (cpumask_test(mask, cpu) && !ipi_bench_wait(cpu, seen[cpu] + 1)) ipi_mask_errors++;
+    }
+    // Give strays a millisecond to land
+    uint64_t start = rdtsc();
+    while (rdtsc() - start < tsc_khz) __asm__ volatile("pause");
+    for (int cpu = 0; cpu < cpu_count; cpu++) {
+        if (ipi_bench_cpus[cpu].received != seen[cpu] + cpumask_test(mask, cpu)) ipi_mask_errors++;
+    }
+}
+
+// Test 6: send_ipi_mask() - single CPUs, odd and even CPUs (the BSP sends
+// to itself too), everyone else, everyone; through every method that can
+// express the mask. Called by every online CPU.
+static void test_ipi_mask(int cpu_id) {
+    barrier_wait(cpu_id);
+    if (cpu_id == 0) {
+        // Odd, even, all but the BSP, all, then each CPU alone
+        struct cpumask mask;
+        for (int kind = 0; kind < 4 + cpu_count; kind++) {
+            cpumask_clear(&mask);
+            for (int cpu = 0; cpu < cpu_count; cpu++) {
+                int in = (kind == 0) ? (cpu & 1) : (kind == 1) ? !(cpu & 1) : (kind == 2) ? cpu != 0 :
+                         (kind == 3) ? 1 : cpu == kind - 4;
+                if (in) cpumask_set(&mask, cpu);
+            }
+            for (int method = IPI_AUTO; method <= IPI_UNICAST; method++) ipi_mask_check(&mask, method);
+        }
+    }
+    barrier_wait(cpu_id);
+}
+
+// Benchmark: IPI costs in the current APIC mode (make XAPIC=1 forces xAPIC)
+// Called by every online CPU; needs at least 2. CPUs that are not sending
+// spin at the global barrier with interrupts on and take the IPIs there.
+static void bench_ipi(int cpu_id) {
+    if (cpu_count < 2) return;
+
+    for (int target = 1; target < cpu_count; target++) {
+        barrier_wait(cpu_id);
+        if (cpu_id == 0) ipi_bench_latency(target);
+        barrier_wait(cpu_id);
+    }
+
+    if (cpu_id == 0) {
+        for (int method = IPI_SHORTHAND; method <= IPI_UNICAST; method++) ipi_bench_fanout(method);
+    }
+    barrier_wait(cpu_id);
+
+    // Run 4: every CPU floods its right neighbour
+    uint64_t before = ipi_bench_cpus[cpu_id].received;
+    uint32_t apic_id = logical_apic_ids[(cpu_id + 1) % cpu_count];
+    barrier_wait(cpu_id);
+    uint64_t start = rdtsc_ordered();
+    for (uint32_t i = 0; i < IPI_BENCH_BURST; i++) {
+        send_ipi(apic_id, APIC_INT_ASSERT | IPI_BENCH_VECTOR);
+    }
+    ipi_burst_cycles[cpu_id] = rdtsc_ordered() - start;
+    barrier_wait(cpu_id);
+    ipi_burst_received[cpu_id] = ipi_bench_cpus[cpu_id].received - before;
+    barrier_wait(cpu_id);
+}
+
+// ============================================================================
+// BENCHMARK HARNESS
+// ============================================================================
+//
+// Benchmarks are entries in benchmarks[]; bench_run_all() is called by every
+// online CPU and runs them in order. Each participating CPU does an untimed
+// setup, BENCH_WARMUP untimed runs, 'iters' timed runs, then an untimed
+// teardown. A timed run is
+// fenced on both sides (lfence; rdtsc ... rdtscp; lfence) and the per-CPU
+// cost of an empty timed region is subtracted. The BSP prints one JSON line
+// per benchmark with min/median/p99/max/mean/stddev per CPU and over all
+// samples from all CPUs (TSC cycles).
+
+#define BENCH_MAX_ITERS 1024
+#define BENCH_WARMUP    16
+#define BENCH_ALL_CPUS  0               // struct bench.cpus: every online CPU
+#define BENCH_BSP_ONLY  1
+
+struct bench {
+    const char *name;
+    void (*setup)(int cpu_id);          // Optional, untimed
+    void (*run)(int cpu_id);            // One timed iteration
+    void (*teardown)(int cpu_id);       // Optional, untimed
+    uint32_t cpus;                      // BENCH_ALL_CPUS or a CPU count
+    uint32_t iters;                     // <= BENCH_MAX_ITERS
+};
+
+struct bench_stats {
+    uint64_t min, median, p99, max, mean, stddev;
+};
+
+static uint64_t (*bench_samples)[BENCH_MAX_ITERS];
+static uint64_t *bench_merged;          // cpu_count * BENCH_MAX_ITERS
+static uint64_t *bench_overhead;
+
+static inline uint64_t bench_start(void) {
+    return rdtsc_ordered();
+}
 
-    puts("[SMP] Trampoline copied to 0x8000\n");
+// Waits for the timed code to finish, and keeps later code from starting early
+static inline uint64_t bench_stop(void) {
+    uint64_t t;
+    if (has_rdtscp) {
+        uint32_t aux;
+        t = rdtscp(&aux);
+    } else {
+        t = rdtsc_ordered();
+    }
+    __asm__ volatile("lfence" ::: "memory");
+    return t;
+}
 
-    // Get current CR3
-    uint64_t cr3;
-    __asm__ volatile("mov %%cr3, %0" : "=r"(cr3));
+static uint64_t bench_isqrt(uint64_t v) {
+    uint64_t r = 0;
+    for (uint64_t bit = 1UL << 62; bit; bit >>= 2) {
+        if (v >= r + bit) {
+            v -= r + bit;
+            r = (r >> 1) + bit;
+        } else {
+            r >>= 1;
+        }
+    }
+    return r;
+}
 
-    // Patch trampoline variables at end (like linux-minimal)
-    // Offsets from end: -24: cr3, -16: stack, -8: entry
-    uint64_t *cr3_ptr = (uint64_t*)(0x8000 + trampoline_size - 24);
-    uint64_t *stack_ptr = (uint64_t*)(0x8000 + trampoline_size - 16);
-    uint64_t *entry_ptr = (uint64_t*)(0x8000 + trampoline_size - 8);
+// Shell sort - n is at most a few thousand
+static void bench_sort(uint64_t *v, uint32_t n) {
+    for (uint32_t gap = n / 2; gap; gap /= 2) {
+        for (uint32_t i = gap; i < n; i++) {
+            uint64_t x = v[i];
+            uint32_t j = i;
+            for (; j >= gap && v[j - gap] > x; j -= gap) v[j] = v[j - gap];
+            v[j] = x;
+        }
+    }
+}
 
-    *cr3_ptr = cr3;
-    *stack_ptr = 0;  // Will be patched per-AP
-    extern void ap_entry(void);
-    *entry_ptr = (uint64_t)ap_entry;
+// Sorts v in place
+static void bench_compute(uint64_t *v, uint32_t n, struct bench_stats *st) {
+    bench_sort(v, n);
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < n; i++) sum += v[i];
+    st->min = v[0];
+    st->max = v[n - 1];
+    st->median = (n & 1) ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+    st->p99 = v[(n * 99 + 99) / 100 - 1];      // Nearest rank
+    st->mean = sum / n;
+    uint64_t var = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        uint64_t d = (v[i] > st->mean) ? v[i] - st->mean : st->mean - v[i];
+        var += d * d;
+    }
+    st->stddev = bench_isqrt(var / n);
+}
 
-    // CRITICAL: Flush caches after patching
-    __asm__ volatile("wbinvd" ::: "memory");
+static void bench_print_stats(const struct bench_stats *st) {
+    log_printf("\"min\":%lu,\"median\":%lu,\"p99\":%lu,\"max\":%lu,\"mean\":%lu,\"stddev\":%lu",
+               st->min, st->median, st->p99, st->max, st->mean, st->stddev);
+}
 
-    puts("[SMP] Trampoline configured\n");
+// BSP, after every participant finished
+static void bench_report(const struct bench *b, uint32_t cpus) {
+    struct bench_stats st;
+    uint32_t merged = 0;
+
+    log_printf("{\"bench\":\"%s\",\"unit\":\"tsc_cycles\",\"iters\":%u,\"cpus\":%u,\"per_cpu\":[",
+               b->name, b->iters, cpus);
+    for (uint32_t cpu = 0; cpu < cpus; cpu++) {
+        bench_compute(bench_samples[cpu], b->iters, &st);
+        log_printf("%s{\"cpu\":%u,\"overhead\":%lu,", cpu ? "," : "", cpu, bench_overhead[cpu]);
+        bench_print_stats(&st);
+        log_printf("}");
+        for (uint32_t i = 0; i < b->iters; i++) bench_merged[merged++] = bench_samples[cpu][i];
+    }
+    bench_compute(bench_merged, merged, &st);
+    log_printf("],\"all\":{");
+    bench_print_stats(&st);
+    log_printf("}}\n");
 }
 
-// Boot a single AP (adapted from Linux smpboot.c)
-static void boot_ap(int cpu_idx) {
-    if (cpu_idx == 0) return;  // Skip BSP
-    if (cpu_idx >= cpu_count) return;
+// Called by every online CPU
+static void bench_run(const struct bench *b, int cpu_id) {
+    uint32_t cpus = (b->cpus == BENCH_ALL_CPUS || b->cpus > (uint32_t)cpu_count) ? (uint32_t)cpu_count : b->cpus;
+    uint32_t iters = (b->iters < BENCH_MAX_ITERS) ? b->iters : BENCH_MAX_ITERS;
 
-    uint8_t apic_id = cpu_apic_ids[cpu_idx];
-    unsigned long start_eip = 0x8000;  // Trampoline address
+    barrier_wait(cpu_id);
+    if ((uint32_t)cpu_id < cpus) {
+        // Cost of an empty timed region, subtracted from every sample
+        uint64_t overhead = ~0UL;
+        for (int i = 0; i < 32; i++) {
+            uint64_t t0 = bench_start();
+            uint64_t t1 = bench_stop();
+            if (t1 - t0 < overhead) overhead = t1 - t0;
+        }
+        bench_overhead[cpu_id] = overhead;
+
+        if (b->setup) b->setup(cpu_id);
+        for (int i = 0; i < BENCH_WARMUP; i++) b->run(cpu_id);
+        for (uint32_t i = 0; i < iters; i++) {
+            uint64_t t0 = bench_start();
+            b->run(cpu_id);
+            uint64_t t = bench_stop() - t0;
+            bench_samples[cpu_id][i] = (t > overhead) ? t - overhead : 0;
+        }
+        if (b->teardown) b->teardown(cpu_id);
+    }
+    barrier_wait(cpu_id);
 
-    // Patch per-CPU stack (like linux-minimal)
-    uint64_t trampoline_size = trampoline_end - trampoline_start;
-    uint64_t *stack_ptr = (uint64_t*)(0x8000 + trampoline_size - 16);
-    *stack_ptr = (uint64_t)&ap_stacks[cpu_idx][AP_STACK_SIZE];
+    if (cpu_id == 0) {
+        struct bench copy = *b;
+        copy.iters = iters;
+        bench_report(&copy, cpus);
+    }
+}
 
-    // CRITICAL: Flush caches after patching
-    __asm__ volatile("wbinvd" ::: "memory");
+// Registered benchmarks
 
-    // INIT-SIPI-SIPI sequence
-    // INIT IPI
-    send_ipi(apic_id, APIC_INT_LEVELTRIG | APIC_INT_ASSERT | APIC_DM_INIT);
-    apic_wait_icr();
+static volatile uint64_t *bench_counters;   // Packed like test 1's counters
+static volatile uint64_t *bench_sink;       // One cache line per CPU (cpu_count * 8)
+static volatile uint64_t bench_sum_len = 10000;
 
-    // Wait 10ms
-    mdelay(10);
+static uint64_t pmm_alloc_page(void);
+static void pmm_free_page(uint64_t phys_addr);
 
-    // INIT deassert
-    send_ipi(apic_id, APIC_INT_LEVELTRIG | APIC_DM_INIT);
-    apic_wait_icr();
+// Test 1's loop: neighbouring CPUs' counters share a cache line
+static void bench_counter_inc(int cpu_id) {
+    for (int i = 0; i < 1000; i++) bench_counters[cpu_id]++;
+}
 
-    // SIPI #1
-    send_ipi(apic_id, APIC_DM_STARTUP | (start_eip >> 12));
-    apic_wait_icr();
+// Test 2's loop on a 10k range
+static void bench_sum_range(int cpu_id) {
+    uint64_t end = bench_sum_len;
+    uint64_t sum = 0;
+    for (uint64_t i = 1; i <= end; i++) sum += i;
+    bench_sink[cpu_id * 8] = sum;
+}
 
-    // Wait 200μs
-    udelay(200);
+static void bench_clock_read(int cpu_id) {
+    bench_sink[cpu_id * 8] = clock_monotonic_ns();
+}
 
-    // SIPI #2
-    send_ipi(apic_id, APIC_DM_STARTUP | (start_eip >> 12));
-    apic_wait_icr();
+static void bench_perf_read(int cpu_id) {
+    struct perf_sample ps;
+    perf_begin(&ps);
+    perf_end(&ps);
+    bench_sink[cpu_id * 8] = ps.tsc;
+}
 
-    // Wait 200μs
-    udelay(200);
+// BSP only: the bump heap can't free, so the run hands back everything it
+// took (1040 x 64 bytes) in one go
+static uint64_t bench_heap_mark;
+
+static void bench_kmalloc_mark(int cpu_id) {
+    (void)cpu_id;
+    bench_heap_mark = heap_current;
 }
 
-// Boot all APs
-static void boot_all_aps(void) {
-    // NO SERIAL OUTPUT AT ALL in this function - it's fragile!
+static void bench_kmalloc(int cpu_id) {
+    bench_sink[cpu_id * 8] = (uint64_t)kmalloc(64);
+}
 
-    // BSP is already online
-    cpus_online = 1;
+static void bench_kmalloc_release(int cpu_id) {
+    (void)cpu_id;
+    heap_current = bench_heap_mark;
+}
 
-    // Boot all APs
-    for (int i = 1; i < cpu_count; i++) {
-        boot_ap(i);
-    }
+static void bench_pmm_page(int cpu_id) {
+    uint64_t page = pmm_alloc_page();
+    pmm_free_page(page);
+    bench_sink[cpu_id * 8] = page;
+}
 
-    // Wait for APs
-    for (volatile int i = 0; i < 1000000; i++) __asm__ volatile("pause");
+static const struct bench benchmarks[] = {
+    { "counter_inc_1k",     0,                  bench_counter_inc, 0,                     BENCH_ALL_CPUS, 256 },
+    { "sum_range_10k",      0,                  bench_sum_range,   0,                     BENCH_ALL_CPUS, 256 },
+    { "clock_monotonic_ns", 0,                  bench_clock_read,  0,                     BENCH_ALL_CPUS, 1024 },
+    { "perf_begin_end",     0,                  bench_perf_read,   0,                     BENCH_ALL_CPUS, 1024 },
+    { "kmalloc_64",         bench_kmalloc_mark, bench_kmalloc,     bench_kmalloc_release, BENCH_BSP_ONLY, 1024 },
+    { "pmm_alloc_free",     0,                  bench_pmm_page,    0,                     BENCH_BSP_ONLY, 256 },
+};
 
-    // NO PUTS HERE! Move to kernel_main after this function returns
+static void bench_run_all(int cpu_id) {
+    if (cpu_id == 0) {
+        log_printf("\n[BENCH] %u benchmarks, JSON lines follow\n",
+                   (uint32_t)(sizeof(benchmarks) / sizeof(benchmarks[0])));
+    }
+    for (uint32_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+        bench_run(&benchmarks[i], cpu_id);
+    }
 }
 
-// ============================================================================
-// PARALLEL COMPUTATION FUNCTIONS
-// ============================================================================
+// Memory primitives: bandwidth of every usable variant per size class
 
-// Simple barrier (sense-reversing)
-static void barrier_wait(int cpu_id) {
-    uint32_t my_sense = barrier_sense;
+#define MEM_BENCH_MAX   (4UL << 20)     // Largest size class
+#define MEM_BENCH_BYTES (1UL << 20)     // Bytes moved per timed run
+#define MEM_BENCH_RUNS  4
 
-    // Last CPU to arrive flips the sense
-    uint32_t arrived = __atomic_add_fetch(&barrier_count, 1, __ATOMIC_SEQ_CST);
+static const uint64_t mem_bench_sizes[] = { 64, 512, 4096, 65536, 1UL << 20, 4UL << 20 };
 
-    if (arrived == (uint32_t)cpu_count) {
-        // Last one - reset and flip sense
-        barrier_count = 0;
-        __atomic_store_n(&barrier_sense, !my_sense, __ATOMIC_SEQ_CST);
-    } else {
-        // Wait for sense to flip
-        while (__atomic_load_n(&barrier_sense, __ATOMIC_SEQ_CST) == my_sense) {
-            __asm__ volatile("pause");
+// MB/s of the best run; copy or set
+static uint64_t mem_bench_one(mem_copy_fn copy, mem_set_fn set,
+                              uint8_t *dst, const uint8_t *src, uint64_t size) {
+    uint64_t reps = (size < MEM_BENCH_BYTES) ? MEM_BENCH_BYTES / size : 1;
+    uint64_t best = ~0UL;
+    for (int run = 0; run < MEM_BENCH_RUNS; run++) {
+        uint64_t t0 = bench_start();
+        for (uint64_t i = 0; i < reps; i++) {
+            if (copy) copy(dst, src, size);
+            else set(dst, (int)i, size);
         }
+        uint64_t t = bench_stop() - t0;
+        if (t < best) best = t;
     }
+    return best ? reps * size * tsc_khz / best / 1000 : 0;
 }
 
-// Test 1: Parallel counter (each CPU counts to 1 million)
-static void test_parallel_counters(int cpu_id) {
-    for (uint64_t i = 0; i < 1000000; i++) {
-        per_cpu_counters[cpu_id]++;
-        if (i % 100000 == 0) {
-            __asm__ volatile("pause");
+static void mem_bench_row(const char *op, uint8_t *dst, const uint8_t *src, uint64_t size) {
+    int copy = (op[3] == 'c');          // "memcpy" or "memset"
+    log_printf("  %s %8lu", op, size);
+    for (uint32_t v = 0; v < MEM_VARIANTS; v++) {
+        if (!mem_variant_usable(v)) {
+            puts("        -");
+            continue;
         }
+        log_printf(" %8lu", mem_bench_one(copy ? mem_variants[v].copy : 0,
+                                          copy ? 0 : mem_variants[v].set, dst, src, size));
     }
+    // What memcpy()/memset() picks for this size
+    log_printf(" %8lu\n", copy ? mem_bench_one(memcpy, 0, dst, src, size)
+                               : mem_bench_one(0, memset, dst, src, size));
 }
 
-// Test 2: Distributed sum (divide work among CPUs)
-static void test_distributed_sum(int cpu_id) {
-    uint64_t per_cpu_work = SUM_TARGET / cpu_count;
-    uint64_t start = cpu_id * per_cpu_work + 1;
-    uint64_t end = (cpu_id + 1) * per_cpu_work;
-
-    // Last CPU handles remainder
-    if (cpu_id == cpu_count - 1) {
-        end = SUM_TARGET;
+// BSP only, other CPUs idle
+static void bench_mem_bandwidth(void) {
+    uint8_t *buf = kmalloc(2 * MEM_BENCH_MAX + 64);
+    if (!buf) return;
+    uint8_t *src = (uint8_t*)(((uint64_t)buf + 63) & ~63UL);
+    uint8_t *dst = src + MEM_BENCH_MAX;
+    memset(src, 0x5A, MEM_BENCH_MAX);
+
+    log_printf("\nBENCH: Memory Primitives (MB/s, best of %d; '-' = not usable)\n", MEM_BENCH_RUNS);
+    puts("----------------------------------------------------------------------------------\n");
+    puts("  op         size");
+    for (uint32_t v = 0; v < MEM_VARIANTS; v++) {
+        const char *name = mem_variants[v].name;
+        uint32_t len = 0;
+        while (name[len]) len++;
+        for (; len < 9; len++) putc(' ');
+        puts(name);
     }
+    puts(" dispatch\n");
 
-    uint64_t local_sum = 0;
-    for (uint64_t i = start; i <= end; i++) {
-        local_sum += i;
+    for (uint32_t i = 0; i < sizeof(mem_bench_sizes) / sizeof(mem_bench_sizes[0]); i++) {
+        mem_bench_row("memcpy", dst, src, mem_bench_sizes[i]);
     }
-
-    partial_sums[cpu_id] = local_sum;
-
-    // Atomically add to total
-    __atomic_add_fetch(&total_sum, local_sum, __ATOMIC_SEQ_CST);
-}
-
-// Test 3: Barrier synchronization test
-static void test_barrier_sync(int cpu_id) {
-    // Phase 1: Count to 500k
-    for (uint64_t i = 0; i < 500000; i++) {
-        per_cpu_counters[cpu_id]++;
+    for (uint32_t i = 0; i < sizeof(mem_bench_sizes) / sizeof(mem_bench_sizes[0]); i++) {
+        mem_bench_row("memset", dst, src, mem_bench_sizes[i]);
     }
 
-    // Barrier: wait for all CPUs
-    barrier_wait(cpu_id);
-
-    // Phase 2: Count to 1M (everyone starts together)
-    for (uint64_t i = 500000; i < 1000000; i++) {
-        per_cpu_counters[cpu_id]++;
+    // Overlapping move with dest above src runs backwards (rep movsb, DF=1)
+    uint64_t best = ~0UL;
+    for (int run = 0; run < MEM_BENCH_RUNS; run++) {
+        uint64_t t0 = bench_start();
+        memmove(src + 64, src, 65536);
+        uint64_t t = bench_stop() - t0;
+        if (t < best) best = t;
     }
+    log_printf("  memmove backward, 64 KB: %lu MB/s\n", best ? 65536 * tsc_khz / best / 1000 : 0);
 }
 
 // AP entry point - now with parallel computation!
 void ap_entry(void) {
+    // Same SIMD state as the BSP before anything here can use it
+    fpu_init_cpu();
+
     // Get our CPU ID for tests
     uint32_t my_id = __atomic_fetch_add(&cpus_online, 1, __ATOMIC_SEQ_CST);
 
@@ -1286,6 +4157,11 @@ void ap_entry(void) {
         apic_write(0x80, 0);  // TPR register at offset 0x80
     }
 
+    // Register our APIC ID (message ring doorbells target it, this_cpu() reads it)
+    cpu_register(my_id);
+    perf_cpu_init();
+    BLOG(SMP, INFO, EV_AP_ONLINE, logical_apic_ids[my_id], rdtsc());
+
     // Wait a bit for APIC to stabilize
     for (volatile int i = 0; i < 100000; i++) __asm__ volatile("pause");
 
@@ -1296,6 +4172,12 @@ void ap_entry(void) {
     // Now safe because trampoline GDT matches BSP GDT (segments 0x08/0x10)
     apic_timer_init();
 
+    // Ticks now report quiescent states for this CPU
+    rcu_cpu_online(my_id);
+
+    // Line up our TSC with the BSP's for clock_monotonic_ns()
+    clock_sync(my_id);
+
     // Test 1: Parallel counters
     test_parallel_counters(my_id);
     barrier_wait(my_id);  // Sync before next test
@@ -1309,8 +4191,33 @@ void ap_entry(void) {
     barrier_wait(my_id);  // Everyone resets together
     test_barrier_sync(my_id);
 
-    // Done - halt
+    // Test 4: RCU
+    test_rcu(my_id);
+
+    // Test 5: Monotonic clock
+    test_clock(my_id);
+
+    // Test 6: Multicast IPIs
+    test_ipi_mask(my_id);
+
+    // Benchmark: barrier latency
+    bench_barriers(my_id);
+
+    // Benchmark: message rings
+    bench_msg_rings(my_id);
+
+    // Benchmark: cache-line transfers
+    bench_coherence(my_id);
+
+    // Benchmark: IPIs
+    bench_ipi(my_id);
+
+    // Registered microbenchmarks (results printed by the BSP)
+    bench_run_all(my_id);
+
+    // Done - halt (idle is a quiescent state)
     while (1) {
+        rcu_quiescent_state(my_id);
         __asm__ volatile("hlt");
     }
 }
@@ -1334,10 +4241,7 @@ static void parse_multiboot_mmap(uint64_t multiboot_info_addr) {
         if (tag->type == MULTIBOOT_TAG_TYPE_MMAP) {
             struct multiboot_tag_mmap *mmap_tag = (struct multiboot_tag_mmap*)tag;
 
-            puts("[MMAP] Memory map found!\n");
-            puts("[MMAP] Entry size: ");
-            print_dec(mmap_tag->entry_size);
-            puts(" bytes\n");
+            LOG(MMAP, DEBUG, "[MMAP] Memory map found! Entry size: %u bytes\n", mmap_tag->entry_size);
 
             // Iterate through all memory map entries
             uint32_t num_entries = (mmap_tag->size - sizeof(struct multiboot_tag_mmap)) / mmap_tag->entry_size;
@@ -1346,17 +4250,10 @@ static void parse_multiboot_mmap(uint64_t multiboot_info_addr) {
                 struct multiboot_mmap_entry *entry = (struct multiboot_mmap_entry*)
                     ((uint8_t*)mmap_tag->entries + i * mmap_tag->entry_size);
 
-                puts("[MMAP]   ");
-                print_hex_64(entry->addr);
-                puts(" - ");
-                print_hex_64(entry->addr + entry->len - 1);
-                puts(" (");
-                print_dec_64(entry->len / 1024 / 1024);
-                puts(" MB) - ");
-
+                const char *type_name;
                 switch (entry->type) {
                     case MULTIBOOT_MEMORY_AVAILABLE:
-                        puts("Available\n");
+                        type_name = "Available";
                         usable_memory += entry->len;
                         // Find highest AVAILABLE address for total memory (not reserved!)
                         // Ignore MMIO regions above 4GB
@@ -1368,23 +4265,25 @@ static void parse_multiboot_mmap(uint64_t multiboot_info_addr) {
                         }
                         break;
                     case MULTIBOOT_MEMORY_RESERVED:
-                        puts("Reserved\n");
+                        type_name = "Reserved";
                         break;
                     case MULTIBOOT_MEMORY_ACPI_RECLAIMABLE:
-                        puts("ACPI Reclaimable\n");
+                        type_name = "ACPI Reclaimable";
                         break;
                     case MULTIBOOT_MEMORY_NVS:
-                        puts("ACPI NVS\n");
+                        type_name = "ACPI NVS";
                         break;
                     case MULTIBOOT_MEMORY_BADRAM:
-                        puts("Bad RAM\n");
+                        type_name = "Bad RAM";
                         break;
                     default:
-                        puts("Unknown (");
-                        print_dec(entry->type);
-                        puts(")\n");
+                        type_name = "Unknown";
                         break;
                 }
+
+                LOG(MMAP, DEBUG, "[MMAP]   %#018lx - %#018lx (%lu MB) - %s (type %u)\n",
+                    entry->addr, entry->addr + entry->len - 1,
+                    entry->len / 1024 / 1024, type_name, entry->type);
             }
 
             puts("[MMAP] Total memory: ");
@@ -1448,15 +4347,8 @@ static void pmm_init(uint64_t multiboot_info_addr) {
     uint64_t bitmap_addr = PAGE_ALIGN(safe_addr);
     pmm_bitmap = (uint8_t*)bitmap_addr;
 
-    puts("[PMM] Bitmap location: ");
-    print_hex_64(bitmap_addr);
-    puts("\n");
-
-    puts("[PMM] Bitmap size: ");
-    print_dec_64(bitmap_size / 1024);
-    puts(" KB (");
-    print_dec_64(total_pages);
-    puts(" pages)\n");
+    LOG(PMM, DEBUG, "[PMM] Bitmap location: %#018lx\n", bitmap_addr);
+    LOG(PMM, DEBUG, "[PMM] Bitmap size: %lu KB (%lu pages)\n", bitmap_size / 1024, total_pages);
 
     // Mark all pages as used initially (using memset for speed)
     memset(pmm_bitmap, 0xFF, bitmap_size);
@@ -1520,7 +4412,7 @@ static void pmm_mark_region_used(uint64_t base, uint64_t length) {
 }
 
 static void pmm_mark_free_regions(uint64_t multiboot_info_addr) {
-    puts("[PMM] Marking free regions...\n");
+    LOG(PMM, DEBUG, "[PMM] Marking free regions...\n");
 
     struct multiboot_tag *tag = (struct multiboot_tag*)(multiboot_info_addr + 8);
 
@@ -1559,21 +4451,12 @@ static void pmm_mark_free_regions(uint64_t multiboot_info_addr) {
     uint64_t bitmap_end = (uint64_t)pmm_bitmap + bitmap_size;
     uint64_t kernel_size = bitmap_end - kernel_start_addr;
 
-    puts("[PMM] Marking kernel + bitmap as used: ");
-    print_hex_64(kernel_start_addr);
-    puts(" - ");
-    print_hex_64(bitmap_end);
-    puts("\n");
+    LOG(PMM, DEBUG, "[PMM] Marking kernel + bitmap as used: %#018lx - %#018lx\n", kernel_start_addr, bitmap_end);
 
     pmm_mark_region_used(kernel_start_addr, kernel_size);
 
-    puts("[PMM] Free pages: ");
-    print_dec_64(total_pages - used_pages);
-    puts(" / ");
-    print_dec_64(total_pages);
-    puts(" (");
-    print_dec_64((total_pages - used_pages) * 4);
-    puts(" KB free)\n");
+    LOG(PMM, INFO, "[PMM] Free pages: %lu / %lu (%lu KB free)\n",
+        total_pages - used_pages, total_pages, (total_pages - used_pages) * 4);
 }
 
 static uint64_t pmm_alloc_page(void) {
@@ -1581,6 +4464,7 @@ static uint64_t pmm_alloc_page(void) {
         if (!pmm_is_page_used(i)) {
             pmm_mark_page(i);
             used_pages++;
+            BLOG(PMM, TRACE, EV_PMM_ALLOC, i * PAGE_SIZE, used_pages);
             return i * PAGE_SIZE;
         }
     }
@@ -1592,6 +4476,7 @@ static void pmm_free_page(uint64_t phys_addr) {
     if (page_idx < total_pages && pmm_is_page_used(page_idx)) {
         pmm_clear_page(page_idx);
         used_pages--;
+        BLOG(PMM, TRACE, EV_PMM_FREE, phys_addr, used_pages);
     }
 }
 
@@ -1674,7 +4559,7 @@ static void vmm_map_page(uint64_t virt_addr, uint64_t phys_addr, uint64_t flags)
 
         // Clear new PDPT
         uint64_t *pdpt_table = (uint64_t*)PDPT_VIRT_ADDR(pml4_idx);
-        for (int i = 0; i < 512; i++) pdpt_table[i] = 0;
+        memset(pdpt_table, 0, PAGE_SIZE);
     }
 
     // Access/create PDPT entry
@@ -1686,7 +4571,7 @@ static void vmm_map_page(uint64_t virt_addr, uint64_t phys_addr, uint64_t flags)
 
         // Clear new PD
         uint64_t *pd_table = (uint64_t*)PD_VIRT_ADDR(pml4_idx, pdpt_idx);
-        for (int i = 0; i < 512; i++) pd_table[i] = 0;
+        memset(pd_table, 0, PAGE_SIZE);
     }
 
     // Access/create PD entry
@@ -1698,7 +4583,7 @@ static void vmm_map_page(uint64_t virt_addr, uint64_t phys_addr, uint64_t flags)
 
         // Clear new PT
         uint64_t *pt_table = (uint64_t*)PT_VIRT_ADDR(pml4_idx, pdpt_idx, pd_idx);
-        for (int i = 0; i < 512; i++) pt_table[i] = 0;
+        memset(pt_table, 0, PAGE_SIZE);
     }
 
     // Map the page
@@ -1741,6 +4626,7 @@ static void heap_init(void) {
     heap_start = PAGE_ALIGN(bitmap_end);
     heap_current = heap_start;
     heap_end = heap_start + (16 * 1024 * 1024);  // 16MB heap
+    pmm_mark_region_used(heap_start, heap_end - heap_start);
 
     puts("[HEAP] Heap start: ");
     print_hex_64(heap_start);
@@ -1751,16 +4637,17 @@ static void heap_init(void) {
     puts("[HEAP] Kernel heap initialized!\n");
 }
 
-static void *kmalloc(uint64_t size) {
+void *kmalloc(uint64_t size) {
     if (size == 0) return 0;
 
     // Align to 16 bytes
     size = (size + 15) & ~15UL;
 
-    uint64_t addr = heap_current;
-    heap_current += size;
+    // APs allocate too (msg_ring_get)
+    uint64_t addr = __atomic_fetch_add(&heap_current, size, __ATOMIC_RELAXED);
+    BLOG(HEAP, TRACE, EV_HEAP_ALLOC, size, addr);
 
-    if (heap_current >= heap_end) {
+    if (addr + size >= heap_end) {
         puts("[HEAP ERROR] Out of heap memory!\n");
         return 0;
     }
@@ -1768,6 +4655,29 @@ static void *kmalloc(uint64_t size) {
     return (void*)addr;
 }
 
+// align: a power of two
+static void *kmalloc_aligned(uint64_t size, uint64_t align) {
+    uint64_t addr = (uint64_t)kmalloc(size + align - 1);
+    return addr ? (void*)((addr + align - 1) & ~(align - 1)) : 0;
+}
+
+// BSP, before the APs start: make room for 'bytes' more by extending the
+// heap over the free pages right after it. 0 if they are taken.
+static int heap_reserve(uint64_t bytes) {
+    if (heap_current + bytes < heap_end) return 1;
+
+    uint64_t end = PAGE_ALIGN(heap_current + bytes + 1);
+    if (end / PAGE_SIZE > total_pages) return 0;
+    for (uint64_t page = heap_end / PAGE_SIZE; page < end / PAGE_SIZE; page++) {
+        if (pmm_is_page_used(page)) return 0;
+    }
+    pmm_mark_region_used(heap_end, end - heap_end);
+    LOG(HEAP, INFO, "[HEAP] Grown by %lu KB to %lu KB\n",
+        (end - heap_end) >> 10, (end - heap_start) >> 10);
+    heap_end = end;
+    return 1;
+}
+
 static void kfree(void *ptr) {
     // Simple bump allocator doesn't support free
     // In a real OS, use a proper allocator (buddy, slab, etc.)
@@ -1845,10 +4755,146 @@ static void test_heap_allocator(void) {
     puts("[Allocator Test] All tests passed!\n\n");
 }
 
+// ============================================================================
+// PER-CPU DATA
+// ============================================================================
+//
+// Per-CPU tables are heap arrays sized by percpu_init() for the CPUs the
+// MADT lists, so a 4-CPU guest doesn't pay for MAX_CPUS and a 256-CPU one
+// doesn't overflow a fixed table. Tables the BSP writes before the MADT is
+// parsed (console ring, event log, FPU owner, TSC offset) start on a
+// one-slot boot instance that becomes slot 0.
+
+// Zeroed, cache-line aligned array of 'count' elements; 'boot' (if any)
+// is copied into element 0
+static void *percpu_alloc(uint64_t size, uint64_t count, const void *boot) {
+    void *p = kmalloc_aligned(size * count, CACHE_LINE_SIZE);
+    if (!p) {
+        puts("[ERROR] Out of memory for per-CPU data\n");
+        puts("System halted.\n");
+        while (1) __asm__ volatile("hlt");
+    }
+    memset(p, 0, size * count);
+    if (boot) memcpy(p, boot, size);
+    return p;
+}
+
+// BSP, once, after acpi_parse_madt() and before anything runs on an AP
+static void percpu_init(void) {
+    uint64_t n = cpu_count;
+
+    // Everything below plus a few message rings per CPU (msg_ring_get)
+    uint64_t per_cpu = AP_STACK_SIZE + sizeof(struct prof_cpu) + sizeof(struct console_ring) +
+                       sizeof(struct blog_ring) + 2 * BENCH_MAX_ITERS * sizeof(uint64_t) +
+                       2 * sizeof(struct barrier_cpu) + 4 * sizeof(struct msg_ring) + 1024;
+    if (!heap_reserve(n * per_cpu + 2 * n * n * sizeof(uint64_t) + 64 * CACHE_LINE_SIZE)) {
+        LOG(HEAP, WARN, "[HEAP] Can't grow the heap for %lu CPUs\n", n);
+    }
+
+    uint32_t slots = 2;
+    while (slots < 2 * n) slots <<= 1;
+    struct apic_map *map = percpu_alloc(sizeof(struct apic_map) + slots * sizeof(uint64_t), 1, 0);
+    map->mask = slots - 1;
+    memset(map->slots, 0xFF, slots * sizeof(uint64_t));  // APIC_MAP_EMPTY
+    rcu_assign_pointer(apic_map, map);
+
+    ap_stacks = percpu_alloc(AP_STACK_SIZE, n, 0);
+    logical_apic_ids = percpu_alloc(sizeof(uint32_t), n, 0);
+    x2apic_ldrs = percpu_alloc(sizeof(uint32_t), n, 0);
+    timer_ticks = percpu_alloc(sizeof(uint64_t), n, 0);
+    prof_cpus = percpu_alloc(sizeof(struct prof_cpu), n, 0);
+    perf_test_counters = percpu_alloc(sizeof(struct perf_sample), n, 0);
+    perf_test_sum = percpu_alloc(sizeof(struct perf_sample), n, 0);
+
+    // Tests
+    per_cpu_counters = percpu_alloc(sizeof(uint64_t), n, 0);
+    partial_sums = percpu_alloc(sizeof(uint64_t), n, 0);
+    global_barrier.cpu = percpu_alloc(sizeof(struct barrier_cpu), n, 0);
+    rcu_cpus = percpu_alloc(sizeof(struct rcu_cpu), n, 0);
+    rcu_snap = percpu_alloc(sizeof(uint64_t), n, 0);
+    rcu_test_reads = percpu_alloc(sizeof(uint64_t), n, 0);
+
+    // Message rings
+    msg_rings = percpu_alloc(sizeof(struct msg_ring*), n * n, 0);
+    cpu_halt = percpu_alloc(sizeof(struct cpu_halt_flag), n, 0);
+    msg_bench_cycles = percpu_alloc(sizeof(uint64_t), n, 0);
+
+    // Benchmarks
+    bench_dissem_barrier.cpu = percpu_alloc(sizeof(struct barrier_cpu), n, 0);
+    barrier_bench_central = percpu_alloc(sizeof(uint64_t), n + 1, 0);
+    barrier_bench_dissem = percpu_alloc(sizeof(uint64_t), n + 1, 0);
+    c2c_latency = percpu_alloc(sizeof(uint64_t), n * n, 0);
+    coh_packed = percpu_alloc(sizeof(uint64_t), n, 0);
+    coh_padded = percpu_alloc(sizeof(struct coh_line), n, 0);
+    coh_cycles = percpu_alloc(sizeof(uint64_t), n, 0);
+    for (int kind = 0; kind < COH_COUNTER_KINDS; kind++) {
+        coh_counter_cycles[kind] = percpu_alloc(sizeof(uint64_t), n + 1, 0);
+    }
+    ipi_bench_cpus = percpu_alloc(sizeof(struct ipi_bench_cpu), n, 0);
+    ipi_bench_seen = percpu_alloc(sizeof(uint64_t), n, 0);
+    ipi_oneway = percpu_alloc(sizeof(uint64_t), n, 0);
+    ipi_roundtrip = percpu_alloc(sizeof(uint64_t), n, 0);
+    ipi_burst_cycles = percpu_alloc(sizeof(uint64_t), n, 0);
+    ipi_burst_received = percpu_alloc(sizeof(uint64_t), n, 0);
+    bench_samples = percpu_alloc(BENCH_MAX_ITERS * sizeof(uint64_t), n, 0);
+    bench_merged = percpu_alloc(BENCH_MAX_ITERS * sizeof(uint64_t), n, 0);
+    bench_overhead = percpu_alloc(sizeof(uint64_t), n, 0);
+    bench_counters = percpu_alloc(sizeof(uint64_t), n, 0);
+    bench_sink = percpu_alloc(CACHE_LINE_SIZE, n, 0);
+
+    // Already in use on the BSP: switch over last, nothing in between logs
+    struct console_ring *cons = percpu_alloc(sizeof(struct console_ring), n, &console_ring_boot);
+    struct blog_ring *blog = percpu_alloc(sizeof(struct blog_ring), n, &blog_ring_boot);
+    void **owner = percpu_alloc(sizeof(void*), n, 0);
+    void **current = percpu_alloc(sizeof(void*), n, 0);
+    uint64_t *traps = percpu_alloc(sizeof(uint64_t), n, 0);
+    uint64_t *offsets = percpu_alloc(sizeof(uint64_t), n, &tsc_offset_boot);
+    uint64_t irq = irq_save();
+    console_rings = cons;
+    blog_rings = blog;
+    fpu_percpu_init(owner, current, traps, n);
+    tsc_offsets = offsets;
+    percpu_cpus = n;
+    irq_restore(irq);
+
+    LOG(SMP, INFO, "[SMP] Per-CPU data for %lu CPU(s), %lu KB of heap in use\n", n, (heap_current - heap_start) >> 10);
+}
+
+// ============================================================================
+// QEMU EXIT
+// ============================================================================
+//
+// With '-device isa-debug-exit,iobase=0xf4,iosize=0x04' a write to the port
+// ends QEMU with status (value << 1) | 1: 33 = tests passed, 35 = a test
+// failed (tools/bench_runner.py). Without the device the write is ignored.
+
+#ifndef QEMU_EXIT
+#define QEMU_EXIT 1
+#endif
+
+#define QEMU_EXIT_PORT 0xF4
+#define QEMU_EXIT_PASS 0x10
+#define QEMU_EXIT_FAIL 0x11
+
+static void qemu_exit(uint32_t code) {
+#if QEMU_EXIT
+    console_flush();
+    outl(QEMU_EXIT_PORT, code);
+#else
+    (void)code;
+#endif
+}
+
 // Kernel entry
 void kernel_main(uint64_t multiboot_addr) {
     serial_init();
     vga_init();
+    console_init();
+
+    // Enable SSE/AVX state, then pick memcpy/memset variants for it
+    // before the PMM clears its bitmap
+    fpu_init();
+    mem_init();
 
     puts("\n");
     puts("===========================================\n");
@@ -1859,6 +4905,12 @@ void kernel_main(uint64_t multiboot_addr) {
     puts("[INFO] Multiboot2 info at: ");
     print_hex_64(multiboot_addr);
     puts("\n");
+    log_printf("[FPU] XCR0 %#lx (%s), save area %u bytes via %s\n",
+               fpu_xcr0, (fpu_xcr0 & XCR0_AVX512) ? "avx512" : (fpu_xcr0 & XCR0_AVX) ? "avx" : "sse",
+               fpu_area_size, fpu_mode_names[fpu_mode]);
+    log_printf("[MEM] memcpy/memset: %s, >= %lu KB: %s (ERMS %d, FSRM %d, SSE2 %d, AVX2 %d)\n",
+               mem_variants[mem_small].name, MEM_NT_THRESHOLD >> 10, mem_variants[mem_large].name,
+               mem_has_erms, mem_has_fsrm, mem_has_sse2, mem_has_avx2);
 
     // Parse Multiboot2 memory map
     parse_multiboot_mmap(multiboot_addr);
@@ -1873,12 +4925,20 @@ void kernel_main(uint64_t multiboot_addr) {
     // Initialize Kernel Heap
     heap_init();
 
+#if CONSOLE_BACKEND == CONSOLE_VIRTIO
+    // Bulk console output over virtio (PCI is usable from here on)
+    virtio_console_init();
+#endif
+
     // Test heap allocator
     test_heap_allocator();
 
     puts("\n");
 
     puts("[OK] Serial port initialized (COM1)\n");
+    puts("[OK] Console backend: ");
+    puts(console->name);
+    puts("\n");
     puts("[OK] Running in 64-bit long mode\n");
     puts("\n");
 
@@ -1896,6 +4956,10 @@ void kernel_main(uint64_t multiboot_addr) {
     idt_init();
     puts("[IDT] IDT initialized with 32 exception handlers\n");
     puts("[IDT] IDT loaded successfully!\n");
+
+    // Lazy FPU switching goes through #NM, so it needs the IDT
+    int fpu_ok = fpu_selftest();
+    log_printf("[FPU] Lazy switch test: %s\n", fpu_ok ? "PASS" : "FAIL");
     puts("\n");
 
     // TSC Calibration
@@ -1903,7 +4967,10 @@ void kernel_main(uint64_t multiboot_addr) {
     calibrate_tsc();
     puts("[TSC] TSC frequency: ");
     print_dec(tsc_khz);
-    puts(" kHz\n");
+    puts(" kHz (");
+    puts(tsc_khz_source);
+    puts(")\n");
+    clock_init();
 
     // ACPI Detection
     puts("\n[ACPI] Searching for RSDP...\n");
@@ -1934,8 +5001,19 @@ void kernel_main(uint64_t multiboot_addr) {
     print_dec(cpu_count);
     puts(" CPU(s)\n");
 
+    // Per-CPU tables for that many CPUs (this_cpu() needs them)
+    percpu_init();
+
     // Initialize Local APIC
     apic_init();
+    cpu_register(0);
+
+    // Performance counters (APs program theirs in ap_entry)
+    perf_detect();
+    perf_cpu_init();
+
+    // RCU state must be ready before APs start using it
+    rcu_init();
 
     // Setup trampoline
     setup_trampoline();
@@ -1998,6 +5076,12 @@ void kernel_main(uint64_t multiboot_addr) {
 
     puts("[TIMER] BSP timer started successfully!\n");
 
+    // Ticks now report quiescent states for the BSP
+    rcu_cpu_online(0);
+
+    // Every CPU's ticks sample from here on
+    prof_on = 1;
+
     // AP timers will be started in ap_entry() now that we have proper VMM
     puts("\n[INFO] APs will initialize their timers in parallel...\n");
 
@@ -2018,6 +5102,9 @@ void kernel_main(uint64_t multiboot_addr) {
     // BSP (CPU 0) runs tests too!
     puts("[TEST] BSP running tests...\n");
 
+    // Measure AP TSC offsets for clock_monotonic_ns()
+    clock_sync(0);
+
     // Test 1: Parallel counters
     test_parallel_counters(0);
     barrier_wait(0);  // Sync with APs
@@ -2031,6 +5118,30 @@ void kernel_main(uint64_t multiboot_addr) {
     barrier_wait(0);  // Everyone resets together
     test_barrier_sync(0);
 
+    // Test 4: RCU
+    test_rcu(0);
+
+    // Test 5: Monotonic clock
+    test_clock(0);
+
+    // Test 6: Multicast IPIs
+    test_ipi_mask(0);
+
+    // Benchmark: barrier latency
+    bench_barriers(0);
+
+    // Benchmark: message rings
+    bench_msg_rings(0);
+
+    // Benchmark: cache-line transfers
+    bench_coherence(0);
+
+    // Benchmark: IPIs
+    bench_ipi(0);
+
+    // Registered microbenchmarks (one JSON line each)
+    bench_run_all(0);
+
     puts("[TEST] All tests completed!\n");
 
     // ========================================================================
@@ -2113,16 +5224,246 @@ void kernel_main(uint64_t multiboot_addr) {
         puts("  [FAIL] Some CPUs didn't reach barrier\n");
     }
 
+    // Test 4: RCU
+    puts("\nTEST 4: RCU Read-Mostly Table\n");
+    puts("------------------------------\n");
+    puts("  Updates: ");
+    print_dec(RCU_TEST_UPDATES);
+    puts(" (avg ");
+    print_dec_64(rcu_test_grace_cycles);
+    puts(" cycles each, incl. grace period)\n");
+    for (int i = 1; i < cpu_count; i++) {
+        puts("  CPU ");
+        print_dec(i);
+        puts(": ");
+        print_dec_64(rcu_test_reads[i]);
+        puts(" lock-free reads\n");
+    }
+
+    int rcu_ok = (rcu_test_errors == 0);
+    if (rcu_ok) {
+        puts("  [OK] No reader saw a torn or reclaimed table\n");
+    } else {
+        puts("  [FAIL] ");
+        print_dec_64(rcu_test_errors);
+        puts(" bad reads\n");
+    }
+
+    // Test 5: Monotonic clock
+    puts("\nTEST 5: Monotonic Clock\n");
+    puts("-----------------------\n");
+    puts("  TSC: ");
+    print_dec_64(tsc_khz);
+    puts(" kHz (");
+    puts(tsc_khz_source);
+    puts("), CPU lookup via ");
+    puts(has_rdtscp ? "rdtscp\n" : "APIC ID\n");
+    for (int i = 1; i < cpu_count; i++) {
+        puts("  CPU ");
+        print_dec(i);
+        puts(" TSC offset: ");
+        if (tsc_offsets[i] >> 63) {
+            puts("-");
+            print_dec_64(-tsc_offsets[i]);
+        } else {
+            print_dec_64(tsc_offsets[i]);
+        }
+        puts(" cycles\n");
+    }
+    puts("  clock_monotonic_ns(): ");
+    print_dec_64(clock_read_cycles);
+    puts(" cycles per read, now ");
+    print_dec_64(clock_monotonic_ns() / 1000000);
+    puts(" ms since boot\n");
+
+    int clock_ok = (clock_test_max_backstep <= CLOCK_SKEW_TOLERANCE_NS);
+    if (clock_test_backsteps == 0) {
+        puts("  [OK] Time never went backwards across CPUs\n");
+    } else {
+        puts(clock_ok ? "  [OK] " : "  [FAIL] ");
+        print_dec_64(clock_test_backsteps);
+        puts(" backward steps across CPUs (max ");
+        print_dec_64(clock_test_max_backstep);
+        puts(" ns)\n");
+    }
+
+    // Test 6: Multicast IPIs
+    log_printf("\nTEST 6: Multicast IPIs (%s)\n", use_x2apic ? "x2APIC, cluster mode available" : "xAPIC");
+    puts("----------------------------------------------\n");
+    int ipi_mask_ok = (ipi_mask_errors == 0);
+    if (ipi_mask_ok) {
+        puts("  [OK] Every mask reached exactly its CPUs, by every method\n");
+    } else {
+        log_printf("  [FAIL] %lu CPUs missed or hit wrongly\n", ipi_mask_errors);
+    }
+
     // Final status
     puts("\n");
     puts("===========================================\n");
-    if (total_sum == expected_sum && barrier_ok) {
+    if (total_sum == expected_sum && barrier_ok && rcu_ok && clock_ok && ipi_mask_ok) {
         puts("[SUCCESS] All parallel tests passed!\n");
     } else {
         puts("[WARNING] Some tests failed\n");
     }
     puts("===========================================\n");
 
+    // Hardware counters around tests 1-2
+    puts("\nPERF: Tests 1-2 per CPU (");
+    puts(perf_version ? "PMU" : "no PMU, TSC only");
+    puts(")\n");
+    puts("------------------------------\n");
+    for (int i = 0; i < cpu_count; i++) {
+        log_printf("  CPU %d counters: ", i);
+        perf_print(&perf_test_counters[i]);
+        log_printf("  CPU %d sum:      ", i);
+        perf_print(&perf_test_sum[i]);
+    }
+
+    // Barrier benchmark
+    puts("\nBENCH: Barrier Latency (TSC cycles per episode)\n");
+    puts("------------------------------------------------\n");
+    for (int n = 1; n <= cpu_count; n = bench_next_cpu_count(n)) {
+        puts("  ");
+        print_dec(n);
+        puts(" CPU(s): central ");
+        print_dec_64(barrier_bench_central[n]);
+        puts(", dissemination ");
+        print_dec_64(barrier_bench_dissem[n]);
+        puts("\n");
+    }
+
+    // Message ring benchmark
+    if (cpu_count >= 2) {
+        puts("\nBENCH: Message Rings (SPSC, batch of ");
+        print_dec(MSG_BENCH_BATCH);
+        puts(")\n");
+        puts("----------------------------------------\n");
+        puts("  Throughput (each CPU -> right neighbour):\n");
+        for (int i = 0; i < cpu_count; i++) {
+            puts("    CPU ");
+            print_dec(i);
+            puts(": ");
+            print_dec_64(msg_bench_cycles[i]);
+            puts(" cycles/msg");
+            if (msg_bench_cycles[i]) {
+                puts(" (~");
+                print_dec_64(tsc_khz / msg_bench_cycles[i]);
+                puts(" K msg/s)");
+            }
+            puts("\n");
+        }
+        puts("  One-way latency, polling:  ");
+        print_dec_64(msg_bench_pingpong);
+        puts(" cycles\n");
+        puts("  One-way latency, doorbell: ");
+        print_dec_64(msg_bench_doorbell);
+        puts(" cycles (");
+        print_dec_64(doorbell_irqs);
+        puts(" IPIs)\n");
+        if (msg_bench_errors == 0) {
+            puts("  [OK] All messages delivered in order\n");
+        } else {
+            puts("  [FAIL] ");
+            print_dec_64(msg_bench_errors);
+            puts(" messages lost or out of order\n");
+        }
+    }
+
+    // Cache-coherence benchmark
+    if (cpu_count >= 2) {
+        log_printf("\nBENCH: Core-to-Core Latency (one-way TSC cycles, %u round trips)\n", C2C_ROUNDS);
+        puts("---------------------------------------------------------\n");
+        puts("  CPU");
+        for (int b = 0; b < cpu_count; b++) log_printf(" %6d", b);
+        puts("\n");
+        for (int a = 0; a < cpu_count; a++) {
+            log_printf("  %3d", a);
+            for (int b = 0; b < cpu_count; b++) {
+                if (a == b) puts("      -");
+                else log_printf(" %6lu", c2c_latency[a * cpu_count + b]);
+            }
+            puts("\n");
+        }
+        // Whole matrix on one line for placement tools (0 on the diagonal)
+        log_printf("{\"matrix\":\"c2c_latency\",\"unit\":\"tsc_cycles\",\"rounds\":%u,\"cpus\":%d,\"rows\":[",
+                   C2C_ROUNDS, cpu_count);
+        for (int a = 0; a < cpu_count; a++) {
+            puts(a ? ",[" : "[");
+            for (int b = 0; b < cpu_count; b++) log_printf("%s%lu", b ? "," : "", c2c_latency[a * cpu_count + b]);
+            puts("]");
+        }
+        puts("]}\n");
+    }
+
+    log_printf("\nBENCH: Counters (cycles/increment on the slowest CPU, total M/s; %u each)\n",
+               COH_COUNTER_ITERS);
+    puts("------------------------------------------------------------------------\n");
+    for (int n = 1; n <= cpu_count; n = bench_next_cpu_count(n)) {
+        log_printf("  %2d CPU(s):", n);
+        for (int kind = 0; kind < COH_COUNTER_KINDS; kind++) {
+            uint64_t cycles = coh_counter_cycles[kind][n];
+            uint64_t tenths = cycles * 10 / COH_COUNTER_ITERS;
+            log_printf("  %s %3lu.%lu (%5lu M/s)", coh_counter_names[kind], tenths / 10, tenths % 10,
+                       cycles ? (uint64_t)n * COH_COUNTER_ITERS * tsc_khz / cycles / 1000 : 0);
+        }
+        puts("\n");
+    }
+    if (coh_errors == 0) {
+        puts("  [OK] Shared counter reached n x iterations every run\n");
+    } else {
+        log_printf("  [FAIL] Shared counter lost increments in %lu runs\n", coh_errors);
+    }
+
+    log_printf("\nBENCH: Atomics (cycles/op on the slowest of %d CPUs)\n", cpu_count);
+    puts("------------------------------------------------\n");
+    puts("  op             private   shared\n");
+    for (int op = 0; op < COH_ATOMIC_OPS; op++) {
+        uint64_t priv = coh_atomic_cycles[0][op] * 10 / COH_ATOMIC_ITERS;
+        uint64_t shared = coh_atomic_cycles[1][op] * 10 / COH_ATOMIC_ITERS;
+        uint32_t len = 0;
+        while (coh_atomic_names[op][len]) len++;
+        puts("  ");
+        puts(coh_atomic_names[op]);
+        for (; len < 14; len++) putc(' ');
+        log_printf(" %5lu.%lu %6lu.%lu\n", priv / 10, priv % 10, shared / 10, shared % 10);
+    }
+
+    // IPI benchmark
+    if (cpu_count >= 2) {
+        log_printf("\nBENCH: IPIs (%s, TSC cycles, %u rounds)\n", use_x2apic ? "x2APIC" : "xAPIC",
+                   IPI_BENCH_ROUNDS);
+        puts("-------------------------------------------\n");
+        puts("  CPU  one-way  round-trip\n");
+        for (int cpu = 1; cpu < cpu_count; cpu++) {
+            log_printf("  %3d %8lu %11lu\n", cpu, ipi_oneway[cpu], ipi_roundtrip[cpu]);
+        }
+        static const char *const method_names[] = { "auto", "shorthand", "cluster", "unicast" };
+        log_printf("  Reach the other %d CPUs (send_ipi_mask_via):\n", cpu_count - 1);
+        for (int method = IPI_SHORTHAND; method <= IPI_UNICAST; method++) {
+            if (ipi_fanout_writes[method] == 0) {
+                log_printf("    %s: not usable here\n", method_names[method]);
+                continue;
+            }
+            log_printf("    %s: %u ICR write(s), send %lu, done %lu\n", method_names[method],
+                       ipi_fanout_writes[method], ipi_fanout_send[method], ipi_fanout_done[method]);
+        }
+        log_printf("  Throughput (each CPU -> right neighbour, %u sends):\n", IPI_BENCH_BURST);
+        for (int cpu = 0; cpu < cpu_count; cpu++) {
+            uint64_t cycles = ipi_burst_cycles[cpu];
+            log_printf("    CPU %d: %lu cycles/IPI (~%lu K IPI/s), %lu handled by CPU %d\n", cpu,
+                       cycles / IPI_BENCH_BURST, cycles ? IPI_BENCH_BURST * tsc_khz / cycles : 0,
+                       ipi_burst_received[(cpu + 1) % cpu_count], (cpu + 1) % cpu_count);
+        }
+        if (ipi_bench_timeouts == 0) {
+            puts("  [OK] Every IPI arrived\n");
+        } else {
+            log_printf("  [FAIL] %lu IPIs never arrived\n", ipi_bench_timeouts);
+        }
+    }
+
+    // Memory primitive bandwidth (BSP only)
+    bench_mem_bandwidth();
+
     // ========================================================================
     // TIMER TEST: Display timer ticks
     // ========================================================================
@@ -2194,6 +5535,20 @@ void kernel_main(uint64_t multiboot_addr) {
     puts("\n");
     puts("System halted successfully.\n");
 
+    // Binary log records for tools/blog_decode.py
+    blog_dump();
+
+    // Profiler samples for tools/prof_fold.py
+    prof_dump();
+
+    // Verdict for the host runner, then leave QEMU if it has the exit device
+    int all_ok = total_sum == expected_sum && barrier_ok && rcu_ok && clock_ok && ipi_mask_ok &&
+                 msg_bench_errors == 0 && coh_errors == 0 && ipi_bench_timeouts == 0 &&
+                 total_ticks > 0 && fpu_ok;
+    log_printf("@RESULT %s\n", all_ok ? "pass" : "fail");
+    console_flush();
+    qemu_exit(all_ok ? QEMU_EXIT_PASS : QEMU_EXIT_FAIL);
+
     while (1) {
         __asm__ volatile("hlt");
     }
@@ -0,0 +1,688 @@
+// Memory primitives and FPU/SIMD register state, shared by the C kernel
+// (c/kernel/minimal_step9.c) and the hybrid bootstrap (hybrid/boot/init.c).
+// Interface and what each kernel provides: simd.h.
+
+#include "simd.h"
+
+static inline void cpuid_count(uint32_t leaf, uint32_t subleaf,
+                               uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx) {
+    __asm__ volatile("cpuid"
+                     : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+                     : "a"(leaf), "c"(subleaf));
+}
+
+static inline void cpuid(uint32_t leaf, uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx) {
+    cpuid_count(leaf, 0, eax, ebx, ecx, edx);
+}
+
+static inline uint64_t irq_save(void) {
+    uint64_t flags;
+    __asm__ volatile("pushfq; pop %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void irq_restore(uint64_t flags) {
+    if (flags & 0x200) __asm__ volatile("sti" ::: "memory");
+}
+
+// ============================================================================
+// MEMORY PRIMITIVES
+// ============================================================================
+//
+// memcpy()/memset() go through pointers that mem_init() sets once from CPUID:
+// rep movsb/stosb when the CPU has fast strings (ERMS/FSRM), AVX2 or SSE2
+// loops otherwise, and non-temporal stores from MEM_NT_THRESHOLD up so bulk
+// copies and clears do not evict the whole cache. A SIMD variant is only
+// picked when its register state is enabled (CR4.OSFXSR, XCR0). Before
+// mem_init() the rep movsq/stosq variants run - they work on any x86-64.
+// With interrupts off only the string variants run: an interrupt handler
+// must not touch the vector registers of the code it interrupted.
+//
+// The variants are plain SysV functions in assembly: code built with
+// -mno-sse cannot name vector registers in inline asm.
+
+#define CR4_OSFXSR (1UL << 9)
+
+void *mem_copy_rep(void *dest, const void *src, uint64_t n);
+void *mem_copy_erms(void *dest, const void *src, uint64_t n);
+void *mem_copy_sse2(void *dest, const void *src, uint64_t n);
+void *mem_copy_sse2_nt(void *dest, const void *src, uint64_t n);
+void *mem_copy_avx2(void *dest, const void *src, uint64_t n);
+void *mem_copy_avx2_nt(void *dest, const void *src, uint64_t n);
+void *mem_set_rep(void *dest, int val, uint64_t n);
+void *mem_set_erms(void *dest, int val, uint64_t n);
+void *mem_set_sse2(void *dest, int val, uint64_t n);
+void *mem_set_sse2_nt(void *dest, int val, uint64_t n);
+void *mem_set_avx2(void *dest, int val, uint64_t n);
+void *mem_set_avx2_nt(void *dest, int val, uint64_t n);
+
+// rdi = dest, rsi = src (or fill byte), rdx = n; every variant returns dest.
+// Tails and non-temporal alignment heads use rep movsb/stosb.
+__asm__(
+    ".pushsection .text\n"
+
+    // 8 bytes at a time, then the 0-7 byte tail
+    ".global mem_copy_rep\n"
+    "mem_copy_rep:\n"
+    "    mov %rdi, %rax\n"
+    "    mov %rdx, %rcx\n"
+    "    shr $3, %rcx\n"
+    "    rep movsq\n"
+    "    mov %rdx, %rcx\n"
+    "    and $7, %rcx\n"
+    "    rep movsb\n"
+    "    ret\n"
+
+    ".global mem_copy_erms\n"
+    "mem_copy_erms:\n"
+    "    mov %rdi, %rax\n"
+    "    mov %rdx, %rcx\n"
+    "    rep movsb\n"
+    "    ret\n"
+
+    ".global mem_copy_sse2\n"
+    "mem_copy_sse2:\n"
+    "    mov %rdi, %rax\n"
+    "    cmp $64, %rdx\n"
+    "    jb .Lcopy_sse2_tail\n"
+    ".Lcopy_sse2_loop:\n"
+    "    movdqu (%rsi), %xmm0\n"
+    "    movdqu 16(%rsi), %xmm1\n"
+    "    movdqu 32(%rsi), %xmm2\n"
+    "    movdqu 48(%rsi), %xmm3\n"
+    "    movdqu %xmm0, (%rdi)\n"
+    "    movdqu %xmm1, 16(%rdi)\n"
+    "    movdqu %xmm2, 32(%rdi)\n"
+    "    movdqu %xmm3, 48(%rdi)\n"
+    "    add $64, %rsi\n"
+    "    add $64, %rdi\n"
+    "    sub $64, %rdx\n"
+    "    cmp $64, %rdx\n"
+    "    jae .Lcopy_sse2_loop\n"
+    ".Lcopy_sse2_tail:\n"
+    "    mov %rdx, %rcx\n"
+    "    rep movsb\n"
+    "    ret\n"
+
+    // Align dest to 16, stream 64-byte blocks past the caches
+    ".global mem_copy_sse2_nt\n"
+    "mem_copy_sse2_nt:\n"
+    "    mov %rdi, %rax\n"
+    "    mov %rdi, %rcx\n"
+    "    neg %rcx\n"
+    "    and $15, %rcx\n"
+    "    cmp %rcx, %rdx\n"
+    "    jb .Lcopy_sse2_nt_tail\n"
+    "    sub %rcx, %rdx\n"
+    "    rep movsb\n"
+    "    cmp $64, %rdx\n"
+    "    jb .Lcopy_sse2_nt_tail\n"
+    ".Lcopy_sse2_nt_loop:\n"
+    "    movdqu (%rsi), %xmm0\n"
+    "    movdqu 16(%rsi), %xmm1\n"
+    "    movdqu 32(%rsi), %xmm2\n"
+    "    movdqu 48(%rsi), %xmm3\n"
+    "    movntdq %xmm0, (%rdi)\n"
+    "    movntdq %xmm1, 16(%rdi)\n"
+    "    movntdq %xmm2, 32(%rdi)\n"
+    "    movntdq %xmm3, 48(%rdi)\n"
+    "    add $64, %rsi\n"
+    "    add $64, %rdi\n"
+    "    sub $64, %rdx\n"
+    "    cmp $64, %rdx\n"
+    "    jae .Lcopy_sse2_nt_loop\n"
+    "    sfence\n"
+    ".Lcopy_sse2_nt_tail:\n"
+    "    mov %rdx, %rcx\n"
+    "    rep movsb\n"
+    "    ret\n"
+
+    ".global mem_copy_avx2\n"
+    "mem_copy_avx2:\n"
+    "    mov %rdi, %rax\n"
+    "    cmp $128, %rdx\n"
+    "    jb .Lcopy_avx2_tail\n"
+    ".Lcopy_avx2_loop:\n"
+    "    vmovdqu (%rsi), %ymm0\n"
+    "    vmovdqu 32(%rsi), %ymm1\n"
+    "    vmovdqu 64(%rsi), %ymm2\n"
+    "    vmovdqu 96(%rsi), %ymm3\n"
+    "    vmovdqu %ymm0, (%rdi)\n"
+    "    vmovdqu %ymm1, 32(%rdi)\n"
+    "    vmovdqu %ymm2, 64(%rdi)\n"
+    "    vmovdqu %ymm3, 96(%rdi)\n"
+    "    add $128, %rsi\n"
+    "    add $128, %rdi\n"
+    "    sub $128, %rdx\n"
+    "    cmp $128, %rdx\n"
+    "    jae .Lcopy_avx2_loop\n"
+    "    vzeroupper\n"
+    ".Lcopy_avx2_tail:\n"
+    "    mov %rdx, %rcx\n"
+    "    rep movsb\n"
+    "    ret\n"
+
+    ".global mem_copy_avx2_nt\n"
+    "mem_copy_avx2_nt:\n"
+    "    mov %rdi, %rax\n"
+    "    mov %rdi, %rcx\n"
+    "    neg %rcx\n"
+    "    and $31, %rcx\n"
+    "    cmp %rcx, %rdx\n"
+    "    jb .Lcopy_avx2_nt_tail\n"
+    "    sub %rcx, %rdx\n"
+    "    rep movsb\n"
+    "    cmp $128, %rdx\n"
+    "    jb .Lcopy_avx2_nt_tail\n"
+    ".Lcopy_avx2_nt_loop:\n"
+    "    vmovdqu (%rsi), %ymm0\n"
+    "    vmovdqu 32(%rsi), %ymm1\n"
+    "    vmovdqu 64(%rsi), %ymm2\n"
+    "    vmovdqu 96(%rsi), %ymm3\n"
+    "    vmovntdq %ymm0, (%rdi)\n"
+    "    vmovntdq %ymm1, 32(%rdi)\n"
+    "    vmovntdq %ymm2, 64(%rdi)\n"
+    "    vmovntdq %ymm3, 96(%rdi)\n"
+    "    add $128, %rsi\n"
+    "    add $128, %rdi\n"
+    "    sub $128, %rdx\n"
+    "    cmp $128, %rdx\n"
+    "    jae .Lcopy_avx2_nt_loop\n"
+    "    sfence\n"
+    "    vzeroupper\n"
+    ".Lcopy_avx2_nt_tail:\n"
+    "    mov %rdx, %rcx\n"
+    "    rep movsb\n"
+    "    ret\n"
+
+    // Fill byte replicated into all 8 bytes of rax
+    ".global mem_set_rep\n"
+    "mem_set_rep:\n"
+    "    mov %rdi, %r9\n"
+    "    movzbl %sil, %eax\n"
+    "    movabs $0x0101010101010101, %r8\n"
+    "    imul %r8, %rax\n"
+    "    mov %rdx, %rcx\n"
+    "    shr $3, %rcx\n"
+    "    rep stosq\n"
+    "    mov %rdx, %rcx\n"
+    "    and $7, %rcx\n"
+    "    rep stosb\n"
+    "    mov %r9, %rax\n"
+    "    ret\n"
+
+    ".global mem_set_erms\n"
+    "mem_set_erms:\n"
+    "    mov %rdi, %r9\n"
+    "    movzbl %sil, %eax\n"
+    "    mov %rdx, %rcx\n"
+    "    rep stosb\n"
+    "    mov %r9, %rax\n"
+    "    ret\n"
+
+    ".global mem_set_sse2\n"
+    "mem_set_sse2:\n"
+    "    mov %rdi, %r9\n"
+    "    movzbl %sil, %eax\n"
+    "    movabs $0x0101010101010101, %r8\n"
+    "    imul %r8, %rax\n"
+    "    cmp $64, %rdx\n"
+    "    jb .Lset_sse2_tail\n"
+    "    movq %rax, %xmm0\n"
+    "    punpcklqdq %xmm0, %xmm0\n"
+    ".Lset_sse2_loop:\n"
+    "    movdqu %xmm0, (%rdi)\n"
+    "    movdqu %xmm0, 16(%rdi)\n"
+    "    movdqu %xmm0, 32(%rdi)\n"
+    "    movdqu %xmm0, 48(%rdi)\n"
+    "    add $64, %rdi\n"
+    "    sub $64, %rdx\n"
+    "    cmp $64, %rdx\n"
+    "    jae .Lset_sse2_loop\n"
+    ".Lset_sse2_tail:\n"
+    "    mov %rdx, %rcx\n"
+    "    rep stosb\n"
+    "    mov %r9, %rax\n"
+    "    ret\n"
+
+    ".global mem_set_sse2_nt\n"
+    "mem_set_sse2_nt:\n"
+    "    mov %rdi, %r9\n"
+    "    movzbl %sil, %eax\n"
+    "    movabs $0x0101010101010101, %r8\n"
+    "    imul %r8, %rax\n"
+    "    mov %rdi, %rcx\n"
+    "    neg %rcx\n"
+    "    and $15, %rcx\n"
+    "    cmp %rcx, %rdx\n"
+    "    jb .Lset_sse2_nt_tail\n"
+    "    sub %rcx, %rdx\n"
+    "    rep stosb\n"
+    "    cmp $64, %rdx\n"
+    "    jb .Lset_sse2_nt_tail\n"
+    "    movq %rax, %xmm0\n"
+    "    punpcklqdq %xmm0, %xmm0\n"
+    ".Lset_sse2_nt_loop:\n"
+    "    movntdq %xmm0, (%rdi)\n"
+    "    movntdq %xmm0, 16(%rdi)\n"
+    "    movntdq %xmm0, 32(%rdi)\n"
+    "    movntdq %xmm0, 48(%rdi)\n"
+    "    add $64, %rdi\n"
+    "    sub $64, %rdx\n"
+    "    cmp $64, %rdx\n"
+    "    jae .Lset_sse2_nt_loop\n"
+    "    sfence\n"
+    ".Lset_sse2_nt_tail:\n"
+    "    mov %rdx, %rcx\n"
+    "    rep stosb\n"
+    "    mov %r9, %rax\n"
+    "    ret\n"
+
+    ".global mem_set_avx2\n"
+    "mem_set_avx2:\n"
+    "    mov %rdi, %r9\n"
+    "    movzbl %sil, %eax\n"
+    "    cmp $128, %rdx\n"
+    "    jb .Lset_avx2_tail\n"
+    "    vmovd %eax, %xmm0\n"
+    "    vpbroadcastb %xmm0, %ymm0\n"
+    ".Lset_avx2_loop:\n"
+    "    vmovdqu %ymm0, (%rdi)\n"
+    "    vmovdqu %ymm0, 32(%rdi)\n"
+    "    vmovdqu %ymm0, 64(%rdi)\n"
+    "    vmovdqu %ymm0, 96(%rdi)\n"
+    "    add $128, %rdi\n"
+    "    sub $128, %rdx\n"
+    "    cmp $128, %rdx\n"
+    "    jae .Lset_avx2_loop\n"
+    "    vzeroupper\n"
+    ".Lset_avx2_tail:\n"
+    "    mov %rdx, %rcx\n"
+    "    rep stosb\n"
+    "    mov %r9, %rax\n"
+    "    ret\n"
+
+    ".global mem_set_avx2_nt\n"
+    "mem_set_avx2_nt:\n"
+    "    mov %rdi, %r9\n"
+    "    movzbl %sil, %eax\n"
+    "    mov %rdi, %rcx\n"
+    "    neg %rcx\n"
+    "    and $31, %rcx\n"
+    "    cmp %rcx, %rdx\n"
+    "    jb .Lset_avx2_nt_tail\n"
+    "    sub %rcx, %rdx\n"
+    "    rep stosb\n"
+    "    cmp $128, %rdx\n"
+    "    jb .Lset_avx2_nt_tail\n"
+    "    vmovd %eax, %xmm0\n"
+    "    vpbroadcastb %xmm0, %ymm0\n"
+    ".Lset_avx2_nt_loop:\n"
+    "    vmovntdq %ymm0, (%rdi)\n"
+    "    vmovntdq %ymm0, 32(%rdi)\n"
+    "    vmovntdq %ymm0, 64(%rdi)\n"
+    "    vmovntdq %ymm0, 96(%rdi)\n"
+    "    add $128, %rdi\n"
+    "    sub $128, %rdx\n"
+    "    cmp $128, %rdx\n"
+    "    jae .Lset_avx2_nt_loop\n"
+    "    sfence\n"
+    "    vzeroupper\n"
+    ".Lset_avx2_nt_tail:\n"
+    "    mov %rdx, %rcx\n"
+    "    rep stosb\n"
+    "    mov %r9, %rax\n"
+    "    ret\n"
+
+    ".popsection\n"
+);
+
+const struct mem_variant mem_variants[MEM_VARIANTS] = {
+    [MEM_REP]     = { "rep",     mem_copy_rep,     mem_set_rep,     MEM_NEEDS_NONE },
+    [MEM_ERMS]    = { "erms",    mem_copy_erms,    mem_set_erms,    MEM_NEEDS_NONE },
+    [MEM_SSE2]    = { "sse2",    mem_copy_sse2,    mem_set_sse2,    MEM_NEEDS_SSE2 },
+    [MEM_SSE2_NT] = { "sse2_nt", mem_copy_sse2_nt, mem_set_sse2_nt, MEM_NEEDS_SSE2 },
+    [MEM_AVX2]    = { "avx2",    mem_copy_avx2,    mem_set_avx2,    MEM_NEEDS_AVX2 },
+    [MEM_AVX2_NT] = { "avx2_nt", mem_copy_avx2_nt, mem_set_avx2_nt, MEM_NEEDS_AVX2 },
+};
+
+// Set by mem_init()
+int mem_has_erms, mem_has_fsrm, mem_has_sse2, mem_has_avx2;
+uint32_t mem_small = MEM_REP;
+uint32_t mem_large = MEM_REP;
+static mem_copy_fn mem_copy = mem_copy_rep;
+static mem_copy_fn mem_copy_large = mem_copy_rep;
+static mem_set_fn mem_set = mem_set_rep;
+static mem_set_fn mem_set_large = mem_set_rep;
+static mem_copy_fn mem_copy_irqoff = mem_copy_rep;
+static mem_set_fn mem_set_irqoff = mem_set_rep;
+
+int mem_variant_usable(uint32_t v) {
+    switch (mem_variants[v].needs) {
+    case MEM_NEEDS_SSE2: return mem_has_sse2;
+    case MEM_NEEDS_AVX2: return mem_has_avx2;
+    default:             return 1;
+    }
+}
+
+static inline int irqs_enabled(void) {
+    uint64_t flags;
+    __asm__ volatile("pushfq; pop %0" : "=r"(flags));
+    return (flags & 0x200) != 0;
+}
+
+void *memcpy(void *dest, const void *src, uint64_t n) {
+    if (!irqs_enabled()) return mem_copy_irqoff(dest, src, n);
+    return (n >= MEM_NT_THRESHOLD ? mem_copy_large : mem_copy)(dest, src, n);
+}
+
+void *memset(void *dest, int val, uint64_t n) {
+    if (!irqs_enabled()) return mem_set_irqoff(dest, val, n);
+    return (n >= MEM_NT_THRESHOLD ? mem_set_large : mem_set)(dest, val, n);
+}
+
+// Overlap-safe: forward unless dest starts inside src, then backwards -
+// with interrupts off, since DF stays set for the whole copy
+void *memmove(void *dest, const void *src, uint64_t n) {
+    uint8_t *d = (uint8_t*)dest;
+    const uint8_t *s = (const uint8_t*)src;
+    if (d <= s || d >= s + n) return memcpy(dest, src, n);
+
+    d += n - 1;
+    s += n - 1;
+    uint64_t flags = irq_save();
+    __asm__ volatile("std\n\trep movsb\n\tcld" : "+D"(d), "+S"(s), "+c"(n) : : "memory");
+    irq_restore(flags);
+    return dest;
+}
+
+// BSP, once, after fpu_init(): probe the CPU and the enabled register
+// state, pick variants
+void mem_init(void) {
+    uint32_t max_leaf, eax, ebx, ecx, edx;
+    uint64_t cr4;
+
+    cpuid(0, &max_leaf, &ebx, &ecx, &edx);
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+    mem_has_sse2 = (edx & (1 << 26)) && (cr4 & CR4_OSFXSR);
+
+    // AVX needs OSXSAVE and the XMM+YMM bits in XCR0
+    int os_avx = 0;
+    if ((ecx & (1 << 27)) && (ecx & (1 << 28))) {
+        uint32_t xcr0_lo, xcr0_hi;
+        __asm__ volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+        os_avx = (xcr0_lo & 6) == 6;
+    }
+
+    if (max_leaf >= 7) {
+        cpuid(7, &eax, &ebx, &ecx, &edx);
+        mem_has_erms = (ebx >> 9) & 1;
+        mem_has_fsrm = (edx >> 4) & 1;
+        mem_has_avx2 = ((ebx >> 5) & 1) && os_avx;
+    }
+
+    // Cache-resident sizes: fast strings if the CPU has them, else the
+    // widest vectors. Bulk sizes: non-temporal stores.
+    if (mem_has_erms || mem_has_fsrm) {
+        mem_small = MEM_ERMS;
+    } else if (mem_has_avx2) {
+        mem_small = MEM_AVX2;
+    } else if (mem_has_sse2) {
+        mem_small = MEM_SSE2;
+    }
+    if (mem_has_avx2) {
+        mem_large = MEM_AVX2_NT;
+    } else if (mem_has_sse2) {
+        mem_large = MEM_SSE2_NT;
+    } else {
+        mem_large = mem_small;
+    }
+
+    mem_copy = mem_variants[mem_small].copy;
+    mem_set = mem_variants[mem_small].set;
+    mem_copy_large = mem_variants[mem_large].copy;
+    mem_set_large = mem_variants[mem_large].set;
+    if (mem_has_erms || mem_has_fsrm) {
+        mem_copy_irqoff = mem_copy_erms;
+        mem_set_irqoff = mem_set_erms;
+    }
+}
+
+// ============================================================================
+// FPU / SIMD STATE
+// ============================================================================
+//
+// fpu_init_cpu() runs on every CPU before anything there touches a vector
+// register: x87 and SSE always, AVX and AVX-512 when CPUID reports them
+// (CR4.OSXSAVE plus XCR0). fpu_init() decides XCR0 once on the BSP, sizes
+// the save area from CPUID leaf 0xD and picks XSAVEOPT, XSAVE, or FXSAVE on
+// CPUs without XSAVE.
+//
+// Each thread owns an area from fpu_state_alloc(). Switching is lazy:
+// fpu_switch() only sets CR0.TS, and the thread's first vector instruction
+// traps to #NM, which saves the registers to their owner's area and loads
+// the thread's. A thread that never uses SIMD costs nothing, and XSAVEOPT
+// skips the components that did not change since they were loaded.
+//
+// Both kernels build their C without compiler-generated SIMD
+// (-mgeneral-regs-only, -mno-sse), so interrupt handlers leave the vector
+// registers alone (memcpy()/memset() included, see above).
+
+#define CR0_MP          (1UL << 1)
+#define CR0_EM          (1UL << 2)
+#define CR0_TS          (1UL << 3)
+#define CR0_NE          (1UL << 5)
+#define CR4_OSXMMEXCPT  (1UL << 10)
+#define CR4_OSXSAVE     (1UL << 18)
+
+#define FPU_LEGACY_SIZE 512             // FXSAVE image; the XSAVE header follows
+#define FPU_ALIGN       64
+
+const char *const fpu_mode_names[] = { "fxsave", "xsave", "xsaveopt" };
+
+uint64_t fpu_xcr0;
+uint32_t fpu_area_size = FPU_LEGACY_SIZE;
+enum fpu_mode fpu_mode = FPU_FXSAVE;
+
+// Per CPU: whose state is in the registers, who is running, #NM count
+// (the BSP's boot slot until fpu_percpu_init())
+static void *fpu_owner_boot, *fpu_current_boot;
+static uint64_t fpu_nm_traps_boot;
+static void **fpu_owner = &fpu_owner_boot;
+static void **fpu_current = &fpu_current_boot;
+static uint64_t *fpu_nm_traps = &fpu_nm_traps_boot;
+static uint32_t fpu_cpus = 1;
+
+// Initial state: x87 control word 0x37F, MXCSR 0x1F80 (exceptions masked).
+// The XSAVE header is zero, so XRSTOR puts every other component in its
+// init state.
+static uint8_t fpu_init_image[FPU_LEGACY_SIZE + 64] __attribute__((aligned(FPU_ALIGN))) = {
+    [0] = 0x7F, [1] = 0x03,
+    [24] = 0x80, [25] = 0x1F,
+};
+
+static void fpu_save(void *area) {
+    switch (fpu_mode) {
+    case FPU_XSAVEOPT:
+        __asm__ volatile("xsaveopt64 (%0)" : : "r"(area), "a"(~0U), "d"(~0U) : "memory");
+        break;
+    case FPU_XSAVE:
+        __asm__ volatile("xsave64 (%0)" : : "r"(area), "a"(~0U), "d"(~0U) : "memory");
+        break;
+    default:
+        __asm__ volatile("fxsave64 (%0)" : : "r"(area) : "memory");
+        break;
+    }
+}
+
+static void fpu_restore(const void *area) {
+    if (fpu_mode == FPU_FXSAVE) {
+        __asm__ volatile("fxrstor64 (%0)" : : "r"(area) : "memory");
+    } else {
+        __asm__ volatile("xrstor64 (%0)" : : "r"(area), "a"(~0U), "d"(~0U) : "memory");
+    }
+}
+
+// Every CPU, first thing: enable the state fpu_init() chose, start clean
+void fpu_init_cpu(void) {
+    uint64_t cr0, cr4;
+
+    __asm__ volatile("mov %%cr0, %0" : "=r"(cr0));
+    cr0 = (cr0 & ~(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE;
+    __asm__ volatile("mov %0, %%cr0" : : "r"(cr0));
+
+    __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+    cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+    if (fpu_xcr0) cr4 |= CR4_OSXSAVE;
+    __asm__ volatile("mov %0, %%cr4" : : "r"(cr4));
+
+    if (fpu_xcr0) {
+        __asm__ volatile("xsetbv" : : "c"(0), "a"((uint32_t)fpu_xcr0),
+                         "d"((uint32_t)(fpu_xcr0 >> 32)));
+    }
+    __asm__ volatile("fninit");
+    fpu_restore(fpu_init_image);
+}
+
+// BSP, once, before mem_init() and before the APs start
+void fpu_init(void) {
+    uint32_t max_leaf, eax, ebx, ecx, edx;
+
+    cpuid(0, &max_leaf, &ebx, &ecx, &edx);
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    int has_xsave = (ecx >> 26) & 1;
+    int has_avx = (ecx >> 28) & 1;
+
+    if (has_xsave && max_leaf >= 0xD) {
+        uint64_t want = XCR0_X87 | XCR0_SSE;
+        if (has_avx) {
+            want |= XCR0_AVX;
+            if (max_leaf >= 7) {
+                cpuid(7, &eax, &ebx, &ecx, &edx);
+                if ((ebx >> 16) & 1) want |= XCR0_AVX512;     // AVX512F
+            }
+        }
+
+        uint32_t supported_lo, supported_hi;
+        cpuid_count(0xD, 0, &supported_lo, &ebx, &ecx, &supported_hi);
+        uint64_t supported = ((uint64_t)supported_hi << 32) | supported_lo;
+        // The three AVX-512 components go together or not at all
+        if ((supported & XCR0_AVX512) != XCR0_AVX512) want &= ~XCR0_AVX512;
+        fpu_xcr0 = want & supported;
+        if (!(fpu_xcr0 & XCR0_AVX)) fpu_xcr0 &= ~XCR0_AVX512;
+    }
+
+    fpu_init_cpu();
+
+    if (fpu_xcr0) {
+        // EBX: standard-format size for the components now in XCR0
+        cpuid_count(0xD, 0, &eax, &ebx, &ecx, &edx);
+        fpu_area_size = (ebx + FPU_ALIGN - 1) & ~(FPU_ALIGN - 1);
+        cpuid_count(0xD, 1, &eax, &ebx, &ecx, &edx);
+        fpu_mode = (eax & 1) ? FPU_XSAVEOPT : FPU_XSAVE;
+    }
+}
+
+// Per-CPU tables once the CPU count is known: zeroed, 'cpus' entries each.
+// Slot 0 takes over the BSP's boot state. BSP, interrupts off.
+void fpu_percpu_init(void **owner, void **current, uint64_t *nm_traps, uint32_t cpus) {
+    owner[0] = fpu_owner[0];
+    current[0] = fpu_current[0];
+    nm_traps[0] = fpu_nm_traps[0];
+    fpu_owner = owner;
+    fpu_current = current;
+    fpu_nm_traps = nm_traps;
+    fpu_cpus = cpus;
+}
+
+// A new thread's save area, in the initial state (NULL if the heap is out)
+void *fpu_state_alloc(void) {
+    uint8_t *raw = kmalloc(fpu_area_size + FPU_ALIGN);
+    if (!raw) return 0;
+    uint8_t *area = (uint8_t*)(((uint64_t)raw + FPU_ALIGN - 1) & ~(uint64_t)(FPU_ALIGN - 1));
+    memset(area, 0, fpu_area_size);
+    memcpy(area, fpu_init_image, FPU_LEGACY_SIZE);
+    return area;
+}
+
+// Context switch, interrupts off: state = incoming thread's area (NULL if it
+// has none). Nothing is saved here - the next vector instruction traps.
+void fpu_switch(void *state) {
+    uint32_t cpu = this_cpu();
+    uint64_t cr0;
+
+    fpu_current[cpu] = state;
+    __asm__ volatile("mov %%cr0, %0" : "=r"(cr0));
+    if (state == fpu_owner[cpu]) {
+        if (cr0 & CR0_TS) __asm__ volatile("clts");
+    } else if (!(cr0 & CR0_TS)) {
+        __asm__ volatile("mov %0, %%cr0" : : "r"(cr0 | CR0_TS));
+    }
+}
+
+// Write this CPU's registers back to their owner's area - before that
+// thread runs on another CPU or its area is read
+void fpu_flush(void) {
+    uint32_t cpu = this_cpu();
+    if (!fpu_owner[cpu]) return;
+
+    __asm__ volatile("clts");
+    fpu_save(fpu_owner[cpu]);
+    fpu_owner[cpu] = 0;
+    if (fpu_current[cpu]) {
+        uint64_t cr0;
+        __asm__ volatile("mov %%cr0, %0" : "=r"(cr0));
+        __asm__ volatile("mov %0, %%cr0" : : "r"(cr0 | CR0_TS));
+    }
+}
+
+// #NM (vector 7): first vector instruction since fpu_switch()
+void fpu_handle_nm(void) {
+    uint32_t cpu = this_cpu();
+    __asm__ volatile("clts");
+    if (cpu >= fpu_cpus) return;
+
+    fpu_nm_traps[cpu]++;
+    void *next = fpu_current[cpu];
+    if (next == fpu_owner[cpu]) return;
+    if (fpu_owner[cpu]) fpu_save(fpu_owner[cpu]);
+    if (next) fpu_restore(next);
+    fpu_owner[cpu] = next;
+}
+
+// Two threads' xmm0 across lazy switches: each sees only its own value,
+// and only a switch to a thread whose state isn't loaded traps
+int fpu_selftest(void) {
+    static const uint64_t pattern_a[2] = { 0x0123456789ABCDEFUL, 0x1122334455667788UL };
+    static const uint64_t pattern_b[2] = { 0xFEDCBA9876543210UL, 0x8877665544332211UL };
+    uint64_t out[2];
+    uint8_t *a = fpu_state_alloc();
+    uint8_t *b = fpu_state_alloc();
+    if (!a || !b) return 0;
+
+    uint32_t cpu = this_cpu();
+    uint64_t traps = fpu_nm_traps[cpu];
+    int ok = 1;
+
+    fpu_switch(a);
+    __asm__ volatile("movdqu %0, %%xmm0" : : "m"(pattern_a));     // Trap: load a
+    fpu_switch(b);
+    __asm__ volatile("movdqu %%xmm0, %0" : "=m"(out));           // Trap: save a, load b
+    ok &= out[0] == 0 && out[1] == 0;
+    __asm__ volatile("movdqu %0, %%xmm0" : : "m"(pattern_b));
+    fpu_switch(a);
+    __asm__ volatile("movdqu %%xmm0, %0" : "=m"(out));           // Trap: save b, load a
+    ok &= out[0] == pattern_a[0] && out[1] == pattern_a[1];
+    fpu_switch(a);
+    __asm__ volatile("movdqu %%xmm0, %0" : "=m"(out));           // Still loaded: no trap
+    ok &= fpu_nm_traps[cpu] - traps == 3;
+
+    // xmm0 sits at byte 160 of both the FXSAVE and the XSAVE layout
+    const uint64_t *saved_b = (const uint64_t*)(b + 160);
+    ok &= saved_b[0] == pattern_b[0] && saved_b[1] == pattern_b[1];
+
+    fpu_switch(0);
+    fpu_flush();
+    return ok;
+}
@@ -0,0 +1,92 @@
+#ifndef COMMON_SIMD_H
+#define COMMON_SIMD_H
+
+// Memory primitives and FPU/SIMD register state (simd.c), compiled into
+// both the C kernel and the hybrid bootstrap. See the section comments in
+// simd.c for how the variants are picked and how lazy switching works.
+
+// Bare-metal types (no standard headers with -nostdinc)
+typedef unsigned char uint8_t;
+typedef unsigned int uint32_t;
+typedef unsigned long uint64_t;
+
+// Provided by the kernel that links simd.c
+uint32_t this_cpu(void);
+void *kmalloc(uint64_t size);
+
+// ----------------------------------------------------------------------------
+// Memory primitives
+// ----------------------------------------------------------------------------
+
+#ifndef MEM_NT_THRESHOLD
+#define MEM_NT_THRESHOLD (1UL << 20)    // Non-temporal stores from 1 MB
+#endif
+
+typedef void *(*mem_copy_fn)(void *dest, const void *src, uint64_t n);
+typedef void *(*mem_set_fn)(void *dest, int val, uint64_t n);
+
+enum mem_needs {
+    MEM_NEEDS_NONE,
+    MEM_NEEDS_SSE2,
+    MEM_NEEDS_AVX2,
+};
+
+struct mem_variant {
+    const char *name;
+    mem_copy_fn copy;
+    mem_set_fn set;
+    enum mem_needs needs;
+};
+
+enum {
+    MEM_REP,
+    MEM_ERMS,
+    MEM_SSE2,
+    MEM_SSE2_NT,
+    MEM_AVX2,
+    MEM_AVX2_NT,
+    MEM_VARIANTS
+};
+
+extern const struct mem_variant mem_variants[MEM_VARIANTS];
+
+// Set by mem_init()
+extern int mem_has_erms, mem_has_fsrm, mem_has_sse2, mem_has_avx2;
+extern uint32_t mem_small;              // Below MEM_NT_THRESHOLD
+extern uint32_t mem_large;              // MEM_NT_THRESHOLD and up
+
+void *memcpy(void *dest, const void *src, uint64_t n);
+void *memset(void *dest, int val, uint64_t n);
+void *memmove(void *dest, const void *src, uint64_t n);
+int mem_variant_usable(uint32_t v);
+void mem_init(void);
+
+// ----------------------------------------------------------------------------
+// FPU / SIMD state
+// ----------------------------------------------------------------------------
+
+#define XCR0_X87        (1UL << 0)
+#define XCR0_SSE        (1UL << 1)
+#define XCR0_AVX        (1UL << 2)
+#define XCR0_AVX512     (7UL << 5)      // Opmask, ZMM_Hi256, Hi16_ZMM
+
+enum fpu_mode { FPU_FXSAVE, FPU_XSAVE, FPU_XSAVEOPT };
+extern const char *const fpu_mode_names[];
+
+// Set by fpu_init() on the BSP before any AP starts
+extern uint64_t fpu_xcr0;               // 0 = no XSAVE, SSE via FXSAVE only
+extern uint32_t fpu_area_size;
+extern enum fpu_mode fpu_mode;
+
+void fpu_init(void);
+void fpu_init_cpu(void);
+void fpu_percpu_init(void **owner, void **current, uint64_t *nm_traps, uint32_t cpus);
+void fpu_handle_nm(void);
+int fpu_selftest(void);
+
+// Also called from Zig in the hybrid kernel (boot_info.zig)
+void *fpu_state_alloc(void);
+void fpu_switch(void *state);
+void fpu_flush(void);
+
+#endif
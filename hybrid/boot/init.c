@@ -14,11 +14,57 @@
 
 #include "vga.h"
 #include "../shared/boot_info.h"
+#include "../../common/simd.h"
 
 #define COM1 0x3F8
+#define DEBUGCON_PORT 0xE9              // QEMU/Bochs debug console
+
+// Console backend, chosen at build time (zig build -Dconsole=...)
+#define CONSOLE_SERIAL   0              // COM1, polls LSR for every byte
+#define CONSOLE_DEBUGCON 1              // Port 0xE9, one outb per byte, no polling
+
+#ifndef CONSOLE_BACKEND
+#define CONSOLE_BACKEND CONSOLE_SERIAL
+#endif
+
+// APIC timer period in bus clocks / 16 (10000000 is roughly 10 Hz)
+#ifndef TIMER_INITIAL_COUNT
+#define TIMER_INITIAL_COUNT 10000000
+#endif
+
+// Sampling profiler: every timer tick records the interrupted RIP. With
+// PROF_DEPTH > 1 it also walks frame pointers (zig build -Dprofile=true
+// builds with frame pointers and a faster tick)
+#ifndef PROF_DEPTH
+#define PROF_DEPTH 1
+#endif
+#define PROF_BUCKETS 512        // Distinct stacks per CPU (power of two)
+#define PROF_PROBES 16          // Hash probes before a sample is dropped
+#define PROF_STACK_SPAN 65536   // Bound on the frame walk (BSP stack comes from boot.S)
+
+// Fast boot (zig build -Dfast-boot=true): no VGA, no diagnostic dumps, and
+// AP bring-up waits for the AP instead of sleeping fixed delays
+#ifndef FAST_BOOT
+#define FAST_BOOT 0
+#endif
+
+// Event tracer (zig build -Dtrace=false compiles every trace point out)
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 1
+#endif
+#define TRACE_RING_SIZE 1024            // Records per CPU (power of two)
 #define ACPI_SEARCH_START 0x000E0000
 #define ACPI_SEARCH_END   0x000FFFFF
-#define MAX_CPUS 16
+// Most CPUs brought up (zig build -Dmax-cpus=n). Per-CPU tables are sized
+// at boot for the CPUs the MADT lists; this only caps how many that is.
+#ifndef MAX_CPUS
+#define MAX_CPUS 256
+#endif
+#if MAX_CPUS < 2
+#error "MAX_CPUS must be at least 2"
+#endif
+#define CPU_NONE     0xFFFFFFFFU    // No logical CPU
+#define APIC_ID_NONE 0xFFFFFFFFU    // Not a usable MADT processor entry
 #define AP_STACK_SIZE 8192  // 8KB per CPU
 
 // Memory Management constants
@@ -39,7 +85,7 @@
 #define PT_NX         (1UL << 63)
 
 // Recursive mapping: last PML4 entry points to PML4 itself
-#define RECURSIVE_INDEX 511
+#define RECURSIVE_INDEX 511UL
 #define RECURSIVE_BASE  0xFFFF000000000000UL
 
 // Virtual addresses for page table manipulation via recursive mapping
@@ -173,16 +219,31 @@ static inline uint64_t rdtsc(void) {
     return ((uint64_t)high << 32) | low;
 }
 
+// TSC plus IA32_TSC_AUX (holds our logical CPU ID once the CPU set it)
+static inline uint64_t rdtscp(uint32_t *aux) {
+    uint32_t low, high;
+    __asm__ volatile("rdtscp" : "=a"(low), "=d"(high), "=c"(*aux));
+    return ((uint64_t)high << 32) | low;
+}
+
+#define MSR_TSC_AUX 0xC0000103
+
 // CPUID function
-static inline void cpuid(uint32_t leaf, uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx) {
+static inline void cpuid_count(uint32_t leaf, uint32_t subleaf,
+                               uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx) {
     __asm__ volatile("cpuid"
                      : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
-                     : "a"(leaf), "c"(0));
+                     : "a"(leaf), "c"(subleaf));
+}
+
+static inline void cpuid(uint32_t leaf, uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx) {
+    cpuid_count(leaf, 0, eax, ebx, ecx, edx);
 }
 
 // APIC mode tracking
 static volatile uint32_t *apic_base = 0;  // xAPIC MMIO base (if using xAPIC)
 int use_x2apic = 0;                       // 1 if x2APIC, 0 if xAPIC (non-static for services.c)
+int use_debugcon = 0;                     // 1 if console goes to port 0xE9 (non-static for services.c)
 
 // APIC read/write abstraction (supports both xAPIC MMIO and x2APIC MSR)
 static inline uint32_t apic_read(uint32_t reg) {
@@ -215,8 +276,8 @@ static inline void atomic_inc(volatile uint32_t *ptr) {
     __asm__ volatile("lock incl %0" : "+m"(*ptr) : : "memory");
 }
 
-// Per-CPU stacks (8KB each, aligned)
-static uint8_t __attribute__((aligned(16))) ap_stacks[MAX_CPUS][AP_STACK_SIZE];
+// Per-CPU stacks (8KB each, aligned), allocated by percpu_init()
+static uint8_t (*ap_stacks)[AP_STACK_SIZE];
 
 // Trampoline symbols (from trampoline.S)
 extern char trampoline_start[];
@@ -244,22 +305,6 @@ static uint64_t heap_end = 0;         // End of heap
 // Virtual Memory Manager (VMM) - uses recursive page table mapping
 static uint64_t *pml4 = 0;            // Pointer to PML4 (via recursive mapping)
 
-// ============================================================================
-// PARALLEL COMPUTATION DATA STRUCTURES
-// ============================================================================
-
-// Test 1: Parallel counters
-static volatile uint64_t per_cpu_counters[MAX_CPUS] = {0};
-
-// Test 2: Distributed sum (sum of 1 to 10,000,000)
-#define SUM_TARGET 10000000UL
-static volatile uint64_t partial_sums[MAX_CPUS] = {0};
-static volatile uint64_t total_sum = 0;
-
-// Test 3: Barrier synchronization
-static volatile uint32_t barrier_count = 0;
-static volatile uint32_t barrier_sense = 0;
-
 // ============================================================================
 // IDT (INTERRUPT DESCRIPTOR TABLE)
 // ============================================================================
@@ -328,8 +373,8 @@ static const char *exception_names[32] = {
 // Exception counter
 static volatile uint32_t exception_count = 0;
 
-// Timer interrupt counters (per-CPU)
-static volatile uint64_t timer_ticks[MAX_CPUS] = {0};
+// Timer interrupt counters (per logical CPU)
+static volatile uint64_t *timer_ticks;
 
 // ============================================================================
 // IDT FUNCTIONS
@@ -354,6 +399,12 @@ static void idt_set_gate(uint8_t num, uint64_t handler, uint16_t selector, uint8
 // Generic exception handler (called from assembly stubs)
 __attribute__((used))
 static void exception_handler(uint64_t vector, uint64_t error_code, uint64_t rip) {
+    // Lazy FPU switch (CR0.TS), not an error
+    if (vector == 7) {
+        fpu_handle_nm();
+        return;
+    }
+
     __atomic_fetch_add(&exception_count, 1, __ATOMIC_SEQ_CST);
 
     puts("\n[EXCEPTION] ");
@@ -462,7 +513,8 @@ __attribute__((naked)) void exception_common(void) {
         "mov 16*8(%%rsp), %%rsi\n"    // error_code (arg 2)
         "mov 17*8(%%rsp), %%rdx\n"    // RIP (arg 3)
 
-        // Call C handler
+        // Call C handler (the ABI wants DF clear; iretq restores it)
+        "cld\n"
         "call exception_handler\n"
 
         // Restore registers (we'll never get here if handler halts)
@@ -542,6 +594,149 @@ static void idt_load(void) {
     __asm__ volatile("lidt %0" : : "m"(idtr));
 }
 
+// ============================================================================
+// EVENT TRACING
+// ============================================================================
+//
+// Every CPU owns a ring of TSC-stamped records that it alone writes, so
+// recording takes no lock and no atomic bus cycle. The rings are flight
+// recorders: once full, the oldest records are overwritten. trace_dump()
+// prints them at shutdown for tools/trace2chrome.py.
+
+enum trace_type {
+    TRACE_IRQ_ENTRY = 1,    // arg = vector
+    TRACE_IRQ_EXIT,         // arg = vector
+    TRACE_IPI_SEND,         // arg = destination APIC ID, arg2 = ICR low word
+    TRACE_IPI_RECV,         // arg = vector (SIPI start page for AP wake-up)
+    TRACE_ALLOC,            // arg = address, arg2 = size
+    TRACE_FREE,             // arg = address
+    TRACE_BARRIER,          // arg = generation (CPU arrived at a barrier)
+    TRACE_PROBE_BEGIN,      // arg = name (static string), arg2 = value
+    TRACE_PROBE_END,        // arg = name
+    TRACE_PROBE_MARK,       // arg = name, arg2 = value
+    TRACE_TYPE_COUNT
+};
+
+static const char *const trace_type_names[TRACE_TYPE_COUNT] = {
+    [TRACE_IRQ_ENTRY]   = "irq_entry",
+    [TRACE_IRQ_EXIT]    = "irq_exit",
+    [TRACE_IPI_SEND]    = "ipi_send",
+    [TRACE_IPI_RECV]    = "ipi_recv",
+    [TRACE_ALLOC]       = "alloc",
+    [TRACE_FREE]        = "free",
+    [TRACE_BARRIER]     = "barrier",
+    [TRACE_PROBE_BEGIN] = "probe_begin",
+    [TRACE_PROBE_END]   = "probe_end",
+    [TRACE_PROBE_MARK]  = "probe_mark",
+};
+
+struct trace_record {
+    uint64_t tsc;
+    uint64_t arg;
+    uint32_t type;
+    uint32_t arg2;
+};
+
+struct trace_ring {
+    uint64_t head;          // Records ever written (next slot = head % size)
+    struct trace_record records[TRACE_RING_SIZE];
+} __attribute__((aligned(64)));
+
+static struct trace_ring *trace_rings;
+static volatile int trace_on = 0;           // Set once CPU IDs can be resolved
+static int has_rdtscp = 0;
+
+// APIC ID -> logical CPU, written once by each CPU at startup. x2APIC IDs
+// are 32-bit and sparse, so this is an open-addressing hash of
+// (apic_id << 32 | cpu) entries with at least twice as many slots as CPUs.
+#define APIC_MAP_EMPTY (~0UL)
+static uint64_t *apic_map;
+static uint32_t apic_map_mask;          // Slots - 1 (a power of two)
+static uint32_t percpu_cpus = 0;        // Slots per per-CPU table, set by percpu_init()
+
+static inline uint32_t apic_map_hash(uint32_t apic_id) {
+    return (apic_id * 0x9E3779B1U) & apic_map_mask;
+}
+
+// Logical CPU with this APIC ID (CPU_NONE if none registered it)
+static uint32_t cpu_from_apic_id(uint32_t apic_id) {
+    if (!apic_map) return CPU_NONE;
+    for (uint32_t i = apic_map_hash(apic_id); ; i = (i + 1) & apic_map_mask) {
+        uint64_t entry = __atomic_load_n(&apic_map[i], __ATOMIC_ACQUIRE);
+        if (entry == APIC_MAP_EMPTY) return CPU_NONE;
+        if ((uint32_t)(entry >> 32) == apic_id) return (uint32_t)entry;
+    }
+}
+
+// CPUs register concurrently: claim the first empty slot of the probe sequence
+static void apic_map_insert(uint32_t apic_id, uint32_t cpu) {
+    uint64_t entry = ((uint64_t)apic_id << 32) | cpu;
+    for (uint32_t i = apic_map_hash(apic_id); ; i = (i + 1) & apic_map_mask) {
+        uint64_t empty = APIC_MAP_EMPTY;
+        if (__atomic_compare_exchange_n(&apic_map[i], &empty, entry, 0,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            return;
+        }
+    }
+}
+
+// Non-static: the Zig kernel records its probes through this (kernel/trace.zig)
+void trace_event(uint32_t type, uint64_t arg, uint32_t arg2) {
+#if TRACE_ENABLED
+    if (!trace_on) return;
+
+    uint32_t cpu;
+    uint64_t tsc;
+    if (has_rdtscp) {
+        tsc = rdtscp(&cpu);
+    } else {
+        uint32_t apic_id = use_x2apic ? (uint32_t)rdmsr(X2APIC_APICID)
+                                      : apic_read(APIC_ID_REG) >> 24;
+        cpu = cpu_from_apic_id(apic_id);
+        tsc = rdtsc();
+    }
+    if (cpu >= percpu_cpus) return;
+
+    // Only this CPU writes its ring, and an unlocked xadd is a single
+    // instruction, so an interrupt can't tear the slot claim
+    struct trace_ring *ring = &trace_rings[cpu];
+    uint64_t slot = 1;
+    __asm__ volatile("xaddq %0, %1" : "+r"(slot), "+m"(ring->head));
+
+    struct trace_record *rec = &ring->records[slot & (TRACE_RING_SIZE - 1)];
+    rec->tsc = tsc;
+    rec->arg = arg;
+    rec->type = type;
+    rec->arg2 = arg2;
+#else
+    (void)type; (void)arg; (void)arg2;
+#endif
+}
+
+// Called by each CPU (BSP as 0) before it records trace events or samples
+static void cpu_register(uint32_t cpu_id) {
+    uint32_t apic_id = use_x2apic ? (uint32_t)rdmsr(X2APIC_APICID)
+                                  : apic_read(APIC_ID_REG) >> 24;
+    apic_map_insert(apic_id, cpu_id);
+    if (has_rdtscp) {
+        wrmsr(MSR_TSC_AUX, cpu_id);
+    }
+}
+
+// Logical CPU of the caller (0 for the BSP before cpu_register())
+uint32_t this_cpu(void) {
+    if (has_rdtscp) {
+        uint32_t cpu;
+        rdtscp(&cpu);
+        return cpu;
+    }
+    if (!apic_base && !use_x2apic) return 0;
+    uint32_t apic_id = use_x2apic ? (uint32_t)rdmsr(X2APIC_APICID)
+                                  : apic_read(APIC_ID_REG) >> 24;
+    uint32_t cpu = cpu_from_apic_id(apic_id);
+    return cpu == CPU_NONE ? 0 : cpu;
+}
+
 // EOI helper - sends End of Interrupt to APIC
 static void send_eoi(void) {
     if (use_x2apic) {
@@ -553,14 +748,90 @@ static void send_eoi(void) {
     }
 }
 
-// Global debug counter to see if handler is called at all
-static volatile uint64_t global_timer_calls = 0;
+// ============================================================================
+// SAMPLING PROFILER
+// ============================================================================
+//
+// The timer tick samples whatever it interrupted. Each CPU keeps its own
+// hash table of distinct stacks with a hit count, written only from its own
+// timer interrupt, so sampling needs no locks. prof_dump() prints the tables
+// for tools/prof_fold.py, which symbolizes them into folded stacks.
+
+// Stack layout built by timer_irq_stub: saved registers, then the iret frame
+struct irq_frame {
+    uint64_t r15, r14, r13, r12, r11, r10, r9, r8;
+    uint64_t rbp, rdi, rsi, rdx, rcx, rbx, rax;
+    uint64_t rip, cs, rflags, rsp, ss;
+};
+
+struct prof_bucket {
+    uint32_t count;             // 0 = empty
+    uint32_t depth;
+    uint64_t pcs[PROF_DEPTH];   // Interrupted RIP, then return addresses
+};
+
+struct prof_cpu {
+    uint64_t samples;
+    uint64_t dropped;           // Table full around the stack's hash
+    struct prof_bucket buckets[PROF_BUCKETS];
+} __attribute__((aligned(64)));
+
+static struct prof_cpu *prof_cpus;
+static volatile int prof_on = 0;
+
+static void prof_sample(const struct irq_frame *frame, uint32_t cpu) {
+    if (!prof_on || cpu >= percpu_cpus) return;
+
+    uint64_t pcs[PROF_DEPTH];
+    uint32_t depth = 0;
+    pcs[depth++] = frame->rip;
+
+#if PROF_DEPTH > 1
+    // Follow saved RBPs while they stay on the interrupted stack and move up
+    uint64_t fp = frame->rbp;
+    uint64_t low = frame->rsp;
+    while (depth < PROF_DEPTH && fp >= low && !(fp & 7) &&
+           fp - frame->rsp < PROF_STACK_SPAN) {
+        const uint64_t *f = (const uint64_t *)fp;
+        if (!f[1]) break;
+        pcs[depth++] = f[1];
+        low = fp + 16;
+        fp = f[0];
+    }
+#endif
+
+    // FNV-1a over the stack picks the home bucket
+    uint64_t hash = 0xcbf29ce484222325UL;
+    for (uint32_t i = 0; i < depth; i++) {
+        hash = (hash ^ pcs[i]) * 0x100000001b3UL;
+    }
+
+    struct prof_cpu *pc = &prof_cpus[cpu];
+    pc->samples++;
+    for (uint32_t probe = 0; probe < PROF_PROBES; probe++) {
+        struct prof_bucket *b = &pc->buckets[(hash + probe) & (PROF_BUCKETS - 1)];
+        if (b->count == 0) {
+            b->depth = depth;
+            for (uint32_t i = 0; i < depth; i++) b->pcs[i] = pcs[i];
+            b->count = 1;
+            return;
+        }
+        if (b->depth == depth) {
+            uint32_t i = 0;
+            while (i < depth && b->pcs[i] == pcs[i]) i++;
+            if (i == depth) {
+                b->count++;
+                return;
+            }
+        }
+    }
+    pc->dropped++;
+}
 
 // Timer interrupt handler (called from assembly stub)
 __attribute__((used))
-void timer_interrupt_handler(void) {
-    // Increment global counter (debug)
-    __atomic_fetch_add(&global_timer_calls, 1, __ATOMIC_SEQ_CST);
+void timer_interrupt_handler(struct irq_frame *frame) {
+    trace_event(TRACE_IRQ_ENTRY, TIMER_VECTOR, 0);
 
     // Get current CPU APIC ID
     uint32_t apic_id;
@@ -570,14 +841,17 @@ void timer_interrupt_handler(void) {
         apic_id = apic_read(APIC_ID_REG) >> 24;
     }
 
-    // Use APIC ID directly as index (works for sequential APIC IDs like in QEMU)
-    // In QEMU with -smp 4, APIC IDs are typically 0, 1, 2, 3
-    if (apic_id < MAX_CPUS) {
-        __atomic_fetch_add(&timer_ticks[apic_id], 1, __ATOMIC_SEQ_CST);
+    // APIC IDs can be sparse and 32-bit: count by logical CPU
+    uint32_t cpu = cpu_from_apic_id(apic_id);
+    if (cpu < percpu_cpus) {
+        __atomic_fetch_add(&timer_ticks[cpu], 1, __ATOMIC_SEQ_CST);
+        prof_sample(frame, cpu);
     }
 
     // Send EOI to acknowledge interrupt
     send_eoi();
+
+    trace_event(TRACE_IRQ_EXIT, TIMER_VECTOR, 0);
 }
 
 // Timer IRQ stub - must be global and used
@@ -604,7 +878,9 @@ __asm__(
     "    push %r14\n"
     "    push %r15\n"
 
-    // Call C handler
+    // Call C handler with the saved registers + iret frame (struct irq_frame)
+    "    cld\n"
+    "    mov %rsp, %rdi\n"
     "    call timer_interrupt_handler\n"
 
     // Restore all registers
@@ -672,22 +948,37 @@ static void serial_init(void) {
     outb(COM1 + 3, 0x03);
     outb(COM1 + 2, 0xC7);
     outb(COM1 + 4, 0x0B);
+
+#if CONSOLE_BACKEND == CONSOLE_DEBUGCON
+    // Reading the debugcon port returns 0xE9 when the device exists;
+    // otherwise stay on serial
+    use_debugcon = (inb(DEBUGCON_PORT) == DEBUGCON_PORT);
+#endif
 }
 
 static void putc(char c) {
+    if (use_debugcon) {
+        outb(DEBUGCON_PORT, c);
+        return;
+    }
     while ((inb(COM1 + 5) & 0x20) == 0);
     outb(COM1, c);
 }
 
 static void puts(const char *s) {
     while (*s) {
-        if (*s == '\n') putc('\r');
+        if (*s == '\n' && !use_debugcon) putc('\r');
         putc(*s);
-        vga_putchar(*s);  // Also write to VGA
+        if (!FAST_BOOT) vga_putchar(*s);  // Also write to VGA
         s++;
     }
 }
 
+// Diagnostics that fast boot leaves out
+static void boot_puts(const char *s) {
+    if (!FAST_BOOT) puts(s);
+}
+
 static void print_dec(uint32_t num) {
     char buf[12];
     int i = 11;
@@ -748,29 +1039,168 @@ static void print_hex_64(uint64_t num) {
     puts(buf);
 }
 
-// Minimal memcpy
-static void *memcpy(void *dest, const void *src, uint64_t n) {
-    uint8_t *d = (uint8_t*)dest;
-    const uint8_t *s = (const uint8_t*)src;
-    while (n--) *d++ = *s++;
-    return dest;
+// Print the trace rings for tools/trace2chrome.py:
+//   @TRACE v1 tsc_khz=<khz> cpus=<n> ring=<records per CPU>
+//   @Y <type> <name>                           (type table)
+//   @D <cpu> <records lost to wrap-around>
+//   @T <cpu> <tsc> <type> <arg> <arg2> [probe name]
+//   @END
+// Tracing stops first - other CPUs keep taking timer interrupts.
+static uint64_t tsc_khz;
+
+void trace_dump(void) {  // Non-static for Zig access
+    trace_on = 0;
+    for (volatile int i = 0; i < 100000; i++) __asm__ volatile("pause");
+
+    puts("\n@TRACE v1 tsc_khz=");
+    print_dec_64(tsc_khz);
+    puts(" cpus=");
+    print_dec(cpus_online);
+    puts(" ring=");
+    print_dec(TRACE_RING_SIZE);
+    puts("\n");
+
+    for (uint32_t t = 1; t < TRACE_TYPE_COUNT; t++) {
+        puts("@Y ");
+        print_dec(t);
+        puts(" ");
+        puts(trace_type_names[t]);
+        puts("\n");
+    }
+
+    for (uint32_t cpu = 0; cpu < percpu_cpus; cpu++) {
+        struct trace_ring *ring = &trace_rings[cpu];
+        uint64_t head = ring->head;
+        uint64_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+
+        if (first) {
+            puts("@D ");
+            print_dec(cpu);
+            puts(" ");
+            print_dec_64(first);
+            puts("\n");
+        }
+
+        for (uint64_t i = first; i < head; i++) {
+            struct trace_record *rec = &ring->records[i & (TRACE_RING_SIZE - 1)];
+            puts("@T ");
+            print_dec(cpu);
+            puts(" ");
+            print_hex_64(rec->tsc);
+            puts(" ");
+            print_dec(rec->type);
+            puts(" ");
+            print_hex_64(rec->arg);
+            puts(" ");
+            print_hex(rec->arg2);
+            if (rec->type >= TRACE_PROBE_BEGIN && rec->type <= TRACE_PROBE_MARK) {
+                puts(" ");
+                puts((const char *)rec->arg);
+            }
+            puts("\n");
+        }
+    }
+
+    puts("@END\n");
 }
 
-static void *memset(void *dest, int val, uint64_t n) {
-    uint8_t *d = (uint8_t*)dest;
-    while (n--) *d++ = (uint8_t)val;
-    return dest;
+// Print every CPU's stacks for tools/prof_fold.py:
+//   @PROF v1 depth=<max frames>
+//   @C <cpu> <samples> <dropped>
+//   @S <cpu> <count> <rip> [<return address> ...]   (innermost first)
+//   @END
+void prof_dump(void) {  // Non-static for Zig access
+    prof_on = 0;
+
+    puts("\n@PROF v1 depth=");
+    print_dec(PROF_DEPTH);
+    puts("\n");
+    for (uint32_t cpu = 0; cpu < percpu_cpus; cpu++) {
+        struct prof_cpu *pc = &prof_cpus[cpu];
+        if (!pc->samples) continue;
+
+        puts("@C ");
+        print_dec(cpu);
+        puts(" ");
+        print_dec_64(pc->samples);
+        puts(" ");
+        print_dec_64(pc->dropped);
+        puts("\n");
+        for (uint32_t i = 0; i < PROF_BUCKETS; i++) {
+            struct prof_bucket *b = &pc->buckets[i];
+            if (!b->count) continue;
+            puts("@S ");
+            print_dec(cpu);
+            puts(" ");
+            print_dec(b->count);
+            for (uint32_t d = 0; d < b->depth; d++) {
+                puts(" ");
+                print_hex_64(b->pcs[d]);
+            }
+            puts("\n");
+        }
+    }
+    puts("@END\n");
 }
 
+// ============================================================================
+// TSC CALIBRATION
+// ============================================================================
+
 // TSC calibration and delays
-static uint64_t tsc_khz = 0;
+static uint64_t tsc_khz = 0;  // Also reported in the trace dump and BootInfo
+static const char *tsc_khz_source = "fixed estimate";
+
+#define PIT_CH2_DATA      0x42
+#define PIT_COMMAND       0x43
+#define PIT_GATE_PORT     0x61          // Bit 0: ch2 gate, bit 1: speaker, bit 5: ch2 output
+#define PIT_FREQ_HZ       1193182
+#define PIT_CALIBRATE_MS  10
+
+// Measure the TSC against a PIT channel 2 one-shot (0 if the PIT never fires)
+static uint64_t calibrate_tsc_pit(void) {
+    uint32_t latch = PIT_FREQ_HZ / (1000 / PIT_CALIBRATE_MS);
+
+    // Gate on, speaker off; mode 0 starts counting when the count is written
+    outb(PIT_GATE_PORT, (inb(PIT_GATE_PORT) & ~0x02) | 0x01);
+    outb(PIT_COMMAND, 0xB0);            // Channel 2, lo/hi byte, mode 0, binary
+    outb(PIT_CH2_DATA, latch & 0xFF);
+    outb(PIT_CH2_DATA, latch >> 8);
+
+    uint64_t start = rdtsc();
+    uint32_t spins = 0;
+    while (!(inb(PIT_GATE_PORT) & 0x20)) {
+        if (++spins > 10000000) return 0;
+    }
+    uint64_t end = rdtsc();
+
+    return (end - start) / PIT_CALIBRATE_MS;
+}
 
+// Same sources as the C kernel: CPUID 0x15, then the PIT, then a guess
 static void calibrate_tsc(void) {
-    // For this minimal kernel, we use a simple fixed estimate
-    // TCG: ~500 MHz, KVM: ~2-6 GHz
-    // We'll use 2GHz as a reasonable middle ground
-    // The delays don't need to be exact for SMP boot to work
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(0, &eax, &ebx, &ecx, &edx);
+    uint32_t max_leaf = eax;
+
+    // CPUID 0x15: TSC = crystal * ebx / eax (crystal Hz in ecx, may be 0)
+    if (max_leaf >= 0x15) {
+        cpuid(0x15, &eax, &ebx, &ecx, &edx);
+        if (eax && ebx && ecx) {
+            tsc_khz = (uint64_t)ecx * ebx / eax / 1000;
+            tsc_khz_source = "CPUID 0x15";
+            return;
+        }
+    }
 
+    uint64_t khz = calibrate_tsc_pit();
+    if (khz) {
+        tsc_khz = khz;
+        tsc_khz_source = "PIT";
+        return;
+    }
+
+    // Last resort - the delays don't need to be exact for SMP boot to work
     tsc_khz = 2000000;  // 2 GHz = 2,000,000 kHz
 }
 
@@ -788,6 +1218,85 @@ static void mdelay(uint64_t msec) {
     }
 }
 
+// ============================================================================
+// BOOT PHASE TIMING
+// ============================================================================
+
+// Each phase is stamped when it ends; boot.S stamps _start
+enum boot_phase {
+    BOOT_START,
+    BOOT_ASM,           // boot.S: page tables, long mode
+    BOOT_CONSOLE,       // Serial + VGA
+    BOOT_MMAP,
+    BOOT_IDT,
+    BOOT_PMM,
+    BOOT_VMM,
+    BOOT_HEAP,
+    BOOT_CPU_DETECT,    // CPUID + TSC calibration
+    BOOT_ACPI,
+    BOOT_APIC,
+    BOOT_TRAMPOLINE,
+    BOOT_AP_BOOT,
+    BOOT_TIMER,
+    BOOT_HANDOFF,       // BootInfo, up to zig_kernel_main
+    BOOT_PHASE_COUNT
+};
+
+static const char *const boot_phase_names[BOOT_PHASE_COUNT] = {
+    [BOOT_ASM]        = "boot.S      ",
+    [BOOT_CONSOLE]    = "console     ",
+    [BOOT_MMAP]       = "mmap parse  ",
+    [BOOT_IDT]        = "IDT         ",
+    [BOOT_PMM]        = "PMM         ",
+    [BOOT_VMM]        = "VMM         ",
+    [BOOT_HEAP]       = "heap        ",
+    [BOOT_CPU_DETECT] = "CPU detect  ",
+    [BOOT_ACPI]       = "ACPI        ",
+    [BOOT_APIC]       = "APIC        ",
+    [BOOT_TRAMPOLINE] = "trampoline  ",
+    [BOOT_AP_BOOT]    = "AP boot     ",
+    [BOOT_TIMER]      = "timer       ",
+    [BOOT_HANDOFF]    = "handoff     ",
+};
+
+extern uint64_t boot_tsc_start;         // boot.S, first instruction of _start
+static uint64_t boot_phase_tsc[BOOT_PHASE_COUNT];
+
+static inline void boot_phase_end(enum boot_phase phase) {
+    boot_phase_tsc[phase] = rdtsc();
+}
+
+static void print_dec_pad(uint64_t num, int width) {
+    int digits = 1;
+    for (uint64_t v = num; v >= 10; v /= 10) digits++;
+    while (digits++ < width) putc(' ');
+    print_dec_64(num);
+}
+
+// Cycles and microseconds per phase (at the calibrated tsc_khz)
+static void boot_phase_report(void) {
+    boot_phase_tsc[BOOT_START] = boot_tsc_start;
+    uint64_t total = boot_phase_tsc[BOOT_HANDOFF] - boot_phase_tsc[BOOT_START];
+
+    puts("[BOOT] Phase timing, _start -> zig_kernel_main (");
+    puts(FAST_BOOT ? "fast boot" : "full boot");
+    puts("):\n");
+    puts("  phase             cycles        us      %\n");
+    for (int p = BOOT_ASM; p < BOOT_PHASE_COUNT; p++) {
+        uint64_t cycles = boot_phase_tsc[p] - boot_phase_tsc[p - 1];
+        puts("  ");
+        puts(boot_phase_names[p]);
+        print_dec_pad(cycles, 12);
+        print_dec_pad(cycles * 1000 / tsc_khz, 10);
+        print_dec_pad(total ? cycles * 100 / total : 0, 7);
+        puts("\n");
+    }
+    puts("  total       ");
+    print_dec_pad(total, 12);
+    print_dec_pad(total * 1000 / tsc_khz, 10);
+    puts("\n\n");
+}
+
 // ACPI structures
 struct acpi_rsdp {
     char signature[8];
@@ -827,6 +1336,21 @@ struct acpi_madt_lapic {
     uint32_t flags;
 } __attribute__((packed));
 
+// Firmware lists CPUs whose APIC ID doesn't fit in 8 bits (and, on some
+// machines, all of them) as x2APIC entries
+struct acpi_madt_x2apic {
+    uint8_t type;
+    uint8_t length;
+    uint16_t reserved;
+    uint32_t x2apic_id;
+    uint32_t flags;
+    uint32_t processor_uid;
+} __attribute__((packed));
+
+#define MADT_LAPIC    0
+#define MADT_X2APIC   9
+#define MADT_ENABLED  0x1
+
 static int acpi_checksum(void *ptr, int length) {
     uint8_t sum = 0;
     uint8_t *p = (uint8_t*)ptr;
@@ -879,37 +1403,78 @@ static struct acpi_sdt_header *acpi_find_madt(struct acpi_rsdp *rsdp) {
     return 0;
 }
 
-// CPU tracking
-static uint8_t cpu_apic_ids[MAX_CPUS];
+// CPU tracking: APIC ID by MADT index, the BSP first
+static uint32_t *cpu_apic_ids;
 static volatile int cpu_count = 0;
 
+// APIC ID of the caller from CPUID: all 32 bits from leaf 0xB, else the
+// 8-bit initial ID from leaf 1 (usable before the local APIC is set up)
+static uint32_t cpuid_apic_id(void) {
+    uint32_t max_leaf, eax, ebx, ecx, edx;
+    cpuid(0, &max_leaf, &ebx, &ecx, &edx);
+    if (max_leaf >= 0xB) {
+        cpuid_count(0xB, 0, &eax, &ebx, &ecx, &edx);
+        if (ebx) return edx;
+    }
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    return ebx >> 24;
+}
+
+// APIC ID of an enabled processor entry, APIC_ID_NONE for anything else
+static uint32_t madt_cpu_apic_id(const uint8_t *entry) {
+    if (entry[0] == MADT_LAPIC) {
+        const struct acpi_madt_lapic *lapic = (const struct acpi_madt_lapic*)entry;
+        return (lapic->flags & MADT_ENABLED) ? lapic->apic_id : APIC_ID_NONE;
+    }
+    if (entry[0] == MADT_X2APIC) {
+        const struct acpi_madt_x2apic *x2apic = (const struct acpi_madt_x2apic*)entry;
+        return (x2apic->flags & MADT_ENABLED) ? x2apic->x2apic_id : APIC_ID_NONE;
+    }
+    return APIC_ID_NONE;
+}
+
+// Fills cpu_apic_ids with the BSP and then every other enabled CPU, up to
+// MAX_CPUS. Returns the CPU count.
 static int acpi_parse_madt(struct acpi_sdt_header *madt_header) {
     struct acpi_madt_header *madt = (struct acpi_madt_header*)madt_header;
-    uint8_t *ptr = (uint8_t*)madt + sizeof(struct acpi_madt_header);
+    uint8_t *start = (uint8_t*)madt + sizeof(struct acpi_madt_header);
     uint8_t *end = (uint8_t*)madt + madt->header.length;
-    int count = 0;
-
-    while (ptr < end) {
-        uint8_t type = *ptr;
-        uint8_t length = *(ptr + 1);
-
-        if (type == 0) {  // Local APIC
-            struct acpi_madt_lapic *lapic = (struct acpi_madt_lapic*)ptr;
-            if (lapic->flags & 0x1) {
-                puts("[ACPI] CPU ");
-                print_dec(count);
-                puts(" detected (APIC ID ");
-                print_dec(lapic->apic_id);
-                puts(")\n");
-
-                if (count < MAX_CPUS) {
-                    cpu_apic_ids[count] = lapic->apic_id;
-                }
-                count++;
-            }
-        }
 
-        ptr += length;
+    int entries = 0;
+    for (uint8_t *ptr = start; ptr < end && ptr[1]; ptr += ptr[1]) {
+        if (madt_cpu_apic_id(ptr) != APIC_ID_NONE) entries++;
+    }
+    int limit = (entries < MAX_CPUS) ? entries : MAX_CPUS;
+    if (limit < 1) limit = 1;
+    cpu_apic_ids = (uint32_t*)kmalloc(limit * sizeof(uint32_t));
+
+    // Boot code takes MADT index 0 to be the CPU running it
+    cpu_apic_ids[0] = cpuid_apic_id();
+    int count = 1, skipped = 0;
+    for (uint8_t *ptr = start; ptr < end && ptr[1]; ptr += ptr[1]) {
+        uint32_t apic_id = madt_cpu_apic_id(ptr);
+        if (apic_id == APIC_ID_NONE) continue;
+
+        int dup = 0;
+        for (int i = 0; i < count && !dup; i++) dup = cpu_apic_ids[i] == apic_id;
+        if (dup) continue;                  // The BSP, or listed as both types
+        if (count == limit) {
+            skipped++;
+            continue;
+        }
+        puts("[ACPI] CPU ");
+        print_dec(count);
+        puts(" detected (APIC ID ");
+        print_dec(apic_id);
+        puts(")\n");
+        cpu_apic_ids[count++] = apic_id;
+    }
+    if (skipped) {
+        puts("[ACPI] WARNING: ");
+        print_dec(skipped);
+        puts(" more CPU(s) left offline (MAX_CPUS=");
+        print_dec(MAX_CPUS);
+        puts(")\n");
     }
 
     return count;
@@ -929,7 +1494,7 @@ static void disable_pic(void) {
 static void detect_cpu_features(void) {
     uint32_t eax, ebx, ecx, edx;
 
-    puts("\n[CPU] Detecting CPU features...\n");
+    boot_puts("\n[CPU] Detecting CPU features...\n");
 
     // CPUID leaf 0: Get vendor string and max basic leaf
     cpuid(0, &eax, &ebx, &ecx, &edx);
@@ -940,38 +1505,38 @@ static void detect_cpu_features(void) {
     *((uint32_t*)(vendor + 4)) = edx;
     *((uint32_t*)(vendor + 8)) = ecx;
 
-    puts("[CPU] Vendor: ");
-    puts(vendor);
-    puts("\n");
+    boot_puts("[CPU] Vendor: ");
+    boot_puts(vendor);
+    boot_puts("\n");
 
     if (max_basic_leaf >= 1) {
         // CPUID leaf 1: Feature flags
         cpuid(1, &eax, &ebx, &ecx, &edx);
 
-        puts("[CPU] Features detected:\n");
+        boot_puts("[CPU] Features detected:\n");
 
         // EDX features (leaf 1)
-        if (edx & (1 << 0))  puts("  [✓] FPU - x87 Floating Point Unit\n");
-        if (edx & (1 << 4))  puts("  [✓] TSC - Time Stamp Counter\n");
-        if (edx & (1 << 5))  puts("  [✓] MSR - Model Specific Registers\n");
-        if (edx & (1 << 6))  puts("  [✓] PAE - Physical Address Extension\n");
-        if (edx & (1 << 8))  puts("  [✓] CX8 - CMPXCHG8B\n");
-        if (edx & (1 << 9))  puts("  [✓] APIC - On-chip APIC\n");
-        if (edx & (1 << 13)) puts("  [✓] PGE - Page Global Enable\n");
-        if (edx & (1 << 15)) puts("  [✓] CMOV - Conditional Move\n");
-        if (edx & (1 << 23)) puts("  [✓] MMX - MMX instructions\n");
-        if (edx & (1 << 24)) puts("  [✓] FXSR - FXSAVE/FXRSTOR\n");
-        if (edx & (1 << 25)) puts("  [✓] SSE - Streaming SIMD Extensions\n");
-        if (edx & (1 << 26)) puts("  [✓] SSE2 - Streaming SIMD Extensions 2\n");
+        if (edx & (1 << 0))  boot_puts("  [✓] FPU - x87 Floating Point Unit\n");
+        if (edx & (1 << 4))  boot_puts("  [✓] TSC - Time Stamp Counter\n");
+        if (edx & (1 << 5))  boot_puts("  [✓] MSR - Model Specific Registers\n");
+        if (edx & (1 << 6))  boot_puts("  [✓] PAE - Physical Address Extension\n");
+        if (edx & (1 << 8))  boot_puts("  [✓] CX8 - CMPXCHG8B\n");
+        if (edx & (1 << 9))  boot_puts("  [✓] APIC - On-chip APIC\n");
+        if (edx & (1 << 13)) boot_puts("  [✓] PGE - Page Global Enable\n");
+        if (edx & (1 << 15)) boot_puts("  [✓] CMOV - Conditional Move\n");
+        if (edx & (1 << 23)) boot_puts("  [✓] MMX - MMX instructions\n");
+        if (edx & (1 << 24)) boot_puts("  [✓] FXSR - FXSAVE/FXRSTOR\n");
+        if (edx & (1 << 25)) boot_puts("  [✓] SSE - Streaming SIMD Extensions\n");
+        if (edx & (1 << 26)) boot_puts("  [✓] SSE2 - Streaming SIMD Extensions 2\n");
 
         // ECX features (leaf 1)
-        if (ecx & (1 << 0))  puts("  [✓] SSE3 - Streaming SIMD Extensions 3\n");
-        if (ecx & (1 << 9))  puts("  [✓] SSSE3 - Supplemental SSE3\n");
-        if (ecx & (1 << 19)) puts("  [✓] SSE4.1 - Streaming SIMD Extensions 4.1\n");
-        if (ecx & (1 << 20)) puts("  [✓] SSE4.2 - Streaming SIMD Extensions 4.2\n");
-        if (ecx & (1 << 21)) puts("  [✓] x2APIC - Extended xAPIC\n");
-        if (ecx & (1 << 23)) puts("  [✓] POPCNT - Population Count\n");
-        if (ecx & (1 << 28)) puts("  [✓] AVX - Advanced Vector Extensions\n");
+        if (ecx & (1 << 0))  boot_puts("  [✓] SSE3 - Streaming SIMD Extensions 3\n");
+        if (ecx & (1 << 9))  boot_puts("  [✓] SSSE3 - Supplemental SSE3\n");
+        if (ecx & (1 << 19)) boot_puts("  [✓] SSE4.1 - Streaming SIMD Extensions 4.1\n");
+        if (ecx & (1 << 20)) boot_puts("  [✓] SSE4.2 - Streaming SIMD Extensions 4.2\n");
+        if (ecx & (1 << 21)) boot_puts("  [✓] x2APIC - Extended xAPIC\n");
+        if (ecx & (1 << 23)) boot_puts("  [✓] POPCNT - Population Count\n");
+        if (ecx & (1 << 28)) boot_puts("  [✓] AVX - Advanced Vector Extensions\n");
     }
 
     // CPUID leaf 0x80000000: Get max extended leaf
@@ -982,14 +1547,182 @@ static void detect_cpu_features(void) {
         // Extended feature flags
         cpuid(0x80000001, &eax, &ebx, &ecx, &edx);
 
-        if (edx & (1 << 11)) puts("  [✓] SYSCALL/SYSRET\n");
-        if (edx & (1 << 20)) puts("  [✓] NX - No-Execute bit\n");
-        if (edx & (1 << 26)) puts("  [✓] 1GB Pages\n");
-        if (edx & (1 << 27)) puts("  [✓] RDTSCP\n");
-        if (edx & (1 << 29)) puts("  [✓] Long Mode (64-bit)\n");
+        if (edx & (1 << 11)) boot_puts("  [✓] SYSCALL/SYSRET\n");
+        if (edx & (1 << 20)) boot_puts("  [✓] NX - No-Execute bit\n");
+        if (edx & (1 << 26)) boot_puts("  [✓] 1GB Pages\n");
+        if (edx & (1 << 27)) {
+            boot_puts("  [✓] RDTSCP\n");
+            has_rdtscp = 1;
+        }
+        if (edx & (1 << 29)) boot_puts("  [✓] Long Mode (64-bit)\n");
     }
 
-    puts("\n");
+    boot_puts("\n");
+}
+
+// ============================================================================
+// CPU TOPOLOGY
+// ============================================================================
+//
+// Each CPU reads its own place in the machine from CPUID: its x2APIC ID and
+// how many low bits of it select the thread and the core (leaf 0x1F, else
+// 0xB, else the leaf 1/4 counts), and how many IDs share its L2 and L3
+// (leaf 4, 0x8000001D on AMD). Every ID in CpuTopology is the APIC ID with
+// the bits below that level shifted out, so two CPUs share a core, a cache
+// or a package exactly when the IDs match. Zig gets the table as
+// BootInfo.topology; kernel/topology.zig has the queries.
+
+static CpuTopology *cpu_topology;       // By logical CPU (percpu_init)
+static uint32_t topology_cpus = 0;      // CPUs that filled their slot
+
+// Bits that hold 0..n-1
+static uint32_t id_width(uint32_t n) {
+    uint32_t w = 0;
+    while (w < 31 && (1U << w) < n) w++;
+    return w;
+}
+
+// Walks the levels of leaf 0x1F or 0xB: the SMT level's shift and the
+// last level's (the package). 0 if the leaf doesn't enumerate anything.
+static int topology_leaf(uint32_t leaf, uint32_t *apic_id, uint32_t *smt_shift, uint32_t *pkg_shift) {
+    uint32_t eax, ebx, ecx, edx;
+    int levels = 0;
+    for (uint32_t sub = 0; sub < 8; sub++) {
+        cpuid_count(leaf, sub, &eax, &ebx, &ecx, &edx);
+        uint32_t type = (ecx >> 8) & 0xFF;      // 1 SMT, 2 core, 3+ module/tile/die
+        if (!type || !(ebx & 0xFFFF)) break;
+        if (type == 1) *smt_shift = eax & 0x1F;
+        *pkg_shift = eax & 0x1F;
+        *apic_id = edx;
+        levels++;
+    }
+    return levels;
+}
+
+// Shift for the IDs sharing the level-'level' data or unified cache, -1 if
+// there is none. cache_leaf: 4, 0x8000001D or 0 (unknown).
+static int cache_sharing_shift(uint32_t cache_leaf, uint32_t level) {
+    uint32_t eax, ebx, ecx, edx;
+    for (uint32_t sub = 0; cache_leaf && sub < 16; sub++) {
+        cpuid_count(cache_leaf, sub, &eax, &ebx, &ecx, &edx);
+        uint32_t type = eax & 0x1F;             // 1 data, 2 instruction, 3 unified
+        if (!type) break;
+        if (((eax >> 5) & 7) == level && type != 2) {
+            return id_width(((eax >> 14) & 0xFFF) + 1);
+        }
+    }
+    return -1;
+}
+
+// Every CPU, once, after cpu_register(): fills its cpu_topology slot
+static void topology_detect(uint32_t cpu) {
+    if (cpu >= percpu_cpus) return;
+
+    uint32_t max_leaf, max_ext, eax, ebx, ecx, edx;
+    cpuid(0, &max_leaf, &ebx, &ecx, &edx);
+    cpuid(0x80000000, &max_ext, &ebx, &ecx, &edx);
+
+    uint32_t apic_id = 0, smt_shift = 0, pkg_shift = 0;
+    int found = (max_leaf >= 0x1F && topology_leaf(0x1F, &apic_id, &smt_shift, &pkg_shift)) ||
+                (max_leaf >= 0xB && topology_leaf(0xB, &apic_id, &smt_shift, &pkg_shift));
+    if (!found) {
+        // Logical processors per package (HTT) and cores per package (leaf 4)
+        cpuid(1, &eax, &ebx, &ecx, &edx);
+        apic_id = ebx >> 24;
+        uint32_t logical = (edx & (1U << 28)) ? ((ebx >> 16) & 0xFF) : 1;
+        uint32_t cores = 1;
+        if (max_leaf >= 4) {
+            cpuid_count(4, 0, &eax, &ebx, &ecx, &edx);
+            if (eax & 0x1F) cores = (eax >> 26) + 1;
+        }
+        if (!logical) logical = 1;
+        if (cores > logical) cores = logical;
+        smt_shift = id_width(logical / cores);
+        pkg_shift = id_width(logical);
+    }
+
+    uint32_t cache_leaf = 0;
+    if (max_leaf >= 4) {
+        cpuid_count(4, 0, &eax, &ebx, &ecx, &edx);
+        if (eax & 0x1F) cache_leaf = 4;
+    }
+    if (!cache_leaf && max_ext >= 0x8000001D) {
+        cpuid_count(0x8000001D, 0, &eax, &ebx, &ecx, &edx);
+        if (eax & 0x1F) cache_leaf = 0x8000001D;
+    }
+    int l2_shift = cache_sharing_shift(cache_leaf, 2);
+    int l3_shift = cache_sharing_shift(cache_leaf, 3);
+
+    CpuTopology *t = &cpu_topology[cpu];
+    t->apic_id = apic_id;
+    t->smt_id = apic_id & ((1U << smt_shift) - 1);
+    t->core_id = apic_id >> smt_shift;
+    t->package_id = apic_id >> pkg_shift;
+    t->l2_id = l2_shift < 0 ? CPU_NONE : apic_id >> l2_shift;
+    t->l3_id = l3_shift < 0 ? CPU_NONE : apic_id >> l3_shift;
+    t->l2_shift = l2_shift < 0 ? 0 : l2_shift;
+    t->l3_shift = l3_shift < 0 ? 0 : l3_shift;
+    __atomic_fetch_add(&topology_cpus, 1, __ATOMIC_RELEASE);
+}
+
+enum topo_level { TOPO_CORE, TOPO_L2, TOPO_L3, TOPO_PACKAGE };
+
+static uint32_t topology_id(uint32_t cpu, enum topo_level level) {
+    const CpuTopology *t = &cpu_topology[cpu];
+    switch (level) {
+    case TOPO_CORE:    return t->core_id;
+    case TOPO_L2:      return t->l2_id;
+    case TOPO_L3:      return t->l3_id;
+    case TOPO_PACKAGE: return t->package_id;
+    }
+    return CPU_NONE;
+}
+
+// Same cache only if the IDs were cut at the same bit: a 4-core L2 cluster
+// and a 1-core L2 can end up with equal IDs
+static uint32_t topology_shift(uint32_t cpu, enum topo_level level) {
+    const CpuTopology *t = &cpu_topology[cpu];
+    if (level == TOPO_L2) return t->l2_shift;
+    if (level == TOPO_L3) return t->l3_shift;
+    return 0;
+}
+
+static int topology_same(uint32_t a, uint32_t b, enum topo_level level) {
+    return topology_id(a, level) == topology_id(b, level) &&
+           topology_shift(a, level) == topology_shift(b, level);
+}
+
+// Distinct cores, caches or packages among the first n CPUs
+static uint32_t topology_count(uint32_t n, enum topo_level level) {
+    uint32_t distinct = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        if (topology_id(i, level) == CPU_NONE) continue;
+        uint32_t j = 0;
+        while (j < i && !topology_same(i, j, level)) j++;
+        if (j == i) distinct++;
+    }
+    return distinct;
+}
+
+// BSP, once the APs are up: one line summing up the table
+static void topology_print(uint32_t n) {
+    // APs check in before they read CPUID: give the last ones 10ms
+    uint64_t deadline = rdtsc() + 10 * tsc_khz;
+    while (__atomic_load_n(&topology_cpus, __ATOMIC_ACQUIRE) < n && rdtsc() < deadline) {
+        __asm__ volatile("pause");
+    }
+
+    puts("[TOPO] ");
+    print_dec(topology_count(n, TOPO_PACKAGE));
+    puts(" package(s), ");
+    print_dec(topology_count(n, TOPO_CORE));
+    puts(" core(s), ");
+    print_dec(n);
+    puts(" thread(s); ");
+    print_dec(topology_count(n, TOPO_L2));
+    puts(" L2 and ");
+    print_dec(topology_count(n, TOPO_L3));
+    puts(" L3 domain(s)\n");
 }
 
 static void apic_init(void) {
@@ -1104,7 +1837,7 @@ static void apic_timer_init(void) {
 
     // Set initial count (this starts the timer)
     // Lower value = faster interrupts. 10000000 gives roughly 10 Hz with divide-by-16
-    uint32_t initial_count = 10000000;
+    uint32_t initial_count = TIMER_INITIAL_COUNT;
     if (use_x2apic) {
         wrmsr(X2APIC_TIMER_ICR, initial_count);
         timer_init_debug[3] = (uint32_t)rdmsr(X2APIC_TIMER_ICR);
@@ -1128,6 +1861,8 @@ static void apic_wait_icr(void) {
 }
 
 static void send_ipi(uint32_t apic_id, uint32_t flags) {
+    trace_event(TRACE_IPI_SEND, apic_id, flags);
+
     if (use_x2apic) {
         // x2APIC: ICR is a single 64-bit MSR
         // Bits 0-31: flags (ICR low)
@@ -1179,12 +1914,22 @@ static void setup_trampoline(void) {
     puts("[SMP] Trampoline configured\n");
 }
 
+// Spin until 'n' CPUs have checked in or 'usec' passed
+static int wait_cpus_online(uint32_t n, uint64_t usec) {
+    uint64_t deadline = rdtsc() + usec * tsc_khz / 1000;
+    while (__atomic_load_n(&cpus_online, __ATOMIC_ACQUIRE) < n) {
+        if (rdtsc() > deadline) return 0;
+        __asm__ volatile("pause");
+    }
+    return 1;
+}
+
 // Boot a single AP (adapted from Linux smpboot.c)
 static void boot_ap(int cpu_idx) {
     if (cpu_idx == 0) return;  // Skip BSP
     if (cpu_idx >= cpu_count) return;
 
-    uint8_t apic_id = cpu_apic_ids[cpu_idx];
+    uint32_t apic_id = cpu_apic_ids[cpu_idx];
     unsigned long start_eip = 0x8000;  // Trampoline address
 
     // Patch per-CPU stack (like linux-minimal)
@@ -1200,6 +1945,20 @@ static void boot_ap(int cpu_idx) {
     send_ipi(apic_id, APIC_INT_LEVELTRIG | APIC_INT_ASSERT | APIC_DM_INIT);
     apic_wait_icr();
 
+    if (FAST_BOOT) {
+        // Modern CPUs and hypervisors need no INIT delay; the second SIPI
+        // only goes out if the AP has not checked in after the first one
+        send_ipi(apic_id, APIC_INT_LEVELTRIG | APIC_DM_INIT);
+        apic_wait_icr();
+        send_ipi(apic_id, APIC_DM_STARTUP | (start_eip >> 12));
+        apic_wait_icr();
+        if (wait_cpus_online(cpu_idx + 1, 1000)) return;
+        send_ipi(apic_id, APIC_DM_STARTUP | (start_eip >> 12));
+        apic_wait_icr();
+        wait_cpus_online(cpu_idx + 1, 100000);
+        return;
+    }
+
     // Wait 10ms
     mdelay(10);
 
@@ -1234,86 +1993,20 @@ static void boot_all_aps(void) {
         boot_ap(i);
     }
 
-    // Wait for APs
-    for (volatile int i = 0; i < 1000000; i++) __asm__ volatile("pause");
-
-    // NO PUTS HERE! Move to kernel_main after this function returns
-}
-
-// ============================================================================
-// PARALLEL COMPUTATION FUNCTIONS
-// ============================================================================
-
-// Simple barrier (sense-reversing)
-static void barrier_wait(int cpu_id) {
-    uint32_t my_sense = barrier_sense;
-
-    // Last CPU to arrive flips the sense
-    uint32_t arrived = __atomic_add_fetch(&barrier_count, 1, __ATOMIC_SEQ_CST);
-
-    if (arrived == (uint32_t)cpu_count) {
-        // Last one - reset and flip sense
-        barrier_count = 0;
-        __atomic_store_n(&barrier_sense, !my_sense, __ATOMIC_SEQ_CST);
-    } else {
-        // Wait for sense to flip
-        while (__atomic_load_n(&barrier_sense, __ATOMIC_SEQ_CST) == my_sense) {
-            __asm__ volatile("pause");
-        }
-    }
-}
-
-// Test 1: Parallel counter (each CPU counts to 1 million)
-static void test_parallel_counters(int cpu_id) {
-    for (uint64_t i = 0; i < 1000000; i++) {
-        per_cpu_counters[cpu_id]++;
-        if (i % 100000 == 0) {
-            __asm__ volatile("pause");
-        }
-    }
-}
-
-// Test 2: Distributed sum (divide work among CPUs)
-static void test_distributed_sum(int cpu_id) {
-    uint64_t per_cpu_work = SUM_TARGET / cpu_count;
-    uint64_t start = cpu_id * per_cpu_work + 1;
-    uint64_t end = (cpu_id + 1) * per_cpu_work;
-
-    // Last CPU handles remainder
-    if (cpu_id == cpu_count - 1) {
-        end = SUM_TARGET;
+    // Wait for APs (fast boot already waited for each one)
+    if (!FAST_BOOT) {
+        for (volatile int i = 0; i < 1000000; i++) __asm__ volatile("pause");
     }
 
-    uint64_t local_sum = 0;
-    for (uint64_t i = start; i <= end; i++) {
-        local_sum += i;
-    }
-
-    partial_sums[cpu_id] = local_sum;
-
-    // Atomically add to total
-    __atomic_add_fetch(&total_sum, local_sum, __ATOMIC_SEQ_CST);
-}
-
-// Test 3: Barrier synchronization test
-static void test_barrier_sync(int cpu_id) {
-    // Phase 1: Count to 500k
-    for (uint64_t i = 0; i < 500000; i++) {
-        per_cpu_counters[cpu_id]++;
-    }
-
-    // Barrier: wait for all CPUs
-    barrier_wait(cpu_id);
-
-    // Phase 2: Count to 1M (everyone starts together)
-    for (uint64_t i = 500000; i < 1000000; i++) {
-        per_cpu_counters[cpu_id]++;
-    }
+    // NO PUTS HERE! Move to kernel_main after this function returns
 }
 
-// AP entry point - now with parallel computation!
+// AP entry point - brings up the local APIC, then parks in the Zig kernel
 void ap_entry(void) {
-    // Get our CPU ID for tests
+    // Same SIMD state as the BSP before any Zig code runs here
+    fpu_init_cpu();
+
+    // Get our logical CPU ID
     uint32_t my_id = __atomic_fetch_add(&cpus_online, 1, __ATOMIC_SEQ_CST);
 
     // Load IDT on this AP (IDT is already set up by BSP)
@@ -1356,8 +2049,15 @@ void ap_entry(void) {
         apic_write(0x80, 0);  // TPR register at offset 0x80
     }
 
+    // Can resolve our CPU ID now - first record is the SIPI that woke us
+    cpu_register(my_id);
+    topology_detect(my_id);
+    trace_event(TRACE_IPI_RECV, 0x8000 >> 12, 0);
+
     // Wait a bit for APIC to stabilize
-    for (volatile int i = 0; i < 100000; i++) __asm__ volatile("pause");
+    if (!FAST_BOOT) {
+        for (volatile int i = 0; i < 100000; i++) __asm__ volatile("pause");
+    }
 
     // Enable interrupts on APs BEFORE initializing timer
     __asm__ volatile("sti");
@@ -1366,23 +2066,8 @@ void ap_entry(void) {
     // Now safe because trampoline GDT matches BSP GDT (segments 0x08/0x10)
     apic_timer_init();
 
-    // Test 1: Parallel counters
-    test_parallel_counters(my_id);
-    barrier_wait(my_id);  // Sync before next test
-
-    // Test 2: Distributed sum
-    test_distributed_sum(my_id);
-    barrier_wait(my_id);  // Sync before next test
-
-    // Test 3: Barrier sync (resets counters first)
-    per_cpu_counters[my_id] = 0;  // Reset for test 3
-    barrier_wait(my_id);  // Everyone resets together
-    test_barrier_sync(my_id);
-
-    // Done - halt
-    while (1) {
-        __asm__ volatile("hlt");
-    }
+    // Hand this CPU to the Zig kernel - it waits there for parallel work
+    zig_ap_main(my_id);
 }
 
 // ============================================================================
@@ -1498,9 +2183,10 @@ static int pmm_is_page_used(uint64_t page_idx) {
 static void pmm_init(uint64_t multiboot_info_addr) {
     puts("\n[PMM] Initializing Physical Memory Manager...\n");
 
-    // Limit to 64MB for now (enough for kernel + allocations)
-    if (total_memory > 64 * 1024 * 1024) {
-        total_memory = 64 * 1024 * 1024;
+    // Limit to the 1GB identity map, so every page is reachable at its
+    // physical address (32 KB of bitmap)
+    if (total_memory > 1024 * 1024 * 1024) {
+        total_memory = 1024 * 1024 * 1024;
     }
 
     // Calculate number of pages
@@ -1665,6 +2351,22 @@ static void pmm_free_page(uint64_t phys_addr) {
     }
 }
 
+// First run of `pages` free pages starting on an `align_pages` boundary
+// (a power of two), above the first 1MB. Returns 0 if there is none.
+static uint64_t pmm_alloc_contig(uint64_t pages, uint64_t align_pages) {
+    uint64_t first = (0x100000 / PAGE_SIZE + align_pages - 1) & ~(align_pages - 1);
+    for (uint64_t start = first; start + pages <= total_pages; start += align_pages) {
+        uint64_t i = 0;
+        while (i < pages && !pmm_is_page_used(start + i)) i++;
+        if (i < pages) continue;
+
+        for (i = 0; i < pages; i++) pmm_mark_page(start + i);
+        used_pages += pages;
+        return start * PAGE_SIZE;
+    }
+    return 0;
+}
+
 // Virtual Memory Manager (VMM) - Recursive Page Tables
 
 static void vmm_init(void) {
@@ -1744,7 +2446,7 @@ static void vmm_map_page(uint64_t virt_addr, uint64_t phys_addr, uint64_t flags)
 
         // Clear new PDPT
         uint64_t *pdpt_table = (uint64_t*)PDPT_VIRT_ADDR(pml4_idx);
-        for (int i = 0; i < 512; i++) pdpt_table[i] = 0;
+        memset(pdpt_table, 0, PAGE_SIZE);
     }
 
     // Access/create PDPT entry
@@ -1756,7 +2458,7 @@ static void vmm_map_page(uint64_t virt_addr, uint64_t phys_addr, uint64_t flags)
 
         // Clear new PD
         uint64_t *pd_table = (uint64_t*)PD_VIRT_ADDR(pml4_idx, pdpt_idx);
-        for (int i = 0; i < 512; i++) pd_table[i] = 0;
+        memset(pd_table, 0, PAGE_SIZE);
     }
 
     // Access/create PD entry
@@ -1768,7 +2470,7 @@ static void vmm_map_page(uint64_t virt_addr, uint64_t phys_addr, uint64_t flags)
 
         // Clear new PT
         uint64_t *pt_table = (uint64_t*)PT_VIRT_ADDR(pml4_idx, pdpt_idx, pd_idx);
-        for (int i = 0; i < 512; i++) pt_table[i] = 0;
+        memset(pt_table, 0, PAGE_SIZE);
     }
 
     // Map the page
@@ -1801,6 +2503,110 @@ static void vmm_unmap_page(uint64_t virt_addr) {
     __asm__ volatile("invlpg (%0)" : : "r"(virt_addr) : "memory");
 }
 
+// Large regions (benchmark buffers) - mapped in a window above the 4GB
+// line, clear of the identity map and the APIC. Addresses are never handed
+// out twice, so freeing a region needs no TLB shootdown on other CPUs.
+#define VMAP_BASE       0x100000000UL
+#define HUGE_PAGE_SIZE  (2UL * 1024 * 1024)
+#define HUGE_PAGE_PAGES (HUGE_PAGE_SIZE / PAGE_SIZE)
+
+static uint64_t vmap_next = VMAP_BASE;
+
+// Page directory covering virt_addr, created on first use (NULL if OOM)
+static uint64_t *vmm_pd_for(uint64_t virt_addr) {
+    uint64_t pml4_idx = (virt_addr >> 39) & 0x1FF;
+    uint64_t pdpt_idx = (virt_addr >> 30) & 0x1FF;
+
+    uint64_t *pml4_table = (uint64_t*)PML4_VIRT_ADDR;
+    if (!(pml4_table[pml4_idx] & PT_PRESENT)) {
+        uint64_t new_pdpt = pmm_alloc_contig(1, 1);
+        if (!new_pdpt) return 0;
+        pml4_table[pml4_idx] = new_pdpt | PT_PRESENT | PT_WRITE;
+        memset((void*)PDPT_VIRT_ADDR(pml4_idx), 0, PAGE_SIZE);
+    }
+
+    uint64_t *pdpt_table = (uint64_t*)PDPT_VIRT_ADDR(pml4_idx);
+    if (!(pdpt_table[pdpt_idx] & PT_PRESENT)) {
+        uint64_t new_pd = pmm_alloc_contig(1, 1);
+        if (!new_pd) return 0;
+        pdpt_table[pdpt_idx] = new_pd | PT_PRESENT | PT_WRITE;
+        memset((void*)PD_VIRT_ADDR(pml4_idx, pdpt_idx), 0, PAGE_SIZE);
+    }
+
+    return (uint64_t*)PD_VIRT_ADDR(pml4_idx, pdpt_idx);
+}
+
+void vmm_free_region(void *virt, uint64_t bytes);
+
+// `bytes` (rounded up to 2MB) of physical memory, taken in 2MB-aligned
+// chunks and mapped with 4KB pages or, if huge, 2MB pages. Both layouts use
+// the same kind of chunks, so only the TLB reach differs.
+// NULL when physical memory runs out. Non-static for Zig access.
+void *vmm_alloc_region(uint64_t bytes, int huge) {
+    uint64_t size = (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    uint64_t base = vmap_next;
+    vmap_next += size;
+
+    for (uint64_t off = 0; off < size; off += HUGE_PAGE_SIZE) {
+        uint64_t virt = base + off;
+        uint64_t pd_idx = (virt >> 21) & 0x1FF;
+        uint64_t *pd_table = vmm_pd_for(virt);
+        uint64_t phys = pd_table ? pmm_alloc_contig(HUGE_PAGE_PAGES, HUGE_PAGE_PAGES) : 0;
+        uint64_t pt = (phys && !huge) ? pmm_alloc_contig(1, 1) : 0;
+        if (!phys || (!huge && !pt)) {
+            for (uint64_t i = 0; phys && i < HUGE_PAGE_PAGES; i++) pmm_free_page(phys + i * PAGE_SIZE);
+            vmm_free_region((void*)base, off);
+            return 0;
+        }
+
+        if (huge) {
+            pd_table[pd_idx] = phys | PT_PRESENT | PT_WRITE | PT_HUGE;
+            continue;
+        }
+        pd_table[pd_idx] = pt | PT_PRESENT | PT_WRITE;
+        uint64_t *pt_table = (uint64_t*)PT_VIRT_ADDR((virt >> 39) & 0x1FF, (virt >> 30) & 0x1FF, pd_idx);
+        for (uint64_t i = 0; i < 512; i++) {
+            pt_table[i] = (phys + i * PAGE_SIZE) | PT_PRESENT | PT_WRITE;
+        }
+    }
+
+    trace_event(TRACE_ALLOC, base, (uint32_t)size);
+    return (void*)base;
+}
+
+// Unmaps a vmm_alloc_region() region and returns its memory and page
+// tables to the PMM. Non-static for Zig access.
+void vmm_free_region(void *virt, uint64_t bytes) {
+    uint64_t base = (uint64_t)virt;
+    uint64_t size = (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+
+    for (uint64_t off = 0; off < size; off += HUGE_PAGE_SIZE) {
+        uint64_t virt_addr = base + off;
+        uint64_t pml4_idx = (virt_addr >> 39) & 0x1FF;
+        uint64_t pdpt_idx = (virt_addr >> 30) & 0x1FF;
+        uint64_t pd_idx = (virt_addr >> 21) & 0x1FF;
+
+        uint64_t *pd_table = (uint64_t*)PD_VIRT_ADDR(pml4_idx, pdpt_idx);
+        uint64_t entry = pd_table[pd_idx];
+        if (!(entry & PT_PRESENT)) continue;
+
+        uint64_t addr = entry & 0x000FFFFFFFFFF000UL;
+        if (!(entry & PT_HUGE)) {
+            uint64_t *pt_table = (uint64_t*)PT_VIRT_ADDR(pml4_idx, pdpt_idx, pd_idx);
+            uint64_t data = pt_table[0] & 0x000FFFFFFFFFF000UL;
+            pmm_free_page(addr);  // The page table
+            addr = data;
+        }
+        for (uint64_t i = 0; i < HUGE_PAGE_PAGES; i++) pmm_free_page(addr + i * PAGE_SIZE);
+        pd_table[pd_idx] = 0;
+    }
+
+    // This CPU's TLB only (see VMAP_BASE)
+    uint64_t cr3;
+    __asm__ volatile("mov %%cr3, %0; mov %0, %%cr3" : "=r"(cr3) : : "memory");
+    trace_event(TRACE_FREE, base, 0);
+}
+
 // Kernel Heap (Simple Bump Allocator)
 
 static void heap_init(void) {
@@ -1812,6 +2618,9 @@ static void heap_init(void) {
     heap_current = heap_start;
     heap_end = heap_start + (16 * 1024 * 1024);  // 16MB heap
 
+    // Keep the PMM from handing out heap pages
+    pmm_mark_region_used(heap_start, heap_end - heap_start);
+
     puts("[HEAP] Heap start: ");
     print_hex_64(heap_start);
     puts("\n");
@@ -1827,27 +2636,120 @@ void *kmalloc(uint64_t size) {  // Non-static for Zig access
     // Align to 16 bytes
     size = (size + 15) & ~15UL;
 
-    uint64_t addr = heap_current;
-    heap_current += size;
+    // Zig code allocates on every CPU
+    uint64_t addr = __atomic_fetch_add(&heap_current, size, __ATOMIC_RELAXED);
 
-    if (heap_current >= heap_end) {
+    if (addr + size >= heap_end) {
         puts("[HEAP ERROR] Out of heap memory!\n");
         return 0;
     }
 
+    trace_event(TRACE_ALLOC, addr, (uint32_t)size);
     return (void*)addr;
 }
 
+// align: a power of two
+static void *kmalloc_aligned(uint64_t size, uint64_t align) {
+    uint64_t addr = (uint64_t)kmalloc(size + align - 1);
+    return addr ? (void*)((addr + align - 1) & ~(align - 1)) : 0;
+}
+
+// BSP, before the APs start: make room for 'bytes' more by extending the
+// heap over the free pages right after it. 0 if they are taken.
+static int heap_reserve(uint64_t bytes) {
+    if (heap_current + bytes < heap_end) return 1;
+
+    uint64_t end = PAGE_ALIGN(heap_current + bytes + 1);
+    if (end / PAGE_SIZE > total_pages) return 0;
+    for (uint64_t page = heap_end / PAGE_SIZE; page < end / PAGE_SIZE; page++) {
+        if (pmm_is_page_used(page)) return 0;
+    }
+    pmm_mark_region_used(heap_end, end - heap_end);
+    puts("[HEAP] Grown by ");
+    print_dec_64((end - heap_end) >> 10);
+    puts(" KB to ");
+    print_dec_64((end - heap_start) >> 10);
+    puts(" KB\n");
+    heap_end = end;
+    return 1;
+}
+
 void kfree(void *ptr) {  // Non-static for Zig access
+    trace_event(TRACE_FREE, (uint64_t)ptr, 0);
+
     // Simple bump allocator doesn't support free
     // In a real OS, use a proper allocator (buddy, slab, etc.)
     (void)ptr;
 }
 
+// ============================================================================
+// PER-CPU DATA
+// ============================================================================
+//
+// Per-CPU tables are heap arrays sized by percpu_init() for the CPUs the
+// MADT lists, so a 4-CPU guest doesn't pay for MAX_CPUS and a 256-CPU one
+// doesn't overflow a fixed table. Nothing indexes them before cpu_register(0).
+
+// Zeroed, cache-line aligned array of 'count' elements
+static void *percpu_alloc(uint64_t size, uint64_t count) {
+    void *p = kmalloc_aligned(size * count, 64);
+    if (!p) {
+        puts("[ERROR] Out of memory for per-CPU data\n");
+        puts("System halted.\n");
+        while (1) __asm__ volatile("hlt");
+    }
+    memset(p, 0, size * count);
+    return p;
+}
+
+// BSP, once, after acpi_parse_madt() and before cpu_register(0)
+static void percpu_init(void) {
+    uint64_t n = cpu_count;
+
+    uint64_t per_cpu = AP_STACK_SIZE + sizeof(struct trace_ring) + sizeof(struct prof_cpu) +
+                       2 * sizeof(uint64_t) + 3 * sizeof(void*) + sizeof(CpuTopology) + 1024;
+    if (!heap_reserve(n * per_cpu)) {
+        puts("[HEAP] WARNING: can't grow the heap for ");
+        print_dec_64(n);
+        puts(" CPUs\n");
+    }
+
+    uint32_t slots = 2;
+    while (slots < 2 * n) slots <<= 1;
+    uint64_t *map = percpu_alloc(sizeof(uint64_t), slots);
+    memset(map, 0xFF, slots * sizeof(uint64_t));        // APIC_MAP_EMPTY
+    apic_map_mask = slots - 1;
+    apic_map = map;
+
+    ap_stacks = percpu_alloc(AP_STACK_SIZE, n);
+    timer_ticks = percpu_alloc(sizeof(uint64_t), n);
+    trace_rings = percpu_alloc(sizeof(struct trace_ring), n);
+    prof_cpus = percpu_alloc(sizeof(struct prof_cpu), n);
+    fpu_percpu_init(percpu_alloc(sizeof(void*), n), percpu_alloc(sizeof(void*), n),
+                    percpu_alloc(sizeof(uint64_t), n), n);
+    cpu_topology = percpu_alloc(sizeof(CpuTopology), n);
+    percpu_cpus = n;
+
+    puts("[SMP] Per-CPU data for ");
+    print_dec_64(n);
+    puts(" CPU(s), ");
+    print_dec_64((heap_current - heap_start) >> 10);
+    puts(" KB of heap in use\n");
+}
+
+// XCR0 bits the Zig code was compiled to use (build.zig -Dsimd)
+#ifndef ZIG_REQUIRED_XCR0
+#define ZIG_REQUIRED_XCR0 0
+#endif
+
 // Kernel entry
 void kernel_main(uint64_t multiboot_addr) {
+    boot_phase_end(BOOT_ASM);
     serial_init();
-    vga_init();
+    if (!FAST_BOOT) vga_init();
+    fpu_init();
+    mem_init();
+    boot_phase_end(BOOT_CONSOLE);
 
     puts("\n");
     puts("===========================================\n");
@@ -1859,8 +2761,32 @@ void kernel_main(uint64_t multiboot_addr) {
     print_hex_64(multiboot_addr);
     puts("\n");
 
+    puts("[FPU] XCR0 ");
+    print_hex_64(fpu_xcr0);
+    puts((fpu_xcr0 & XCR0_AVX512) ? " (avx512)" : (fpu_xcr0 & XCR0_AVX) ? " (avx)" : " (sse)");
+    puts(", save area ");
+    print_dec(fpu_area_size);
+    puts(" bytes via ");
+    puts(fpu_mode_names[fpu_mode]);
+    puts("\n");
+    if ((fpu_xcr0 & ZIG_REQUIRED_XCR0) != ZIG_REQUIRED_XCR0) {
+        puts("[FPU] Zig code was built for XCR0 ");
+        print_hex_64(ZIG_REQUIRED_XCR0);
+        puts(" (-Dsimd) - this CPU can't run it, halting\n");
+        while (1) {
+            __asm__ volatile("cli; hlt");
+        }
+    }
+
+    puts("[MEM] memcpy/memset: ");
+    puts(mem_variants[mem_small].name);
+    puts(", bulk (>= 1 MB): ");
+    puts(mem_variants[mem_large].name);
+    puts("\n");
+
     // Parse Multiboot2 memory map
     parse_multiboot_mmap(multiboot_addr);
+    boot_phase_end(BOOT_MMAP);
 
     // Initialize IDT FIRST (before anything that might fault!)
     puts("[IDT] Initializing Interrupt Descriptor Table...\n");
@@ -1868,16 +2794,20 @@ void kernel_main(uint64_t multiboot_addr) {
     puts("[IDT] IDT initialized with 32 exception handlers\n");
     puts("[IDT] IDT loaded successfully!\n");
     puts("\n");
+    boot_phase_end(BOOT_IDT);
 
     // Initialize Physical Memory Manager
     pmm_init(multiboot_addr);
     pmm_mark_free_regions(multiboot_addr);
+    boot_phase_end(BOOT_PMM);
 
     // Initialize Virtual Memory Manager
     vmm_init();
+    boot_phase_end(BOOT_VMM);
 
     // Initialize Kernel Heap
     heap_init();
+    boot_phase_end(BOOT_HEAP);
 
     puts("\n");
 
@@ -1902,7 +2832,10 @@ void kernel_main(uint64_t multiboot_addr) {
     calibrate_tsc();
     puts("[TSC] TSC frequency: ");
     print_dec(tsc_khz);
-    puts(" kHz\n");
+    puts(" kHz (");
+    puts(tsc_khz_source);
+    puts(")\n");
+    boot_phase_end(BOOT_CPU_DETECT);
 
     // ACPI Detection
     puts("\n[ACPI] Searching for RSDP...\n");
@@ -1932,16 +2865,45 @@ void kernel_main(uint64_t multiboot_addr) {
     puts("\n[ACPI] Detected ");
     print_dec(cpu_count);
     puts(" CPU(s)\n");
+    boot_phase_end(BOOT_ACPI);
 
     // Initialize Local APIC
     apic_init();
 
+    // xAPIC destinations are 8 bits and 0xFF is broadcast: leave CPUs with
+    // larger IDs out rather than have every rendezvous wait for them
+    if (!use_x2apic) {
+        int kept = 1;
+        for (int i = 1; i < cpu_count; i++) {
+            if (cpu_apic_ids[i] < 0xFF) cpu_apic_ids[kept++] = cpu_apic_ids[i];
+        }
+        if (kept < cpu_count) {
+            puts("[SMP] WARNING: ");
+            print_dec(cpu_count - kept);
+            puts(" CPU(s) need x2APIC, left offline\n");
+            cpu_count = kept;
+        }
+    }
+    percpu_init();
+    boot_phase_end(BOOT_APIC);
+
+    // Start tracing (the AP wake-up IPIs are the first events) and sampling
+    cpu_register(0);
+    topology_detect(0);
+
+    // Lazy FPU switching needs the IDT (#NM) and this_cpu()
+    puts(fpu_selftest() ? "[FPU] Lazy switch test: PASS\n" : "[FPU] Lazy switch test: FAIL\n");
+    trace_on = 1;
+    prof_on = 1;
+
     // Setup trampoline
     setup_trampoline();
+    boot_phase_end(BOOT_TRAMPOLINE);
 
     // Boot APs
     puts("\n[SMP] Starting AP boot sequence...\n");
     boot_all_aps();
+    boot_phase_end(BOOT_AP_BOOT);
 
     // NOW we can print (SMP boot period is over)
     puts("\n[SMP] Application Processors booted\n");
@@ -1951,6 +2913,8 @@ void kernel_main(uint64_t multiboot_addr) {
     print_dec(cpu_count);
     puts("\n");
 
+    topology_print(cpus_online);
+
     if (cpus_online != (uint32_t)cpu_count) {
         puts("\n[WARNING] Not all CPUs came online\n");
         puts("[INFO] This may be normal in some environments\n");
@@ -1970,6 +2934,7 @@ void kernel_main(uint64_t multiboot_addr) {
     // Start APIC Timer on BSP
     apic_timer_init();
 
+#if !FAST_BOOT
     // Debug: Check BSP timer init details
     puts("[DEBUG] BSP Timer Init:\n");
     puts("  LVT before:  ");
@@ -1994,11 +2959,13 @@ void kernel_main(uint64_t multiboot_addr) {
     puts("  LVT current: ");
     print_hex(bsp_lvt);
     puts("\n");
+#endif
 
     puts("[TIMER] BSP timer started successfully!\n");
 
     // AP timers will be started in ap_entry() now that we have proper VMM
     puts("\n[INFO] APs will initialize their timers in parallel...\n");
+    boot_phase_end(BOOT_TIMER);
 
     // ========================================================================
     // PREPARE BOOT INFO FOR ZIG KERNEL
@@ -2010,6 +2977,7 @@ void kernel_main(uint64_t multiboot_addr) {
     puts("===========================================\n");
     puts("\n");
 
+#if !FAST_BOOT
     puts("[C] Summary of initialized subsystems:\n");
     puts("  [OK] Serial port (COM1)\n");
     puts("  [OK] Memory management (PMM + VMM)\n");
@@ -2027,6 +2995,7 @@ void kernel_main(uint64_t multiboot_addr) {
     puts("  [OK] IDT with 32 exception handlers\n");
     puts("  [OK] APIC timers on all CPUs\n");
     puts("\n");
+#endif
 
     // Get current CR3 for page table physical address
     uint64_t cr3_value;
@@ -2062,15 +3031,25 @@ void kernel_main(uint64_t multiboot_addr) {
         // APIC
         .apic_base = (uintptr_t)apic_base,
         .serial_initialized = 1,
+
+        // SIMD state, identical on every CPU
+        .xcr0 = fpu_xcr0,
+        .fpu_area_size = fpu_area_size,
+
+        .tsc_khz = tsc_khz,
     };
 
     // Fill per-CPU information
+    CpuInfo *cpus = percpu_alloc(sizeof(CpuInfo), cpu_count);
+    boot_info.cpus = cpus;
+    boot_info.topology = cpu_topology;
     for (int i = 0; i < cpu_count; i++) {
-        boot_info.cpus[i].apic_id = cpu_apic_ids[i];
-        boot_info.cpus[i].stack_top = (uintptr_t)&ap_stacks[i][0] + AP_STACK_SIZE;
-        boot_info.cpus[i].online = (i == 0 || cpus_online > i);  // BSP always online
+        cpus[i].apic_id = cpu_apic_ids[i];
+        cpus[i].stack_top = (uintptr_t)&ap_stacks[i][0] + AP_STACK_SIZE;
+        cpus[i].online = (i == 0 || cpus_online > i);  // BSP always online
     }
 
+#if !FAST_BOOT
     puts("[C] BootInfo structure filled:\n");
     puts("  CPU count:     ");
     print_dec(boot_info.cpu_count);
@@ -2094,6 +3073,11 @@ void kernel_main(uint64_t multiboot_addr) {
     puts("  IDT loaded:    ");
     puts(boot_info.idt_loaded ? "YES\n" : "NO\n");
     puts("\n");
+#endif
+
+    // Where the time went (not counting this table)
+    boot_phase_end(BOOT_HANDOFF);
+    boot_phase_report();
 
     // ========================================================================
     // HANDOFF TO ZIG KERNEL
@@ -12,9 +12,18 @@ static inline uint8_t inb(uint16_t port) {
     return ret;
 }
 
-// Write string to serial port
+// Console backend selected by init.c (serial or QEMU debugcon)
+extern int use_debugcon;  // Defined in init.c
+
+// Write string to the console (serial port, or port 0xE9 with -Dconsole=debugcon)
 void c_write_serial(const char* str) {
     const uint16_t COM1 = 0x3F8;
+    if (use_debugcon) {
+        while (*str) {
+            outb(0xE9, *str++);
+        }
+        return;
+    }
     while (*str) {
         // Wait for transmit buffer to be empty
         while ((inb(COM1 + 5) & 0x20) == 0);
@@ -1,14 +1,77 @@
 const std = @import("std");
 
 pub fn build(b: *std.Build) void {
+    // Vector ISA for Zig code (compute.zig's @Vector width). The C bootstrap
+    // halts at boot if the CPU can't enable the register state it needs.
+    const Simd = enum { sse2, avx2, avx512 };
+    const simd = b.option(Simd, "simd", "Vector ISA for Zig code: sse2 (any x86-64), avx2 or avx512") orelse .sse2;
+    const x86 = std.Target.x86;
     const target = b.resolveTargetQuery(.{
         .cpu_arch = .x86_64,
         .os_tag = .freestanding,
         .abi = .none,
+        .cpu_features_add = switch (simd) {
+            .sse2 => .empty,
+            .avx2 => x86.featureSet(&.{ .avx2, .fma }),
+            .avx512 => x86.featureSet(&.{ .avx512f, .avx512bw, .avx512dq, .avx512vl, .fma }),
+        },
     });
+    // XCR0 bits: x87 | SSE | AVX, plus opmask | ZMM_Hi256 | Hi16_ZMM
+    const simd_xcr0: u32 = switch (simd) {
+        .sse2 => 0,
+        .avx2 => 0x7,
+        .avx512 => 0xE7,
+    };
+    const simd_define = b.fmt("-DZIG_REQUIRED_XCR0=0x{x}", .{simd_xcr0});
 
     const optimize = b.standardOptimizeOption(.{});
 
+    // Console backend: serial (COM1, default) or debugcon (QEMU port 0xE9)
+    const ConsoleBackend = enum { serial, debugcon };
+    const console = b.option(ConsoleBackend, "console", "Console backend: serial or debugcon") orelse .serial;
+    const console_define = b.fmt("-DCONSOLE_BACKEND={d}", .{@intFromEnum(console)});
+    const qemu_console = switch (console) {
+        .serial => [_][]const u8{ "-serial", "stdio" },
+        .debugcon => [_][]const u8{ "-debugcon", "stdio" },
+    };
+
+    // Log threshold for kernel/log.zig - messages above it are compiled out
+    const LogLevel = enum { err, warn, info, debug, trace };
+    const log_level = b.option(LogLevel, "log-level", "Kernel log level: err, warn, info, debug or trace") orelse .info;
+
+    // Event tracer - on by default, -Dtrace=false compiles every trace point out
+    const trace = b.option(bool, "trace", "Record per-CPU trace events and dump them at shutdown") orelse true;
+    const trace_define = b.fmt("-DTRACE_ENABLED={d}", .{@intFromBool(trace)});
+
+    // Sampling profiler - always samples RIPs; -Dprofile=true keeps frame
+    // pointers for call stacks and ticks the APIC timer ~100x faster
+    const profile = b.option(bool, "profile", "Frame-pointer stacks and a fast tick for the sampling profiler") orelse false;
+
+    // Fast boot - no VGA, no diagnostic dumps, AP bring-up without fixed delays
+    const fast_boot = b.option(bool, "fast-boot", "Skip VGA, verbose boot output and blind AP start-up delays") orelse false;
+    const fast_boot_define = b.fmt("-DFAST_BOOT={d}", .{@intFromBool(fast_boot)});
+
+    // Page size for the memory benchmarks' buffers (kernel/membench.zig):
+    // 4k, 2m, or both to compare TLB reach
+    const MemPages = enum { @"4k", @"2m", both };
+    const mem_pages = b.option(MemPages, "mem-pages", "Memory benchmark pages: 4k, 2m or both") orelse .both;
+
+    // Most CPUs brought up - per-CPU tables are sized at boot for the CPUs
+    // the MADT lists. A power of two, at most 256 (sort.zig's sample sort
+    // takes one radix bucket per CPU).
+    const max_cpus = b.option(u32, "max-cpus", "Most CPUs to bring up (power of two, 2-256)") orelse 256;
+    if (max_cpus < 2 or max_cpus > 256 or !std.math.isPowerOfTwo(max_cpus)) {
+        std.debug.panic("-Dmax-cpus={d}: need a power of two from 2 to 256", .{max_cpus});
+    }
+    const max_cpus_define = b.fmt("-DMAX_CPUS={d}", .{max_cpus});
+
+    const build_options = b.addOptions();
+    build_options.addOption(u8, "log_level", @intFromEnum(log_level));
+    build_options.addOption(bool, "trace", trace);
+    build_options.addOption(u32, "max_cpus", max_cpus);
+    build_options.addOption(bool, "mem_pages_4k", mem_pages != .@"2m");
+    build_options.addOption(bool, "mem_pages_2m", mem_pages != .@"4k");
+
     // Create kernel executable
     const kernel = b.addExecutable(.{
         .name = "kernel.elf",
@@ -16,6 +79,36 @@ pub fn build(b: *std.Build) void {
         .target = target,
         .optimize = optimize,
     });
+    kernel.root_module.addOptions("build_options", build_options);
+    if (profile) kernel.root_module.omit_frame_pointer = false;
+
+    var c_flags = std.ArrayList([]const u8).init(b.allocator);
+    c_flags.appendSlice(&[_][]const u8{
+        "-std=c11",
+        "-ffreestanding",
+        "-fno-stack-protector",
+        "-fno-pic",
+        "-mno-red-zone",
+        "-mno-80387",
+        "-mno-mmx",
+        "-mno-sse",
+        "-mno-sse2",
+        "-mcmodel=kernel",
+        "-Wall",
+        "-Wextra",
+        console_define,
+        trace_define,
+        fast_boot_define,
+        simd_define,
+        max_cpus_define,
+    }) catch @panic("OOM");
+    if (profile) {
+        c_flags.appendSlice(&[_][]const u8{
+            "-fno-omit-frame-pointer",
+            "-DPROF_DEPTH=16",
+            "-DTIMER_INITIAL_COUNT=100000",
+        }) catch @panic("OOM");
+    }
 
     // Kernel configuration
     kernel.pie = false;
@@ -28,20 +121,12 @@ pub fn build(b: *std.Build) void {
             "boot/init.c",
             "boot/services.c",
         },
-        .flags = &[_][]const u8{
-            "-std=c11",
-            "-ffreestanding",
-            "-fno-stack-protector",
-            "-fno-pic",
-            "-mno-red-zone",
-            "-mno-80387",
-            "-mno-mmx",
-            "-mno-sse",
-            "-mno-sse2",
-            "-mcmodel=kernel",
-            "-Wall",
-            "-Wextra",
-        },
+        .flags = c_flags.items,
+    });
+    // Memory primitives and FPU state, shared with the C kernel
+    kernel.addCSourceFile(.{
+        .file = b.path("../common/simd.c"),
+        .flags = c_flags.items,
     });
 
     // Add assembly files
@@ -108,8 +193,8 @@ pub fn build(b: *std.Build) void {
         "qemu-system-x86_64",
         "-cdrom",
         b.fmt("{s}/boot.iso", .{b.install_path}),
-        "-serial",
-        "stdio",
+        qemu_console[0],
+        qemu_console[1],
         "-display",
         "none",
         "-m",
@@ -126,8 +211,8 @@ pub fn build(b: *std.Build) void {
         "qemu-system-x86_64",
         "-cdrom",
         b.fmt("{s}/boot.iso", .{b.install_path}),
-        "-serial",
-        "stdio",
+        qemu_console[0],
+        qemu_console[1],
         "-display",
         "none",
         "-m",
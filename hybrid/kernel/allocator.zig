@@ -15,11 +15,15 @@ const CHeapAllocator = struct {
         ptr_align: std.mem.Alignment,
         ret_addr: usize,
     ) ?[*]u8 {
-        _ = ptr_align;
         _ = ret_addr;
 
-        const ptr = c_kmalloc(len) orelse return null;
-        return @ptrCast(ptr);
+        // kmalloc blocks are 16-byte aligned; for stricter alignments
+        // over-allocate and round up, like fpu_state_alloc() in init.c.
+        // free() then gets an interior pointer - harmless, kfree is a no-op.
+        const a = ptr_align.toByteUnits();
+        const slack = if (a > 16) a - 16 else 0;
+        const ptr = c_kmalloc(len + slack) orelse return null;
+        return @ptrFromInt(std.mem.alignForward(usize, @intFromPtr(ptr), a));
     }
 
     fn resize(
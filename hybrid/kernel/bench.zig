@@ -0,0 +1,266 @@
+// Microbenchmark harness - same method and JSON schema as the C kernel's
+// bench_run() (c/kernel/minimal_step9.c)
+// Every participating CPU runs an untimed setup, WARMUP untimed calls, then
+// `iters` timed calls fenced with lfence;rdtsc ... rdtscp;lfence, minus the
+// cost of an empty timed region. The BSP prints one JSON line per benchmark
+// with min/median/p99/max/mean/stddev per CPU and over every sample.
+const std = @import("std");
+const c_write_serial = @import("boot_info.zig").c_write_serial;
+const smp = @import("smp.zig");
+
+pub const MAX_ITERS = 1024;
+const WARMUP = 16;
+
+pub const Bench = struct {
+    name: []const u8,
+    run: *const fn (cpu_id: u32) void, // One timed iteration
+    setup: ?*const fn (cpu_id: u32) void = null, // Untimed, once per CPU
+    iters: u32 = 256, // Clamped to MAX_ITERS
+    bsp_only: bool = false,
+};
+
+const Stats = struct {
+    min: u64,
+    median: u64,
+    p99: u64,
+    max: u64,
+    mean: u64,
+    stddev: u64,
+};
+
+// Per CPU (smp.alloc_per_cpu), allocated by the first run()
+var samples: [][MAX_ITERS]u64 = undefined;
+var merged: []u64 = undefined;
+var buffers_ready = false;
+var overhead: []u64 = undefined; // smp.alloc_per_cpu_small, same time
+
+var has_rdtscp: ?bool = null;
+
+// Keep a benchmark's result alive without a volatile store
+pub inline fn sink(value: anytype) void {
+    std.mem.doNotOptimizeAway(value);
+}
+
+fn detect_rdtscp() bool {
+    var eax: u32 = 0x80000000;
+    var edx: u32 = undefined;
+    asm volatile ("cpuid"
+        : [eax] "+{eax}" (eax),
+          [edx] "={edx}" (edx),
+        :
+        : "ebx", "ecx"
+    );
+    if (eax < 0x80000001) return false;
+    eax = 0x80000001;
+    asm volatile ("cpuid"
+        : [eax] "+{eax}" (eax),
+          [edx] "={edx}" (edx),
+        :
+        : "ebx", "ecx"
+    );
+    return (edx & (1 << 27)) != 0;
+}
+
+pub inline fn start() u64 {
+    var lo: u32 = undefined;
+    var hi: u32 = undefined;
+    asm volatile ("lfence; rdtsc"
+        : [lo] "={eax}" (lo),
+          [hi] "={edx}" (hi),
+        :
+        : "memory"
+    );
+    return (@as(u64, hi) << 32) | lo;
+}
+
+// Waits for the timed code to finish, and keeps later code from starting early
+inline fn stop(rdtscp: bool) u64 {
+    var lo: u32 = undefined;
+    var hi: u32 = undefined;
+    if (rdtscp) {
+        asm volatile ("rdtscp; lfence"
+            : [lo] "={eax}" (lo),
+              [hi] "={edx}" (hi),
+            :
+            : "ecx", "memory"
+        );
+    } else {
+        asm volatile ("lfence; rdtsc; lfence"
+            : [lo] "={eax}" (lo),
+              [hi] "={edx}" (hi),
+            :
+            : "memory"
+        );
+    }
+    return (@as(u64, hi) << 32) | lo;
+}
+
+// End of a region opened with start(), for callers timing on their own
+pub fn end() u64 {
+    if (has_rdtscp == null) has_rdtscp = detect_rdtscp();
+    return stop(has_rdtscp.?);
+}
+
+// For callers timing whole operations on the BSP: ctx.run() once untimed
+// to warm up, then once per sample between start() and end(). ctx.prepare(),
+// if ctx has one, runs untimed before every call. Leaves samples sorted for
+// report_series() and returns the median, at least 1.
+pub fn time_median(samples: []u64, ctx: anytype) u64 {
+    var i: usize = 0;
+    while (i <= samples.len) : (i += 1) {
+        if (comptime @hasDecl(@TypeOf(ctx), "prepare")) ctx.prepare();
+        const t0 = start();
+        ctx.run();
+        const t = end() -% t0;
+        if (i > 0) samples[i - 1] = t;
+    }
+    std.mem.sort(u64, samples, {}, std.sort.asc(u64));
+    return @max(samples[samples.len / 2], 1);
+}
+
+// Sorts v in place; all zero for no samples (a Bench with iters = 0)
+fn compute(v: []u64) Stats {
+    const n = v.len;
+    if (n == 0) return .{ .min = 0, .median = 0, .p99 = 0, .max = 0, .mean = 0, .stddev = 0 };
+    std.mem.sort(u64, v, {}, std.sort.asc(u64));
+    var sum: u64 = 0;
+    for (v) |x| sum += x;
+    const mean = sum / n;
+    var variance: u64 = 0;
+    for (v) |x| {
+        const d = if (x > mean) x - mean else mean - x;
+        variance += d * d;
+    }
+    return .{
+        .min = v[0],
+        .median = if ((n & 1) == 1) v[n / 2] else (v[n / 2 - 1] + v[n / 2]) / 2,
+        .p99 = v[(n * 99 + 99) / 100 - 1], // Nearest rank
+        .max = v[n - 1],
+        .mean = mean,
+        .stddev = std.math.sqrt(variance / n),
+    };
+}
+
+// Result lines grow with the CPU count (about 100 bytes per CPU), so they
+// go out in pieces rather than through one fixed line buffer
+const SerialWriter = struct {
+    buf: [256]u8 = undefined,
+    len: usize = 0,
+
+    fn write(self: *SerialWriter, bytes: []const u8) error{}!usize {
+        const n = @min(bytes.len, self.buf.len - 1 - self.len);
+        @memcpy(self.buf[self.len..][0..n], bytes[0..n]);
+        self.len += n;
+        if (self.len == self.buf.len - 1) self.flush();
+        return n;
+    }
+
+    fn flush(self: *SerialWriter) void {
+        self.buf[self.len] = 0;
+        c_write_serial(@ptrCast(&self.buf));
+        self.len = 0;
+    }
+
+    fn writer(self: *SerialWriter) std.io.GenericWriter(*SerialWriter, error{}, write) {
+        return .{ .context = self };
+    }
+};
+
+fn print_stats(w: anytype, s: Stats) !void {
+    try w.print("\"min\":{d},\"median\":{d},\"p99\":{d},\"max\":{d},\"mean\":{d},\"stddev\":{d}", .{ s.min, s.median, s.p99, s.max, s.mean, s.stddev });
+}
+
+fn format_report(w: anytype, b: *const Bench, iters: u32, cpus: u32) !void {
+    try w.print("{{\"bench\":\"{s}\",\"unit\":\"tsc_cycles\",\"iters\":{d},\"cpus\":{d},\"per_cpu\":[", .{ b.name, iters, cpus });
+    var count: usize = 0;
+    var cpu: u32 = 0;
+    while (cpu < cpus) : (cpu += 1) {
+        if (cpu != 0) try w.writeByte(',');
+        try w.print("{{\"cpu\":{d},\"overhead\":{d},", .{ cpu, overhead[cpu] });
+        try print_stats(w, compute(samples[cpu][0..iters]));
+        try w.writeByte('}');
+        @memcpy(merged[count .. count + iters], samples[cpu][0..iters]);
+        count += iters;
+    }
+    try w.writeAll("],\"all\":{");
+    try print_stats(w, compute(merged[0..count]));
+    try w.writeAll("}}\n");
+}
+
+fn report(b: *const Bench, iters: u32, cpus: u32) void {
+    var out = SerialWriter{};
+    format_report(out.writer(), b, iters, cpus) catch {};
+    out.flush();
+}
+
+fn format_series(w: anytype, name: []const u8, cpus: u32, v: []u64, extra: []const u8) !void {
+    try w.print("{{\"bench\":\"{s}\",\"unit\":\"tsc_cycles\",\"iters\":{d},\"cpus\":{d},\"per_cpu\":[],\"all\":{{", .{ name, v.len, cpus });
+    try print_stats(w, compute(v));
+    try w.writeByte('}');
+    if (extra.len != 0) try w.print(",{s}", .{extra});
+    try w.writeAll("}\n");
+}
+
+// One series the caller timed on the BSP (e.g. whole parallel calls): same
+// schema with an empty per_cpu list, `extra` (`"key":value,...`) appended.
+// Sorts v in place.
+pub fn report_series(name: []const u8, cpus: u32, v: []u64, extra: []const u8) void {
+    var out = SerialWriter{};
+    format_series(out.writer(), name, cpus, v, extra) catch {};
+    out.flush();
+}
+
+const Context = struct {
+    bench: *const Bench,
+    iters: u32,
+    rdtscp: bool,
+};
+
+fn worker(cpu_id: u32, ctx: *Context) void {
+    const b = ctx.bench;
+    if (b.bsp_only and cpu_id != 0) return;
+
+    // Cost of an empty timed region, subtracted from every sample
+    var floor: u64 = std.math.maxInt(u64);
+    var i: u32 = 0;
+    while (i < 32) : (i += 1) {
+        const t0 = start();
+        floor = @min(floor, stop(ctx.rdtscp) -% t0);
+    }
+    overhead[cpu_id] = floor;
+
+    if (b.setup) |setup| setup(cpu_id);
+    i = 0;
+    while (i < WARMUP) : (i += 1) b.run(cpu_id);
+
+    i = 0;
+    while (i < ctx.iters) : (i += 1) {
+        const t0 = start();
+        b.run(cpu_id);
+        const t = stop(ctx.rdtscp) -% t0;
+        samples[cpu_id][i] = if (t > floor) t - floor else 0;
+    }
+}
+
+// BSP only; runs b on every CPU in the SMP layer (or just the BSP)
+pub fn run(b: *const Bench) void {
+    if (has_rdtscp == null) has_rdtscp = detect_rdtscp();
+    if (!buffers_ready) {
+        samples = smp.alloc_per_cpu([MAX_ITERS]u64);
+        merged = std.mem.bytesAsSlice(u64, std.mem.sliceAsBytes(smp.alloc_per_cpu([MAX_ITERS]u64)));
+        overhead = smp.alloc_per_cpu_small(u64);
+        buffers_ready = true;
+    }
+
+    var ctx = Context{
+        .bench = b,
+        .iters = @min(b.iters, MAX_ITERS),
+        .rdtscp = has_rdtscp.?,
+    };
+    smp.run_on_all(Context, &ctx, worker);
+    report(b, ctx.iters, if (b.bsp_only) 1 else smp.get_cpu_count());
+}
+
+pub fn run_all(list: []const Bench) void {
+    for (list) |*b| run(b);
+}
@@ -1,14 +1,25 @@
 // Boot information structure received from C bootstrap
 // IMPORTANT: Keep in sync with C definition in shared/boot_info.h
 
-const MAX_CPUS = 16;
-
 pub const CpuInfo = extern struct {
-    apic_id: u8,
+    apic_id: u32,
     stack_top: usize,
     online: bool,
 };
 
+// Each ID is the APIC ID without the bits below that level: two CPUs share
+// a core, an L2, an L3 or a package exactly when those IDs are equal
+pub const CpuTopology = extern struct {
+    apic_id: u32,
+    smt_id: u32, // Thread within its core
+    core_id: u32,
+    package_id: u32,
+    l2_id: u32, // 0xFFFFFFFF: CPUID doesn't describe this cache
+    l3_id: u32, // 0xFFFFFFFF: no L3 (or not described)
+    l2_shift: u32, // APIC ID bits below l2_id
+    l3_shift: u32, // APIC ID bits below l3_id
+};
+
 pub const BootInfo = extern struct {
     // CPU Information
     cpu_count: u32,
@@ -35,17 +46,35 @@ pub const BootInfo = extern struct {
     idt_limit: u16,
     idt_loaded: bool,
 
-    // Per-CPU Information
-    cpus: [MAX_CPUS]CpuInfo,
+    // Per-CPU Information (cpu_count entries, BSP first)
+    cpus: [*]const CpuInfo,
+    topology: [*]const CpuTopology, // By logical CPU (the cpu_id jobs get)
 
     // APIC Base
     apic_base: usize,
 
     // Debug/Serial
     serial_initialized: bool,
+
+    // SIMD state (enabled on every CPU before it runs Zig code)
+    xcr0: u64, // Enabled XSAVE components (0 = SSE without XSAVE)
+    fpu_area_size: u32, // Bytes per thread save area (64-byte aligned)
+
+    // Timing
+    tsc_khz: u64, // TSC ticks per millisecond (calibrated)
 };
 
 // C services that Zig can call back to
 pub extern fn c_write_serial(str: [*:0]const u8) void;
 pub extern fn c_write_serial_hex(value: u64) void;
 pub extern fn c_send_eoi() void;
+pub extern fn prof_dump() void;
+
+// Lazy FPU/SIMD state - see shared/boot_info.h
+pub extern fn fpu_state_alloc() ?*anyopaque;
+pub extern fn fpu_switch(state: ?*anyopaque) void;
+pub extern fn fpu_flush() void;
+
+// Page-mapped PMM regions - see shared/boot_info.h
+pub extern fn vmm_alloc_region(bytes: u64, huge: c_int) ?*anyopaque;
+pub extern fn vmm_free_region(virt: *anyopaque, bytes: u64) void;
@@ -0,0 +1,419 @@
+// Vectorized compute kernels, split across CPUs by the SMP dispatch layer
+// Every kernel hands each CPU of a Group a contiguous share of the input
+// (smp.split) and runs @Vector loops over it - several independent
+// accumulators per loop so vector adds overlap - then the BSP combines the
+// per-CPU results. The vector width follows the ISA Zig is built for
+// (-Dsimd=sse2|avx2|avx512). `scalar` has one-element-at-a-time versions
+// of the same kernels as the reference for tests and benchmarks.
+//
+// A Group runs one kernel at a time, from the BSP only (like smp.run_on_all).
+const std = @import("std");
+const smp = @import("smp.zig");
+const ReduceOp = std.builtin.ReduceOp;
+
+const UNROLL = 4; // Independent vector accumulators per loop iteration
+
+// Elements of T per vector register
+pub fn lanes(comptime T: type) comptime_int {
+    return std.simd.suggestVectorLength(T) orelse 1;
+}
+
+fn is_int(comptime T: type) bool {
+    return switch (@typeInfo(T)) {
+        .int => true,
+        .vector => |v| @typeInfo(v.child) == .int,
+        else => false,
+    };
+}
+
+// Integer sums and products wrap, like the scalar loops in the C kernel
+inline fn add(a: anytype, b: @TypeOf(a)) @TypeOf(a) {
+    return if (comptime is_int(@TypeOf(a))) a +% b else a + b;
+}
+
+inline fn mul(a: anytype, b: @TypeOf(a)) @TypeOf(a) {
+    return if (comptime is_int(@TypeOf(a))) a *% b else a * b;
+}
+
+inline fn apply(comptime op: ReduceOp, a: anytype, b: @TypeOf(a)) @TypeOf(a) {
+    return switch (op) {
+        .Add => add(a, b),
+        .Min => @min(a, b),
+        .Max => @max(a, b),
+        else => @compileError("reduce supports .Add, .Min and .Max"),
+    };
+}
+
+fn identity(comptime T: type, comptime op: ReduceOp) T {
+    const float = @typeInfo(T) == .float;
+    return switch (op) {
+        .Add => 0,
+        .Min => if (float) std.math.inf(T) else std.math.maxInt(T),
+        .Max => if (float) -std.math.inf(T) else std.math.minInt(T),
+        else => @compileError("reduce supports .Add, .Min and .Max"),
+    };
+}
+
+// ============================================================================
+// Per-CPU kernels
+// ============================================================================
+
+fn reduce_slice(comptime T: type, comptime op: ReduceOp, data: []const T) T {
+    const N = lanes(T);
+    const V = @Vector(N, T);
+    var acc = [_]V{@splat(identity(T, op))} ** UNROLL;
+
+    var i: usize = 0;
+    while (i + N * UNROLL <= data.len) : (i += N * UNROLL) {
+        inline for (0..UNROLL) |k| {
+            const v: V = data[i + k * N ..][0..N].*;
+            acc[k] = apply(op, acc[k], v);
+        }
+    }
+    while (i + N <= data.len) : (i += N) {
+        const v: V = data[i..][0..N].*;
+        acc[0] = apply(op, acc[0], v);
+    }
+    inline for (1..UNROLL) |k| acc[0] = apply(op, acc[0], acc[k]);
+
+    var result = @reduce(op, acc[0]);
+    while (i < data.len) : (i += 1) result = apply(op, result, data[i]);
+    return result;
+}
+
+// Lane i of the result comes from lane i - shift of the input, or zero
+fn shift_mask(comptime N: comptime_int, comptime shift: comptime_int) @Vector(N, i32) {
+    var mask: [N]i32 = undefined;
+    for (&mask, 0..) |*m, i| m.* = if (i >= shift) @intCast(i - shift) else -1;
+    return mask;
+}
+
+// Inclusive scan inside one register in log2(N) shift-and-add steps
+inline fn scan_lanes(comptime T: type, comptime N: comptime_int, v: @Vector(N, T)) @Vector(N, T) {
+    const zero: @Vector(N, T) = @splat(0);
+    var x = v;
+    comptime var shift = 1;
+    inline while (shift < N) : (shift *= 2) {
+        x = add(x, @shuffle(T, x, zero, comptime shift_mask(N, shift)));
+    }
+    return x;
+}
+
+fn scan_slice(comptime T: type, data: []const T, out: []T, carry_in: T) void {
+    const N = lanes(T);
+    const V = @Vector(N, T);
+    var carry = carry_in;
+
+    var i: usize = 0;
+    while (i + N <= data.len) : (i += N) {
+        const v = add(scan_lanes(T, N, data[i..][0..N].*), @as(V, @splat(carry)));
+        out[i..][0..N].* = v;
+        carry = v[N - 1];
+    }
+    while (i < data.len) : (i += 1) {
+        carry = add(carry, data[i]);
+        out[i] = carry;
+    }
+}
+
+fn dot_slice(comptime T: type, a: []const T, b: []const T) T {
+    const N = lanes(T);
+    const V = @Vector(N, T);
+    var acc = [_]V{@splat(0)} ** UNROLL;
+
+    var i: usize = 0;
+    while (i + N * UNROLL <= a.len) : (i += N * UNROLL) {
+        inline for (0..UNROLL) |k| {
+            const va: V = a[i + k * N ..][0..N].*;
+            const vb: V = b[i + k * N ..][0..N].*;
+            acc[k] = add(acc[k], mul(va, vb));
+        }
+    }
+    while (i + N <= a.len) : (i += N) {
+        const va: V = a[i..][0..N].*;
+        const vb: V = b[i..][0..N].*;
+        acc[0] = add(acc[0], mul(va, vb));
+    }
+    inline for (1..UNROLL) |k| acc[0] = add(acc[0], acc[k]);
+
+    var result = @reduce(.Add, acc[0]);
+    while (i < a.len) : (i += 1) result = add(result, mul(a[i], b[i]));
+    return result;
+}
+
+fn saxpy_slice(alpha: f32, x: []const f32, y: []f32) void {
+    const N = lanes(f32);
+    const V = @Vector(N, f32);
+    const va: V = @splat(alpha);
+
+    var i: usize = 0;
+    while (i + N * UNROLL <= x.len) : (i += N * UNROLL) {
+        inline for (0..UNROLL) |k| {
+            const vx: V = x[i + k * N ..][0..N].*;
+            const vy: V = y[i + k * N ..][0..N].*;
+            y[i + k * N ..][0..N].* = va * vx + vy;
+        }
+    }
+    while (i < x.len) : (i += 1) y[i] = alpha * x[i] + y[i];
+}
+
+// Increments to data-dependent bins don't vectorize (no scatter-with-
+// conflicts before AVX-512CD). Instead: 8 bytes per load, spread over 4
+// sub-histograms so runs of equal bytes don't serialize on one counter.
+fn histogram_slice(data: []const u8, tables: *[4][256]u32) void {
+    for (tables) |*t| @memset(t, 0);
+
+    var i: usize = 0;
+    while (i + 8 <= data.len) : (i += 8) {
+        const w = std.mem.readInt(u64, data[i..][0..8], .little);
+        inline for (0..8) |k| tables[k % 4][@as(u8, @truncate(w >> (8 * k)))] += 1;
+    }
+    while (i < data.len) : (i += 1) tables[0][data[i]] += 1;
+}
+
+// Per CPU (smp.alloc_per_cpu), allocated by the first histogram()
+var hist_tables: [][4][256]u32 = undefined;
+var hist_ready = false;
+
+// Per CPU (smp.alloc_per_cpu_small), allocated by the first reduce(),
+// scan() or dot(): each CPU's result for the BSP to combine, one line each
+const Partial = struct {
+    bytes: [64]u8 align(64),
+};
+var partials: []Partial = undefined;
+var partials_ready = false;
+
+fn init_partials() void {
+    if (partials_ready) return;
+    partials = smp.alloc_per_cpu_small(Partial);
+    partials_ready = true;
+}
+
+fn partial(comptime T: type, cpu_id: u32) *T {
+    comptime std.debug.assert(@sizeOf(T) <= @sizeOf(Partial));
+    return @ptrCast(&partials[cpu_id].bytes);
+}
+
+// ============================================================================
+// Parallel dispatch
+// ============================================================================
+
+pub const Group = struct {
+    cpus: u32,
+
+    // func(cpu_id, ctx) on CPUs 0..cpus-1; a single CPU skips the dispatch
+    pub fn run(self: Group, comptime Context: type, ctx: *Context, comptime func: fn (cpu_id: u32, ctx: *Context) void) void {
+        if (self.cpus <= 1) return func(0, ctx);
+
+        const Job = struct {
+            ctx: *Context,
+            cpus: u32,
+
+            fn call(cpu_id: u32, job: *@This()) void {
+                if (cpu_id < job.cpus) func(cpu_id, job.ctx);
+            }
+        };
+        var job = Job{ .ctx = ctx, .cpus = self.cpus };
+        smp.run_on_all(Job, &job, Job.call);
+    }
+
+    pub fn reduce(self: Group, comptime T: type, comptime op: ReduceOp, data: []const T) T {
+        const Ctx = struct {
+            data: []const T,
+            cpus: u32,
+
+            fn work(cpu_id: u32, ctx: *@This()) void {
+                const r = smp.split(ctx.data.len, cpu_id, ctx.cpus);
+                partial(T, cpu_id).* = reduce_slice(T, op, ctx.data[r.start..r.end]);
+            }
+        };
+        init_partials();
+        var ctx = Ctx{ .data = data, .cpus = self.cpus };
+        self.run(Ctx, &ctx, Ctx.work);
+
+        var result = partial(T, 0).*;
+        var cpu: u32 = 1;
+        while (cpu < self.cpus) : (cpu += 1) result = apply(op, result, partial(T, cpu).*);
+        return result;
+    }
+
+    pub fn sum(self: Group, comptime T: type, data: []const T) T {
+        return self.reduce(T, .Add, data);
+    }
+
+    pub fn min(self: Group, comptime T: type, data: []const T) T {
+        return self.reduce(T, .Min, data);
+    }
+
+    pub fn max(self: Group, comptime T: type, data: []const T) T {
+        return self.reduce(T, .Max, data);
+    }
+
+    // Inclusive prefix sum, out[i] = data[0] + ... + data[i]. Two passes:
+    // every CPU sums its share, then scans it starting from the total of
+    // the shares before it.
+    pub fn scan(self: Group, comptime T: type, data: []const T, out: []T) void {
+        std.debug.assert(out.len == data.len);
+        const Ctx = struct {
+            data: []const T,
+            out: []T,
+            cpus: u32,
+
+            fn sums(cpu_id: u32, ctx: *@This()) void {
+                const r = smp.split(ctx.data.len, cpu_id, ctx.cpus);
+                partial(T, cpu_id).* = reduce_slice(T, .Add, ctx.data[r.start..r.end]);
+            }
+
+            fn scans(cpu_id: u32, ctx: *@This()) void {
+                const r = smp.split(ctx.data.len, cpu_id, ctx.cpus);
+                scan_slice(T, ctx.data[r.start..r.end], ctx.out[r.start..r.end], partial(T, cpu_id).*);
+            }
+        };
+        init_partials();
+        var ctx = Ctx{ .data = data, .out = out, .cpus = self.cpus };
+        partial(T, 0).* = 0;
+
+        if (self.cpus > 1) {
+            self.run(Ctx, &ctx, Ctx.sums);
+            // Each CPU's carry-in: the exclusive scan of the share totals
+            var carry: T = 0;
+            var cpu: u32 = 0;
+            while (cpu < self.cpus) : (cpu += 1) {
+                const p = partial(T, cpu);
+                const total = p.*;
+                p.* = carry;
+                carry = add(carry, total);
+            }
+        }
+        self.run(Ctx, &ctx, Ctx.scans);
+    }
+
+    pub fn dot(self: Group, comptime T: type, a: []const T, b: []const T) T {
+        std.debug.assert(a.len == b.len);
+        const Ctx = struct {
+            a: []const T,
+            b: []const T,
+            cpus: u32,
+
+            fn work(cpu_id: u32, ctx: *@This()) void {
+                const r = smp.split(ctx.a.len, cpu_id, ctx.cpus);
+                partial(T, cpu_id).* = dot_slice(T, ctx.a[r.start..r.end], ctx.b[r.start..r.end]);
+            }
+        };
+        init_partials();
+        var ctx = Ctx{ .a = a, .b = b, .cpus = self.cpus };
+        self.run(Ctx, &ctx, Ctx.work);
+
+        var result: T = 0;
+        var cpu: u32 = 0;
+        while (cpu < self.cpus) : (cpu += 1) result = add(result, partial(T, cpu).*);
+        return result;
+    }
+
+    // y = alpha * x + y
+    pub fn saxpy(self: Group, alpha: f32, x: []const f32, y: []f32) void {
+        std.debug.assert(x.len == y.len);
+        const Ctx = struct {
+            alpha: f32,
+            x: []const f32,
+            y: []f32,
+            cpus: u32,
+
+            fn work(cpu_id: u32, ctx: *@This()) void {
+                const r = smp.split(ctx.x.len, cpu_id, ctx.cpus);
+                saxpy_slice(ctx.alpha, ctx.x[r.start..r.end], ctx.y[r.start..r.end]);
+            }
+        };
+        var ctx = Ctx{ .alpha = alpha, .x = x, .y = y, .cpus = self.cpus };
+        self.run(Ctx, &ctx, Ctx.work);
+    }
+
+    // bins[v] = number of bytes equal to v
+    pub fn histogram(self: Group, data: []const u8, bins: *[256]u64) void {
+        if (!hist_ready) {
+            hist_tables = smp.alloc_per_cpu([4][256]u32);
+            hist_ready = true;
+        }
+        const Ctx = struct {
+            data: []const u8,
+            cpus: u32,
+
+            fn work(cpu_id: u32, ctx: *@This()) void {
+                const r = smp.split(ctx.data.len, cpu_id, ctx.cpus);
+                histogram_slice(ctx.data[r.start..r.end], &hist_tables[cpu_id]);
+            }
+        };
+        var ctx = Ctx{ .data = data, .cpus = self.cpus };
+        self.run(Ctx, &ctx, Ctx.work);
+
+        for (bins, 0..) |*bin, v| {
+            var count: u64 = 0;
+            for (hist_tables[0..self.cpus]) |*tables| {
+                for (tables) |*t| count += t[v];
+            }
+            bin.* = count;
+        }
+    }
+};
+
+// The first n CPUs of the SMP layer (at least the BSP, at most all of them)
+pub fn group(n: u32) Group {
+    return .{ .cpus = std.math.clamp(n, 1, smp.get_cpu_count()) };
+}
+
+pub fn all() Group {
+    return group(smp.get_cpu_count());
+}
+
+// ============================================================================
+// Scalar references
+// ============================================================================
+
+// One element at a time, on the calling CPU. The volatile loads keep LLVM
+// from vectorizing these loops, so they stay a true scalar baseline.
+pub const scalar = struct {
+    inline fn load(comptime T: type, p: *const T) T {
+        return @as(*const volatile T, p).*;
+    }
+
+    pub fn reduce(comptime T: type, comptime op: ReduceOp, data: []const T) T {
+        var result = identity(T, op);
+        for (data) |*e| result = apply(op, result, load(T, e));
+        return result;
+    }
+
+    pub fn sum(comptime T: type, data: []const T) T {
+        return reduce(T, .Add, data);
+    }
+
+    pub fn min(comptime T: type, data: []const T) T {
+        return reduce(T, .Min, data);
+    }
+
+    pub fn max(comptime T: type, data: []const T) T {
+        return reduce(T, .Max, data);
+    }
+
+    pub fn scan(comptime T: type, data: []const T, out: []T) void {
+        var carry: T = 0;
+        for (data, out) |*e, *o| {
+            carry = add(carry, load(T, e));
+            o.* = carry;
+        }
+    }
+
+    pub fn dot(comptime T: type, a: []const T, b: []const T) T {
+        var result: T = 0;
+        for (a, b) |*x, *y| result = add(result, mul(load(T, x), load(T, y)));
+        return result;
+    }
+
+    pub fn saxpy(alpha: f32, x: []const f32, y: []f32) void {
+        for (x, y) |*vx, *vy| vy.* = alpha * load(f32, vx) + load(f32, vy);
+    }
+
+    pub fn histogram(data: []const u8, bins: *[256]u64) void {
+        @memset(bins, 0);
+        for (data) |*e| bins[load(u8, e)] += 1;
+    }
+};
@@ -0,0 +1,304 @@
+// Cache-blocked matrix multiply, C = A * B (row-major f32 or f64), tiled
+// across CPUs by the SMP dispatch layer
+// The loop nest is the usual five-loop GEMM: nc columns of B at a time, kc
+// of the shared dimension, mc rows of A. The kc x nc panel of B and the
+// mc x kc block of A are packed into per-CPU buffers as MR-row and NR-column
+// slivers, so the micro-kernel reads both with unit stride. The micro-kernel
+// keeps an MR x NR tile of C in @Vector registers (MR * NR / lanes of them)
+// and adds one rank-1 update per k. kc and mc come from the L1d and L2
+// sizes CPUID reports (blocking()).
+//
+// CPUs get a 2D grid of C tiles (grid()), each a whole number of
+// micro-tiles. A CPU owns its tile outright: it packs its own slices of A
+// and B, so there is no sharing and no synchronisation inside a multiply.
+const std = @import("std");
+const builtin = @import("builtin");
+const smp = @import("smp.zig");
+const compute = @import("compute.zig");
+
+pub const MR = 6; // Rows of a micro-tile
+// Columns of a micro-tile: two vectors, so MR * 2 accumulators, two B
+// vectors and a broadcast fit the 16 vector registers of SSE2/AVX2
+pub fn nr(comptime T: type) comptime_int {
+    return 2 * compute.lanes(T);
+}
+
+// Limits of the static packing buffers (elements)
+const MC_MAX = 96;
+const KC_MAX = 256;
+const NC_MAX = 128;
+
+comptime {
+    std.debug.assert(MC_MAX % MR == 0 and NC_MAX % nr(f32) == 0 and NC_MAX % nr(f64) == 0);
+}
+
+const has_fma = builtin.cpu.arch == .x86_64 and
+    std.Target.x86.featureSetHas(builtin.cpu.features, .fma);
+
+// a * b + c - one instruction when Zig is built with FMA (-Dsimd=avx2 or
+// avx512); @mulAdd without it would be a libcall per lane
+inline fn madd(comptime V: type, a: V, b: V, c: V) V {
+    return if (has_fma) @mulAdd(V, a, b, c) else a * b + c;
+}
+
+// ============================================================================
+// Cache sizes and blocking
+// ============================================================================
+
+pub const Caches = struct {
+    l1d: usize = 32 * 1024,
+    l2: usize = 256 * 1024,
+    source: []const u8 = "default",
+};
+
+pub fn cpuid(leaf: u32, subleaf: u32) [4]u32 {
+    var eax: u32 = undefined;
+    var ebx: u32 = undefined;
+    var ecx: u32 = undefined;
+    var edx: u32 = undefined;
+    asm volatile ("cpuid"
+        : [eax] "={eax}" (eax),
+          [ebx] "={ebx}" (ebx),
+          [ecx] "={ecx}" (ecx),
+          [edx] "={edx}" (edx),
+        : [leaf] "{eax}" (leaf),
+          [subleaf] "{ecx}" (subleaf),
+    );
+    return .{ eax, ebx, ecx, edx };
+}
+
+// Deterministic cache parameters: leaf 4 on Intel, 0x8000001D (same
+// layout) on AMD. Size = ways * partitions * line size * sets.
+pub fn detect_caches() Caches {
+    var c = Caches{};
+    const max_leaf = cpuid(0, 0)[0];
+    const max_ext = cpuid(0x80000000, 0)[0];
+    const leaf: u32 = if (max_leaf >= 4 and (cpuid(4, 0)[0] & 0x1F) != 0)
+        4
+    else if (max_ext >= 0x8000001D and (cpuid(0x8000001D, 0)[0] & 0x1F) != 0)
+        0x8000001D
+    else
+        return c;
+
+    var sub: u32 = 0;
+    while (sub < 16) : (sub += 1) {
+        const r = cpuid(leaf, sub);
+        const kind = r[0] & 0x1F; // 1 data, 2 instruction, 3 unified
+        if (kind == 0) break;
+        const level = (r[0] >> 5) & 7;
+        const size = @as(usize, (r[1] >> 22) + 1) * (((r[1] >> 12) & 0x3FF) + 1) *
+            ((r[1] & 0xFFF) + 1) * (@as(usize, r[2]) + 1);
+        if (level == 1 and kind == 1) c.l1d = size;
+        if (level == 2 and kind != 2) c.l2 = size;
+    }
+    c.source = if (leaf == 4) "cpuid 4" else "cpuid 0x8000001d";
+    return c;
+}
+
+pub const Blocking = struct {
+    mc: usize, // Multiple of MR
+    kc: usize,
+    nc: usize, // Multiple of nr(T)
+};
+
+// kc: an MR x kc sliver of A and a kc x NR sliver of B fill half the L1d.
+// mc: the packed mc x kc block of A fills half the L2. nc would follow the
+// L3; here it is the packing buffer's limit.
+pub fn blocking(comptime T: type, caches: Caches) Blocking {
+    const sliver = (MR + nr(T)) * @sizeOf(T);
+    const kc = std.math.clamp(caches.l1d / 2 / sliver / 8 * 8, 16, KC_MAX);
+    const mc = std.math.clamp(caches.l2 / 2 / (kc * @sizeOf(T)) / MR * MR, MR, MC_MAX);
+    return .{ .mc = mc, .kc = kc, .nc = NC_MAX };
+}
+
+// ============================================================================
+// Packing and micro-kernel
+// ============================================================================
+
+// Per CPU (smp.alloc_per_cpu), allocated by the first gemm(). Sized in
+// f64; f32 packs into the same bytes.
+var pack_a_buf: [][MC_MAX * KC_MAX]f64 = undefined;
+var pack_b_buf: [][KC_MAX * NC_MAX]f64 = undefined;
+var pack_ready = false;
+
+fn pack_buf(comptime T: type, buf: anytype) []T {
+    return std.mem.bytesAsSlice(T, std.mem.sliceAsBytes(buf));
+}
+
+// mc x kc block of A -> MR-row slivers, each stored k-major (MR values per
+// k); rows past mc are zero
+fn pack_a(comptime T: type, mc: usize, kc: usize, a: []const T, lda: usize, out: []T) void {
+    var ir: usize = 0;
+    while (ir < mc) : (ir += MR) {
+        const sliver = out[ir * kc ..];
+        const rows = @min(MR, mc - ir);
+        for (0..kc) |p| {
+            inline for (0..MR) |i| {
+                sliver[p * MR + i] = if (i < rows) a[(ir + i) * lda + p] else 0;
+            }
+        }
+    }
+}
+
+// kc x nc panel of B -> NR-column slivers, each stored k-major (one row of
+// NR values per k); columns past nc are zero
+fn pack_b(comptime T: type, kc: usize, nc: usize, b: []const T, ldb: usize, out: []T) void {
+    const NR = nr(T);
+    var jr: usize = 0;
+    while (jr < nc) : (jr += NR) {
+        const sliver = out[jr * kc ..];
+        const cols = @min(NR, nc - jr);
+        for (0..kc) |p| {
+            const dst = sliver[p * NR ..][0..NR];
+            const src = b[p * ldb + jr ..];
+            if (cols == NR) {
+                dst.* = src[0..NR].*;
+            } else {
+                @memset(dst, 0);
+                @memcpy(dst[0..cols], src[0..cols]);
+            }
+        }
+    }
+}
+
+// C[0..m, 0..n] += (MR x kc sliver of A) * (kc x NR sliver of B), m <= MR
+// and n <= NR. The whole tile accumulates in registers.
+fn micro_kernel(comptime T: type, kc: usize, a: []const T, b: []const T, c: []T, ldc: usize, m: usize, n: usize) void {
+    const L = compute.lanes(T);
+    const V = @Vector(L, T);
+    const NR = nr(T);
+    const NV = NR / L;
+
+    var acc = [_][NV]V{[_]V{@splat(0)} ** NV} ** MR;
+    for (0..kc) |p| {
+        var bv: [NV]V = undefined;
+        inline for (0..NV) |v| bv[v] = b[p * NR + v * L ..][0..L].*;
+        inline for (0..MR) |i| {
+            const av: V = @splat(a[p * MR + i]);
+            inline for (0..NV) |v| acc[i][v] = madd(V, av, bv[v], acc[i][v]);
+        }
+    }
+
+    if (m == MR and n == NR) {
+        inline for (0..MR) |i| {
+            inline for (0..NV) |v| {
+                const dst = c[i * ldc + v * L ..][0..L];
+                dst.* = @as(V, dst.*) + acc[i][v];
+            }
+        }
+        return;
+    }
+    // Edge tile: only the rows and columns inside C
+    for (0..m) |i| {
+        var row: [NR]T = undefined;
+        inline for (0..NV) |v| row[v * L ..][0..L].* = acc[i][v];
+        for (c[i * ldc ..][0..n], row[0..n]) |*dst, x| dst.* += x;
+    }
+}
+
+// ============================================================================
+// Parallel multiply
+// ============================================================================
+
+// rows x cols = p, as square as p allows (rows <= cols)
+pub fn grid(p: u32) [2]u32 {
+    var rows: u32 = 1;
+    var d: u32 = 1;
+    while (d * d <= p) : (d += 1) {
+        if (p % d == 0) rows = d;
+    }
+    return .{ rows, p / rows };
+}
+
+fn Job(comptime T: type) type {
+    return struct {
+        blk: Blocking,
+        m: usize,
+        n: usize,
+        k: usize,
+        a: []const T,
+        b: []const T,
+        c: []T,
+        rows: u32,
+        cols: u32,
+
+        // This CPU's tile of C: a share of the MR-row and NR-column
+        // micro-tiles, zeroed and then accumulated over all of k
+        fn work(cpu_id: u32, job: *@This()) void {
+            const NR = nr(T);
+            const ru = smp.split(std.math.divCeil(usize, job.m, MR) catch unreachable, cpu_id / job.cols, job.rows);
+            const cu = smp.split(std.math.divCeil(usize, job.n, NR) catch unreachable, cpu_id % job.cols, job.cols);
+            const i_0 = ru.start * MR;
+            const i_1 = @min(ru.end * MR, job.m);
+            const j_0 = cu.start * NR;
+            const j_1 = @min(cu.end * NR, job.n);
+            if (i_0 >= i_1 or j_0 >= j_1) return;
+
+            var i = i_0;
+            while (i < i_1) : (i += 1) @memset(job.c[i * job.n + j_0 .. i * job.n + j_1], 0);
+
+            const ap = pack_buf(T, &pack_a_buf[cpu_id]);
+            const bp = pack_buf(T, &pack_b_buf[cpu_id]);
+            var jc = j_0;
+            while (jc < j_1) : (jc += job.blk.nc) {
+                const nc = @min(job.blk.nc, j_1 - jc);
+                var pc: usize = 0;
+                while (pc < job.k) : (pc += job.blk.kc) {
+                    const kc = @min(job.blk.kc, job.k - pc);
+                    pack_b(T, kc, nc, job.b[pc * job.n + jc ..], job.n, bp);
+                    var ic = i_0;
+                    while (ic < i_1) : (ic += job.blk.mc) {
+                        const mc = @min(job.blk.mc, i_1 - ic);
+                        pack_a(T, mc, kc, job.a[ic * job.k + pc ..], job.k, ap);
+                        macro_kernel(T, mc, nc, kc, ap, bp, job.c[ic * job.n + jc ..], job.n);
+                    }
+                }
+            }
+        }
+    };
+}
+
+fn macro_kernel(comptime T: type, mc: usize, nc: usize, kc: usize, ap: []const T, bp: []const T, c: []T, ldc: usize) void {
+    const NR = nr(T);
+    var jr: usize = 0;
+    while (jr < nc) : (jr += NR) {
+        var ir: usize = 0;
+        while (ir < mc) : (ir += MR) {
+            micro_kernel(T, kc, ap[ir * kc ..], bp[jr * kc ..], c[ir * ldc + jr ..], ldc, @min(MR, mc - ir), @min(NR, nc - jr));
+        }
+    }
+}
+
+// C (m x n) = A (m x k) * B (k x n), all row-major and dense. BSP only.
+pub fn gemm(comptime T: type, g: compute.Group, blk: Blocking, m: usize, n: usize, k: usize, a: []const T, b: []const T, c: []T) void {
+    std.debug.assert(a.len >= m * k and b.len >= k * n and c.len >= m * n);
+    std.debug.assert(blk.mc % MR == 0 and blk.mc <= MC_MAX and blk.kc <= KC_MAX);
+    std.debug.assert(blk.nc % nr(T) == 0 and blk.nc <= NC_MAX);
+    if (!pack_ready) {
+        pack_a_buf = smp.alloc_per_cpu([MC_MAX * KC_MAX]f64);
+        pack_b_buf = smp.alloc_per_cpu([KC_MAX * NC_MAX]f64);
+        pack_ready = true;
+    }
+    const shape = grid(g.cpus);
+    const J = Job(T);
+    var job = J{ .blk = blk, .m = m, .n = n, .k = k, .a = a, .b = b, .c = c, .rows = shape[0], .cols = shape[1] };
+    g.run(J, &job, J.work);
+}
+
+// Triple loop on the calling CPU - the reference for tests and benchmarks
+pub fn reference(comptime T: type, m: usize, n: usize, k: usize, a: []const T, b: []const T, c: []T) void {
+    for (0..m) |i| {
+        for (0..n) |j| {
+            var sum: T = 0;
+            for (0..k) |p| sum += a[i * k + p] * b[p * n + j];
+            c[i * n + j] = sum;
+        }
+    }
+}
+
+// Sum of all elements, in f64
+pub fn checksum(comptime T: type, c: []const T) f64 {
+    var sum: f64 = 0;
+    for (c) |x| sum += @floatCast(x);
+    return sum;
+}
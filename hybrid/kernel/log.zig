@@ -0,0 +1,51 @@
+// Leveled logging for the Zig kernel
+// Each subsystem gets a scope; calls above the build-time threshold
+// (-Dlog-level=...) are comptime-dead and cost nothing. Enabled calls format
+// the whole line into a stack buffer and hand it to the C console in one write.
+const std = @import("std");
+const c_write_serial = @import("boot_info.zig").c_write_serial;
+const build_options = @import("build_options");
+
+pub const Level = enum(u8) { err, warn, info, debug, trace };
+
+pub const threshold: Level = @enumFromInt(build_options.log_level);
+
+const LINE_MAX = 160;
+
+pub fn scoped(comptime scope: []const u8) type {
+    return struct {
+        pub fn err(comptime fmt: []const u8, args: anytype) void {
+            log(.err, scope, fmt, args);
+        }
+        pub fn warn(comptime fmt: []const u8, args: anytype) void {
+            log(.warn, scope, fmt, args);
+        }
+        pub fn info(comptime fmt: []const u8, args: anytype) void {
+            log(.info, scope, fmt, args);
+        }
+        pub fn debug(comptime fmt: []const u8, args: anytype) void {
+            log(.debug, scope, fmt, args);
+        }
+        pub fn trace(comptime fmt: []const u8, args: anytype) void {
+            log(.trace, scope, fmt, args);
+        }
+    };
+}
+
+pub inline fn enabled(comptime level: Level) bool {
+    return @intFromEnum(level) <= @intFromEnum(threshold);
+}
+
+fn log(comptime level: Level, comptime scope: []const u8, comptime fmt: []const u8, args: anytype) void {
+    if (comptime !enabled(level)) return;
+
+    var buf: [LINE_MAX]u8 = undefined;
+    const prefix = "[Zig:" ++ scope ++ "] ";
+    const line = std.fmt.bufPrintZ(&buf, prefix ++ fmt ++ "\n", args) catch blk: {
+        // Too long - emit what fits, terminated
+        buf[LINE_MAX - 2] = '\n';
+        buf[LINE_MAX - 1] = 0;
+        break :blk buf[0 .. LINE_MAX - 1 :0];
+    };
+    c_write_serial(line.ptr);
+}
@@ -2,8 +2,15 @@
 const BootInfo = @import("boot_info.zig").BootInfo;
 const c_write_serial = @import("boot_info.zig").c_write_serial;
 const c_write_serial_hex = @import("boot_info.zig").c_write_serial_hex;
+const prof_dump = @import("boot_info.zig").prof_dump;
 const tests = @import("tests.zig");
+const smp = @import("smp.zig");
+const topology = @import("topology.zig");
 const allocator_mod = @import("allocator.zig");
+const log = @import("log.zig");
+const trace = @import("trace.zig");
+
+const smp_log = log.scoped("smp");
 
 // Panic handler (required for freestanding)
 pub const panic = @import("panic.zig").panic;
@@ -44,32 +51,27 @@ export fn zig_kernel_main(boot_info: *const BootInfo) callconv(.C) noreturn {
     write_dec_u64(boot_info.free_mem_size);
     c_write_serial(" bytes\n\n");
 
-    // Display per-CPU information
-    c_write_serial("[Zig] Per-CPU Information:\n");
+    // Per-CPU information (debug builds only)
     var i: u32 = 0;
     while (i < boot_info.cpu_count) : (i += 1) {
-        c_write_serial("  CPU ");
-        write_dec_u32(i);
-        c_write_serial(": APIC ID ");
-        write_dec_u32(boot_info.cpus[i].apic_id);
-        c_write_serial(", Online: ");
-        if (boot_info.cpus[i].online) {
-            c_write_serial("YES\n");
-        } else {
-            c_write_serial("NO\n");
-        }
+        smp_log.debug("CPU {d}: APIC ID {d}, online: {}", .{ i, boot_info.cpus[i].apic_id, boot_info.cpus[i].online });
     }
 
     // Test memory allocator
     allocator_mod.test_allocator();
 
+    // Wait for APs to check in with the Zig SMP layer
+    smp.init(boot_info);
+    smp_log.info("APs ready for work: {d}", .{smp.get_cpu_count() - 1});
+    topology.init(boot_info);
+
     c_write_serial("\n");
     c_write_serial("===========================================\n");
     c_write_serial("  Running Parallel Computation Tests\n");
     c_write_serial("===========================================\n");
     c_write_serial("\n");
 
-    // Run parallel tests (APs already running, waiting for work)
+    // Run parallel tests (APs parked in smp.zig, waiting for work)
     tests.run_all(boot_info);
 
     c_write_serial("\n");
@@ -77,6 +79,11 @@ export fn zig_kernel_main(boot_info: *const BootInfo) callconv(.C) noreturn {
     c_write_serial("[SUCCESS] Zig kernel completed!\n");
     c_write_serial("===========================================\n");
 
+    // Shutdown: hand the event trace and profile to the host
+    // (tools/trace2chrome.py, tools/prof_fold.py)
+    trace.dump();
+    prof_dump();
+
     // Halt
     while (true) {
         asm volatile ("hlt");
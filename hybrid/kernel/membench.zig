@@ -0,0 +1,332 @@
+// Memory benchmarks on page-mapped PMM memory
+// Buffers come from vmm_alloc_region() (boot/init.c): physical 2MB chunks
+// from the PMM, mapped in a fresh virtual window with 4KB or 2MB pages, so
+// the two runs differ only in TLB reach (-Dmem-pages=4k|2m|both).
+// For each page size:
+//  - latency: a pointer chase through a random cyclic chain of cache lines,
+//    over working sets from 4 KB to the whole region. Every load depends
+//    on the previous one, so the time per load is the latency of whichever
+//    level (L1/L2/L3/DRAM, plus page walks) the working set spills to.
+//  - read bandwidth: a vector sum over the same working sets on one CPU
+//  - STREAM copy/scale/add/triad over three arrays of a quarter of the
+//    region each, on one CPU and on every CPU; best of STREAM_REPS, and
+//    the results checked like stream.c does.
+// BSP only, like everything built on smp.run_on_all.
+const std = @import("std");
+const build_options = @import("build_options");
+const boot_info = @import("boot_info.zig");
+const c_write_serial = boot_info.c_write_serial;
+const compute = @import("compute.zig");
+const bench = @import("bench.zig");
+const smp = @import("smp.zig");
+
+const REGION_MAX = 64 * 1024 * 1024;
+const REGION_MIN = 4 * 1024 * 1024;
+const LINE = 64;
+const CHASE_STEPS = 1 << 20;
+const SWEEP_MIN = 4 * 1024;
+const SWEEP_BYTES = 64 * 1024 * 1024; // Read per bandwidth point
+const TRIALS = 3;
+const STREAM_REPS = 5;
+const STREAM_SCALAR: f64 = 3.0;
+
+pub const Region = struct {
+    mem: []align(4096) u8,
+    huge: bool,
+
+    // Largest power-of-two size from `max` down to REGION_MIN that fits
+    pub fn alloc(max: usize, huge: bool) ?Region {
+        var size = max;
+        while (size >= REGION_MIN) : (size /= 2) {
+            if (boot_info.vmm_alloc_region(size, @intFromBool(huge))) |p| {
+                const base: [*]align(4096) u8 = @ptrCast(@alignCast(p));
+                return .{ .mem = base[0..size], .huge = huge };
+            }
+        }
+        return null;
+    }
+
+    pub fn free(self: Region) void {
+        boot_info.vmm_free_region(@ptrCast(self.mem.ptr), self.mem.len);
+    }
+
+    fn label(self: Region) []const u8 {
+        return if (self.huge) "2m" else "4k";
+    }
+};
+
+fn print(comptime fmt: []const u8, args: anytype) void {
+    var buf: [256]u8 = undefined;
+    const s = std.fmt.bufPrintZ(&buf, fmt, args) catch return;
+    c_write_serial(s.ptr);
+}
+
+// xorshift64 - the chains only need to defeat the prefetchers
+fn next_random(state: *u64) u64 {
+    var x = state.*;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    state.* = x;
+    return x;
+}
+
+// ============================================================================
+// Latency
+// ============================================================================
+
+// One pointer per cache line of buf[0..lines * LINE], forming a single
+// random cycle (Sattolo's shuffle). Returns the first node.
+fn build_chain(buf: []align(4096) u8, lines: usize, seed: u64) usize {
+    const base = @intFromPtr(buf.ptr);
+    for (0..lines) |i| node(base, i).* = base + i * LINE;
+    var rng = seed | 1;
+    var i = lines - 1;
+    while (i > 0) : (i -= 1) {
+        const j = next_random(&rng) % i;
+        std.mem.swap(usize, node(base, i), node(base, j));
+    }
+    return base;
+}
+
+inline fn node(base: usize, i: usize) *usize {
+    return @ptrFromInt(base + i * LINE);
+}
+
+fn chase(start: usize, steps: usize) usize {
+    var p = start;
+    var i: usize = 0;
+    while (i < steps) : (i += 8) {
+        inline for (0..8) |_| p = @as(*const volatile usize, @ptrFromInt(p)).*;
+    }
+    return p;
+}
+
+fn latency_sweep(r: Region, tsc_khz: u64) void {
+    print("  {s:<10} {s:>10} {s:>10} {s:>10}\n", .{ "latency", "ws_kb", "cycles", "ns/load" });
+    var ws: usize = SWEEP_MIN;
+    while (ws <= r.mem.len) : (ws *= 2) {
+        const start = build_chain(r.mem, ws / LINE, ws);
+        bench.sink(chase(start, @min(ws / LINE, CHASE_STEPS))); // Warm caches and TLB
+
+        var samples: [TRIALS]u64 = undefined;
+        for (&samples) |*s| {
+            const t0 = bench.start();
+            bench.sink(chase(start, CHASE_STEPS));
+            s.* = bench.end() -% t0;
+        }
+        std.mem.sort(u64, &samples, {}, std.sort.asc(u64));
+        const per_load = @as(f64, @floatFromInt(samples[TRIALS / 2])) / CHASE_STEPS;
+        const ns = per_load * 1e6 / @as(f64, @floatFromInt(tsc_khz));
+        print("  {s:<10} {d:>10} {d:>10.1} {d:>10.2}\n", .{ "", ws / 1024, per_load, ns });
+
+        var name_buf: [64]u8 = undefined;
+        const name = std.fmt.bufPrint(&name_buf, "mem_lat_{s}_{d}k", .{ r.label(), ws / 1024 }) catch "mem_lat";
+        var extra_buf: [96]u8 = undefined;
+        const extra = std.fmt.bufPrint(&extra_buf, "\"ws_bytes\":{d},\"loads\":{d},\"ns_per_load\":{d:.2}", .{ ws, CHASE_STEPS, ns }) catch "";
+        bench.report_series(name, 1, &samples, extra);
+    }
+}
+
+// ============================================================================
+// Bandwidth
+// ============================================================================
+
+fn bandwidth_sweep(r: Region, tsc_khz: u64) void {
+    print("  {s:<10} {s:>10} {s:>10} {s:>10}\n", .{ "read bw", "ws_kb", "cycles", "GB/s" });
+    const data = std.mem.bytesAsSlice(f64, r.mem);
+    @memset(data, 1.0);
+    const g = compute.group(1);
+
+    var ws: usize = SWEEP_MIN;
+    while (ws <= r.mem.len) : (ws *= 2) {
+        const v = data[0 .. ws / @sizeOf(f64)];
+        const passes = @max(SWEEP_BYTES / ws, 1);
+        bench.sink(g.sum(f64, v));
+
+        var samples: [TRIALS]u64 = undefined;
+        for (&samples) |*s| {
+            const t0 = bench.start();
+            for (0..passes) |_| bench.sink(g.sum(f64, v));
+            s.* = bench.end() -% t0;
+        }
+        std.mem.sort(u64, &samples, {}, std.sort.asc(u64));
+        const bytes = ws * passes;
+        const gbps = gb_per_s(bytes, samples[0], tsc_khz);
+        print("  {s:<10} {d:>10} {d:>10} {d:>10.2}\n", .{ "", ws / 1024, samples[0], gbps });
+
+        var name_buf: [64]u8 = undefined;
+        const name = std.fmt.bufPrint(&name_buf, "mem_bw_{s}_{d}k", .{ r.label(), ws / 1024 }) catch "mem_bw";
+        var extra_buf: [96]u8 = undefined;
+        const extra = std.fmt.bufPrint(&extra_buf, "\"ws_bytes\":{d},\"bytes\":{d},\"best_gbps\":{d:.2}", .{ ws, bytes, gbps }) catch "";
+        bench.report_series(name, 1, &samples, extra);
+    }
+}
+
+fn gb_per_s(bytes: usize, cycles: u64, tsc_khz: u64) f64 {
+    return @as(f64, @floatFromInt(bytes)) * @as(f64, @floatFromInt(tsc_khz)) /
+        (@as(f64, @floatFromInt(@max(cycles, 1))) * 1e6);
+}
+
+// ============================================================================
+// STREAM
+// ============================================================================
+
+const StreamOp = enum { copy, scale, add, triad };
+
+// Bytes moved per element, as stream.c counts them
+fn stream_bytes(op: StreamOp) usize {
+    return switch (op) {
+        .copy, .scale => 2 * @sizeOf(f64),
+        .add, .triad => 3 * @sizeOf(f64),
+    };
+}
+
+fn stream_slice(comptime op: StreamOp, a: []f64, b: []f64, c: []f64) void {
+    const N = compute.lanes(f64);
+    const V = @Vector(N, f64);
+    const q: V = @splat(STREAM_SCALAR);
+
+    var i: usize = 0;
+    while (i + N <= a.len) : (i += N) {
+        switch (op) {
+            .copy => c[i..][0..N].* = a[i..][0..N].*,
+            .scale => b[i..][0..N].* = q * @as(V, c[i..][0..N].*),
+            .add => c[i..][0..N].* = @as(V, a[i..][0..N].*) + @as(V, b[i..][0..N].*),
+            .triad => a[i..][0..N].* = @as(V, b[i..][0..N].*) + q * @as(V, c[i..][0..N].*),
+        }
+    }
+    while (i < a.len) : (i += 1) {
+        switch (op) {
+            .copy => c[i] = a[i],
+            .scale => b[i] = STREAM_SCALAR * c[i],
+            .add => c[i] = a[i] + b[i],
+            .triad => a[i] = b[i] + STREAM_SCALAR * c[i],
+        }
+    }
+}
+
+fn stream(comptime op: StreamOp, g: compute.Group, a: []f64, b: []f64, c: []f64) void {
+    const Ctx = struct {
+        a: []f64,
+        b: []f64,
+        c: []f64,
+        cpus: u32,
+
+        fn work(cpu_id: u32, ctx: *@This()) void {
+            const r = smp.split(ctx.a.len, cpu_id, ctx.cpus);
+            stream_slice(op, ctx.a[r.start..r.end], ctx.b[r.start..r.end], ctx.c[r.start..r.end]);
+        }
+    };
+    var ctx = Ctx{ .a = a, .b = b, .c = c, .cpus = g.cpus };
+    g.run(Ctx, &ctx, Ctx.work);
+}
+
+// stream.c's check: replay the iterations on one element and compare
+fn stream_check(a: []const f64, b: []const f64, c: []const f64, iterations: usize) bool {
+    var aj: f64 = 1.0;
+    var bj: f64 = 2.0;
+    var cj: f64 = 0.0;
+    for (0..iterations) |_| {
+        cj = aj;
+        bj = STREAM_SCALAR * cj;
+        cj = aj + bj;
+        aj = bj + STREAM_SCALAR * cj;
+    }
+    for (a, b, c) |x, y, z| {
+        if (x != aj or y != bj or z != cj) return false;
+    }
+    return true;
+}
+
+fn stream_suite(r: Region, tsc_khz: u64) void {
+    const all = std.mem.bytesAsSlice(f64, r.mem);
+    const n = all.len / 4;
+    const a = all[0..n];
+    const b = all[n .. 2 * n];
+    const c = all[2 * n .. 3 * n];
+
+    print("  {s:<10} {s:>10} {s:>10} {s:>10}   ({d} MB per array)\n", .{ "STREAM", "cpus", "best", "GB/s", n * @sizeOf(f64) >> 20 });
+    const sizes = [_]u32{ 1, smp.get_cpu_count() };
+    const groups: []const u32 = if (sizes[1] > 1) &sizes else sizes[0..1];
+    for (groups) |cpus| {
+        const g = compute.group(cpus);
+        @memset(a, 1.0);
+        @memset(b, 2.0);
+        @memset(c, 0.0);
+
+        var samples: [4][STREAM_REPS]u64 = undefined;
+        for (0..STREAM_REPS) |k| {
+            inline for (comptime std.enums.values(StreamOp), 0..) |op, o| {
+                const t0 = bench.start();
+                stream(op, g, a, b, c);
+                samples[o][k] = bench.end() -% t0;
+            }
+        }
+        const ok = stream_check(a, b, c, STREAM_REPS);
+
+        inline for (comptime std.enums.values(StreamOp), 0..) |op, o| {
+            const s = &samples[o];
+            std.mem.sort(u64, s, {}, std.sort.asc(u64));
+            const bytes = n * stream_bytes(op);
+            const gbps = gb_per_s(bytes, s[0], tsc_khz);
+            print("  {s:<10} {d:>10} {d:>10} {d:>10.2}\n", .{ @tagName(op), cpus, s[0], gbps });
+
+            var name_buf: [64]u8 = undefined;
+            const name = std.fmt.bufPrint(&name_buf, "stream_{s}_{s}_{d}cpu", .{ @tagName(op), r.label(), cpus }) catch "stream";
+            var extra_buf: [96]u8 = undefined;
+            const extra = std.fmt.bufPrint(&extra_buf, "\"bytes\":{d},\"best_gbps\":{d:.2},\"valid\":{}", .{ bytes, gbps, ok }) catch "";
+            bench.report_series(name, cpus, s, extra);
+        }
+        print("  {s:<10} {d:>10} {s:>21}\n", .{ "check", cpus, if (ok) "ok" else "FAILED" });
+    }
+}
+
+// ============================================================================
+// Entry points
+// ============================================================================
+
+// The whole suite once per page size enabled with -Dmem-pages
+pub fn run(tsc_khz: u64) void {
+    for ([_]bool{ false, true }) |huge| {
+        if (!(if (huge) build_options.mem_pages_2m else build_options.mem_pages_4k)) continue;
+        const r = Region.alloc(REGION_MAX, huge) orelse {
+            print("\n[Bench] Memory: no {s} region of at least {d} MB\n", .{ if (huge) "2MB-page" else "4KB-page", REGION_MIN >> 20 });
+            continue;
+        };
+        print("\n[Bench] Memory, {s} pages: {d} MB region at 0x{x}\n", .{ if (huge) "2MB" else "4KB", r.mem.len >> 20, @intFromPtr(r.mem.ptr) });
+        latency_sweep(r, tsc_khz);
+        bandwidth_sweep(r, tsc_khz);
+        stream_suite(r, tsc_khz);
+        r.free();
+    }
+}
+
+// Maps regions with both page sizes, writes a different value into every
+// 4 KB page and reads them all back, then frees them and maps again (the
+// freed chunks are reused). Catches overlapping or misdirected mappings.
+pub fn selftest() bool {
+    var ok = true;
+    for (0..2) |_| {
+        const small = Region.alloc(REGION_MIN, false) orelse return false;
+        const large = Region.alloc(REGION_MIN, true) orelse {
+            small.free();
+            return false;
+        };
+        for ([_]Region{ small, large }, 0..) |r, k| {
+            const words = std.mem.bytesAsSlice(u64, r.mem);
+            var page: usize = 0;
+            while (page < words.len) : (page += 4096 / @sizeOf(u64)) words[page] = page * 2 + k;
+        }
+        for ([_]Region{ small, large }, 0..) |r, k| {
+            const words = std.mem.bytesAsSlice(u64, r.mem);
+            var page: usize = 0;
+            while (page < words.len) : (page += 4096 / @sizeOf(u64)) {
+                if (words[page] != page * 2 + k) ok = false;
+            }
+        }
+        large.free();
+        small.free();
+    }
+    return ok;
+}
@@ -0,0 +1,127 @@
+// SMP work dispatch - run Zig functions on every online CPU
+// The C bootstrap hands each AP to zig_ap_main() once its APIC and timer
+// are up; APs then wait here until the BSP publishes a job.
+const std = @import("std");
+const BootInfo = @import("boot_info.zig").BootInfo;
+const vmm_alloc_region = @import("boot_info.zig").vmm_alloc_region;
+const allocator = @import("allocator.zig");
+const trace = @import("trace.zig");
+const build_options = @import("build_options");
+
+pub const MAX_CPUS = build_options.max_cpus; // -Dmax-cpus, same cap as the C side
+pub const CACHE_LINE_SIZE = 64;
+
+const JobFn = *const fn (cpu_id: u32, ctx: *anyopaque) void;
+
+// Current job (written by BSP before bumping job_generation)
+var job_func: JobFn = undefined;
+var job_ctx: *anyopaque = undefined;
+
+// Each counter on its own cache line: APs spin on job_generation while
+// finishing APs hammer job_done
+var job_generation: u32 align(CACHE_LINE_SIZE) = 0; // Bumped by BSP to publish a job
+var job_done: u32 align(CACHE_LINE_SIZE) = 0; // APs finished with the current job
+var aps_ready: u32 align(CACHE_LINE_SIZE) = 0; // APs parked in zig_ap_main
+var cpu_count: u32 = 1; // CPUs taking part in jobs (BSP + ready APs)
+
+// Wait for the APs the C bootstrap brought online to reach zig_ap_main
+pub fn init(boot_info: *const BootInfo) void {
+    var online: u32 = 0;
+    var i: u32 = 0;
+    while (i < boot_info.cpu_count) : (i += 1) {
+        if (boot_info.cpus[i].online) online += 1;
+    }
+
+    var spins: u32 = 0;
+    while (@atomicLoad(u32, &aps_ready, .acquire) + 1 < online and spins < 100_000_000) : (spins += 1) {
+        asm volatile ("pause");
+    }
+
+    @atomicStore(u32, &cpu_count, @atomicLoad(u32, &aps_ready, .acquire) + 1, .release);
+}
+
+pub fn get_cpu_count() u32 {
+    return cpu_count;
+}
+
+// One T per CPU taking part in jobs. Per-CPU scratch can't live on the
+// job's stack - APs run on 8KB stacks (AP_STACK_SIZE in boot/init.c) - and
+// a static [MAX_CPUS]T pays for MAX_CPUS copies on any guest, so per-CPU
+// tables are sized for the CPUs present. Tables of more than a few hundred
+// bytes per CPU come from here: page-mapped from the PMM
+// (vmm_alloc_region), not the 16MB heap; never freed. BSP only, after
+// init(); contents undefined.
+pub fn alloc_per_cpu(comptime T: type) []T {
+    const n = cpu_count;
+    const raw = vmm_alloc_region(@as(u64, @sizeOf(T)) * n, 0) orelse @panic("out of memory for per-CPU data");
+    const items: [*]T = @ptrCast(@alignCast(raw));
+    return items[0..n];
+}
+
+// Smaller tables (counters, flags, result slots) come from the kernel heap
+// instead of a 2MB region each. Zeroed and cache-line aligned; never
+// freed. BSP only, after init().
+pub fn alloc_per_cpu_small(comptime T: type) []T {
+    const items = allocator.get_allocator().alignedAlloc(T, CACHE_LINE_SIZE, cpu_count) catch
+        @panic("out of memory for per-CPU data");
+    @memset(items, std.mem.zeroes(T));
+    return items;
+}
+
+// Run func(cpu_id, ctx) on every CPU (BSP included, as CPU 0) and return
+// once all of them have finished. BSP only.
+pub fn run_on_all(comptime Context: type, ctx: *Context, comptime func: fn (cpu_id: u32, ctx: *Context) void) void {
+    const Wrapper = struct {
+        fn call(cpu_id: u32, raw: *anyopaque) void {
+            func(cpu_id, @ptrCast(@alignCast(raw)));
+        }
+    };
+
+    job_func = Wrapper.call;
+    job_ctx = ctx;
+    @atomicStore(u32, &job_done, 0, .monotonic);
+    const generation = @atomicRmw(u32, &job_generation, .Add, 1, .release) +% 1;
+
+    Wrapper.call(0, ctx);
+    trace.barrier(generation);
+
+    while (@atomicLoad(u32, &job_done, .acquire) + 1 < cpu_count) {
+        asm volatile ("pause");
+    }
+}
+
+// Contiguous share of [0, len) for one CPU - remainder spread over the first CPUs
+pub const Range = struct {
+    start: usize,
+    end: usize,
+};
+
+pub fn split(len: usize, cpu_id: u32, n: u32) Range {
+    const chunk = len / n;
+    const rem = len % n;
+    const start = cpu_id * chunk + @min(cpu_id, rem);
+    const extra: usize = if (cpu_id < rem) 1 else 0;
+    return .{ .start = start, .end = start + chunk + extra };
+}
+
+// AP main loop (called from C ap_entry, never returns)
+export fn zig_ap_main(cpu_id: u32) callconv(.C) noreturn {
+    var seen = @atomicLoad(u32, &job_generation, .acquire);
+    _ = @atomicRmw(u32, &aps_ready, .Add, 1, .release);
+
+    while (true) {
+        const generation = @atomicLoad(u32, &job_generation, .acquire);
+        if (generation == seen) {
+            asm volatile ("pause");
+            continue;
+        }
+        seen = generation;
+
+        // APs that came up after init() are not counted in cpu_count
+        if (cpu_id < @atomicLoad(u32, &cpu_count, .acquire)) {
+            job_func(cpu_id, job_ctx);
+            trace.barrier(generation);
+            _ = @atomicRmw(u32, &job_done, .Add, 1, .release);
+        }
+    }
+}
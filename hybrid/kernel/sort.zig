@@ -0,0 +1,375 @@
+// Parallel sorting of u64 keys, split across CPUs by the SMP dispatch layer
+// Two sorts share one partition pass:
+//  - radix: LSD radix sort, 8 bits per pass. Every CPU histograms its share
+//    of the keys, the BSP turns the per-CPU histograms into per-CPU write
+//    offsets, then every CPU moves its share. Digits all keys share (high
+//    bytes of small keys) cost one histogram and no data movement.
+//  - sample: sample sort. Splitters picked from a sorted sample cut the key
+//    range into one bucket per CPU, a partition pass moves every key into
+//    its bucket, then each CPU sorts its own bucket.
+// The partition pass is cache-aware: rather than storing each key straight
+// to its bucket (up to 256 scattered write streams per CPU), a CPU collects
+// keys in one cache line per bucket and writes whole lines out.
+//
+// Sorts of up to NETWORK keys - the leaves of the local quicksort - run in
+// registers through a bitonic network of @Vector min/max when
+// Options.network is set. The default follows the ISA Zig is built for:
+// only AVX-512 has unsigned 64-bit vector min/max (vpminuq/vpmaxuq); below
+// that LLVM emulates them with compare sequences, so it starts off.
+//
+// Every sort takes a scratch buffer at least as long as the keys and leaves
+// the result in `keys`. Like compute.zig: one sort at a time, BSP only.
+const std = @import("std");
+const builtin = @import("builtin");
+const smp = @import("smp.zig");
+const compute = @import("compute.zig");
+
+const MAX_CPUS = smp.MAX_CPUS;
+const RADIX_BITS = 8;
+const RADIX = 1 << RADIX_BITS;
+const LINE_KEYS = 64 / @sizeOf(u64); // Keys per cache line
+const OVERSAMPLE = 32; // Sample keys per bucket when picking splitters
+pub const NETWORK = 16; // Largest sort done by the sorting network
+
+comptime {
+    // Splitters tables are powers of two up to MAX_CPUS; sample buckets live
+    // in the radix histograms
+    std.debug.assert(std.math.isPowerOfTwo(MAX_CPUS) and MAX_CPUS <= RADIX);
+}
+
+pub const Options = struct {
+    network: bool = builtin.cpu.arch == .x86_64 and
+        std.Target.x86.featureSetHas(builtin.cpu.features, .avx512f),
+};
+
+// ============================================================================
+// Small sorts
+// ============================================================================
+
+// Lane i is compared with lane i ^ j
+fn bitonic_partner(comptime n: comptime_int, comptime j: comptime_int) @Vector(n, i32) {
+    var mask: [n]i32 = undefined;
+    for (&mask, 0..) |*m, i| m.* = @intCast(i ^ j);
+    return mask;
+}
+
+// Lane i keeps the smaller key when it is the lower lane of its pair in an
+// ascending block (i & k == 0), or the upper lane in a descending one
+fn bitonic_take_min(comptime n: comptime_int, comptime k: comptime_int, comptime j: comptime_int) @Vector(n, bool) {
+    var mask: [n]bool = undefined;
+    for (&mask, 0..) |*m, i| m.* = ((i & j) == 0) == ((i & k) == 0);
+    return mask;
+}
+
+// Bitonic sorting network: log2(n) * (log2(n) + 1) / 2 compare-exchange
+// stages, each one shuffle, one min, one max and one select
+inline fn bitonic(comptime n: comptime_int, v: @Vector(n, u64)) @Vector(n, u64) {
+    var x = v;
+    comptime var k = 2;
+    inline while (k <= n) : (k *= 2) {
+        comptime var j = k / 2;
+        inline while (j > 0) : (j /= 2) {
+            const other = @shuffle(u64, x, undefined, comptime bitonic_partner(n, j));
+            x = @select(u64, comptime bitonic_take_min(n, k, j), @min(x, other), @max(x, other));
+        }
+    }
+    return x;
+}
+
+// Up to NETWORK keys, padded with the largest key so the real ones sort first
+fn network_sort(keys: []u64) void {
+    var buf = [_]u64{std.math.maxInt(u64)} ** NETWORK;
+    @memcpy(buf[0..keys.len], keys);
+    buf = bitonic(NETWORK, buf);
+    @memcpy(keys, buf[0..keys.len]);
+}
+
+fn insertion_sort(keys: []u64) void {
+    var i: usize = 1;
+    while (i < keys.len) : (i += 1) {
+        const k = keys[i];
+        var j = i;
+        while (j > 0 and keys[j - 1] > k) : (j -= 1) keys[j] = keys[j - 1];
+        keys[j] = k;
+    }
+}
+
+// Hoare partition around the median of the first, middle and last keys.
+// Returns p with keys[0..p] <= pivot <= keys[p..], both sides non-empty.
+fn partition_keys(keys: []u64) usize {
+    const last = keys.len - 1;
+    const mid = last / 2;
+    if (keys[mid] < keys[0]) std.mem.swap(u64, &keys[0], &keys[mid]);
+    if (keys[last] < keys[mid]) {
+        std.mem.swap(u64, &keys[mid], &keys[last]);
+        if (keys[mid] < keys[0]) std.mem.swap(u64, &keys[0], &keys[mid]);
+    }
+    const pivot = keys[mid];
+
+    var i: usize = 0;
+    var j: usize = last;
+    while (true) {
+        while (keys[i] < pivot) i += 1;
+        while (keys[j] > pivot) j -= 1;
+        if (i >= j) return j + 1;
+        std.mem.swap(u64, &keys[i], &keys[j]);
+        i += 1;
+        j -= 1;
+    }
+}
+
+// Quicksort that recurses into the smaller side (stack depth <= log2 n),
+// falls back to heapsort past the depth limit, and finishes partitions of
+// up to NETWORK keys with the network or insertion sort
+fn quicksort(keys_in: []u64, depth_in: u32, network: bool) void {
+    var keys = keys_in;
+    var depth = depth_in;
+    while (keys.len > NETWORK) {
+        if (depth == 0) return std.sort.heap(u64, keys, {}, std.sort.asc(u64));
+        depth -= 1;
+        const p = partition_keys(keys);
+        if (p < keys.len - p) {
+            quicksort(keys[0..p], depth, network);
+            keys = keys[p..];
+        } else {
+            quicksort(keys[p..], depth, network);
+            keys = keys[0..p];
+        }
+    }
+    if (network) network_sort(keys) else insertion_sort(keys);
+}
+
+// Sequential sort on the calling CPU (each sample-sort bucket)
+pub fn local_sort(keys: []u64, opt: Options) void {
+    const depth = 2 * (@as(u32, std.math.log2_int(usize, keys.len | 1)) + 1);
+    quicksort(keys, depth, opt.network);
+}
+
+// ============================================================================
+// Partition pass
+// ============================================================================
+
+// Per-CPU histogram, then write offsets, plus one line buffer per bucket.
+// One per CPU (smp.alloc_per_cpu), allocated by the first sort.
+const PartState = struct {
+    lines: [RADIX][LINE_KEYS]u64 align(64),
+    count: [RADIX]usize,
+    fill: [RADIX]u8,
+};
+var part: []PartState = undefined;
+var part_ready = false;
+
+// BSP, before a pass runs
+fn init_part() void {
+    if (part_ready) return;
+    part = smp.alloc_per_cpu(PartState);
+    part_ready = true;
+}
+
+// Bucket = one byte of the key
+const Digit = struct {
+    const buckets = RADIX;
+    shift: u6,
+
+    inline fn bucket(self: *const Digit, key: u64) usize {
+        return @as(u8, @truncate(key >> self.shift));
+    }
+};
+
+// Bucket = number of splitters below the key, out of a power-of-two
+// table of n buckets. Unused splitters are the largest key, so no key goes
+// past the last real bucket.
+fn Splitters(comptime n: usize) type {
+    return struct {
+        const buckets = n;
+        s: [n - 1]u64,
+
+        // Branch-free binary search over the sorted splitters
+        inline fn bucket(self: *const @This(), key: u64) usize {
+            var b: usize = 0;
+            comptime var step = n / 2;
+            inline while (step > 0) : (step /= 2) {
+                if (key > self.s[b + step - 1]) b += step;
+            }
+            return b;
+        }
+    };
+}
+
+fn Pass(comptime C: type) type {
+    return struct {
+        cls: C,
+        src: []const u64,
+        dst: []u64,
+        cpus: u32,
+
+        fn count(cpu_id: u32, p: *@This()) void {
+            const st = &part[cpu_id];
+            const r = smp.split(p.src.len, cpu_id, p.cpus);
+            @memset(st.count[0..C.buckets], 0);
+            for (p.src[r.start..r.end]) |k| st.count[p.cls.bucket(k)] += 1;
+        }
+
+        // Moves this CPU's share to the offsets left in st.count; a bucket's
+        // keys go out a full cache line at a time, the rest at the end
+        fn scatter(cpu_id: u32, p: *@This()) void {
+            const st = &part[cpu_id];
+            const r = smp.split(p.src.len, cpu_id, p.cpus);
+            @memset(st.fill[0..C.buckets], 0);
+            for (p.src[r.start..r.end]) |k| {
+                const b = p.cls.bucket(k);
+                const f = st.fill[b];
+                st.lines[b][f] = k;
+                if (f == LINE_KEYS - 1) {
+                    p.dst[st.count[b]..][0..LINE_KEYS].* = st.lines[b];
+                    st.count[b] += LINE_KEYS;
+                    st.fill[b] = 0;
+                } else {
+                    st.fill[b] = f + 1;
+                }
+            }
+            for (0..C.buckets) |b| {
+                const f = st.fill[b];
+                @memcpy(p.dst[st.count[b]..][0..f], st.lines[b][0..f]);
+            }
+        }
+    };
+}
+
+// True when one bucket holds all n keys (the pass would move nothing)
+fn single_bucket(cpus: u32, comptime buckets: usize, n: usize) bool {
+    for (0..buckets) |b| {
+        var total: usize = 0;
+        for (part[0..cpus]) |*st| total += st.count[b];
+        if (total != 0) return total == n;
+    }
+    return true;
+}
+
+// Per-CPU counts -> write offsets, bucket-major and CPU-minor: every bucket
+// holds CPU 0's keys, then CPU 1's, ... which keeps the pass stable.
+// `bounds` (if given) gets where each bucket starts, then the total.
+fn offsets(cpus: u32, comptime buckets: usize, bounds: ?*[buckets + 1]usize) void {
+    var base: usize = 0;
+    for (0..buckets) |b| {
+        if (bounds) |bd| bd[b] = base;
+        for (part[0..cpus]) |*st| {
+            const c = st.count[b];
+            st.count[b] = base;
+            base += c;
+        }
+    }
+    if (bounds) |bd| bd[buckets] = base;
+}
+
+fn copy(g: compute.Group, src: []const u64, dst: []u64) void {
+    const Ctx = struct {
+        src: []const u64,
+        dst: []u64,
+        cpus: u32,
+
+        fn work(cpu_id: u32, ctx: *@This()) void {
+            const r = smp.split(ctx.src.len, cpu_id, ctx.cpus);
+            @memcpy(ctx.dst[r.start..r.end], ctx.src[r.start..r.end]);
+        }
+    };
+    var ctx = Ctx{ .src = src, .dst = dst, .cpus = g.cpus };
+    g.run(Ctx, &ctx, Ctx.work);
+}
+
+// ============================================================================
+// Sorts
+// ============================================================================
+
+// Stable LSD radix sort, 64 / RADIX_BITS passes ping-ponging between keys
+// and tmp. The key distribution doesn't matter, only which bytes vary.
+pub fn radix_sort(g: compute.Group, keys: []u64, tmp: []u64) void {
+    std.debug.assert(tmp.len >= keys.len);
+    init_part();
+    const P = Pass(Digit);
+    var src = keys;
+    var dst = tmp[0..keys.len];
+
+    var shift: u32 = 0;
+    while (shift < 64) : (shift += RADIX_BITS) {
+        var pass = P{ .cls = .{ .shift = @intCast(shift) }, .src = src, .dst = dst, .cpus = g.cpus };
+        g.run(P, &pass, P.count);
+        if (single_bucket(g.cpus, RADIX, keys.len)) continue;
+        offsets(g.cpus, RADIX, null);
+        g.run(P, &pass, P.scatter);
+        std.mem.swap([]u64, &src, &dst);
+    }
+    if (src.ptr != keys.ptr) copy(g, src, keys);
+}
+
+// OVERSAMPLE keys per CPU (smp.alloc_per_cpu_small), allocated by the
+// first sample_sort(); the sample is sorted on the BSP
+var sample_buf: [][OVERSAMPLE]u64 = undefined;
+var sample_ready = false;
+
+// SplitMix64 finalizer: spreads the sample positions inside their strides
+fn mix(x: u64) u64 {
+    var z = x +% 0x9E3779B97F4A7C15;
+    z = (z ^ (z >> 30)) *% 0xBF58476D1CE4E5B9;
+    z = (z ^ (z >> 27)) *% 0x94D049BB133111EB;
+    return z ^ (z >> 31);
+}
+
+// Sample sort: one bucket per CPU. Buckets are as even as the sample is
+// representative; many copies of one key all land in the same bucket.
+pub fn sample_sort(g: compute.Group, keys: []u64, tmp: []u64, opt: Options) void {
+    std.debug.assert(tmp.len >= keys.len);
+    const n = keys.len;
+    const m = @as(usize, g.cpus) * OVERSAMPLE;
+    if (g.cpus <= 1 or n < 4 * m) return local_sort(keys, opt);
+
+    // One sample key at a random spot in each of m even strides
+    const stride = n / m;
+    if (!sample_ready) {
+        sample_buf = smp.alloc_per_cpu_small([OVERSAMPLE]u64);
+        sample_ready = true;
+    }
+    const sample = std.mem.bytesAsSlice(u64, std.mem.sliceAsBytes(sample_buf))[0..m];
+    for (sample, 0..) |*s, i| s.* = keys[i * stride + mix(i) % stride];
+    local_sort(sample, opt);
+
+    // Smallest splitter table that covers the group, so a 4-CPU sort
+    // searches 2 levels per key rather than log2(MAX_CPUS)
+    comptime var size: usize = 2;
+    inline while (size <= MAX_CPUS) : (size *= 2) {
+        if (g.cpus <= size) return sample_partition(Splitters(size), g, keys, tmp, sample, opt);
+    }
+    unreachable;
+}
+
+// Buckets keys around the sample's splitters, then sorts each bucket
+fn sample_partition(comptime S: type, g: compute.Group, keys: []u64, tmp: []u64, sample: []const u64, opt: Options) void {
+    const n = keys.len;
+    var cls = S{ .s = [_]u64{std.math.maxInt(u64)} ** (S.buckets - 1) };
+    for (1..g.cpus) |b| cls.s[b - 1] = sample[b * OVERSAMPLE];
+
+    init_part();
+    const P = Pass(S);
+    var pass = P{ .cls = cls, .src = keys, .dst = tmp[0..n], .cpus = g.cpus };
+    var bounds: [S.buckets + 1]usize = undefined;
+    g.run(P, &pass, P.count);
+    offsets(g.cpus, S.buckets, &bounds);
+    g.run(P, &pass, P.scatter);
+
+    // Bucket cpu_id is sorted in tmp and copied back to the same place
+    const Ctx = struct {
+        keys: []u64,
+        tmp: []u64,
+        bounds: *const [S.buckets + 1]usize,
+        opt: Options,
+
+        fn work(cpu_id: u32, ctx: *@This()) void {
+            const lo = ctx.bounds[cpu_id];
+            const hi = ctx.bounds[cpu_id + 1];
+            local_sort(ctx.tmp[lo..hi], ctx.opt);
+            @memcpy(ctx.keys[lo..hi], ctx.tmp[lo..hi]);
+        }
+    };
+    var ctx = Ctx{ .keys = keys, .tmp = tmp, .bounds = &bounds, .opt = opt };
+    g.run(Ctx, &ctx, Ctx.work);
+}
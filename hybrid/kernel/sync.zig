@@ -0,0 +1,173 @@
+// Lock-free primitives for sharing work and buffers between CPUs
+// Both types are fixed-size, need no allocator and can live in static memory.
+const CACHE_LINE_SIZE = @import("smp.zig").CACHE_LINE_SIZE;
+
+// Bounded multi-producer/multi-consumer queue (Vyukov sequence-number ring)
+//
+// Each cell carries a sequence number telling whose turn it is:
+//   seq == pos          -> free, a producer at pos may claim it
+//   seq == pos + 1      -> full, a consumer at pos may claim it
+//   seq == pos + N      -> released by the consumer for the next lap
+// Producers and consumers only contend on their own position counter.
+pub fn MpmcQueue(comptime T: type, comptime capacity: usize) type {
+    if (capacity < 2 or (capacity & (capacity - 1)) != 0) {
+        @compileError("MpmcQueue capacity must be a power of two >= 2");
+    }
+
+    return struct {
+        const Self = @This();
+        const mask = capacity - 1;
+
+        const Cell = struct {
+            sequence: usize,
+            data: T,
+        };
+
+        cells: [capacity]Cell = undefined,
+        enqueue_pos: usize align(CACHE_LINE_SIZE) = 0,
+        dequeue_pos: usize align(CACHE_LINE_SIZE) = 0,
+
+        // Must be called before use (and only while no CPU is using the queue)
+        pub fn init(self: *Self) void {
+            for (&self.cells, 0..) |*cell, i| {
+                cell.sequence = i;
+            }
+            self.enqueue_pos = 0;
+            self.dequeue_pos = 0;
+        }
+
+        // Returns false if the queue is full
+        pub fn push(self: *Self, value: T) bool {
+            var pos = @atomicLoad(usize, &self.enqueue_pos, .monotonic);
+            while (true) {
+                const cell = &self.cells[pos & mask];
+                const seq = @atomicLoad(usize, &cell.sequence, .acquire);
+                const diff = @as(isize, @bitCast(seq -% pos));
+
+                if (diff == 0) {
+                    if (@cmpxchgWeak(usize, &self.enqueue_pos, pos, pos +% 1, .monotonic, .monotonic)) |actual| {
+                        pos = actual;
+                        continue;
+                    }
+                    cell.data = value;
+                    @atomicStore(usize, &cell.sequence, pos +% 1, .release);
+                    return true;
+                } else if (diff < 0) {
+                    return false; // Consumer hasn't freed this cell yet
+                } else {
+                    pos = @atomicLoad(usize, &self.enqueue_pos, .monotonic);
+                }
+            }
+        }
+
+        // Returns null if the queue is empty
+        pub fn pop(self: *Self) ?T {
+            var pos = @atomicLoad(usize, &self.dequeue_pos, .monotonic);
+            while (true) {
+                const cell = &self.cells[pos & mask];
+                const seq = @atomicLoad(usize, &cell.sequence, .acquire);
+                const diff = @as(isize, @bitCast(seq -% (pos +% 1)));
+
+                if (diff == 0) {
+                    if (@cmpxchgWeak(usize, &self.dequeue_pos, pos, pos +% 1, .monotonic, .monotonic)) |actual| {
+                        pos = actual;
+                        continue;
+                    }
+                    const value = cell.data;
+                    @atomicStore(usize, &cell.sequence, pos +% capacity, .release);
+                    return value;
+                } else if (diff < 0) {
+                    return null; // Producer hasn't filled this cell yet
+                } else {
+                    pos = @atomicLoad(usize, &self.dequeue_pos, .monotonic);
+                }
+            }
+        }
+    };
+}
+
+// Fixed-size lock-free object pool
+//
+// Free objects form a Treiber stack of indices. The head packs a 32-bit
+// modification tag above the index so a pop that races with pop/push/pop of
+// the same object (ABA) fails its CAS instead of installing a stale link.
+pub fn ObjectPool(comptime T: type, comptime capacity: u32) type {
+    if (capacity == 0 or capacity >= NIL) {
+        @compileError("ObjectPool capacity out of range");
+    }
+
+    return struct {
+        const Self = @This();
+
+        objects: [capacity]T = undefined,
+        next: [capacity]u32 = undefined, // Free-list link per object
+        head: u64 align(CACHE_LINE_SIZE) = pack(0, NIL), // (tag << 32) | index
+
+        fn pack(tag: u32, index: u32) u64 {
+            return (@as(u64, tag) << 32) | index;
+        }
+
+        fn index_of(word: u64) u32 {
+            return @truncate(word);
+        }
+
+        fn tag_of(word: u64) u32 {
+            return @truncate(word >> 32);
+        }
+
+        // Must be called before use (and only while no CPU is using the pool)
+        pub fn init(self: *Self) void {
+            var i: u32 = 0;
+            while (i < capacity) : (i += 1) {
+                self.next[i] = if (i + 1 < capacity) i + 1 else NIL;
+            }
+            @atomicStore(u64, &self.head, pack(0, 0), .release);
+        }
+
+        // Returns null if every object is in use
+        pub fn alloc(self: *Self) ?*T {
+            var old = @atomicLoad(u64, &self.head, .acquire);
+            while (true) {
+                const index = index_of(old);
+                if (index == NIL) return null;
+
+                // May read a link that is stale by now - the tag makes the CAS fail then
+                const next = @atomicLoad(u32, &self.next[index], .monotonic);
+                const new = pack(tag_of(old) +% 1, next);
+                if (@cmpxchgWeak(u64, &self.head, old, new, .acquire, .acquire)) |actual| {
+                    old = actual;
+                    continue;
+                }
+                return &self.objects[index];
+            }
+        }
+
+        pub fn free(self: *Self, obj: *T) void {
+            const offset = @intFromPtr(obj) - @intFromPtr(&self.objects[0]);
+            const index: u32 = @intCast(offset / @sizeOf(T));
+
+            var old = @atomicLoad(u64, &self.head, .monotonic);
+            while (true) {
+                @atomicStore(u32, &self.next[index], index_of(old), .monotonic);
+                const new = pack(tag_of(old) +% 1, index);
+                if (@cmpxchgWeak(u64, &self.head, old, new, .release, .monotonic)) |actual| {
+                    old = actual;
+                    continue;
+                }
+                return;
+            }
+        }
+
+        // Number of free objects (walks the list - only meaningful when quiescent)
+        pub fn count_free(self: *Self) u32 {
+            var n: u32 = 0;
+            var index = index_of(@atomicLoad(u64, &self.head, .acquire));
+            while (index != NIL and n <= capacity) : (index = self.next[index]) {
+                n += 1;
+            }
+            return n;
+        }
+    };
+}
+
+const NIL: u32 = 0xFFFFFFFF;
@@ -1,18 +1,38 @@
 // Parallel computation tests for Zig kernel
-// APs are already running, ready to receive work from BSP
+// APs are parked in smp.zig, ready to receive work from BSP
 const BootInfo = @import("boot_info.zig").BootInfo;
 const c_write_serial = @import("boot_info.zig").c_write_serial;
+const smp = @import("smp.zig");
+const sync = @import("sync.zig");
+const trace = @import("trace.zig");
+const bench = @import("bench.zig");
+const compute = @import("compute.zig");
+const sort = @import("sort.zig");
+const gemm = @import("gemm.zig");
+const membench = @import("membench.zig");
+const topology = @import("topology.zig");
+const allocator_mod = @import("allocator.zig");
+const std = @import("std");
 
-const MAX_CPUS = 16;
-
-// Shared test data (accessed by all CPUs)
-pub var per_cpu_counters: [MAX_CPUS]u64 = [_]u64{0} ** MAX_CPUS;
-pub var partial_sums: [MAX_CPUS]u64 = [_]u64{0} ** MAX_CPUS;
+// Shared test data (accessed by all CPUs). Per CPU
+// (smp.alloc_per_cpu_small), allocated by run_all().
+pub var per_cpu_counters: []u64 = undefined;
+pub var partial_sums: []u64 = undefined;
 pub var total_sum: u64 = 0;
 
-// For now, just simple tests on BSP
-// TODO: Implement IPI mechanism to wake APs for parallel work
+// Tests 1-2 run on the BSP only; tests 3-4 stress the lock-free
+// primitives on every CPU via the SMP dispatch layer; test 5 checks the
+// vector compute kernels against their scalar references, test 6 the
+// parallel sorts against std.sort, test 7 the blocked GEMM against a
+// naive triple loop, test 8 the 4KB/2MB page mappings the memory
+// benchmarks run on and test 9 the topology queries
 pub fn run_all(boot_info: *const BootInfo) void {
+    per_cpu_counters = smp.alloc_per_cpu_small(u64);
+    partial_sums = smp.alloc_per_cpu_small(u64);
+    bench_counters = smp.alloc_per_cpu_small(u64);
+    topo_buf = smp.alloc_per_cpu_small(u32);
+    topo_seen = smp.alloc_per_cpu_small(bool);
+
     c_write_serial("[Zig Test] Running on BSP (CPU 0)...\n\n");
 
     // Test 1: Simple counter
@@ -52,7 +72,970 @@ pub fn run_all(boot_info: *const BootInfo) void {
     c_write_serial("[Info] Total CPUs available: ");
     write_dec_u32(boot_info.cpu_count);
     c_write_serial("\n");
-    c_write_serial("[Info] (Parallel tests will be implemented via IPI mechanism)\n");
+    c_write_serial("[Info] CPUs in Zig SMP layer: ");
+    write_dec_u32(smp.get_cpu_count());
+    c_write_serial("\n\n");
+
+    test_mpmc_queue();
+    test_object_pool();
+    test_compute();
+    test_sort();
+    test_gemm();
+    test_vmm_regions();
+    test_topology(boot_info);
+
+    c_write_serial("\n[Bench] Microbenchmarks, one JSON line each\n");
+    bench.run_all(&benchmarks);
+    bench_compute(boot_info);
+    bench_sort(boot_info);
+    bench_gemm(boot_info);
+    membench.run(boot_info.tsc_khz);
+    bench_c2c();
+}
+
+// ============================================================================
+// Microbenchmarks (bench.zig)
+// ============================================================================
+
+// Packed like per_cpu_counters: neighbouring CPUs share a cache line.
+// Per CPU, allocated by run_all().
+var bench_counters: []u64 = undefined;
+
+fn bench_counter_inc(cpu_id: u32) void {
+    const counter: *volatile u64 = &bench_counters[cpu_id];
+    var i: u32 = 0;
+    while (i < 1000) : (i += 1) counter.* += 1;
+}
+
+// Read through a volatile pointer so the loop is not folded to n*(n+1)/2
+var bench_sum_len: u64 = 10000;
+
+fn bench_sum_range(cpu_id: u32) void {
+    const end = @as(*volatile u64, &bench_sum_len).*;
+    var sum: u64 = 0;
+    var i: u64 = 1;
+    while (i <= end) : (i += 1) sum += i;
+    bench.sink(sum +% cpu_id);
+}
+
+// Tests 3-4 leave the queue and the pool empty; every CPU hits them at once
+fn bench_mpmc_push_pop(cpu_id: u32) void {
+    _ = mpmc_queue.push(cpu_id);
+    bench.sink(mpmc_queue.pop() orelse 0);
+}
+
+fn bench_pool_alloc_free(cpu_id: u32) void {
+    if (object_pool.alloc()) |obj| {
+        obj.owner = cpu_id;
+        object_pool.free(obj);
+    }
+}
+
+const benchmarks = [_]bench.Bench{
+    .{ .name = "counter_inc_1k", .run = bench_counter_inc },
+    .{ .name = "sum_range_10k", .run = bench_sum_range },
+    .{ .name = "mpmc_push_pop", .run = bench_mpmc_push_pop, .iters = 1024 },
+    .{ .name = "pool_alloc_free", .run = bench_pool_alloc_free, .iters = 1024 },
+};
+
+// ============================================================================
+// Lock-free primitive stress tests (run on all CPUs)
+// ============================================================================
+
+const MPMC_CAPACITY = 256;
+const MPMC_ITEMS_PER_CPU: u64 = 100000;
+
+// Shared by every CPU in the test
+var mpmc_queue: sync.MpmcQueue(u64, MPMC_CAPACITY) = .{};
+
+// Per CPU (smp.alloc_per_cpu_small), allocated by test_mpmc_queue()
+const MpmcContext = struct {
+    pushed_sum: []u64,
+    popped_sum: []u64,
+    popped_count: []u64,
+};
+
+// Every CPU is both producer and consumer; values encode (cpu << 32 | seq)
+fn mpmc_worker(cpu_id: u32, ctx: *MpmcContext) void {
+    trace.begin("mpmc_worker");
+    defer trace.end("mpmc_worker");
+
+    var pushed: u64 = 0;
+    var push_sum: u64 = 0;
+    var pop_sum: u64 = 0;
+    var pop_count: u64 = 0;
+
+    while (pushed < MPMC_ITEMS_PER_CPU) {
+        const value = (@as(u64, cpu_id) << 32) | pushed;
+        if (mpmc_queue.push(value)) {
+            push_sum +%= value;
+            pushed += 1;
+        }
+        if (mpmc_queue.pop()) |v| {
+            pop_sum +%= v;
+            pop_count += 1;
+        }
+    }
+
+    // Drain what's left; other CPUs may still be pushing, so an empty
+    // queue here is not final - the BSP drains the remainder afterwards
+    while (mpmc_queue.pop()) |v| {
+        pop_sum +%= v;
+        pop_count += 1;
+    }
+
+    ctx.pushed_sum[cpu_id] = push_sum;
+    ctx.popped_sum[cpu_id] = pop_sum;
+    ctx.popped_count[cpu_id] = pop_count;
+}
+
+fn test_mpmc_queue() void {
+    const n = smp.get_cpu_count();
+    c_write_serial("[Test 3] MPMC queue stress (");
+    write_dec_u32(n);
+    c_write_serial(" CPUs, ");
+    write_dec_u64(MPMC_ITEMS_PER_CPU);
+    c_write_serial(" items each)...\n");
+
+    mpmc_queue.init();
+    var mpmc_ctx = MpmcContext{
+        .pushed_sum = smp.alloc_per_cpu_small(u64),
+        .popped_sum = smp.alloc_per_cpu_small(u64),
+        .popped_count = smp.alloc_per_cpu_small(u64),
+    };
+    smp.run_on_all(MpmcContext, &mpmc_ctx, mpmc_worker);
+
+    var pushed_sum: u64 = 0;
+    var popped_sum: u64 = 0;
+    var popped_count: u64 = 0;
+    var i: u32 = 0;
+    while (i < n) : (i += 1) {
+        pushed_sum +%= mpmc_ctx.pushed_sum[i];
+        popped_sum +%= mpmc_ctx.popped_sum[i];
+        popped_count += mpmc_ctx.popped_count[i];
+    }
+    while (mpmc_queue.pop()) |v| {
+        popped_sum +%= v;
+        popped_count += 1;
+    }
+
+    c_write_serial("[Test 3] Popped: ");
+    write_dec_u64(popped_count);
+    c_write_serial(" / ");
+    write_dec_u64(MPMC_ITEMS_PER_CPU * n);
+    c_write_serial("\n");
+
+    if (popped_count == MPMC_ITEMS_PER_CPU * n and popped_sum == pushed_sum) {
+        c_write_serial("[Test 3] PASSED ✓\n\n");
+    } else {
+        c_write_serial("[Test 3] FAILED ✗ (lost or duplicated items)\n\n");
+    }
+}
+
+const POOL_CAPACITY = 64;
+const POOL_HOLD = 4; // Objects each CPU holds at once
+const POOL_ITERATIONS: u32 = 50000;
+
+const PoolObject = struct {
+    owner: u32,
+    stamp: u32,
+    payload: [6]u64,
+};
+
+var object_pool: sync.ObjectPool(PoolObject, POOL_CAPACITY) = .{};
+
+// Per CPU (smp.alloc_per_cpu_small), allocated by test_object_pool()
+const PoolContext = struct {
+    errors: []u32,
+    exhausted: []u32,
+};
+
+// Allocate, stamp, verify, free - a double hand-out shows up as a stamp mismatch
+fn pool_worker(cpu_id: u32, ctx: *PoolContext) void {
+    trace.begin("pool_worker");
+    defer trace.end("pool_worker");
+
+    var held: [POOL_HOLD]?*PoolObject = [_]?*PoolObject{null} ** POOL_HOLD;
+    var iter: u32 = 0;
+
+    while (iter < POOL_ITERATIONS) : (iter += 1) {
+        for (&held) |*slot| {
+            slot.* = object_pool.alloc();
+            if (slot.*) |obj| {
+                obj.owner = cpu_id;
+                obj.stamp = iter;
+                obj.payload[0] = (@as(u64, cpu_id) << 32) | iter;
+            } else {
+                ctx.exhausted[cpu_id] += 1;
+            }
+        }
+
+        for (&held) |*slot| {
+            if (slot.*) |obj| {
+                if (@atomicLoad(u32, &obj.owner, .monotonic) != cpu_id or
+                    obj.stamp != iter or
+                    obj.payload[0] != ((@as(u64, cpu_id) << 32) | iter))
+                {
+                    ctx.errors[cpu_id] += 1;
+                }
+                object_pool.free(obj);
+                slot.* = null;
+            }
+        }
+    }
+}
+
+fn test_object_pool() void {
+    const n = smp.get_cpu_count();
+    c_write_serial("[Test 4] Object pool stress (");
+    write_dec_u32(n);
+    c_write_serial(" CPUs, ");
+    write_dec_u32(POOL_ITERATIONS);
+    c_write_serial(" rounds each)...\n");
+
+    object_pool.init();
+    var pool_ctx = PoolContext{
+        .errors = smp.alloc_per_cpu_small(u32),
+        .exhausted = smp.alloc_per_cpu_small(u32),
+    };
+    smp.run_on_all(PoolContext, &pool_ctx, pool_worker);
+
+    var errors: u32 = 0;
+    var exhausted: u32 = 0;
+    var i: u32 = 0;
+    while (i < n) : (i += 1) {
+        errors += pool_ctx.errors[i];
+        exhausted += pool_ctx.exhausted[i];
+    }
+    const free_count = object_pool.count_free();
+
+    c_write_serial("[Test 4] Stamp errors: ");
+    write_dec_u32(errors);
+    c_write_serial(", pool exhausted: ");
+    write_dec_u32(exhausted);
+    c_write_serial(", free at end: ");
+    write_dec_u32(free_count);
+    c_write_serial(" / ");
+    write_dec_u32(POOL_CAPACITY);
+    c_write_serial("\n");
+
+    if (errors == 0 and free_count == POOL_CAPACITY) {
+        c_write_serial("[Test 4] PASSED ✓\n");
+    } else {
+        c_write_serial("[Test 4] FAILED ✗\n");
+    }
+}
+
+// ============================================================================
+// Vector compute kernels (compute.zig)
+// ============================================================================
+
+const COMPUTE_LEN = 1 << 20;
+const COMPUTE_REPS = 5;
+const SAXPY_ALPHA: f32 = 2.0;
+
+// Static - 16 MB of inputs and outputs. The floats are small integers, so
+// every f32 sum and product here is exact in any order.
+var compute_data: [COMPUTE_LEN]u32 align(64) = undefined;
+var compute_out: [COMPUTE_LEN]u32 align(64) = undefined;
+var compute_x: [COMPUTE_LEN]f32 align(64) = undefined;
+var compute_y: [COMPUTE_LEN]f32 align(64) = undefined;
+
+fn compute_fill() void {
+    for (&compute_data, 0..) |*d, i| d.* = @truncate((i +% 1) *% 0x9E3779B97F4A7C15 >> 29);
+    for (&compute_x, 0..) |*x, i| x.* = @floatFromInt(i % 8);
+    reset_y();
+}
+
+fn reset_y() void {
+    for (&compute_y, 0..) |*y, i| y.* = @floatFromInt(i % 4);
+}
+
+// Group sizes to test and benchmark: powers of two up to `limit`, then
+// every online CPU
+fn group_sizes(buf: *[6]u32, limit: u32) []const u32 {
+    const n = smp.get_cpu_count();
+    var count: usize = 0;
+    for ([_]u32{ 1, 2, 4, 8, 16, n }) |size| {
+        if (size > n or (size > limit and size != n)) continue;
+        if (count > 0 and buf[count - 1] >= size) continue;
+        buf[count] = size;
+        count += 1;
+    }
+    return buf[0..count];
+}
+
+// Every kernel on every group size against the scalar references; an odd
+// length leaves uneven shares and scalar tails
+fn test_compute() void {
+    const len = COMPUTE_LEN - 13;
+    const data = compute_data[0..len];
+    const bytes = std.mem.sliceAsBytes(data);
+
+    c_write_serial("\n[Test 5] Vector compute kernels (");
+    write_dec_u32(compute.lanes(u32));
+    c_write_serial(" x u32 lanes, ");
+    write_dec_u64(len);
+    c_write_serial(" elements)...\n");
+
+    compute_fill();
+    const sum_ref = compute.scalar.sum(u32, data);
+    const min_ref = compute.scalar.min(u32, data);
+    const max_ref = compute.scalar.max(u32, data);
+    const dot_ref = compute.scalar.dot(f32, compute_x[0..len], compute_y[0..len]);
+    var hist_ref: [256]u64 = undefined;
+    compute.scalar.histogram(bytes, &hist_ref);
+
+    var sizes_buf: [6]u32 = undefined;
+    var failures: u32 = 0;
+    for (group_sizes(&sizes_buf, 4)) |cpus| {
+        const g = compute.group(cpus);
+        var bad: u32 = 0;
+
+        if (g.sum(u32, data) != sum_ref) bad += 1;
+        if (g.min(u32, data) != min_ref) bad += 1;
+        if (g.max(u32, data) != max_ref) bad += 1;
+        if (g.dot(f32, compute_x[0..len], compute_y[0..len]) != dot_ref) bad += 1;
+
+        g.scan(u32, data, compute_out[0..len]);
+        var running: u32 = 0;
+        for (data, compute_out[0..len]) |d, o| {
+            running +%= d;
+            if (o != running) {
+                bad += 1;
+                break;
+            }
+        }
+
+        var hist: [256]u64 = undefined;
+        g.histogram(bytes, &hist);
+        if (!std.mem.eql(u64, &hist, &hist_ref)) bad += 1;
+
+        // The element past the end must stay untouched
+        g.saxpy(SAXPY_ALPHA, compute_x[0..len], compute_y[0..len]);
+        for (compute_x[0 .. len + 1], compute_y[0 .. len + 1], 0..) |x, y, i| {
+            const y0: f32 = @floatFromInt(i % 4);
+            const want = if (i < len) SAXPY_ALPHA * x + y0 else y0;
+            if (y != want) {
+                bad += 1;
+                break;
+            }
+        }
+        reset_y();
+
+        c_write_serial("[Test 5]   ");
+        write_dec_u32(cpus);
+        c_write_serial(if (bad == 0) " CPU(s): ok\n" else " CPU(s): MISMATCH\n");
+        failures += bad;
+    }
+
+    if (failures == 0) {
+        c_write_serial("[Test 5] PASSED ✓\n");
+    } else {
+        c_write_serial("[Test 5] FAILED ✗\n");
+    }
+}
+
+const ComputeBench = struct {
+    name: []const u8,
+    bytes_per_elem: u32, // Memory traffic per element, every pass included
+    scalar: *const fn () void,
+    vector: *const fn (g: compute.Group) void,
+    reset: ?*const fn () void = null, // Restores inputs the kernel modifies
+};
+
+fn cb_sum_scalar() void {
+    bench.sink(compute.scalar.sum(u32, &compute_data));
+}
+fn cb_sum(g: compute.Group) void {
+    bench.sink(g.sum(u32, &compute_data));
+}
+fn cb_min_scalar() void {
+    bench.sink(compute.scalar.min(u32, &compute_data));
+}
+fn cb_min(g: compute.Group) void {
+    bench.sink(g.min(u32, &compute_data));
+}
+fn cb_max_scalar() void {
+    bench.sink(compute.scalar.max(u32, &compute_data));
+}
+fn cb_max(g: compute.Group) void {
+    bench.sink(g.max(u32, &compute_data));
+}
+fn cb_scan_scalar() void {
+    compute.scalar.scan(u32, &compute_data, &compute_out);
+}
+fn cb_scan(g: compute.Group) void {
+    g.scan(u32, &compute_data, &compute_out);
+}
+fn cb_dot_scalar() void {
+    bench.sink(compute.scalar.dot(f32, &compute_x, &compute_y));
+}
+fn cb_dot(g: compute.Group) void {
+    bench.sink(g.dot(f32, &compute_x, &compute_y));
+}
+fn cb_saxpy_scalar() void {
+    compute.scalar.saxpy(SAXPY_ALPHA, &compute_x, &compute_y);
+}
+fn cb_saxpy(g: compute.Group) void {
+    g.saxpy(SAXPY_ALPHA, &compute_x, &compute_y);
+}
+
+var cb_bins: [256]u64 = undefined;
+
+fn cb_hist_scalar() void {
+    compute.scalar.histogram(std.mem.sliceAsBytes(compute_data[0 .. COMPUTE_LEN / 4]), &cb_bins);
+}
+fn cb_hist(g: compute.Group) void {
+    g.histogram(std.mem.sliceAsBytes(compute_data[0 .. COMPUTE_LEN / 4]), &cb_bins);
+}
+
+// The histogram counts COMPUTE_LEN bytes (a quarter of compute_data)
+const compute_benches = [_]ComputeBench{
+    .{ .name = "sum_u32", .bytes_per_elem = 4, .scalar = cb_sum_scalar, .vector = cb_sum },
+    .{ .name = "min_u32", .bytes_per_elem = 4, .scalar = cb_min_scalar, .vector = cb_min },
+    .{ .name = "max_u32", .bytes_per_elem = 4, .scalar = cb_max_scalar, .vector = cb_max },
+    .{ .name = "scan_u32", .bytes_per_elem = 12, .scalar = cb_scan_scalar, .vector = cb_scan },
+    .{ .name = "dot_f32", .bytes_per_elem = 8, .scalar = cb_dot_scalar, .vector = cb_dot },
+    .{ .name = "saxpy_f32", .bytes_per_elem = 12, .scalar = cb_saxpy_scalar, .vector = cb_saxpy, .reset = reset_y },
+    .{ .name = "hist_u8", .bytes_per_elem = 1, .scalar = cb_hist_scalar, .vector = cb_hist },
+};
+
+fn compute_print(comptime fmt: []const u8, args: anytype) void {
+    var buf: [256]u8 = undefined;
+    const s = std.fmt.bufPrintZ(&buf, fmt, args) catch return;
+    c_write_serial(s.ptr);
+}
+
+// Median of COMPUTE_REPS calls after one warm-up; prints a table row and the
+// JSON line (bench.report_series) for tools/bench_runner.py
+fn compute_bench_one(cb: *const ComputeBench, g: ?compute.Group, tsc_khz: u64, scalar_median: u64) u64 {
+    const Call = struct {
+        cb: *const ComputeBench,
+        g: ?compute.Group,
+        pub fn run(self: @This()) void {
+            if (self.g) |grp| self.cb.vector(grp) else self.cb.scalar();
+        }
+    };
+    var samples: [COMPUTE_REPS]u64 = undefined;
+    const median = bench.time_median(&samples, Call{ .cb = cb, .g = g });
+    if (cb.reset) |reset| reset();
+
+    const cpus: u32 = if (g) |grp| grp.cpus else 1;
+    var name_buf: [64]u8 = undefined;
+    const name = std.fmt.bufPrint(&name_buf, "compute_{s}_{s}_{d}cpu", .{ cb.name, if (g == null) "scalar" else "vec", cpus }) catch cb.name;
+    var extra_buf: [64]u8 = undefined;
+    const bytes = @as(u64, COMPUTE_LEN) * cb.bytes_per_elem;
+    const extra = std.fmt.bufPrint(&extra_buf, "\"elements\":{d},\"bytes\":{d}", .{ COMPUTE_LEN, bytes }) catch "";
+
+    const cycles: f64 = @floatFromInt(median);
+    const gbps = @as(f64, @floatFromInt(bytes)) * @as(f64, @floatFromInt(tsc_khz)) / (cycles * 1e6);
+    const per_cycle = @as(f64, @floatFromInt(COMPUTE_LEN)) / cycles;
+    const speedup = @as(f64, @floatFromInt(if (scalar_median != 0) scalar_median else median)) / cycles;
+    compute_print("  {s:<10} {s:<6} {d:>4} {d:>12} {d:>8.2} {d:>10.3} {d:>7.2}x\n", .{
+        cb.name, if (g == null) "scalar" else "vector", cpus, median, gbps, per_cycle, speedup,
+    });
+
+    bench.report_series(name, cpus, &samples, extra);
+    return median;
+}
+
+fn bench_compute(boot_info: *const BootInfo) void {
+    c_write_serial("\n[Bench] Vector compute kernels (median of 5 calls, TSC cycles)\n");
+    compute_print("  {s:<10} {s:<6} {s:>4} {s:>12} {s:>8} {s:>10} {s:>8}\n", .{
+        "kernel", "impl", "cpus", "cycles", "GB/s", "elem/cyc", "speedup",
+    });
+
+    var sizes_buf: [6]u32 = undefined;
+    const sizes = group_sizes(&sizes_buf, 4);
+    for (&compute_benches) |*cb| {
+        const scalar_median = compute_bench_one(cb, null, boot_info.tsc_khz, 0);
+        for (sizes) |cpus| {
+            _ = compute_bench_one(cb, compute.group(cpus), boot_info.tsc_khz, scalar_median);
+        }
+    }
+}
+
+// ============================================================================
+// Parallel sorts (sort.zig)
+// ============================================================================
+
+const SORT_KEYS = 1 << 18;
+const SORT_REPS = 3;
+const SORT_SENTINEL: u64 = 0x5A5A5A5A5A5A5A5A;
+
+// On the kernel heap (allocator.zig), allocated on first use and kept - the
+// bump heap never frees. 6 MB of its 16 MB.
+const SortBuffers = struct {
+    input: []align(64) u64, // Unsorted keys, copied to `keys` before each run
+    keys: []align(64) u64,
+    tmp: []align(64) u64,
+};
+var sort_bufs: ?SortBuffers = null;
+
+fn sort_buffers() ?*SortBuffers {
+    if (sort_bufs == null) {
+        const a = allocator_mod.get_allocator();
+        const input = a.alignedAlloc(u64, 64, SORT_KEYS) catch return null;
+        const keys = a.alignedAlloc(u64, 64, SORT_KEYS) catch return null;
+        const tmp = a.alignedAlloc(u64, 64, SORT_KEYS) catch return null;
+        sort_bufs = .{ .input = input, .keys = keys, .tmp = tmp };
+    }
+    return &sort_bufs.?;
+}
+
+// Random keys, or (few) 1000 distinct values: duplicates, and six of the
+// eight radix passes skipped
+fn sort_fill(keys: []u64, few: bool) void {
+    for (keys, 0..) |*k, i| {
+        var z: u64 = (i +% 1) *% 0x9E3779B97F4A7C15;
+        z = (z ^ (z >> 31)) *% 0xBF58476D1CE4E5B9;
+        z ^= z >> 29;
+        k.* = if (few) z % 1000 else z;
+    }
+}
+
+const SortAlgo = struct {
+    name: []const u8,
+    run: *const fn (g: compute.Group, keys: []u64, tmp: []u64) void,
+};
+
+fn sa_radix(g: compute.Group, keys: []u64, tmp: []u64) void {
+    sort.radix_sort(g, keys, tmp);
+}
+fn sa_sample_net(g: compute.Group, keys: []u64, tmp: []u64) void {
+    sort.sample_sort(g, keys, tmp, .{ .network = true });
+}
+fn sa_sample_ins(g: compute.Group, keys: []u64, tmp: []u64) void {
+    sort.sample_sort(g, keys, tmp, .{ .network = false });
+}
+
+// Sample sort once with each small-sort leaf: sorting network, insertion sort
+const sort_algos = [_]SortAlgo{
+    .{ .name = "radix", .run = sa_radix },
+    .{ .name = "sample_net", .run = sa_sample_net },
+    .{ .name = "sample_ins", .run = sa_sample_ins },
+};
+
+const SortCase = struct {
+    label: [*:0]const u8,
+    len: usize,
+    few: bool,
+};
+
+// Every sort on every group size against std.mem.sort; the key past the
+// end must stay untouched. The short case takes the small-input paths.
+fn test_sort() void {
+    const half = SORT_KEYS / 2;
+    const cases = [_]SortCase{
+        .{ .label = "random keys", .len = half - 13, .few = false },
+        .{ .label = "1000 distinct keys", .len = half - 13, .few = true },
+        .{ .label = "13 keys", .len = 13, .few = false },
+    };
+
+    c_write_serial("\n[Test 6] Parallel sorts (radix, sample; ");
+    write_dec_u64(half - 13);
+    c_write_serial(" u64 keys)...\n");
+
+    const bufs = sort_buffers() orelse {
+        c_write_serial("[Test 6] FAILED ✗ - out of heap\n");
+        return;
+    };
+
+    // input[0..n] is unsorted, input[half..][0..n] the reference
+    var sizes_buf: [6]u32 = undefined;
+    const sizes = group_sizes(&sizes_buf, 16);
+    var failures: u32 = 0;
+    for (&cases) |*tc| {
+        const input = bufs.input[0..tc.len];
+        const want = bufs.input[half..][0..tc.len];
+        sort_fill(input, tc.few);
+        @memcpy(want, input);
+        std.mem.sort(u64, want, {}, std.sort.asc(u64));
+
+        var bad: u32 = 0;
+        for (sizes) |cpus| {
+            for (&sort_algos) |*sa| {
+                @memcpy(bufs.keys[0..tc.len], input);
+                bufs.keys[tc.len] = SORT_SENTINEL;
+                sa.run(compute.group(cpus), bufs.keys[0..tc.len], bufs.tmp);
+                if (!std.mem.eql(u64, bufs.keys[0..tc.len], want) or bufs.keys[tc.len] != SORT_SENTINEL) {
+                    bad += 1;
+                }
+            }
+        }
+
+        c_write_serial("[Test 6]   ");
+        c_write_serial(tc.label);
+        c_write_serial(", up to ");
+        write_dec_u32(sizes[sizes.len - 1]);
+        c_write_serial(if (bad == 0) " CPU(s): ok\n" else " CPU(s): MISMATCH\n");
+        failures += bad;
+    }
+
+    if (failures == 0) {
+        c_write_serial("[Test 6] PASSED ✓\n");
+    } else {
+        c_write_serial("[Test 6] FAILED ✗\n");
+    }
+}
+
+// Median of SORT_REPS sorts of the same input after one warm-up; prints a
+// table row and the JSON line, keys/s included
+fn sort_bench_one(sa: *const SortAlgo, bufs: *SortBuffers, g: compute.Group, tsc_khz: u64, base: u64) u64 {
+    const Call = struct {
+        sa: *const SortAlgo,
+        bufs: *SortBuffers,
+        g: compute.Group,
+        pub fn prepare(self: @This()) void {
+            @memcpy(self.bufs.keys, self.bufs.input);
+        }
+        pub fn run(self: @This()) void {
+            self.sa.run(self.g, self.bufs.keys, self.bufs.tmp);
+        }
+    };
+    var samples: [SORT_REPS]u64 = undefined;
+    const median = bench.time_median(&samples, Call{ .sa = sa, .bufs = bufs, .g = g });
+    const keys_per_sec = SORT_KEYS * tsc_khz * 1000 / median;
+    const cycles: f64 = @floatFromInt(median);
+    const speedup = @as(f64, @floatFromInt(if (base != 0) base else median)) / cycles;
+    compute_print("  {s:<12} {d:>4} {d:>12} {d:>10.2} {d:>7.2}x\n", .{
+        sa.name, g.cpus, median, @as(f64, @floatFromInt(keys_per_sec)) / 1e6, speedup,
+    });
+
+    var name_buf: [64]u8 = undefined;
+    const name = std.fmt.bufPrint(&name_buf, "sort_{s}_{d}cpu", .{ sa.name, g.cpus }) catch sa.name;
+    var extra_buf: [64]u8 = undefined;
+    const extra = std.fmt.bufPrint(&extra_buf, "\"keys\":{d},\"keys_per_sec\":{d}", .{ SORT_KEYS, keys_per_sec }) catch "";
+    bench.report_series(name, g.cpus, &samples, extra);
+    return median;
+}
+
+// Every sort from 1 CPU up to 16 (or all online CPUs); speedup is against
+// the same sort on 1 CPU
+fn bench_sort(boot_info: *const BootInfo) void {
+    const bufs = sort_buffers() orelse return;
+    sort_fill(bufs.input, false);
+
+    compute_print("\n[Bench] Parallel sorts, {d} random u64 keys (median of {d} runs)\n", .{ SORT_KEYS, SORT_REPS });
+    compute_print("  {s:<12} {s:>4} {s:>12} {s:>10} {s:>8}\n", .{ "sort", "cpus", "cycles", "Mkeys/s", "speedup" });
+
+    var sizes_buf: [6]u32 = undefined;
+    const sizes = group_sizes(&sizes_buf, 16);
+    for (&sort_algos) |*sa| {
+        var base: u64 = 0;
+        for (sizes) |cpus| {
+            const median = sort_bench_one(sa, bufs, compute.group(cpus), boot_info.tsc_khz, base);
+            if (base == 0) base = median;
+        }
+    }
+}
+
+// ============================================================================
+// Blocked GEMM (gemm.zig)
+// ============================================================================
+
+const GEMM_N = 192;
+const GEMM_REPS = 3;
+const GEMM_POISON = 99; // Fills C before a test multiply
+
+// Static square matrices per type. The entries are small integers (-8..7),
+// so every product and partial sum is exact: the blocked and naive results
+// must match bit for bit, whatever the summation order.
+fn GemmData(comptime T: type) type {
+    return struct {
+        var a: [GEMM_N * GEMM_N]T align(64) = undefined;
+        var b: [GEMM_N * GEMM_N]T align(64) = undefined;
+        var c: [GEMM_N * GEMM_N]T align(64) = undefined;
+        var ref: [GEMM_N * GEMM_N]T align(64) = undefined;
+
+        fn fill() void {
+            for (&a, 0..) |*x, i| x.* = small(i);
+            for (&b, 0..) |*x, i| x.* = small(i + GEMM_N * GEMM_N);
+        }
+
+        fn small(i: usize) T {
+            const h: u64 = (i +% 1) *% 0x9E3779B97F4A7C15;
+            return @floatFromInt(@as(i32, @intCast(h >> 60)) - 8);
+        }
+    };
+}
+
+// Odd sizes leave edge micro-tiles on every side; the second blocking
+// splits even this small multiply into several mc, kc and nc blocks
+fn test_gemm_type(comptime T: type, caches: gemm.Caches) u32 {
+    const D = GemmData(T);
+    const m = 67;
+    const n = 53;
+    const k = 71;
+    D.fill();
+    gemm.reference(T, m, n, k, &D.a, &D.b, &D.ref);
+
+    const blocks = [_]gemm.Blocking{
+        gemm.blocking(T, caches),
+        .{ .mc = 2 * gemm.MR, .kc = 16, .nc = 2 * gemm.nr(T) },
+    };
+    var sizes_buf: [6]u32 = undefined;
+    var bad: u32 = 0;
+    for (group_sizes(&sizes_buf, 16)) |cpus| {
+        for (blocks) |blk| {
+            @memset(&D.c, GEMM_POISON);
+            gemm.gemm(T, compute.group(cpus), blk, m, n, k, &D.a, &D.b, &D.c);
+            if (!std.mem.eql(T, D.c[0 .. m * n], D.ref[0 .. m * n]) or D.c[m * n] != GEMM_POISON) {
+                bad += 1;
+            }
+        }
+    }
+
+    c_write_serial("[Test 7]   ");
+    c_write_serial(@typeName(T));
+    c_write_serial(if (bad == 0) ": ok\n" else ": MISMATCH\n");
+    return bad;
+}
+
+fn test_gemm() void {
+    c_write_serial("\n[Test 7] Blocked GEMM against the naive triple loop (67x53x71)...\n");
+    const caches = gemm.detect_caches();
+    const failures = test_gemm_type(f32, caches) + test_gemm_type(f64, caches);
+    if (failures == 0) {
+        c_write_serial("[Test 7] PASSED ✓\n");
+    } else {
+        c_write_serial("[Test 7] FAILED ✗\n");
+    }
+}
+
+// Every group size, median of GEMM_REPS multiplies after one warm-up. The
+// checksum of C is compared with the naive reference's after each size.
+fn bench_gemm_type(comptime T: type, caches: gemm.Caches, tsc_khz: u64) void {
+    const D = GemmData(T);
+    const flops = 2 * GEMM_N * GEMM_N * GEMM_N;
+    D.fill();
+    gemm.reference(T, GEMM_N, GEMM_N, GEMM_N, &D.a, &D.b, &D.ref);
+    const want = gemm.checksum(T, &D.ref);
+    const blk = gemm.blocking(T, caches);
+
+    const Call = struct {
+        g: compute.Group,
+        blk: gemm.Blocking,
+        pub fn run(self: @This()) void {
+            gemm.gemm(T, self.g, self.blk, GEMM_N, GEMM_N, GEMM_N, &D.a, &D.b, &D.c);
+        }
+    };
+
+    var sizes_buf: [6]u32 = undefined;
+    var base: u64 = 0;
+    for (group_sizes(&sizes_buf, 16)) |cpus| {
+        var samples: [GEMM_REPS]u64 = undefined;
+        const median = bench.time_median(&samples, Call{ .g = compute.group(cpus), .blk = blk });
+        const ok = gemm.checksum(T, &D.c) == want;
+
+        if (base == 0) base = median;
+        const cycles: f64 = @floatFromInt(median);
+        const gflops = @as(f64, flops) * @as(f64, @floatFromInt(tsc_khz)) / (cycles * 1e6);
+        const speedup = @as(f64, @floatFromInt(base)) / cycles;
+        const efficiency = speedup / @as(f64, @floatFromInt(cpus));
+        compute_print("  {s:<4} {d:>4} {d:>4}/{d:>3}/{d:>3} {d:>12} {d:>8.2} {d:>7.2}x {d:>9.1}% {s:>8}\n", .{
+            @typeName(T), cpus, blk.mc, blk.kc, blk.nc, median, gflops, speedup, efficiency * 100, if (ok) "ok" else "MISMATCH",
+        });
+
+        var name_buf: [64]u8 = undefined;
+        const name = std.fmt.bufPrint(&name_buf, "gemm_{s}_{d}cpu", .{ @typeName(T), cpus }) catch "gemm";
+        var extra_buf: [192]u8 = undefined;
+        const extra = std.fmt.bufPrint(&extra_buf, "\"m\":{d},\"n\":{d},\"k\":{d},\"mc\":{d},\"kc\":{d},\"nc\":{d},\"gflops\":{d:.3},\"efficiency\":{d:.3},\"checksum_ok\":{}", .{
+            GEMM_N, GEMM_N, GEMM_N, blk.mc, blk.kc, blk.nc, gflops, efficiency, ok,
+        }) catch "";
+        bench.report_series(name, cpus, &samples, extra);
+    }
+}
+
+// GFLOP/s per type and group size; efficiency = speedup over 1 CPU / CPUs
+fn bench_gemm(boot_info: *const BootInfo) void {
+    const caches = gemm.detect_caches();
+    compute_print("\n[Bench] Blocked GEMM {d}x{d}x{d} (median of {d} runs; L1d {d} KB, L2 {d} KB from {s})\n", .{
+        GEMM_N, GEMM_N, GEMM_N, GEMM_REPS, caches.l1d / 1024, caches.l2 / 1024, caches.source,
+    });
+    compute_print("  {s:<4} {s:>4} {s:>12} {s:>12} {s:>8} {s:>8} {s:>10} {s:>8}\n", .{
+        "type", "cpus", "mc/kc/nc", "cycles", "GFLOP/s", "speedup", "efficiency", "checksum",
+    });
+    bench_gemm_type(f32, caches, boot_info.tsc_khz);
+    bench_gemm_type(f64, caches, boot_info.tsc_khz);
+}
+
+// ============================================================================
+// Page-mapped regions and memory benchmarks (membench.zig)
+// ============================================================================
+
+fn test_vmm_regions() void {
+    c_write_serial("\n[Test 8] 4KB and 2MB page regions: map, touch every page, free, remap...\n");
+    if (membench.selftest()) {
+        c_write_serial("[Test 8] PASSED ✓\n");
+    } else {
+        c_write_serial("[Test 8] FAILED ✗\n");
+    }
+}
+
+// ============================================================================
+// CPU topology (topology.zig)
+// ============================================================================
+
+// Per CPU, allocated by run_all()
+var topo_buf: []u32 = undefined;
+var topo_seen: []bool = undefined;
+
+// The BSP's own leaf 0x1F/0xB enumeration, read here rather than trusting
+// the bootstrap's table
+const TopoLeaf = struct {
+    apic_id: u32 = 0,
+    smt_shift: u32 = 0,
+    pkg_shift: u32 = 0,
+    per_core: u32 = 1, // Logical CPUs per core
+    per_package: u32 = 1,
+};
+
+fn topo_leaf() ?TopoLeaf {
+    const max_leaf = gemm.cpuid(0, 0)[0];
+    for ([_]u32{ 0x1F, 0xB }) |leaf| {
+        if (max_leaf < leaf) continue;
+        var e = TopoLeaf{};
+        var levels: u32 = 0;
+        var sub: u32 = 0;
+        while (sub < 8) : (sub += 1) {
+            const r = gemm.cpuid(leaf, sub);
+            const kind = (r[2] >> 8) & 0xFF; // 1 SMT, 2 core, 3+ module/tile/die
+            if (kind == 0 or (r[1] & 0xFFFF) == 0) break;
+            if (kind == 1) {
+                e.smt_shift = r[0] & 0x1F;
+                e.per_core = r[1] & 0xFFFF;
+            }
+            e.pkg_shift = r[0] & 0x1F;
+            e.per_package = r[1] & 0xFFFF;
+            e.apic_id = r[3];
+            levels += 1;
+        }
+        if (levels > 0) return e;
+    }
+    return null;
+}
+
+// Every CPU: its APIC ID is one BootInfo.cpus lists, and no other CPU has
+// it; siblings agree with shares(), core siblings share the package, and
+// the victim list is every other CPU once, nearest first. Against the
+// BSP's leaf 0x1F/0xB: CPU 0's IDs, and no core or package holding more
+// CPUs than the leaf counts.
+fn test_topology(boot_info: *const BootInfo) void {
+    c_write_serial("\n[Test 9] Topology: APIC IDs, siblings and victim order...\n");
+    const n = smp.get_cpu_count();
+    var ok = true;
+
+    const bsp = topology.get(0);
+    if (bsp.apic_id != boot_info.bsp_apic_id or bsp.apic_id != boot_info.cpus[0].apic_id) ok = false;
+    const leaf = topo_leaf();
+    if (leaf) |e| {
+        if (bsp.apic_id != e.apic_id or bsp.core_id != e.apic_id >> @intCast(e.smt_shift) or
+            bsp.package_id != e.apic_id >> @intCast(e.pkg_shift)) ok = false;
+    }
+
+    var cpu: u32 = 0;
+    while (cpu < n) : (cpu += 1) {
+        // cpus[] is in MADT order, logical CPUs in check-in order
+        const apic_id = topology.get(cpu).apic_id;
+        var listed = false;
+        for (boot_info.cpus[0..boot_info.cpu_count]) |c| {
+            if (c.apic_id == apic_id) listed = true;
+        }
+        var prev: u32 = 0;
+        while (prev < cpu) : (prev += 1) {
+            if (topology.get(prev).apic_id == apic_id) ok = false;
+        }
+        if (!listed) ok = false;
+
+        if (leaf) |e| {
+            if (topology.siblings(cpu, .core, topo_buf).len + 1 > e.per_core) ok = false;
+            if (topology.siblings(cpu, .package, topo_buf).len + 1 > e.per_package) ok = false;
+        }
+
+        for ([_]topology.Level{ .core, .l2, .l3, .package }) |level| {
+            const sib = topology.siblings(cpu, level, topo_buf);
+            var expect: usize = 0;
+            var other: u32 = 0;
+            while (other < n) : (other += 1) {
+                if (other != cpu and topology.shares(cpu, other, level)) expect += 1;
+            }
+            if (sib.len != expect) ok = false;
+            for (sib) |s| {
+                if (s == cpu or !topology.shares(s, cpu, level)) ok = false;
+                if (level == .core and !topology.shares(s, cpu, .package)) ok = false;
+            }
+        }
+
+        const v = topology.victims(cpu, topo_buf);
+        if (v.len != n - 1) ok = false;
+        @memset(topo_seen, false);
+        var last: usize = 0;
+        for (v) |victim| {
+            const rank = topology.rank_of(cpu, victim);
+            if (victim == cpu or victim >= n or topo_seen[victim] or rank < last) ok = false;
+            if (victim < n) topo_seen[victim] = true;
+            last = rank;
+        }
+    }
+    if (ok) {
+        c_write_serial("[Test 9] PASSED ✓\n");
+    } else {
+        c_write_serial("[Test 9] FAILED ✗\n");
+    }
+}
+
+const C2C_ROUNDS = 256;
+
+// CPU 0 and its peer bounce this line; nothing else touches it
+var c2c_line: u64 align(64) = 0;
+var c2c_samples: [C2C_ROUNDS]u64 = undefined;
+
+const C2cContext = struct {
+    peer: u32,
+};
+
+// CPU 0 stores an odd value and times until the peer answers with the next
+// even one: one round trip of the cache line per sample
+fn c2c_worker(cpu_id: u32, ctx: *C2cContext) void {
+    var i: u64 = 0;
+    if (cpu_id == 0) {
+        while (i < C2C_ROUNDS) : (i += 1) {
+            const t0 = bench.start();
+            @atomicStore(u64, &c2c_line, 2 * i + 1, .release);
+            while (@atomicLoad(u64, &c2c_line, .acquire) != 2 * i + 2) asm volatile ("pause");
+            c2c_samples[i] = bench.end() -% t0;
+        }
+    } else if (cpu_id == ctx.peer) {
+        while (i < C2C_ROUNDS) : (i += 1) {
+            while (@atomicLoad(u64, &c2c_line, .acquire) != 2 * i + 1) asm volatile ("pause");
+            @atomicStore(u64, &c2c_line, 2 * i + 2, .release);
+        }
+    }
+}
+
+// Round-trip latency from CPU 0 to the nearest CPU that shares only its
+// core, L2, L3, package, or nothing (levels without such a CPU are skipped)
+fn bench_c2c() void {
+    const n = smp.get_cpu_count();
+    c_write_serial("\n[Bench] Cache-line round trip from CPU 0 by topology level\n");
+    const names = [_][]const u8{ "core", "l2", "l3", "package", "remote" };
+    for (names, 0..) |level_name, rank| {
+        var peer: u32 = 1;
+        while (peer < n and topology.rank_of(0, peer) != rank) peer += 1;
+        if (peer == n) continue;
+
+        @atomicStore(u64, &c2c_line, 0, .release);
+        var ctx = C2cContext{ .peer = peer };
+        smp.run_on_all(C2cContext, &ctx, c2c_worker);
+
+        var name_buf: [32]u8 = undefined;
+        const name = std.fmt.bufPrint(&name_buf, "c2c_{s}", .{level_name}) catch "c2c";
+        var extra_buf: [32]u8 = undefined;
+        const extra = std.fmt.bufPrint(&extra_buf, "\"peer\":{d}", .{peer}) catch "";
+        bench.report_series(name, 2, &c2c_samples, extra);
+    }
 }
 
 fn write_dec_u32(value: u32) void {
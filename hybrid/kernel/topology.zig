@@ -0,0 +1,127 @@
+// CPU topology queries for placing work - which logical CPUs share a core,
+// an L2, an L3 or a package. The C bootstrap reads CPUID on every CPU
+// (topology_detect() in boot/init.c: leaves 0x1F/0xB and 4) and hands the
+// table over as BootInfo.topology, indexed by the cpu_id jobs get.
+//
+// Read-only after init(), so any CPU can query it.
+const BootInfo = @import("boot_info.zig").BootInfo;
+const CpuTopology = @import("boot_info.zig").CpuTopology;
+const smp = @import("smp.zig");
+const log = @import("log.zig");
+
+const topo_log = log.scoped("topo");
+
+pub const NONE: u32 = 0xFFFFFFFF; // Cache level CPUID doesn't describe
+
+// Narrowest first
+pub const Level = enum { core, l2, l3, package };
+const LEVELS = [_]Level{ .core, .l2, .l3, .package };
+
+var table: [*]const CpuTopology = undefined;
+var count: u32 = 1;
+
+// BSP, after smp.init(): covers the CPUs taking part in jobs
+pub fn init(boot_info: *const BootInfo) void {
+    table = boot_info.topology;
+    count = smp.get_cpu_count();
+    topo_log.info("{d} package(s), {d} core(s), {d} thread(s); {d} L2, {d} L3 domain(s)", .{
+        domains(.package), domains(.core), count, domains(.l2), domains(.l3),
+    });
+    var cpu: u32 = 0;
+    while (cpu < count) : (cpu += 1) {
+        const t = get(cpu);
+        topo_log.debug("CPU {d}: APIC ID {d}, package {d}, core {d}, thread {d}, L2 {d}, L3 {d}", .{
+            cpu, t.apic_id, t.package_id, t.core_id, t.smt_id, t.l2_id, t.l3_id,
+        });
+    }
+}
+
+pub fn get(cpu: u32) *const CpuTopology {
+    return &table[cpu];
+}
+
+fn id(t: *const CpuTopology, level: Level) u32 {
+    return switch (level) {
+        .core => t.core_id,
+        .l2 => t.l2_id,
+        .l3 => t.l3_id,
+        .package => t.package_id,
+    };
+}
+
+// Cache IDs only compare when cut at the same bit: a 4-core L2 cluster and
+// a 1-core L2 can end up with equal IDs
+fn shift(t: *const CpuTopology, level: Level) u32 {
+    return switch (level) {
+        .l2 => t.l2_shift,
+        .l3 => t.l3_shift,
+        .core, .package => 0,
+    };
+}
+
+fn same(a: *const CpuTopology, b: *const CpuTopology, level: Level) bool {
+    return id(a, level) == id(b, level) and shift(a, level) == shift(b, level);
+}
+
+pub fn shares(a: u32, b: u32, level: Level) bool {
+    return id(get(a), level) != NONE and same(get(a), get(b), level);
+}
+
+// Narrowest level a and b share; null if only the machine
+pub fn closest(a: u32, b: u32) ?Level {
+    for (LEVELS) |level| {
+        if (shares(a, b, level)) return level;
+    }
+    return null;
+}
+
+// The other CPUs in cpu's core / L2 / L3 / package, ascending. out needs
+// room for get_cpu_count() - 1.
+pub fn siblings(cpu: u32, level: Level, out: []u32) []u32 {
+    var n: usize = 0;
+    var other: u32 = 0;
+    while (other < count) : (other += 1) {
+        if (other == cpu or !shares(cpu, other, level)) continue;
+        out[n] = other;
+        n += 1;
+    }
+    return out[0..n];
+}
+
+// Every other CPU, nearest first: same core, L2, L3, package, then the
+// rest - the order to try victims in when stealing work. Within a level
+// the list starts after cpu and wraps, so thieves spread over victims.
+// out needs room for get_cpu_count() - 1.
+pub fn victims(cpu: u32, out: []u32) []u32 {
+    var n: usize = 0;
+    var rank: usize = 0;
+    while (rank <= LEVELS.len) : (rank += 1) {
+        var k: u32 = 1;
+        while (k < count) : (k += 1) {
+            const other = (cpu + k) % count;
+            if (rank_of(cpu, other) != rank) continue;
+            out[n] = other;
+            n += 1;
+        }
+    }
+    return out[0..n];
+}
+
+// Index of closest() in LEVELS, LEVELS.len for "only the machine"
+pub fn rank_of(a: u32, b: u32) usize {
+    const level = closest(a, b) orelse return LEVELS.len;
+    return @intFromEnum(level);
+}
+
+// Distinct cores / L2s / L3s / packages among the CPUs
+pub fn domains(level: Level) u32 {
+    var distinct: u32 = 0;
+    var i: u32 = 0;
+    while (i < count) : (i += 1) {
+        if (id(get(i), level) == NONE) continue;
+        var j: u32 = 0;
+        while (j < i and !same(get(i), get(j), level)) j += 1;
+        if (j == i) distinct += 1;
+    }
+    return distinct;
+}
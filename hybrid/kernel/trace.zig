@@ -0,0 +1,49 @@
+// Zig side of the per-CPU event tracer (rings live in boot/init.c)
+// Probes take a comptime name, so the record only carries a pointer to it.
+// Built with -Dtrace=false every call here compiles to nothing.
+const build_options = @import("build_options");
+
+// Must match enum trace_type in boot/init.c
+const Type = enum(u32) {
+    irq_entry = 1,
+    irq_exit,
+    ipi_send,
+    ipi_recv,
+    alloc,
+    free,
+    barrier,
+    probe_begin,
+    probe_end,
+    probe_mark,
+};
+
+extern fn trace_event(kind: u32, arg: u64, arg2: u32) void;
+extern fn trace_dump() void;
+
+inline fn record(kind: Type, arg: u64, arg2: u32) void {
+    if (comptime build_options.trace) trace_event(@intFromEnum(kind), arg, arg2);
+}
+
+// Start/end of a named span on the current CPU
+pub inline fn begin(comptime name: [:0]const u8) void {
+    record(.probe_begin, @intFromPtr(name.ptr), 0);
+}
+
+pub inline fn end(comptime name: [:0]const u8) void {
+    record(.probe_end, @intFromPtr(name.ptr), 0);
+}
+
+// Point event with a value
+pub inline fn mark(comptime name: [:0]const u8, value: u32) void {
+    record(.probe_mark, @intFromPtr(name.ptr), value);
+}
+
+// This CPU arrived at barrier `generation`
+pub inline fn barrier(generation: u32) void {
+    record(.barrier, generation, 0);
+}
+
+// Stop tracing and print every CPU's ring (for tools/trace2chrome.py)
+pub fn dump() void {
+    if (comptime build_options.trace) trace_dump();
+}
@@ -4,7 +4,28 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-#define MAX_CPUS 16
+// Per-CPU information (BootInfo.cpus, one entry per CPU)
+typedef struct {
+    uint32_t apic_id;            // APIC ID for this CPU (32-bit in x2APIC mode)
+    uintptr_t stack_top;         // Top of stack for this CPU
+    bool online;                 // True if CPU is running
+} CpuInfo;
+
+// Where a logical CPU sits, read from CPUID on that CPU (BootInfo.topology).
+// Each ID is the APIC ID without the bits below that level: two CPUs share
+// a core, an L2, an L3 or a package exactly when those IDs are equal (for
+// the caches, with equal shifts too - an E-core cluster's L2 spans more IDs
+// than a P-core's).
+typedef struct {
+    uint32_t apic_id;            // x2APIC ID (CPUID 0x1F/0xB), else the initial APIC ID
+    uint32_t smt_id;             // Thread within its core
+    uint32_t core_id;
+    uint32_t package_id;
+    uint32_t l2_id;              // 0xFFFFFFFF: CPUID doesn't describe this cache
+    uint32_t l3_id;              // 0xFFFFFFFF: no L3 (or not described)
+    uint32_t l2_shift;           // APIC ID bits below l2_id
+    uint32_t l3_shift;           // APIC ID bits below l3_id
+} CpuTopology;
 
 // Boot information structure passed from C bootstrap to Zig kernel
 // IMPORTANT: Keep in sync with Zig definition in kernel/boot_info.zig
@@ -34,12 +55,9 @@ typedef struct {
     uint16_t idt_limit;          // IDT limit
     bool idt_loaded;             // True if IDT is loaded on BSP
 
-    // Per-CPU Information
-    struct {
-        uint8_t apic_id;         // APIC ID for this CPU
-        uintptr_t stack_top;     // Top of stack for this CPU
-        bool online;             // True if CPU is running
-    } cpus[MAX_CPUS];
+    // Per-CPU Information (cpu_count entries, BSP first)
+    const CpuInfo *cpus;
+    const CpuTopology *topology; // By logical CPU (the cpu_id Zig code gets)
 
     // APIC Base Address
     uintptr_t apic_base;         // APIC MMIO base (0xFEE00000 for xAPIC)
@@ -47,16 +65,47 @@ typedef struct {
     // Debug/Serial
     bool serial_initialized;     // True if COM1 is ready
 
+    // SIMD state (enabled on every CPU before it runs Zig code)
+    uint64_t xcr0;               // Enabled XSAVE components (0 = SSE without XSAVE)
+    uint32_t fpu_area_size;      // Bytes per thread save area (64-byte aligned)
+
+    // Timing
+    uint64_t tsc_khz;            // TSC ticks per millisecond (calibrated)
+
 } BootInfo;
 
 // C bootstrap calls this to hand control to Zig kernel
 // This function is implemented in Zig (kernel/main.zig)
 extern void zig_kernel_main(const BootInfo* boot_info) __attribute__((noreturn));
 
+// Each AP calls this once its local APIC and timer are up (cpu_id = 1..N-1)
+// APs wait in the Zig SMP layer (kernel/smp.zig) for parallel work
+extern void zig_ap_main(uint32_t cpu_id) __attribute__((noreturn));
+
 // Zig kernel can call back to C for low-level services
 // These are implemented in C bootstrap (boot/services.c)
 extern void c_write_serial(const char* str);
 extern void c_write_serial_hex(uint64_t value);
 extern void c_send_eoi(void);  // Send End-Of-Interrupt to APIC
 
+// Event tracer (boot/init.c), used by kernel/trace.zig
+extern void trace_event(uint32_t type, uint64_t arg, uint32_t arg2);
+extern void trace_dump(void);
+
+// Sampling profiler (boot/init.c) - prints per-CPU stack histograms
+extern void prof_dump(void);
+
+// Lazy FPU/SIMD state (boot/init.c) for a scheduler: a save area per thread,
+// fpu_switch() on every context switch (interrupts off), fpu_flush() before
+// a thread moves to another CPU
+extern void *fpu_state_alloc(void);
+extern void fpu_switch(void *state);
+extern void fpu_flush(void);
+
+// Large page-mapped regions (boot/init.c): fresh PMM memory in 2MB-aligned
+// chunks, mapped with 4KB pages or (huge != 0) 2MB pages; NULL if out of
+// memory. Sizes round up to 2MB.
+extern void *vmm_alloc_region(uint64_t bytes, int huge);
+extern void vmm_free_region(void *virt, uint64_t bytes);
+
 #endif // BOOT_INFO_H
@@ -0,0 +1,238 @@
+#!/usr/bin/env python3
+"""Boot the kernel ISO under a QEMU matrix and check benchmarks for regressions.
+
+Each configuration (accelerator x CPU count x memory size) boots headless
+with an isa-debug-exit device. The kernel writes its verdict to port 0xf4,
+which ends QEMU with status 33 (tests passed) or 35 (a test failed); no exit
+within --timeout means the kernel hung. The kernel also prints one JSON line
+per benchmark (bench_run in c/kernel/minimal_step9.c):
+    {"bench":"<name>","unit":"tsc_cycles","iters":N,"cpus":N,
+     "per_cpu":[{"cpu":0,"overhead":...,"min":...,...}],"all":{"min":...,
+     "median":...,"p99":...,"max":...,"mean":...,"stddev":...}}
+
+Results are compared against a stored baseline: a benchmark regresses when
+its --metric (over all CPUs) grows by more than --threshold percent and by
+at least --min-delta cycles.
+
+Usage:
+    cd c && make -f Makefile.step9 bench-baseline      # record a baseline
+    cd c && make -f Makefile.step9 bench               # compare against it
+    tools/bench_runner.py --iso c/boot_step9.iso --accel tcg --smp 1,4 \\
+        --baseline bench_baseline.json --threshold 15 \\
+        --threshold-for clock_monotonic_ns=30
+"""
+import argparse
+import json
+import os
+import subprocess
+import sys
+import time
+
+EXIT_PASS = (0x10 << 1) | 1
+EXIT_FAIL = (0x11 << 1) | 1
+
+CONSOLES = {
+    "serial": ["-serial", "stdio"],
+    "debugcon": ["-debugcon", "stdio"],
+    "virtio": ["-chardev", "stdio,id=con0,mux=on", "-serial", "chardev:con0",
+               "-device", "virtio-serial-pci", "-device", "virtconsole,chardev=con0"],
+}
+
+
+def config_key(accel, smp, mem):
+    return "%s/smp%d/%s" % (accel, smp, mem)
+
+
+def qemu_command(args, accel, smp, mem):
+    cmd = [args.qemu, "-cdrom", args.iso, "-display", "none", "-no-reboot",
+           "-m", mem, "-smp", str(smp),
+           "-device", "isa-debug-exit,iobase=0xf4,iosize=0x04"]
+    cmd += CONSOLES[args.console]
+    if accel == "kvm":
+        cmd += ["-enable-kvm", "-cpu", args.kvm_cpu]
+    return cmd
+
+
+def parse_output(text):
+    benches = {}
+    result = None
+    for line in text.splitlines():
+        idx = line.find('{"bench"')
+        if idx >= 0:
+            try:
+                rec = json.loads(line[idx:].strip())
+            except ValueError:
+                continue
+            benches[rec["bench"]] = rec
+            continue
+        idx = line.find("@RESULT")
+        if idx >= 0:
+            f = line[idx:].split()
+            result = f[1] if len(f) > 1 else None
+    return benches, result
+
+
+def run_config(args, accel, smp, mem):
+    cmd = qemu_command(args, accel, smp, mem)
+    start = time.time()
+    try:
+        proc = subprocess.run(cmd, stdin=subprocess.DEVNULL, stdout=subprocess.PIPE,
+                              stderr=subprocess.STDOUT, timeout=args.timeout)
+        output = proc.stdout.decode(errors="replace")
+        code = proc.returncode
+    except subprocess.TimeoutExpired as e:
+        output = (e.output or b"").decode(errors="replace")
+        code = None
+    seconds = time.time() - start
+
+    if code == EXIT_PASS:
+        status = "pass"
+    elif code == EXIT_FAIL:
+        status = "fail"
+    elif code is None:
+        status = "timeout"
+    else:
+        status = "crash"        # Triple fault (-no-reboot) or QEMU error
+
+    if args.log_dir:
+        os.makedirs(args.log_dir, exist_ok=True)
+        name = config_key(accel, smp, mem).replace("/", "_") + ".log"
+        with open(os.path.join(args.log_dir, name), "w") as f:
+            f.write(output)
+
+    benches, result = parse_output(output)
+    return {"accel": accel, "smp": smp, "mem": mem, "status": status,
+            "exit_code": code, "result": result, "seconds": round(seconds, 2),
+            "benchmarks": benches}
+
+
+def threshold_for(args, name):
+    for spec in args.threshold_for:
+        bench, _, pct = spec.partition("=")
+        if bench == name:
+            return float(pct)
+    return args.threshold
+
+
+def compare(args, results, baseline):
+    """Print a comparison table, return the number of regressions."""
+    regressions = 0
+    rows = []
+    for key, cfg in sorted(results.items()):
+        base_cfg = baseline.get(key)
+        if not base_cfg:
+            continue
+        for name, rec in sorted(cfg["benchmarks"].items()):
+            base = base_cfg["benchmarks"].get(name)
+            if not base:
+                continue
+            old = base["all"][args.metric]
+            new = rec["all"][args.metric]
+            delta = new - old
+            pct = 100.0 * delta / old if old else 0.0
+            limit = threshold_for(args, name)
+            if delta >= args.min_delta and pct > limit:
+                verdict = "REGRESSION"
+                regressions += 1
+            elif -delta >= args.min_delta and -pct > limit:
+                verdict = "faster"
+            else:
+                verdict = "ok"
+            rows.append((key, name, old, new, pct, verdict))
+
+    if rows:
+        print("\n%-20s %-22s %10s %10s %8s  %s" % (
+            "config", "benchmark", "base", "now", "delta", args.metric))
+        for key, name, old, new, pct, verdict in rows:
+            print("%-20s %-22s %10d %10d %+7.1f%%  %s" % (key, name, old, new, pct, verdict))
+    else:
+        print("\nno benchmarks in common with the baseline")
+    return regressions
+
+
+def kvm_available():
+    return os.access("/dev/kvm", os.R_OK | os.W_OK)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--iso", required=True, help="bootable kernel ISO")
+    ap.add_argument("--qemu", default="qemu-system-x86_64")
+    ap.add_argument("--console", choices=sorted(CONSOLES), default="serial",
+                    help="console backend the kernel was built with")
+    ap.add_argument("--accel", default="tcg,kvm", help="comma list of tcg,kvm")
+    ap.add_argument("--kvm-cpu", default="host", help="-cpu model under KVM")
+    ap.add_argument("--smp", default="1,2,4,8,16", help="comma list of CPU counts")
+    ap.add_argument("--mem", default="256M", help="comma list of memory sizes")
+    ap.add_argument("--timeout", type=float, default=60.0,
+                    help="seconds before a run counts as hung (default 60)")
+    ap.add_argument("--output", help="write all results as JSON")
+    ap.add_argument("--log-dir", help="keep each run's console output here")
+    ap.add_argument("--baseline", help="baseline JSON to compare against")
+    ap.add_argument("--save-baseline", metavar="FILE",
+                    help="merge these results into FILE instead of comparing")
+    ap.add_argument("--metric", choices=["min", "median", "p99", "mean"],
+                    default="median", help="statistic compared (default median)")
+    ap.add_argument("--threshold", type=float, default=10.0,
+                    help="allowed slowdown in percent (default 10)")
+    ap.add_argument("--threshold-for", action="append", default=[], metavar="NAME=PCT",
+                    help="per-benchmark threshold override (repeatable)")
+    ap.add_argument("--min-delta", type=int, default=20,
+                    help="ignore changes smaller than this many cycles (default 20)")
+    args = ap.parse_args()
+
+    accels = [a for a in args.accel.split(",") if a]
+    if "kvm" in accels and not kvm_available():
+        print("note: /dev/kvm not usable, skipping KVM runs", file=sys.stderr)
+        accels.remove("kvm")
+    smps = [int(n) for n in args.smp.split(",") if n]
+    mems = [m for m in args.mem.split(",") if m]
+
+    results = {}
+    failures = 0
+    for accel in accels:
+        for smp in smps:
+            for mem in mems:
+                key = config_key(accel, smp, mem)
+                print("%-20s ... " % key, end="", flush=True)
+                cfg = run_config(args, accel, smp, mem)
+                results[key] = cfg
+                print("%-7s %6.1fs  %d benchmarks" % (
+                    cfg["status"], cfg["seconds"], len(cfg["benchmarks"])))
+                if cfg["status"] != "pass":
+                    failures += 1
+
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump({"configs": results}, f, indent=1, sort_keys=True)
+
+    if args.save_baseline:
+        stored = {}
+        if os.path.exists(args.save_baseline):
+            with open(args.save_baseline) as f:
+                stored = json.load(f).get("configs", {})
+        stored.update({k: v for k, v in results.items() if v["status"] == "pass"})
+        with open(args.save_baseline, "w") as f:
+            json.dump({"configs": stored}, f, indent=1, sort_keys=True)
+        print("baseline %s: %d configurations" % (args.save_baseline, len(stored)))
+    elif args.baseline:
+        if not os.path.exists(args.baseline):
+            print("no baseline at %s (record one with --save-baseline)" % args.baseline,
+                  file=sys.stderr)
+        else:
+            with open(args.baseline) as f:
+                baseline = json.load(f).get("configs", {})
+            regressions = compare(args, results, baseline)
+            if regressions:
+                print("\n%d regression(s) over %.0f%%" % (regressions, args.threshold))
+                if not failures:
+                    return 1
+
+    if failures:
+        print("\n%d configuration(s) did not pass" % failures)
+        return 2
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
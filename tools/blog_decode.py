@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+"""Decode the binary log dumped by the C kernel (blog_dump) from a console log.
+
+The kernel prints:
+    @BLOG v1 tsc_khz=<khz> events=<n>
+    @E <id> <printf format>            (one per event type)
+    @R <cpu> <tsc hex> <id> <arg0 hex> <arg1 hex>
+    @END
+
+Usage:
+    make -f Makefile.step9 test-tcg | tools/blog_decode.py
+    tools/blog_decode.py serial.log
+"""
+import re
+import sys
+
+CONV = re.compile(r"%([#0-9]*)l?([dusxXc%])")
+
+
+def signed64(v):
+    return v - (1 << 64) if v >> 63 else v
+
+
+def format_event(fmt, args):
+    """Apply a kernel printf format (%lu, %#lx, %ld ...) to 64-bit args."""
+    out = []
+    pos = 0
+    it = iter(args)
+    for m in CONV.finditer(fmt):
+        out.append(fmt[pos:m.start()])
+        flags, conv = m.group(1), m.group(2)
+        pos = m.end()
+        if conv == "%":
+            out.append("%")
+            continue
+        v = next(it, 0)
+        if conv == "d":
+            v = signed64(v)
+        if conv == "u":
+            conv = "d"
+        if conv == "s":
+            out.append("<str %#x>" % v)
+            continue
+        out.append(("%" + flags + conv) % v)
+    out.append(fmt[pos:])
+    return "".join(out)
+
+
+def decode(lines):
+    tsc_khz = 0
+    formats = {}
+    records = []
+    for line in lines:
+        line = line.strip()
+        # Console output may share the line with other text
+        idx = line.find("@")
+        if idx < 0:
+            continue
+        line = line[idx:]
+        parts = line.split(" ", 2)
+        if parts[0] == "@BLOG":
+            m = re.search(r"tsc_khz=(\d+)", line)
+            tsc_khz = int(m.group(1)) if m else 0
+            formats = {}
+            records = []
+        elif parts[0] == "@E" and len(parts) == 3:
+            formats[int(parts[1])] = parts[2]
+        elif parts[0] == "@R":
+            f = line.split()
+            if len(f) != 6:
+                continue
+            records.append((int(f[2], 16), int(f[1]), int(f[3]),
+                            int(f[4], 16), int(f[5], 16)))
+
+    if not records:
+        print("no binary log records found", file=sys.stderr)
+        return 1
+
+    records.sort()
+    t0 = records[0][0]
+    for tsc, cpu, ev, a0, a1 in records:
+        if tsc_khz:
+            stamp = "%12.6f ms" % ((tsc - t0) / tsc_khz)
+        else:
+            stamp = "%14d cyc" % (tsc - t0)
+        fmt = formats.get(ev, "event %d: %%#lx %%#lx" % ev)
+        print("[%s] cpu%-2d %s" % (stamp, cpu, format_event(fmt, (a0, a1))))
+    return 0
+
+
+def main():
+    if len(sys.argv) > 1:
+        with open(sys.argv[1], errors="replace") as f:
+            return decode(f)
+    return decode(sys.stdin)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
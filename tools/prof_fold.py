@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+"""Symbolize the kernel's sampling-profiler dump into folded stacks.
+
+The kernel prints (prof_dump in c/kernel/minimal_step9.c and hybrid/boot/init.c):
+    @PROF v1 depth=<max frames>
+    @C <cpu> <samples> <dropped>
+    @S <cpu> <count> <rip> [<return address> ...]    (hex, innermost first)
+    @END
+
+The output is one "outer;...;inner <count>" line per distinct stack, ready
+for flamegraph.pl or speedscope. Symbols come from `nm` on the kernel ELF.
+
+Usage:
+    cd c && make -f Makefile.step9 PROFILE=1 test-tcg > run.log
+    tools/prof_fold.py c/kernel_step9.elf run.log > kernel.folded
+    flamegraph.pl kernel.folded > kernel.svg
+    tools/prof_fold.py --flat hybrid/zig-out/bin/kernel.elf run.log
+"""
+import argparse
+import bisect
+import collections
+import subprocess
+import sys
+
+
+def load_symbols(elf, nm):
+    out = subprocess.run([nm, "-n", "--defined-only", elf], check=True,
+                         capture_output=True, text=True).stdout
+    addrs, names = [], []
+    for line in out.splitlines():
+        f = line.split()
+        if len(f) < 3 or f[1] not in "tTwW":
+            continue
+        addrs.append(int(f[0], 16))
+        names.append(f[2])
+    return addrs, names
+
+
+def symbolize(addrs, names, pc):
+    i = bisect.bisect_right(addrs, pc) - 1
+    if i < 0:
+        return "[%#x]" % pc
+    return names[i]
+
+
+def parse(lines):
+    stacks = []     # (cpu, count, [pcs innermost first])
+    totals = {}     # cpu -> (samples, dropped)
+    for line in lines:
+        idx = line.find("@")
+        if idx < 0:
+            continue
+        f = line[idx:].split()
+        if not f:
+            continue
+        if f[0] == "@PROF":
+            stacks, totals = [], {}
+        elif f[0] == "@C" and len(f) == 4:
+            totals[int(f[1])] = (int(f[2]), int(f[3]))
+        elif f[0] == "@S" and len(f) >= 4:
+            stacks.append((int(f[1]), int(f[2]), [int(x, 16) for x in f[3:]]))
+        elif f[0] == "@END" and stacks:
+            break
+    return stacks, totals
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("elf", help="kernel ELF (kernel_step9.elf or kernel.elf)")
+    ap.add_argument("log", nargs="?", help="console log (default: stdin)")
+    ap.add_argument("--per-cpu", action="store_true",
+                    help="root every stack at its CPU")
+    ap.add_argument("--flat", action="store_true",
+                    help="print a flat profile of the sampled functions instead")
+    ap.add_argument("--nm", default="nm", help="nm binary (default: nm)")
+    args = ap.parse_args()
+
+    addrs, names = load_symbols(args.elf, args.nm)
+    if args.log:
+        with open(args.log, errors="replace") as f:
+            stacks, totals = parse(f)
+    else:
+        stacks, totals = parse(sys.stdin)
+
+    if not stacks:
+        print("no profiler samples found", file=sys.stderr)
+        return 1
+
+    for cpu in sorted(totals):
+        samples, dropped = totals[cpu]
+        note = " (%d dropped, table full)" % dropped if dropped else ""
+        print("cpu%d: %d samples%s" % (cpu, samples, note), file=sys.stderr)
+
+    if args.flat:
+        hits = collections.Counter()
+        for _cpu, count, pcs in stacks:
+            hits[symbolize(addrs, names, pcs[0])] += count
+        total = sum(hits.values())
+        for name, count in hits.most_common():
+            print("%6.2f%% %8d  %s" % (100.0 * count / total, count, name))
+        return 0
+
+    folded = collections.Counter()
+    for cpu, count, pcs in stacks:
+        # Return addresses point after the call - look up the call itself
+        frames = [symbolize(addrs, names, pcs[0])]
+        frames += [symbolize(addrs, names, pc - 1) for pc in pcs[1:]]
+        frames.reverse()
+        if args.per_cpu:
+            frames.insert(0, "cpu%d" % cpu)
+        folded[";".join(frames)] += count
+
+    for stack, count in sorted(folded.items()):
+        print("%s %d" % (stack, count))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
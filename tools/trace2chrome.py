@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+"""Convert the hybrid kernel's event trace dump to Chrome trace JSON.
+
+The kernel prints (trace_dump in hybrid/boot/init.c):
+    @TRACE v1 tsc_khz=<khz> cpus=<n> ring=<records per CPU>
+    @Y <type> <name>                              (one per event type)
+    @D <cpu> <records lost to wrap-around>
+    @T <cpu> <tsc hex> <type> <arg hex> <arg2 hex> [probe name]
+    @END
+
+Open the output in chrome://tracing or https://ui.perfetto.dev - one track
+per CPU, IRQs and Zig probes as spans, everything else as instant events.
+
+Usage:
+    zig build -Dconsole=debugcon run 2>&1 | tools/trace2chrome.py > trace.json
+    tools/trace2chrome.py serial.log -o trace.json
+"""
+import argparse
+import json
+import re
+import sys
+
+
+def parse(lines):
+    tsc_khz = 0
+    types = {}
+    dropped = {}
+    records = []
+    for line in lines:
+        idx = line.find("@")
+        if idx < 0:
+            continue
+        f = line[idx:].split()
+        if not f:
+            continue
+        tag = f[0]
+        if tag == "@TRACE":
+            m = re.search(r"tsc_khz=(\d+)", line)
+            tsc_khz = int(m.group(1)) if m else 0
+            types, dropped, records = {}, {}, []
+        elif tag == "@Y" and len(f) >= 3:
+            types[int(f[1])] = f[2]
+        elif tag == "@D" and len(f) >= 3:
+            dropped[int(f[1])] = int(f[2])
+        elif tag == "@T" and len(f) >= 6:
+            name = " ".join(f[6:]) if len(f) > 6 else None
+            records.append((int(f[2], 16), int(f[1]), int(f[3]),
+                            int(f[4], 16), int(f[5], 16), name))
+        elif tag == "@END":
+            break
+    return tsc_khz, types, dropped, records
+
+
+def convert(tsc_khz, types, dropped, records):
+    records.sort(key=lambda r: r[0])
+    t0 = records[0][0] if records else 0
+    # Chrome timestamps are microseconds
+    scale = 1000.0 / tsc_khz if tsc_khz else 1.0
+
+    events = []
+    cpus = sorted({r[1] for r in records} | set(dropped))
+    for cpu in cpus:
+        events.append({"ph": "M", "name": "thread_name", "pid": 0, "tid": cpu,
+                       "args": {"name": "CPU %d" % cpu}})
+        if dropped.get(cpu):
+            events.append({"ph": "i", "s": "t", "name": "records lost",
+                           "pid": 0, "tid": cpu, "ts": 0,
+                           "args": {"count": dropped[cpu]}})
+
+    heap_bytes = 0
+    for tsc, cpu, kind, arg, arg2, name in records:
+        ev = {"pid": 0, "tid": cpu, "ts": (tsc - t0) * scale}
+        kind_name = types.get(kind, "type%d" % kind)
+
+        if kind_name in ("irq_entry", "irq_exit"):
+            ev.update(ph="B" if kind_name == "irq_entry" else "E",
+                      name="irq %d" % arg, cat="irq")
+        elif kind_name in ("probe_begin", "probe_end"):
+            ev.update(ph="B" if kind_name == "probe_begin" else "E",
+                      name=name or "probe %#x" % arg, cat="probe")
+        elif kind_name == "probe_mark":
+            ev.update(ph="i", s="t", name=name or "probe %#x" % arg,
+                      cat="probe", args={"value": arg2})
+        elif kind_name == "ipi_send":
+            ev.update(ph="i", s="t", name="ipi -> apic %d" % arg, cat="ipi",
+                      args={"icr": "%#x" % arg2})
+        elif kind_name == "ipi_recv":
+            ev.update(ph="i", s="t", name="ipi recv %#x" % arg, cat="ipi")
+        elif kind_name in ("alloc", "free"):
+            ev.update(ph="i", s="t", name=kind_name, cat="mem",
+                      args={"addr": "%#x" % arg, "size": arg2})
+            if kind_name == "alloc":
+                heap_bytes += arg2
+                events.append({"ph": "C", "name": "heap bytes", "pid": 0,
+                               "ts": ev["ts"], "args": {"bytes": heap_bytes}})
+        elif kind_name == "barrier":
+            ev.update(ph="i", s="t", name="barrier %d" % arg, cat="sync")
+        else:
+            ev.update(ph="i", s="t", name=kind_name,
+                      args={"arg": "%#x" % arg, "arg2": arg2})
+        events.append(ev)
+
+    return {"traceEvents": events, "displayTimeUnit": "ns",
+            "otherData": {"tsc_khz": tsc_khz}}
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("log", nargs="?", help="console log (default: stdin)")
+    ap.add_argument("-o", "--output", help="output file (default: stdout)")
+    args = ap.parse_args()
+
+    if args.log:
+        with open(args.log, errors="replace") as f:
+            parsed = parse(f)
+    else:
+        parsed = parse(sys.stdin)
+
+    if not parsed[3]:
+        print("no trace records found", file=sys.stderr)
+        return 1
+
+    trace = convert(*parsed)
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(trace, f)
+    else:
+        json.dump(trace, sys.stdout)
+    print("%d events from %d records" % (len(trace["traceEvents"]), len(parsed[3])),
+          file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -2,6 +2,8 @@
 const std = @import("std");
 const serial = @import("serial.zig");
 const multiboot = @import("multiboot.zig");
+const allocator = @import("allocator.zig");
+const smp = @import("smp.zig");
 
 const RSDP_SIGNATURE = "RSD PTR ";
 
@@ -49,8 +51,30 @@ const MADTLocalAPIC = extern struct {
     flags: u32,
 };
 
+// Processor Local x2APIC (type 9): used for APIC IDs above 254
+const MADTLocalX2APIC = extern struct {
+    header: MADTEntryHeader,
+    reserved: u16,
+    x2apic_id: u32,
+    flags: u32,
+    acpi_processor_uid: u32,
+};
+
 var cpu_count: u32 = 0;
-pub var cpu_apic_ids: [16]u8 = undefined;
+// APIC ID of each logical CPU, in MADT order (sized by the first pass over the MADT)
+pub var cpu_apic_ids: []u32 = undefined;
+
+// APIC ID of an enabled processor entry, or null for any other entry
+fn madt_cpu_apic_id(entry_header: *align(1) const MADTEntryHeader) ?u32 {
+    if (entry_header.type == 0) { // Local APIC
+        const local_apic = @as(*align(1) const MADTLocalAPIC, @ptrCast(entry_header));
+        if ((local_apic.flags & 1) != 0) return local_apic.apic_id; // CPU enabled
+    } else if (entry_header.type == 9) { // Local x2APIC
+        const local_x2apic = @as(*align(1) const MADTLocalX2APIC, @ptrCast(entry_header));
+        if ((local_x2apic.flags & 1) != 0) return local_x2apic.x2apic_id;
+    }
+    return null;
+}
 
 pub fn detect_cpus() !u32 {
     // Search for RSDP in BIOS area
@@ -67,29 +91,41 @@ pub fn detect_cpus() !u32 {
     serial.write_string("[ACPI] MADT found!\n");
     serial.write_string("[ACPI] Parsing MADT entries...\n");
 
-    // Parse MADT entries to find CPUs
-    cpu_count = 0;
+    // Parse MADT entries to find CPUs: count first, then record the APIC IDs
     const madt_data = @as([*]const u8, @ptrCast(madt));
-    var offset: usize = @sizeOf(MADT);
     const end = madt.header.length;
 
+    var found: u32 = 0;
+    var offset: usize = @sizeOf(MADT);
     while (offset < end) {
         // MADT entries may be misaligned
         const entry_header = @as(*align(1) const MADTEntryHeader, @ptrCast(madt_data + offset));
+        if (madt_cpu_apic_id(entry_header) != null) found += 1;
+        offset += entry_header.length;
+    }
 
-        if (entry_header.type == 0) { // Local APIC
-            const local_apic = @as(*align(1) const MADTLocalAPIC, @ptrCast(entry_header));
-            if ((local_apic.flags & 1) != 0) { // CPU enabled
-                if (cpu_count < 16) {
-                    cpu_apic_ids[cpu_count] = local_apic.apic_id;
-                    serial.write_string("[ACPI] CPU ");
-                    serial.write_dec_u32(cpu_count);
-                    serial.write_string(" detected (APIC ID ");
-                    serial.write_dec_u32(local_apic.apic_id);
-                    serial.write_string(")\n");
-                    cpu_count += 1;
-                }
-            }
+    if (found > smp.MAX_CPUS) {
+        serial.write_string("[ACPI] Limiting to ");
+        serial.write_dec_u32(smp.MAX_CPUS);
+        serial.write_string(" of ");
+        serial.write_dec_u32(found);
+        serial.write_string(" CPUs\n");
+        found = smp.MAX_CPUS;
+    }
+    cpu_apic_ids = try allocator.get_allocator().alloc(u32, found);
+
+    cpu_count = 0;
+    offset = @sizeOf(MADT);
+    while (offset < end and cpu_count < found) {
+        const entry_header = @as(*align(1) const MADTEntryHeader, @ptrCast(madt_data + offset));
+        if (madt_cpu_apic_id(entry_header)) |apic_id| {
+            cpu_apic_ids[cpu_count] = apic_id;
+            serial.write_string("[ACPI] CPU ");
+            serial.write_dec_u32(cpu_count);
+            serial.write_string(" detected (APIC ID ");
+            serial.write_dec_u32(apic_id);
+            serial.write_string(")\n");
+            cpu_count += 1;
         }
 
         offset += entry_header.length;
@@ -141,7 +177,7 @@ pub fn get_cpu_count() u32 {
     return cpu_count;
 }
 
-pub fn get_apic_id(cpu_index: u32) u8 {
+pub fn get_apic_id(cpu_index: u32) u32 {
     if (cpu_index < cpu_count) {
         return cpu_apic_ids[cpu_index];
     }
@@ -18,19 +18,9 @@ const PageAllocator = struct {
         // Round up to page size (4096 bytes)
         const pages_needed = (len + 4095) / 4096;
 
-        // Allocate physical pages
-        var allocated: usize = 0;
-        while (allocated < pages_needed) : (allocated += 1) {
-            const page = pmm.alloc_page() catch return null;
-
-            // For simplicity, we return the first page address
-            // In a real allocator, you'd track multi-page allocations
-            if (allocated == 0) {
-                return @ptrFromInt(page);
-            }
-        }
-
-        return null;
+        // Multi-page buffers must be physically contiguous (memory is identity mapped)
+        const addr = pmm.alloc_pages(pages_needed) catch return null;
+        return @ptrFromInt(addr);
     }
 
     fn resize(
@@ -59,7 +49,11 @@ const PageAllocator = struct {
         _ = ret_addr;
 
         const phys_addr: u64 = @intFromPtr(buf.ptr);
-        pmm.free_page(phys_addr);
+        const pages = (buf.len + 4095) / 4096;
+        var i: usize = 0;
+        while (i < pages) : (i += 1) {
+            pmm.free_page(phys_addr + i * 4096);
+        }
     }
 
     fn remap(
@@ -1,6 +1,8 @@
 // IDT (Interrupt Descriptor Table) - 64-bit mode
 const serial = @import("serial.zig");
 const apic = @import("apic.zig");
+const smp = @import("smp.zig");
+const allocator = @import("allocator.zig");
 
 // IDT Gate Descriptor (64-bit mode)
 const IDTEntry = packed struct {
@@ -62,9 +64,8 @@ const exception_names = [_][]const u8{
 // Exception counter
 pub var exception_count: u32 = 0;
 
-// Timer interrupt counters (per-CPU)
-const MAX_CPUS = 16;
-pub var timer_ticks: [MAX_CPUS]u64 = [_]u64{0} ** MAX_CPUS;
+// Timer interrupt counters (per CPU, indexed by logical CPU; sized by init_per_cpu)
+pub var timer_ticks: []u64 = &[_]u64{};
 pub var global_timer_calls: u64 = 0;
 
 // Set an IDT entry
@@ -133,12 +134,11 @@ export fn timer_interrupt_handler() callconv(.C) void {
     // Increment global counter (debug)
     _ = @atomicRmw(u64, &global_timer_calls, .Add, 1, .monotonic);
 
-    // Get current CPU APIC ID
-    const apic_id = apic.get_apic_id();
-
-    // Use APIC ID directly as index (works for sequential APIC IDs like in QEMU)
-    if (apic_id < MAX_CPUS) {
-        _ = @atomicRmw(u64, &timer_ticks[apic_id], .Add, 1, .monotonic);
+    // Map the APIC ID to a logical CPU (IDs may be sparse or above the CPU count)
+    if (smp.cpu_from_apic_id(apic.get_apic_id())) |cpu| {
+        if (cpu < timer_ticks.len) {
+            _ = @atomicRmw(u64, &timer_ticks[cpu], .Add, 1, .monotonic);
+        }
     }
 
     // Send EOI to acknowledge interrupt
@@ -184,6 +184,13 @@ extern fn exception_stub_29() callconv(.Naked) void;
 extern fn exception_stub_30() callconv(.Naked) void;
 extern fn exception_stub_31() callconv(.Naked) void;
 
+// Allocate the per-CPU timer counters (after smp.init())
+pub fn init_per_cpu(cpu_count: u32) !void {
+    const ticks = try allocator.get_allocator().alloc(u64, cpu_count);
+    @memset(ticks, 0);
+    timer_ticks = ticks;
+}
+
 // Initialize IDT
 pub fn init() void {
     serial.write_string("[IDT] Initializing Interrupt Descriptor Table...\n");
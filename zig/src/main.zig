@@ -90,7 +90,7 @@ export fn kernel_main(multiboot_addr: u64) callconv(.C) noreturn {
 
     // Parse ACPI to detect CPUs
     serial.write_string("[ACPI] Searching for RSDP...\n");
-    const cpu_count = acpi.detect_cpus() catch |err| {
+    const madt_cpu_count = acpi.detect_cpus() catch |err| {
         serial.write_string("[ERROR] ACPI detection failed: ");
         serial.write_dec_u32(@intFromError(err));
         serial.write_string("\n");
@@ -98,7 +98,7 @@ export fn kernel_main(multiboot_addr: u64) callconv(.C) noreturn {
     };
 
     serial.write_string("[ACPI] Detected ");
-    serial.write_dec_u32(cpu_count);
+    serial.write_dec_u32(madt_cpu_count);
     serial.write_string(" CPU(s)\n\n");
 
     // Initialize IDT (disabled for now - not needed for tests)
@@ -116,6 +116,23 @@ export fn kernel_main(multiboot_addr: u64) callconv(.C) noreturn {
     };
     serial.write_string("[APIC] Local APIC initialized successfully!\n\n");
 
+    // Order CPUs (BSP first) and map APIC IDs to logical CPU indices
+    const cpu_count = smp.init(madt_cpu_count) catch |err| {
+        serial.write_string("[ERROR] SMP init failed: ");
+        serial.write_dec_u32(@intFromError(err));
+        serial.write_string("\n");
+        halt();
+    };
+
+    // Per-CPU state is sized by the CPU count, before any AP can touch it
+    tests.init(cpu_count) catch |err| {
+        serial.write_string("[ERROR] Test state allocation failed: ");
+        serial.write_dec_u32(@intFromError(err));
+        serial.write_string("\n");
+        halt();
+    };
+    //idt.init_per_cpu(cpu_count) catch halt();
+
     // Boot Application Processors
     if (cpu_count > 1) {
         serial.write_string("[SMP] Starting Application Processors...\n");
@@ -99,6 +99,25 @@ pub fn alloc_page() !usize {
     return error.OutOfMemory;
 }
 
+// Allocate `count` physically contiguous pages (first fit)
+pub fn alloc_pages(count: usize) !usize {
+    if (count == 0) return error.OutOfMemory;
+    var start: usize = 0;
+    while (start + count <= MAX_PAGES) {
+        var run: usize = 0;
+        while (run < count and is_free(start + run)) : (run += 1) {}
+        if (run == count) {
+            var page = start;
+            while (page < start + count) : (page += 1) {
+                mark_used(page);
+            }
+            return start * PAGE_SIZE;
+        }
+        start += run + 1;
+    }
+    return error.OutOfMemory;
+}
+
 pub fn free_page(phys_addr: usize) void {
     const page = phys_addr / PAGE_SIZE;
     mark_free(page);
@@ -3,6 +3,7 @@ const serial = @import("serial.zig");
 const std = @import("std");
 const acpi = @import("acpi.zig");
 const apic = @import("apic.zig");
+const allocator = @import("allocator.zig");
 const tests = @import("tests.zig");
 
 // Global CPU count (set by BSP, read by APs)
@@ -10,18 +11,73 @@ pub var global_cpu_count: u32 = 1;
 
 const TRAMPOLINE_ADDR: usize = 0x8000;
 const AP_STACK_SIZE: usize = 8192;  // 8KB per AP
-const MAX_CPUS: usize = 16;  // Maximum CPUs supported
+// Cap on CPUs taken from the MADT; per-CPU data is sized by the detected count
+pub const MAX_CPUS: u32 = 1024;
 
 // Trampoline symbols from trampoline.S
 extern const trampoline_start: u8;
 extern const trampoline_end: u8;
 
-// Per-CPU stacks (8KB each, aligned)
-var ap_stacks: [MAX_CPUS][AP_STACK_SIZE]u8 align(16) = undefined;
-
 // CPUs online counter
 var cpus_online: u32 = 1; // BSP is already online
 
+// APIC ID -> logical CPU index (open addressing, power-of-two size >= 2x CPU count)
+// APIC IDs can be sparse and exceed the CPU count (x2APIC), so they never index arrays.
+const NO_APIC_ID: u32 = 0xFFFFFFFF; // x2APIC broadcast ID, never a real CPU
+const ApicMapEntry = struct {
+    apic_id: u32,
+    cpu: u32,
+};
+var apic_map: []ApicMapEntry = &[_]ApicMapEntry{};
+
+// Order the CPUs (BSP first), drop the ones the APIC mode can't address, and
+// build the APIC ID map. Must run after apic.init(); returns the usable CPU count.
+pub fn init(cpu_count: u32) !u32 {
+    const ids = acpi.cpu_apic_ids[0..cpu_count];
+    const bsp_id = apic.get_apic_id();
+
+    var n: u32 = 0;
+    for (ids) |apic_id| {
+        // xAPIC destinations are 8 bits and 0xFF is broadcast
+        if (!apic.use_x2apic and apic_id > 0xFE) {
+            serial.write_string("[SMP] Skipping APIC ID ");
+            serial.write_dec_u32(apic_id);
+            serial.write_string(" (needs x2APIC)\n");
+            continue;
+        }
+        ids[n] = apic_id;
+        if (apic_id == bsp_id) {
+            ids[n] = ids[0];
+            ids[0] = apic_id;
+        }
+        n += 1;
+    }
+    if (n == 0 or ids[0] != bsp_id) return error.BspNotInMadt;
+
+    var size: u32 = 1;
+    while (size < n * 2) size <<= 1;
+    apic_map = try allocator.get_allocator().alloc(ApicMapEntry, size);
+    @memset(apic_map, .{ .apic_id = NO_APIC_ID, .cpu = 0 });
+    for (ids[0..n], 0..) |apic_id, cpu| {
+        var slot = apic_id & (size - 1);
+        while (apic_map[slot].apic_id != NO_APIC_ID) slot = (slot + 1) & (size - 1);
+        apic_map[slot] = .{ .apic_id = apic_id, .cpu = @intCast(cpu) };
+    }
+
+    return n;
+}
+
+// Logical CPU index of an APIC ID, or null if it isn't one of ours
+pub fn cpu_from_apic_id(apic_id: u32) ?u32 {
+    if (apic_map.len == 0) return null;
+    const mask: u32 = @intCast(apic_map.len - 1);
+    var slot = apic_id & mask;
+    while (apic_map[slot].apic_id != NO_APIC_ID) : (slot = (slot + 1) & mask) {
+        if (apic_map[slot].apic_id == apic_id) return apic_map[slot].cpu;
+    }
+    return null;
+}
+
 pub fn boot_aps(cpu_count: u32) !void {
     if (cpu_count <= 1) {
         serial.write_string("[SMP] Only 1 CPU detected, skipping AP boot\n");
@@ -72,7 +128,7 @@ pub fn boot_aps(cpu_count: u32) !void {
     serial.write_string("[SMP] Starting Application Processors...\n");
     var cpu_idx: u32 = 1;
     while (cpu_idx < cpu_count) : (cpu_idx += 1) {
-        boot_ap(cpu_idx, trampoline_size);
+        try boot_ap(cpu_idx, trampoline_size);
 
         // Wait a bit between APs
         delay_ms(10);
@@ -81,7 +137,7 @@ pub fn boot_aps(cpu_count: u32) !void {
     serial.write_string("[SMP] Application Processors booted\n");
 }
 
-fn boot_ap(cpu_idx: u32, trampoline_size: usize) void {
+fn boot_ap(cpu_idx: u32, trampoline_size: usize) !void {
     const apic_id = acpi.get_apic_id(cpu_idx);
 
     serial.write_string("[SMP] Booting AP ");
@@ -91,8 +147,10 @@ fn boot_ap(cpu_idx: u32, trampoline_size: usize) void {
     serial.write_string(")...\n");
 
     // Patch per-CPU stack (point to end of stack - stack grows down)
+    // Page-aligned and contiguous from the PMM; never freed
+    const stack = try allocator.get_allocator().alloc(u8, AP_STACK_SIZE);
     const stack_ptr = @as(*volatile u64, @ptrFromInt(TRAMPOLINE_ADDR + trampoline_size - 16));
-    const stack_top = @intFromPtr(&ap_stacks[cpu_idx]) + AP_STACK_SIZE;
+    const stack_top = @intFromPtr(stack.ptr) + AP_STACK_SIZE;
     stack_ptr.* = stack_top;
 
     // CRITICAL: Flush caches after patching
@@ -112,7 +170,7 @@ fn boot_ap(cpu_idx: u32, trampoline_size: usize) void {
     delay_us(200);
 }
 
-fn send_ipi(apic_id: u8, flags: u32) void {
+fn send_ipi(apic_id: u32, flags: u32) void {
     if (apic.use_x2apic) {
         // x2APIC: ICR is a single 64-bit MSR
         // Bits 0-31: flags (ICR low)
@@ -134,7 +192,7 @@ fn send_ipi(apic_id: u8, flags: u32) void {
 
         // Write destination
         const icr_high_ptr = @as(*volatile u32, @ptrFromInt(apic_base + APIC_ICR_HIGH));
-        icr_high_ptr.* = @as(u32, apic_id) << 24;
+        icr_high_ptr.* = apic_id << 24;
 
         // Write command
         icr_low_ptr.* = flags;
@@ -186,12 +244,7 @@ inline fn rdmsr(msr: u32) u64 {
 
 // AP entry point (called from trampoline after 64-bit transition)
 export fn ap_entry() callconv(.C) noreturn {
-    // Get my CPU ID by atomically incrementing counter
-    const my_id = @atomicRmw(u32, &cpus_online, .Add, 1, .seq_cst);
-
-    serial.write_string("[AP ");
-    serial.write_dec_u32(my_id);
-    serial.write_string("] Started!\n");
+    _ = @atomicRmw(u32, &cpus_online, .Add, 1, .seq_cst);
 
     // Initialize APIC on this AP (same mode as BSP)
     const APIC_BASE_MSR: u32 = 0x1B;
@@ -242,9 +295,17 @@ export fn ap_entry() callconv(.C) noreturn {
         tpr_ptr.* = 0;
     }
 
+    // Logical CPU ID from the APIC ID (readable now that the APIC mode is set)
+    const my_id = cpu_from_apic_id(apic.get_apic_id()) orelse {
+        serial.write_string("[SMP] AP with unknown APIC ID, halting\n");
+        while (true) {
+            asm volatile ("hlt");
+        }
+    };
+
     serial.write_string("[AP ");
     serial.write_dec_u32(my_id);
-    serial.write_string("] APIC initialized\n");
+    serial.write_string("] Started, APIC initialized\n");
 
     serial.write_string("[AP ");
     serial.write_dec_u32(my_id);
@@ -275,6 +336,9 @@ export fn ap_entry() callconv(.C) noreturn {
     serial.write_string("] Running Test 3: Barrier sync...\n");
     tests.test_barrier_sync(my_id, global_cpu_count);
 
+    // Benchmark: barrier latency
+    tests.bench_barriers(my_id, global_cpu_count);
+
     serial.write_string("[AP ");
     serial.write_dec_u32(my_id);
     serial.write_string("] All tests completed!\n");
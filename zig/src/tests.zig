@@ -1,41 +1,142 @@
 // Parallel computation tests
 const serial = @import("serial.zig");
 const std = @import("std");
+const smp = @import("smp.zig");
+const allocator = @import("allocator.zig");
 
-const MAX_CPUS = 16;
+// Per-CPU arrays below are sized by init() to the detected CPU count;
+// MAX_CPUS only bounds the dissemination barrier's round count.
+const MAX_CPUS = smp.MAX_CPUS;
 
 // Test 1: Parallel counters (each CPU counts to 1M)
-pub var per_cpu_counters: [MAX_CPUS]u64 = [_]u64{0} ** MAX_CPUS;
+pub var per_cpu_counters: []u64 = undefined;
 
 // Test 2: Distributed sum (sum of 1 to 10,000,000)
 const SUM_TARGET: u64 = 10000000;
-pub var partial_sums: [MAX_CPUS]u64 = [_]u64{0} ** MAX_CPUS;
+pub var partial_sums: []u64 = undefined;
 pub var total_sum: u64 = 0;
 
 // Test 3: Barrier synchronization
-pub var barrier_count: u32 = 0;
-pub var barrier_sense: u32 = 0;
+const CACHE_LINE_SIZE = 64;
+const BARRIER_MAX_ROUNDS = std.math.log2_int_ceil(u32, MAX_CPUS);
+
+// Centralized sense-reversing barrier (baseline for the barrier benchmark)
+// Every CPU does a RMW on `count` and spins on `sense`: O(N) line transfers
+pub const CentralBarrier = struct {
+    count: u32 = 0,
+    sense: u32 = 0,
+
+    pub fn wait(self: *CentralBarrier, n: u32) void {
+        const my_sense = @atomicLoad(u32, &self.sense, .seq_cst);
+
+        // Last CPU to arrive flips the sense
+        // atomicRmw returns OLD value, so add 1 to get new count
+        const arrived = @atomicRmw(u32, &self.count, .Add, 1, .seq_cst) + 1;
+
+        if (arrived == n) {
+            // Last one - reset and flip sense
+            @atomicStore(u32, &self.count, 0, .seq_cst);
+            @atomicStore(u32, &self.sense, if (my_sense == 0) 1 else 0, .seq_cst);
+        } else {
+            // Wait for sense to flip
+            while (@atomicLoad(u32, &self.sense, .seq_cst) == my_sense) {
+                asm volatile ("pause");
+            }
+        }
+    }
+};
+
+// Dissemination barrier flag - one cache line each, so spinning stays local
+const BarrierFlag = struct {
+    count: u32 align(CACHE_LINE_SIZE) = 0, // Bumped by the partner CPU of this round
+};
+
+const BarrierCpu = struct {
+    round: [BARRIER_MAX_ROUNDS]BarrierFlag = [_]BarrierFlag{.{}} ** BARRIER_MAX_ROUNDS,
+    episodes: u32 align(CACHE_LINE_SIZE) = 0, // Owner-only: episodes entered
+};
+
+// Dissemination barrier - n CPUs with IDs 0..n-1
+// Round r: signal CPU (id + 2^r) % n, then wait for CPU (id - 2^r) % n.
+// After ceil(log2 n) rounds every CPU has (transitively) heard from all others.
+// Flags are monotonic counters, so the barrier is reusable without resetting,
+// as long as the same n is used for every episode on a given instance.
+pub const DisseminationBarrier = struct {
+    cpu: []BarrierCpu = undefined, // One per CPU, allocated by init()
+
+    pub fn init(self: *DisseminationBarrier, cpu_count: u32) !void {
+        self.cpu = try alloc_per_cpu(BarrierCpu, cpu_count);
+    }
 
-// Simple barrier (sense-reversing)
-pub fn barrier_wait(cpu_id: u32, cpu_count: u32) void {
-    _ = cpu_id;  // Unused but kept for API consistency
-    const my_sense = @atomicLoad(u32, &barrier_sense, .seq_cst);
-
-    // Last CPU to arrive flips the sense
-    // atomicRmw returns OLD value, so add 1 to get new count
-    const old_count = @atomicRmw(u32, &barrier_count, .Add, 1, .seq_cst);
-    const arrived = old_count + 1;
-
-    if (arrived == cpu_count) {
-        // Last one - reset and flip sense
-        @atomicStore(u32, &barrier_count, 0, .seq_cst);
-        @atomicStore(u32, &barrier_sense, if (my_sense == 0) 1 else 0, .seq_cst);
-    } else {
-        // Wait for sense to flip
-        while (@atomicLoad(u32, &barrier_sense, .seq_cst) == my_sense) {
-            asm volatile ("pause");
+    pub fn reset(self: *DisseminationBarrier) void {
+        for (self.cpu) |*c| {
+            for (&c.round) |*flag| {
+                flag.count = 0;
+            }
+            c.episodes = 0;
         }
     }
+
+    pub fn wait(self: *DisseminationBarrier, cpu_id: u32, n: u32) void {
+        const me = &self.cpu[cpu_id];
+        me.episodes +%= 1;
+        const target = me.episodes;
+
+        var round: usize = 0;
+        var dist: u32 = 1;
+        while (dist < n) : ({
+            dist <<= 1;
+            round += 1;
+        }) {
+            const partner = &self.cpu[(cpu_id + dist) % n];
+            _ = @atomicRmw(u32, &partner.round[round].count, .Add, 1, .release);
+
+            // Wrap-safe "count < target"
+            while (@as(i32, @bitCast(@atomicLoad(u32, &me.round[round].count, .acquire) -% target)) < 0) {
+                asm volatile ("pause");
+            }
+        }
+    }
+};
+
+var global_barrier: DisseminationBarrier = .{};
+
+// Barrier across all online CPUs
+pub fn barrier_wait(cpu_id: u32, cpu_count: u32) void {
+    global_barrier.wait(cpu_id, cpu_count);
+}
+
+// Barrier benchmark: average TSC cycles per episode, indexed by participant count
+const BARRIER_BENCH_ITERS: u64 = 1000;
+var bench_central_barrier: CentralBarrier = .{};
+var bench_dissem_barrier: DisseminationBarrier = .{};
+var barrier_bench_central: []u64 = undefined; // cpu_count + 1 entries
+var barrier_bench_dissem: []u64 = undefined;
+
+fn alloc_per_cpu(comptime T: type, n: usize) ![]T {
+    const items = try allocator.get_allocator().alloc(T, n);
+    @memset(items, std.mem.zeroes(T));
+    return items;
+}
+
+// Allocate the per-CPU test state; the BSP calls this before starting the APs
+pub fn init(cpu_count: u32) !void {
+    per_cpu_counters = try alloc_per_cpu(u64, cpu_count);
+    partial_sums = try alloc_per_cpu(u64, cpu_count);
+    try global_barrier.init(cpu_count);
+    try bench_dissem_barrier.init(cpu_count);
+    barrier_bench_central = try alloc_per_cpu(u64, cpu_count + 1);
+    barrier_bench_dissem = try alloc_per_cpu(u64, cpu_count + 1);
+}
+
+inline fn rdtsc() u64 {
+    var low: u32 = undefined;
+    var high: u32 = undefined;
+    asm volatile ("rdtsc"
+        : [low] "={eax}" (low),
+          [high] "={edx}" (high),
+    );
+    return (@as(u64, high) << 32) | low;
 }
 
 // Test 1: Parallel counter (each CPU counts to 1 million)
@@ -89,6 +190,46 @@ pub fn test_barrier_sync(cpu_id: u32, cpu_count: u32) void {
     }
 }
 
+// Participant counts for the barrier benchmark: 1, 2, 4, ... then cpu_count
+fn bench_next_cpu_count(n: u32, cpu_count: u32) u32 {
+    if (n >= cpu_count) return cpu_count + 1; // Done
+    return if (n * 2 < cpu_count) n * 2 else cpu_count;
+}
+
+// Benchmark: barrier latency of both implementations across CPU counts
+// Called by every online CPU; CPUs >= n sit out a run at the global barrier.
+pub fn bench_barriers(cpu_id: u32, cpu_count: u32) void {
+    var n: u32 = 1;
+    while (n <= cpu_count) : (n = bench_next_cpu_count(n, cpu_count)) {
+        // Fresh instances for each participant count (everyone is parked here)
+        if (cpu_id == 0) {
+            bench_central_barrier = .{};
+            bench_dissem_barrier.reset();
+        }
+        barrier_wait(cpu_id, cpu_count);
+
+        if (cpu_id < n) {
+            const start = rdtsc();
+            var i: u64 = 0;
+            while (i < BARRIER_BENCH_ITERS) : (i += 1) {
+                bench_central_barrier.wait(n);
+            }
+            const mid = rdtsc();
+            i = 0;
+            while (i < BARRIER_BENCH_ITERS) : (i += 1) {
+                bench_dissem_barrier.wait(cpu_id, n);
+            }
+            const end = rdtsc();
+
+            if (cpu_id == 0) {
+                barrier_bench_central[n] = (mid -% start) / BARRIER_BENCH_ITERS;
+                barrier_bench_dissem[n] = (end -% mid) / BARRIER_BENCH_ITERS;
+            }
+        }
+        barrier_wait(cpu_id, cpu_count);
+    }
+}
+
 // BSP runs all tests and displays results
 pub fn run_all(cpu_count: u32) void {
     serial.write_string("===========================================\n");
@@ -117,6 +258,9 @@ pub fn run_all(cpu_count: u32) void {
     barrier_wait(0, cpu_count);  // Everyone resets together
     test_barrier_sync(0, cpu_count);
 
+    // Benchmark: barrier latency
+    bench_barriers(0, cpu_count);
+
     serial.write_string("[TEST] All tests completed!\n\n");
 
     // Display results
@@ -210,4 +354,18 @@ fn display_results(cpu_count: u32) void {
         serial.write_string("[WARNING] Some tests failed\n");
     }
     serial.write_string("===========================================\n");
+
+    // Barrier benchmark
+    serial.write_string("\nBENCH: Barrier Latency (TSC cycles per episode)\n");
+    serial.write_string("------------------------------------------------\n");
+    var n: u32 = 1;
+    while (n <= cpu_count) : (n = bench_next_cpu_count(n, cpu_count)) {
+        serial.write_string("  ");
+        serial.write_dec_u32(n);
+        serial.write_string(" CPU(s): central ");
+        serial.write_dec_u64(barrier_bench_central[n]);
+        serial.write_string(", dissemination ");
+        serial.write_dec_u64(barrier_bench_dissem[n]);
+        serial.write_string("\n");
+    }
 }